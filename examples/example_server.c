@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+/* the workers share the registers */
+#define TMB_ENABLE_CONCURRENCY
+
+/* include implementation of the library */
+#define TMB_IMPLEMENTATION
+#include <tinymodbus.h>
+
+#define REGISTERS_COUNT 1024
+
+#define DIE(fmt, ...)                                       \
+    do {                                                    \
+        fprintf(stderr, "fatal: " fmt "\n", ##__VA_ARGS__); \
+        exit(1);                                            \
+    } while (0)
+
+// clang-format off
+static const struct option long_options[] = {
+    {"help", 0, NULL, 'h'},
+    {"port", 1, NULL, 'p'},
+    {"workers", 1, NULL, 'w'},
+    { NULL, 0, NULL, 0 },
+};
+static const char *short_options = "hp:w:";
+// clang-format on
+
+/* register store shared by all the workers, that access it through the bank */
+static uint16_t registers[REGISTERS_COUNT];
+static tmb_register_bank_t bank;
+
+static void usage(const char *progname) {
+    fprintf(stderr, "Usage: %s [-p port] [-w workers]\n", progname);
+    fprintf(stderr, "  -h, --help                     show this help message\n");
+    fprintf(stderr, "  -p, --port <port>              TCP port to listen on (default: 502)\n");
+    fprintf(stderr, "  -w, --workers <workers>        number of worker threads (default: 1)\n");
+}
+
+#ifdef TMB_LINUX_SUPPORTED
+
+static const tmb_callbacks_t callbacks = {
+    .holding_registers = &bank,
+};
+
+static tmb_error_t on_worker_init(void *user_data, size_t worker, tmb_handle_t *handle) {
+    return tmb_server_set_callback(handle, TMB_ADDRESS_ANY, &callbacks);
+}
+
+#endif /* TMB_LINUX_SUPPORTED */
+
+int main(int argc, char *argv[]) {
+#ifdef TMB_LINUX_SUPPORTED
+    tmb_posix_tcp_server_config_t config = TMB_POSIX_TCP_SERVER_CONFIG_DEFAULT;
+    config.on_worker_init = on_worker_init;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, short_options, long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'h':
+            usage(argv[0]);
+            exit(0);
+
+        case 'p':
+            config.port = strtoul(optarg, NULL, 10);
+            break;
+
+        case 'w':
+            config.workers = strtoul(optarg, NULL, 10);
+            break;
+
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    tmb_error_t error = tmb_register_bank_init(&bank, 0, registers, REGISTERS_COUNT);
+    if (error != TMB_SUCCESS) {
+        DIE("tmb_register_bank_init(): %d", error);
+    }
+
+    error = tmb_posix_tcp_server_run(&config);
+    DIE("tmb_posix_tcp_server_run(): %d", error);
+#else
+    usage(argv[0]);
+    DIE("the multi-threaded server is only supported on Linux");
+#endif
+}
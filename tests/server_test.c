@@ -0,0 +1,2287 @@
+#include <stdarg.h>
+#include <setjmp.h>
+#include <stddef.h>
+#include <cmocka.h>
+
+#include <pthread.h>
+#include <sched.h>
+
+#define TMB_ENABLE_CONCURRENCY
+#define TMB_IMPLEMENTATION
+#include <tinymodbus.h>
+
+#define BANK_SIZE 64
+
+static uint16_t registers[16];
+
+static tmb_error_t on_read_holding_register(void *user_data, uint8_t address, uint16_t reg, uint16_t *value) {
+    if (reg >= sizeof(registers) / sizeof(registers[0])) {
+        return TMB_E_ILLEGAL_DATA_ADDRESS;
+    }
+
+    *value = registers[reg];
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t on_write_holding_register(void *user_data, uint8_t address, uint16_t reg, uint16_t value) {
+    if (reg >= sizeof(registers) / sizeof(registers[0])) {
+        return TMB_E_ILLEGAL_DATA_ADDRESS;
+    }
+
+    registers[reg] = value;
+
+    return TMB_SUCCESS;
+}
+
+static const tmb_callbacks_t callbacks = {
+    .on_read_holding_register = on_read_holding_register,
+    .on_write_holding_register = on_write_holding_register,
+};
+
+static const tmb_transport_t dummy_transport = {
+    /* just to pass verification of NULL pointer */
+    .read = (void *)1,
+    .write = (void *)1,
+};
+
+static void test_read_holding_registers_rtu(void **state) {
+    tmb_handle_t handle;
+    uint8_t buffer[TMB_ADU_RTU_MAX_SIZE];
+
+    assert_int_equal(tmb_init(&handle, TMB_MODE_SERVER, TMB_TRANSPORT_PROTOCOL_RTU, buffer, sizeof(buffer),
+                              &dummy_transport),
+                     TMB_SUCCESS);
+    assert_int_equal(tmb_server_set_callback(&handle, 0x11, &callbacks), TMB_SUCCESS);
+
+    registers[0x0B] = 0x022B;
+    registers[0x0C] = 0x0000;
+    registers[0x0D] = 0x0064;
+
+    /* read registers 0x0B..0x0D of device 0x11 */
+    const uint8_t request[] = { 0x11, 0x03, 0x00, 0x0B, 0x00, 0x03, 0x76, 0x99 };
+    const uint8_t expected[] = { 0x11, 0x03, 0x06, 0x02, 0x2B, 0x00, 0x00, 0x00, 0x64, 0xC8, 0xBA };
+    memcpy(buffer, request, sizeof(request));
+
+    size_t response_size = 0;
+    assert_int_equal(tmb_server_process_request(&handle, sizeof(request), &response_size), TMB_SUCCESS);
+    assert_int_equal(response_size, sizeof(expected));
+    assert_memory_equal(buffer, expected, sizeof(expected));
+}
+
+static void test_write_multiple_registers_tcpip(void **state) {
+    tmb_handle_t handle;
+    uint8_t buffer[TMB_ADU_TCPIP_MAX_SIZE];
+
+    assert_int_equal(tmb_init(&handle, TMB_MODE_SERVER, TMB_TRANSPORT_PROTOCOL_TCPIP, buffer, sizeof(buffer),
+                              &dummy_transport),
+                     TMB_SUCCESS);
+    assert_int_equal(tmb_server_set_callback(&handle, TMB_ADDRESS_ANY, &callbacks), TMB_SUCCESS);
+
+    const uint8_t request[] = { 0x12, 0x34, 0x00, 0x00, 0x00, 0x0B, 0x01, 0x10,
+                                0x00, 0x01, 0x00, 0x02, 0x04, 0xCA, 0xFE, 0xBE, 0xEF };
+    const uint8_t expected[] = { 0x12, 0x34, 0x00, 0x00, 0x00, 0x06, 0x01, 0x10, 0x00, 0x01, 0x00, 0x02 };
+    memcpy(buffer, request, sizeof(request));
+
+    size_t response_size = 0;
+    assert_int_equal(tmb_server_process_request(&handle, sizeof(request), &response_size), TMB_SUCCESS);
+    assert_int_equal(response_size, sizeof(expected));
+    assert_memory_equal(buffer, expected, sizeof(expected));
+    assert_int_equal(registers[1], 0xCAFE);
+    assert_int_equal(registers[2], 0xBEEF);
+}
+
+static void test_exception_response(void **state) {
+    tmb_handle_t handle;
+    uint8_t buffer[TMB_ADU_TCPIP_MAX_SIZE];
+
+    assert_int_equal(tmb_init(&handle, TMB_MODE_SERVER, TMB_TRANSPORT_PROTOCOL_TCPIP, buffer, sizeof(buffer),
+                              &dummy_transport),
+                     TMB_SUCCESS);
+    assert_int_equal(tmb_server_set_callback(&handle, 1, &callbacks), TMB_SUCCESS);
+
+    /* read past the end of the registers */
+    const uint8_t request[] = { 0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x0F, 0x00, 0x02 };
+    const uint8_t expected[] = { 0x00, 0x01, 0x00, 0x00, 0x00, 0x03, 0x01, 0x83, 0x02 };
+    memcpy(buffer, request, sizeof(request));
+
+    size_t response_size = 0;
+    assert_int_equal(tmb_server_process_request(&handle, sizeof(request), &response_size), TMB_SUCCESS);
+    assert_int_equal(response_size, sizeof(expected));
+    assert_memory_equal(buffer, expected, sizeof(expected));
+
+    /* requests to other addresses are ignored */
+    memcpy(buffer, request, sizeof(request));
+    buffer[6] = 2;
+    assert_int_equal(tmb_server_process_request(&handle, sizeof(request), &response_size), TMB_IGNORED);
+}
+
+static void test_register_bank(void **state) {
+    tmb_handle_t handle;
+    uint8_t buffer[TMB_ADU_TCPIP_MAX_SIZE];
+    uint16_t storage[BANK_SIZE];
+    tmb_register_bank_t bank;
+
+    assert_int_equal(tmb_register_bank_init(&bank, 100, storage, BANK_SIZE), TMB_SUCCESS);
+    const tmb_callbacks_t bank_callbacks = { .holding_registers = &bank };
+
+    assert_int_equal(tmb_init(&handle, TMB_MODE_SERVER, TMB_TRANSPORT_PROTOCOL_TCPIP, buffer, sizeof(buffer),
+                              &dummy_transport),
+                     TMB_SUCCESS);
+    assert_int_equal(tmb_server_set_callback(&handle, 1, &bank_callbacks), TMB_SUCCESS);
+
+    const uint16_t values[] = { 0x1234, 0x5678 };
+    assert_int_equal(tmb_register_bank_write(&bank, 101, 2, values), TMB_SUCCESS);
+    assert_int_equal(tmb_register_bank_write(&bank, 99, 2, values), TMB_E_ILLEGAL_DATA_ADDRESS);
+    assert_int_equal(tmb_register_bank_write(&bank, 100 + BANK_SIZE - 1, 2, values), TMB_E_ILLEGAL_DATA_ADDRESS);
+
+    const uint8_t request[] = { 0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x65, 0x00, 0x02 };
+    const uint8_t expected[] = { 0x00, 0x01, 0x00, 0x00, 0x00, 0x07, 0x01, 0x03, 0x04, 0x12, 0x34, 0x56, 0x78 };
+    memcpy(buffer, request, sizeof(request));
+
+    size_t response_size = 0;
+    assert_int_equal(tmb_server_process_request(&handle, sizeof(request), &response_size), TMB_SUCCESS);
+    assert_int_equal(response_size, sizeof(expected));
+    assert_memory_equal(buffer, expected, sizeof(expected));
+}
+
+static void *register_bank_producer(void *arg) {
+    tmb_register_bank_t *bank = arg;
+
+    for (uint16_t value = 1; value <= 10000; value++) {
+        uint16_t *registers = tmb_register_bank_begin_update(bank);
+        for (size_t i = 0; i < BANK_SIZE; i++) {
+            registers[i] = value;
+        }
+        tmb_register_bank_end_update(bank);
+    }
+
+    return NULL;
+}
+
+static void test_register_bank_concurrent_update(void **state) {
+    uint16_t storage[BANK_SIZE] = { 0 };
+    tmb_register_bank_t bank;
+    assert_int_equal(tmb_register_bank_init(&bank, 0, storage, BANK_SIZE), TMB_SUCCESS);
+
+    pthread_t producer;
+    assert_int_equal(pthread_create(&producer, NULL, register_bank_producer, &bank), 0);
+
+    /* every snapshot must contain the values of a single update */
+    uint16_t values[BANK_SIZE];
+    do {
+        assert_int_equal(tmb_register_bank_read(&bank, 0, BANK_SIZE, values), TMB_SUCCESS);
+        for (size_t i = 1; i < BANK_SIZE; i++) {
+            assert_int_equal(values[i], values[0]);
+        }
+    } while (values[0] != 10000);
+
+    pthread_join(producer, NULL);
+}
+
+static tmb_response_cache_t *ticked_cache;
+
+static tmb_error_t on_read_holding_register_tick(void *user_data, uint8_t address, uint16_t reg, uint16_t *value) {
+    /* as if the application ticked the cache while the server was reading */
+    tmb_response_cache_tick(ticked_cache);
+
+    return on_read_holding_register(user_data, address, reg, value);
+}
+
+static void test_response_cache(void **state) {
+    tmb_handle_t handle;
+    uint8_t buffer[TMB_ADU_TCPIP_MAX_SIZE];
+    uint16_t storage[BANK_SIZE] = { 0 };
+    tmb_register_bank_t bank;
+    tmb_response_cache_entry_t entries[4];
+    tmb_response_cache_t cache;
+
+    assert_int_equal(tmb_register_bank_init(&bank, 0, storage, BANK_SIZE), TMB_SUCCESS);
+    assert_int_equal(tmb_response_cache_init(&cache, entries, 4), TMB_SUCCESS);
+    const tmb_callbacks_t bank_callbacks = { .holding_registers = &bank };
+
+    assert_int_equal(tmb_init(&handle, TMB_MODE_SERVER, TMB_TRANSPORT_PROTOCOL_TCPIP, buffer, sizeof(buffer),
+                              &dummy_transport),
+                     TMB_SUCCESS);
+    assert_int_equal(tmb_server_set_callback(&handle, 1, &bank_callbacks), TMB_SUCCESS);
+    assert_int_equal(tmb_server_set_response_cache(&handle, &cache), TMB_SUCCESS);
+
+    const uint8_t read_request[] = { 0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x00, 0x00, 0x01 };
+    const uint8_t write_request[] = { 0x00, 0x03, 0x00, 0x00, 0x00, 0x06, 0x01, 0x06, 0x00, 0x00, 0xAB, 0xCD };
+    size_t response_size = 0;
+
+    memcpy(buffer, read_request, sizeof(read_request));
+    assert_int_equal(tmb_server_process_request(&handle, sizeof(read_request), &response_size), TMB_SUCCESS);
+    assert_int_equal(cache.misses, 1);
+
+    /* same request with another transaction identifier is answered from the cache */
+    memcpy(buffer, read_request, sizeof(read_request));
+    buffer[1] = 0x02;
+    assert_int_equal(tmb_server_process_request(&handle, sizeof(read_request), &response_size), TMB_SUCCESS);
+    assert_int_equal(cache.hits, 1);
+    assert_int_equal(buffer[1], 0x02);
+    assert_int_equal(TMB_UINT16(buffer, 9), 0x0000);
+
+    /* a write invalidates the cache */
+    memcpy(buffer, write_request, sizeof(write_request));
+    assert_int_equal(tmb_server_process_request(&handle, sizeof(write_request), &response_size), TMB_SUCCESS);
+    memcpy(buffer, read_request, sizeof(read_request));
+    assert_int_equal(tmb_server_process_request(&handle, sizeof(read_request), &response_size), TMB_SUCCESS);
+    assert_int_equal(cache.misses, 2);
+    assert_int_equal(TMB_UINT16(buffer, 9), 0xABCD);
+
+    /* as well as an update of the bank */
+    const uint16_t value = 0x1234;
+    assert_int_equal(tmb_register_bank_write(&bank, 0, 1, &value), TMB_SUCCESS);
+    memcpy(buffer, read_request, sizeof(read_request));
+    assert_int_equal(tmb_server_process_request(&handle, sizeof(read_request), &response_size), TMB_SUCCESS);
+    assert_int_equal(cache.misses, 3);
+    assert_int_equal(TMB_UINT16(buffer, 9), 0x1234);
+
+    /* a response read while the cache is ticked is not cached */
+    const tmb_callbacks_t tick_callbacks = { .on_read_holding_register = on_read_holding_register_tick };
+    ticked_cache = &cache;
+    assert_int_equal(tmb_server_set_callback(&handle, 2, &tick_callbacks), TMB_SUCCESS);
+    for (size_t i = 0; i < 2; i++) {
+        memcpy(buffer, read_request, sizeof(read_request));
+        buffer[6] = 2;
+        assert_int_equal(tmb_server_process_request(&handle, sizeof(read_request), &response_size), TMB_SUCCESS);
+    }
+    assert_int_equal(cache.misses, 5);
+    assert_int_equal(cache.hits, 1);
+
+    /* a write processed by a shard invalidates the caches of the others, if they share their generation */
+    tmb_handle_t shard;
+    uint8_t shard_buffer[TMB_ADU_TCPIP_MAX_SIZE];
+    tmb_response_cache_entry_t shard_entries[4];
+    tmb_response_cache_t shard_cache;
+    assert_int_equal(tmb_response_cache_init(&shard_cache, shard_entries, 4), TMB_SUCCESS);
+    assert_int_equal(tmb_response_cache_share(&shard_cache, &shard_cache), TMB_E_INVALID_ARGUMENTS);
+    assert_int_equal(tmb_response_cache_share(&shard_cache, &cache), TMB_SUCCESS);
+    assert_int_equal(tmb_init(&shard, TMB_MODE_SERVER, TMB_TRANSPORT_PROTOCOL_TCPIP, shard_buffer,
+                              sizeof(shard_buffer), &dummy_transport),
+                     TMB_SUCCESS);
+    assert_int_equal(tmb_server_set_callback(&shard, 1, &callbacks), TMB_SUCCESS);
+    assert_int_equal(tmb_server_set_response_cache(&shard, &shard_cache), TMB_SUCCESS);
+    assert_int_equal(tmb_server_set_callback(&handle, 3, &callbacks), TMB_SUCCESS);
+
+    uint8_t shard_read[sizeof(read_request)];
+    memcpy(shard_read, read_request, sizeof(read_request));
+    shard_read[6] = 3;
+    for (size_t i = 0; i < 2; i++) {
+        memcpy(buffer, shard_read, sizeof(shard_read));
+        assert_int_equal(tmb_server_process_request(&handle, sizeof(shard_read), &response_size), TMB_SUCCESS);
+    }
+    assert_int_equal(cache.hits, 2);
+
+    memcpy(shard_buffer, write_request, sizeof(write_request));
+    assert_int_equal(tmb_server_process_request(&shard, sizeof(write_request), &response_size), TMB_SUCCESS);
+    memcpy(buffer, shard_read, sizeof(shard_read));
+    assert_int_equal(tmb_server_process_request(&handle, sizeof(shard_read), &response_size), TMB_SUCCESS);
+    assert_int_equal(cache.hits, 2);
+    assert_int_equal(TMB_UINT16(buffer, 9), 0xABCD);
+}
+
+typedef struct {
+    /** silence before the chunk, in microseconds */
+    uint32_t gap_us;
+    const uint8_t *data;
+    size_t size;
+} serial_chunk_t;
+
+typedef struct {
+    serial_chunk_t *chunks;
+    size_t count;
+    size_t next;
+} serial_line_t;
+
+static int serial_line_read_timeout(void *user_data, uint8_t *buffer, size_t nbyte, uint32_t timeout_us) {
+    serial_line_t *line = user_data;
+    if (line->next == line->count) {
+        return 0;
+    }
+
+    serial_chunk_t *chunk = &line->chunks[line->next];
+    if (chunk->gap_us > timeout_us) {
+        chunk->gap_us -= timeout_us;
+        return 0;
+    }
+
+    assert_true(chunk->size <= nbyte);
+    memcpy(buffer, chunk->data, chunk->size);
+    line->next++;
+
+    return chunk->size;
+}
+
+static int serial_line_read(void *user_data, uint8_t *buffer, size_t nbyte) {
+    return serial_line_read_timeout(user_data, buffer, nbyte, UINT32_MAX);
+}
+
+static void test_rtu_timing(void **state) {
+    uint32_t t15_us = 0;
+    uint32_t t35_us = 0;
+
+    assert_int_equal(tmb_rtu_get_timing(9600, 11, &t15_us, &t35_us), TMB_SUCCESS);
+    assert_int_equal(t15_us, 1719);
+    assert_int_equal(t35_us, 4011);
+
+    assert_int_equal(tmb_rtu_get_timing(115200, 11, &t15_us, &t35_us), TMB_SUCCESS);
+    assert_int_equal(t15_us, 750);
+    assert_int_equal(t35_us, 1750);
+}
+
+static void test_rtu_receive_frame(void **state) {
+    /* a corrupted frame of unknown size, then a valid request split by a gap shorter than t3.5 */
+    const uint8_t garbage[] = { 0x11, 0x41, 0x01, 0x02, 0x03 };
+    const uint8_t request[] = { 0x11, 0x03, 0x00, 0x0B, 0x00, 0x03, 0x76, 0x99 };
+    serial_chunk_t chunks[] = {
+        { .gap_us = 0, .data = garbage, .size = sizeof(garbage) },
+        { .gap_us = 2000, .data = request, .size = 3 },
+        { .gap_us = 1000, .data = &request[3], .size = sizeof(request) - 3 },
+    };
+    serial_line_t line = { .chunks = chunks, .count = 3 };
+    tmb_transport_t transport = {
+        .user_data = &line,
+        .read = serial_line_read,
+        .write = (void *)1,
+        .read_timeout = serial_line_read_timeout,
+        .rtu_t15_us = 750,
+        .rtu_t35_us = 1750,
+    };
+
+    uint8_t buffer[TMB_ADU_RTU_MAX_SIZE];
+    size_t frame_size = 0;
+    assert_int_equal(tmb_rtu_receive_frame(&transport, buffer, sizeof(buffer), &frame_size), TMB_E_INVALID_CRC);
+    assert_int_equal(tmb_rtu_receive_frame(&transport, buffer, sizeof(buffer), &frame_size), TMB_SUCCESS);
+    assert_int_equal(frame_size, sizeof(request));
+    assert_memory_equal(buffer, request, sizeof(request));
+
+    /* a blocking read that returns nothing means that the line was closed */
+    assert_int_equal(tmb_rtu_receive_frame(&transport, buffer, sizeof(buffer), &frame_size), TMB_E_TRANSPORT);
+}
+
+static void test_diagnostics(void **state) {
+    tmb_handle_t handle;
+    uint8_t buffer[TMB_ADU_TCPIP_MAX_SIZE];
+    size_t response_size = 0;
+
+    assert_int_equal(tmb_init(&handle, TMB_MODE_SERVER, TMB_TRANSPORT_PROTOCOL_TCPIP, buffer, sizeof(buffer),
+                              &dummy_transport),
+                     TMB_SUCCESS);
+    assert_int_equal(tmb_server_set_callback(&handle, 1, &callbacks), TMB_SUCCESS);
+
+    const uint8_t read_request[] = { 0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x00, 0x00, 0x01 };
+    memcpy(buffer, read_request, sizeof(read_request));
+    assert_int_equal(tmb_server_process_request(&handle, sizeof(read_request), &response_size), TMB_SUCCESS);
+
+    /* return bus message count */
+    const uint8_t bus_count_request[] = { 0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0x01, 0x08, 0x00, 0x0B, 0x00, 0x00 };
+    const uint8_t bus_count_expected[] = { 0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0x01, 0x08, 0x00, 0x0B, 0x00, 0x02 };
+    memcpy(buffer, bus_count_request, sizeof(bus_count_request));
+    assert_int_equal(tmb_server_process_request(&handle, sizeof(bus_count_request), &response_size), TMB_SUCCESS);
+    assert_int_equal(response_size, sizeof(bus_count_expected));
+    assert_memory_equal(buffer, bus_count_expected, sizeof(bus_count_expected));
+
+    /* get comm event counter */
+    const uint8_t counter_request[] = { 0x00, 0x03, 0x00, 0x00, 0x00, 0x02, 0x01, 0x0B };
+    const uint8_t counter_expected[] = { 0x00, 0x03, 0x00, 0x00, 0x00, 0x06, 0x01, 0x0B, 0x00, 0x00, 0x00, 0x02 };
+    memcpy(buffer, counter_request, sizeof(counter_request));
+    assert_int_equal(tmb_server_process_request(&handle, sizeof(counter_request), &response_size), TMB_SUCCESS);
+    assert_int_equal(response_size, sizeof(counter_expected));
+    assert_memory_equal(buffer, counter_expected, sizeof(counter_expected));
+
+    /* in listen only mode requests are not answered, until communications are restarted */
+    const uint8_t listen_only_request[] = { 0x00, 0x04, 0x00, 0x00, 0x00, 0x06, 0x01, 0x08, 0x00, 0x04, 0x00, 0x00 };
+    memcpy(buffer, listen_only_request, sizeof(listen_only_request));
+    assert_int_equal(tmb_server_process_request(&handle, sizeof(listen_only_request), &response_size), TMB_IGNORED);
+
+    memcpy(buffer, read_request, sizeof(read_request));
+    assert_int_equal(tmb_server_process_request(&handle, sizeof(read_request), &response_size), TMB_IGNORED);
+
+    const uint8_t restart_request[] = { 0x00, 0x05, 0x00, 0x00, 0x00, 0x06, 0x01, 0x08, 0x00, 0x01, 0x00, 0x00 };
+    memcpy(buffer, restart_request, sizeof(restart_request));
+    assert_int_equal(tmb_server_process_request(&handle, sizeof(restart_request), &response_size), TMB_IGNORED);
+
+    /* get comm event log, the most recent event first */
+    const uint8_t log_request[] = { 0x00, 0x06, 0x00, 0x00, 0x00, 0x02, 0x01, 0x0C };
+    const uint8_t log_expected[] = { 0x00, 0x06, 0x00, 0x00, 0x00, 0x15, 0x01, 0x0C, 0x12, 0x00, 0x00, 0x00,
+                                     0x00, 0x00, 0x01, 0x80, 0x00, 0xA0, 0xA0, 0x04, 0x80, 0x40, 0x80, 0x40,
+                                     0x80, 0x40, 0x80 };
+    memcpy(buffer, log_request, sizeof(log_request));
+    assert_int_equal(tmb_server_process_request(&handle, sizeof(log_request), &response_size), TMB_SUCCESS);
+    assert_int_equal(response_size, sizeof(log_expected));
+    assert_memory_equal(buffer, log_expected, sizeof(log_expected));
+
+    tmb_statistics_t statistics;
+    assert_int_equal(tmb_get_statistics(&handle, &statistics), TMB_SUCCESS);
+    assert_int_equal(statistics.bus_message_count, 1);
+    assert_int_equal(statistics.server_message_count, 1);
+    assert_int_equal(statistics.event_count, 1);
+    assert_int_equal(statistics.events_size, 13);
+
+    assert_int_equal(tmb_clear_statistics(&handle), TMB_SUCCESS);
+    assert_int_equal(tmb_get_statistics(&handle, &statistics), TMB_SUCCESS);
+    assert_int_equal(statistics.bus_message_count, 0);
+    assert_int_equal(statistics.events_size, 0);
+}
+
+static void test_read_write_multiple_registers(void **state) {
+    tmb_handle_t handle;
+    uint8_t buffer[TMB_ADU_TCPIP_MAX_SIZE];
+    uint16_t storage[BANK_SIZE] = { 0 };
+    tmb_register_bank_t bank;
+
+    assert_int_equal(tmb_register_bank_init(&bank, 100, storage, BANK_SIZE), TMB_SUCCESS);
+    const tmb_callbacks_t bank_callbacks = { .holding_registers = &bank };
+
+    assert_int_equal(tmb_init(&handle, TMB_MODE_SERVER, TMB_TRANSPORT_PROTOCOL_TCPIP, buffer, sizeof(buffer),
+                              &dummy_transport),
+                     TMB_SUCCESS);
+    assert_int_equal(tmb_server_set_callback(&handle, 1, &bank_callbacks), TMB_SUCCESS);
+
+    storage[0] = 0xAAAA;
+
+    /* write 101..102, then read 100..102 */
+    const uint8_t request[] = { 0x00, 0x01, 0x00, 0x00, 0x00, 0x0F, 0x01, 0x17, 0x00, 0x64, 0x00,
+                                0x03, 0x00, 0x65, 0x00, 0x02, 0x04, 0x12, 0x34, 0x56, 0x78 };
+    const uint8_t expected[] = { 0x00, 0x01, 0x00, 0x00, 0x00, 0x09, 0x01, 0x17, 0x06,
+                                 0xAA, 0xAA, 0x12, 0x34, 0x56, 0x78 };
+    memcpy(buffer, request, sizeof(request));
+
+    size_t response_size = 0;
+    assert_int_equal(tmb_server_process_request(&handle, sizeof(request), &response_size), TMB_SUCCESS);
+    assert_int_equal(response_size, sizeof(expected));
+    assert_memory_equal(buffer, expected, sizeof(expected));
+    assert_int_equal(storage[1], 0x1234);
+    assert_int_equal(storage[2], 0x5678);
+
+    /* nothing is written if the read range is not valid */
+    memcpy(buffer, request, sizeof(request));
+    buffer[8] = 0x00;
+    buffer[9] = 0x10;
+    buffer[17] = 0xFF;
+    assert_int_equal(tmb_server_process_request(&handle, sizeof(request), &response_size), TMB_SUCCESS);
+    assert_int_equal(buffer[7], 0x97);
+    assert_int_equal(buffer[8], TMB_E_ILLEGAL_DATA_ADDRESS);
+    assert_int_equal(storage[1], 0x1234);
+}
+
+static void test_mask_write_register(void **state) {
+    tmb_handle_t handle;
+    uint8_t buffer[TMB_ADU_TCPIP_MAX_SIZE];
+
+    assert_int_equal(tmb_init(&handle, TMB_MODE_SERVER, TMB_TRANSPORT_PROTOCOL_TCPIP, buffer, sizeof(buffer),
+                              &dummy_transport),
+                     TMB_SUCCESS);
+    assert_int_equal(tmb_server_set_callback(&handle, 1, &callbacks), TMB_SUCCESS);
+
+    registers[4] = 0x0012;
+
+    /* example of the specification: (0x12 & 0xF2) | (0x25 & ~0xF2) */
+    const uint8_t request[] = { 0x00, 0x01, 0x00, 0x00, 0x00, 0x08, 0x01, 0x16, 0x00, 0x04, 0x00, 0xF2, 0x00, 0x25 };
+    memcpy(buffer, request, sizeof(request));
+
+    size_t response_size = 0;
+    assert_int_equal(tmb_server_process_request(&handle, sizeof(request), &response_size), TMB_SUCCESS);
+    assert_int_equal(response_size, sizeof(request));
+    assert_memory_equal(buffer, request, sizeof(request));
+    assert_int_equal(registers[4], 0x0017);
+}
+
+#define FILE_SIZE 1000
+
+static uint16_t file[FILE_SIZE];
+
+static tmb_error_t on_read_file_record(void *user_data, uint8_t address, uint16_t file_number, uint16_t record_number,
+                                       uint16_t record_length, uint16_t *values) {
+    if (file_number != 1 || record_number + record_length > FILE_SIZE) {
+        return TMB_E_ILLEGAL_DATA_ADDRESS;
+    }
+
+    memcpy(values, &file[record_number], record_length * sizeof(uint16_t));
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t on_write_file_record(void *user_data, uint8_t address, uint16_t file_number,
+                                        uint16_t record_number, uint16_t record_length, const uint16_t *values) {
+    if (file_number != 1 || record_number + record_length > FILE_SIZE) {
+        return TMB_E_ILLEGAL_DATA_ADDRESS;
+    }
+
+    memcpy(&file[record_number], values, record_length * sizeof(uint16_t));
+
+    return TMB_SUCCESS;
+}
+
+static const tmb_callbacks_t file_callbacks = {
+    .on_read_file_record = on_read_file_record,
+    .on_write_file_record = on_write_file_record,
+};
+
+/* transport that hands every request to a server handle, and queues its responses */
+typedef struct {
+    tmb_handle_t server;
+    uint8_t server_buffer[TMB_ADU_TCPIP_MAX_SIZE];
+    uint8_t responses[TMB_CLIENT_PIPELINE_DEPTH * TMB_ADU_TCPIP_MAX_SIZE];
+    size_t responses_size;
+    size_t writes;
+    size_t requests;
+    size_t in_flight;
+    size_t max_in_flight;
+    /* if not 0, the write with this number fails */
+    size_t failing_write;
+    /* if not 0, this byte of the next response is altered */
+    size_t corrupted_byte;
+} loopback_t;
+
+static int loopback_write(void *user_data, const uint8_t *buffer, size_t nbyte) {
+    loopback_t *loopback = user_data;
+
+    /* a TCP/IP write may carry more requests, delimited by the length field of their header */
+    loopback->writes++;
+    if (loopback->writes == loopback->failing_write) {
+        return -1;
+    }
+    for (size_t offset = 0; offset < nbyte;) {
+        size_t request_size = nbyte;
+        if (loopback->server.encapsulation == TMB_TRANSPORT_PROTOCOL_TCPIP) {
+            request_size = 6 + ((buffer[offset + 4] << 8) | buffer[offset + 5]);
+        }
+        assert_true(offset + request_size <= nbyte);
+
+        memcpy(loopback->server_buffer, &buffer[offset], request_size);
+        size_t response_size = 0;
+        if (tmb_server_process_request(&loopback->server, request_size, &response_size) == TMB_SUCCESS) {
+            assert_true(loopback->responses_size + response_size <= sizeof(loopback->responses));
+            memcpy(&loopback->responses[loopback->responses_size], loopback->server_buffer, response_size);
+            if (loopback->corrupted_byte != 0 && loopback->corrupted_byte < response_size) {
+                loopback->responses[loopback->responses_size + loopback->corrupted_byte] ^= 0xFF;
+                loopback->corrupted_byte = 0;
+            }
+            loopback->responses_size += response_size;
+        }
+
+        loopback->requests++;
+        loopback->in_flight++;
+        if (loopback->in_flight > loopback->max_in_flight) {
+            loopback->max_in_flight = loopback->in_flight;
+        }
+        offset += request_size;
+    }
+
+    return nbyte;
+}
+
+static int loopback_read(void *user_data, uint8_t *buffer, size_t nbyte) {
+    loopback_t *loopback = user_data;
+
+    if (nbyte > loopback->responses_size) {
+        nbyte = loopback->responses_size;
+    }
+    memcpy(buffer, loopback->responses, nbyte);
+    memmove(loopback->responses, &loopback->responses[nbyte], loopback->responses_size - nbyte);
+    loopback->responses_size -= nbyte;
+    loopback->in_flight = 0;
+
+    return nbyte;
+}
+
+/* the responses are queued as soon as the requests are written: a missing one never comes */
+static int loopback_read_timeout(void *user_data, uint8_t *buffer, size_t nbyte, uint32_t timeout_us) {
+    return loopback_read(user_data, buffer, nbyte);
+}
+
+static void loopback_init(loopback_t *loopback, tmb_transport_t *transport, const tmb_callbacks_t *server_callbacks) {
+    memset(loopback, 0, sizeof(loopback_t));
+    assert_int_equal(tmb_init(&loopback->server, TMB_MODE_SERVER, TMB_TRANSPORT_PROTOCOL_TCPIP,
+                              loopback->server_buffer, sizeof(loopback->server_buffer), &dummy_transport),
+                     TMB_SUCCESS);
+    assert_int_equal(tmb_server_set_callback(&loopback->server, TMB_ADDRESS_ANY, server_callbacks), TMB_SUCCESS);
+
+    memset(transport, 0, sizeof(tmb_transport_t));
+    transport->user_data = loopback;
+    transport->read = loopback_read;
+    transport->write = loopback_write;
+}
+
+static void test_file_records(void **state) {
+    loopback_t loopback;
+    tmb_transport_t transport;
+    loopback_init(&loopback, &transport, &file_callbacks);
+
+    tmb_handle_t handle;
+    uint8_t buffer[TMB_ADU_TCPIP_MAX_SIZE];
+    assert_int_equal(tmb_init(&handle, TMB_MODE_CLIENT, TMB_TRANSPORT_PROTOCOL_TCPIP, buffer, sizeof(buffer),
+                              &transport),
+                     TMB_SUCCESS);
+    assert_int_equal(tmb_client_set_device_address(&handle, 1), TMB_SUCCESS);
+
+    /* a whole file takes several requests, that are pipelined */
+    static uint16_t values[FILE_SIZE];
+    for (size_t i = 0; i < FILE_SIZE; i++) {
+        values[i] = i * 7;
+    }
+    assert_int_equal(tmb_write_file(&handle, 1, 0, FILE_SIZE, values), TMB_SUCCESS);
+    assert_memory_equal(file, values, sizeof(file));
+    assert_int_equal(loopback.max_in_flight, TMB_CLIENT_PIPELINE_DEPTH);
+
+    static uint16_t read_values[FILE_SIZE];
+    assert_int_equal(tmb_read_file(&handle, 1, 0, FILE_SIZE, read_values), TMB_SUCCESS);
+    assert_memory_equal(read_values, values, sizeof(values));
+
+    /* small groups of records are packed in a single request */
+    uint16_t first[3];
+    uint16_t second[5];
+    uint16_t third[1];
+    const tmb_file_record_t records[] = {
+        { .file_number = 1, .record_number = 10, .record_length = 3, .values = first },
+        { .file_number = 1, .record_number = 500, .record_length = 5, .values = second },
+        { .file_number = 1, .record_number = 999, .record_length = 1, .values = third },
+    };
+    size_t requests = loopback.requests;
+    assert_int_equal(tmb_read_file_records(&handle, records, 3), TMB_SUCCESS);
+    assert_int_equal(loopback.requests, requests + 1);
+    assert_memory_equal(first, &values[10], sizeof(first));
+    assert_memory_equal(second, &values[500], sizeof(second));
+    assert_int_equal(third[0], values[999]);
+
+    /* records out of the file are rejected by the server */
+    assert_int_equal(tmb_read_file(&handle, 1, 990, 20, read_values), TMB_E_ILLEGAL_DATA_ADDRESS);
+    assert_int_equal(tmb_read_file(&handle, 2, 0, 1, read_values), TMB_E_ILLEGAL_DATA_ADDRESS);
+
+    /* a request that can't be sent fails the transfer, once the responses in flight are received */
+    loopback.failing_write = loopback.writes + 2;
+    assert_int_equal(tmb_read_file(&handle, 1, 0, FILE_SIZE, read_values), TMB_E_TRANSPORT);
+    assert_int_equal(loopback.responses_size, 0);
+    assert_int_equal(tmb_read_file_records(&handle, records, 3), TMB_SUCCESS);
+    assert_int_equal(third[0], values[999]);
+}
+
+#define FIFO_SIZE 100
+
+static uint16_t fifo[FIFO_SIZE];
+static size_t fifo_size;
+
+static tmb_error_t on_read_fifo_queue(void *user_data, uint8_t address, uint16_t fifo_address, uint16_t *values,
+                                      uint16_t *count) {
+    if (fifo_address != 0x04DE) {
+        return TMB_E_ILLEGAL_DATA_ADDRESS;
+    }
+
+    *count = fifo_size < TMB_READ_FIFO_QUEUE_MAX_COUNT ? fifo_size : TMB_READ_FIFO_QUEUE_MAX_COUNT;
+    memcpy(values, fifo, *count * sizeof(uint16_t));
+    memmove(fifo, &fifo[*count], (fifo_size - *count) * sizeof(uint16_t));
+    fifo_size -= *count;
+
+    return TMB_SUCCESS;
+}
+
+static void test_fifo_queue(void **state) {
+    const tmb_callbacks_t fifo_callbacks = { .on_read_fifo_queue = on_read_fifo_queue };
+    loopback_t loopback;
+    tmb_transport_t transport;
+    loopback_init(&loopback, &transport, &fifo_callbacks);
+
+    tmb_handle_t handle;
+    uint8_t buffer[TMB_ADU_TCPIP_MAX_SIZE];
+    assert_int_equal(tmb_init(&handle, TMB_MODE_CLIENT, TMB_TRANSPORT_PROTOCOL_TCPIP, buffer, sizeof(buffer),
+                              &transport),
+                     TMB_SUCCESS);
+    assert_int_equal(tmb_client_set_device_address(&handle, 1), TMB_SUCCESS);
+
+    for (size_t i = 0; i < FIFO_SIZE; i++) {
+        fifo[i] = 0x1000 + i;
+    }
+    fifo_size = FIFO_SIZE;
+
+    uint16_t values[TMB_READ_FIFO_QUEUE_MAX_COUNT];
+    uint16_t count = 0;
+    assert_int_equal(tmb_read_fifo_queue(&handle, 0x04DE, values, &count), TMB_SUCCESS);
+    assert_int_equal(count, TMB_READ_FIFO_QUEUE_MAX_COUNT);
+    assert_int_equal(values[0], 0x1000);
+    assert_int_equal(values[30], 0x101E);
+
+    /* the ring only has room for two full responses */
+    uint16_t storage[70];
+    tmb_fifo_ring_t ring;
+    size_t drained = 0;
+    assert_int_equal(tmb_fifo_ring_init(&ring, storage, 70), TMB_SUCCESS);
+    assert_int_equal(tmb_drain_fifo_queue(&handle, 0x04DE, &ring, &drained), TMB_SUCCESS);
+    assert_int_equal(drained, 62);
+    assert_int_equal(fifo_size, FIFO_SIZE - 31 - 62);
+
+    uint16_t popped[70];
+    assert_int_equal(tmb_fifo_ring_pop(&ring, popped, 70), 62);
+    assert_int_equal(popped[0], 0x1000 + 31);
+    assert_int_equal(popped[61], 0x1000 + 92);
+
+    /* then it drains what remains, reads are pipelined until the queue is empty */
+    loopback.max_in_flight = 0;
+    assert_int_equal(tmb_drain_fifo_queue(&handle, 0x04DE, &ring, &drained), TMB_SUCCESS);
+    assert_int_equal(drained, 7);
+    assert_int_equal(fifo_size, 0);
+    assert_int_equal(loopback.max_in_flight, 2);
+    assert_int_equal(tmb_fifo_ring_size(&ring), 7);
+    assert_int_equal(tmb_fifo_ring_pop(&ring, popped, 70), 7);
+    assert_int_equal(popped[6], 0x1000 + 99);
+
+    /* a read that can't be sent fails the drain, once the reads in flight are received */
+    fifo_size = FIFO_SIZE;
+    loopback.failing_write = loopback.writes + 2;
+    assert_int_equal(tmb_drain_fifo_queue(&handle, 0x04DE, &ring, &drained), TMB_E_TRANSPORT);
+    assert_int_equal(drained, 31);
+    assert_int_equal(loopback.responses_size, 0);
+
+    /* so does an invalid response */
+    assert_int_equal(tmb_fifo_ring_pop(&ring, popped, 70), 31);
+    fifo_size = FIFO_SIZE;
+    loopback.corrupted_byte = 1;
+    assert_int_equal(tmb_drain_fifo_queue(&handle, 0x04DE, &ring, &drained), TMB_E_INVALID_RESPONSE);
+    assert_int_equal(drained, 31);
+    assert_int_equal(loopback.responses_size, 0);
+}
+
+static void test_device_identification(void **state) {
+    char long_value[200];
+    memset(long_value, 'x', sizeof(long_value));
+    const tmb_device_identification_object_t identification_objects[] = {
+        { .id = TMB_DEVICE_IDENTIFICATION_PRODUCT_CODE, .length = 4, .value = "TMB1" },
+        { .id = TMB_DEVICE_IDENTIFICATION_VENDOR_NAME, .length = 10, .value = "tinymodbus" },
+        { .id = TMB_DEVICE_IDENTIFICATION_MAJOR_MINOR_REVISION, .length = 4, .value = "1.00" },
+        { .id = TMB_DEVICE_IDENTIFICATION_MODEL_NAME, .length = 5, .value = "model" },
+        { .id = 0x80, .length = sizeof(long_value), .value = long_value },
+        { .id = 0x81, .length = sizeof(long_value), .value = long_value },
+    };
+
+    uint8_t storage[512];
+    tmb_device_identification_t identification;
+    assert_int_equal(tmb_device_identification_init(&identification, identification_objects, 2, storage,
+                                                    sizeof(storage)),
+                     TMB_E_INVALID_ARGUMENTS);
+    assert_int_equal(tmb_device_identification_init(&identification, identification_objects, 6, storage, 100),
+                     TMB_E_NO_MEMORY);
+    assert_int_equal(tmb_device_identification_init(&identification, identification_objects, 6, storage,
+                                                    sizeof(storage)),
+                     TMB_SUCCESS);
+
+    const tmb_callbacks_t identification_callbacks = { .device_identification = &identification };
+    loopback_t loopback;
+    tmb_transport_t transport;
+    loopback_init(&loopback, &transport, &identification_callbacks);
+
+    tmb_handle_t handle;
+    uint8_t buffer[TMB_ADU_TCPIP_MAX_SIZE];
+    assert_int_equal(tmb_init(&handle, TMB_MODE_CLIENT, TMB_TRANSPORT_PROTOCOL_TCPIP, buffer, sizeof(buffer),
+                              &transport),
+                     TMB_SUCCESS);
+    assert_int_equal(tmb_client_set_device_address(&handle, 1), TMB_SUCCESS);
+
+    tmb_device_identification_object_t objects[8];
+    char values[512];
+    size_t objects_size = 8;
+    assert_int_equal(tmb_read_device_identification(&handle, TMB_READ_DEVICE_ID_BASIC, 0, objects, &objects_size,
+                                                    values, sizeof(values)),
+                     TMB_SUCCESS);
+    assert_int_equal(objects_size, 3);
+    assert_string_equal(objects[0].value, "tinymodbus");
+    assert_string_equal(objects[1].value, "TMB1");
+    assert_string_equal(objects[2].value, "1.00");
+
+    /* the extended objects do not fit a single response: the stream continues with another request */
+    objects_size = 8;
+    loopback.requests = 0;
+    assert_int_equal(tmb_read_device_identification(&handle, TMB_READ_DEVICE_ID_EXTENDED, 0, objects, &objects_size,
+                                                    values, sizeof(values)),
+                     TMB_SUCCESS);
+    assert_int_equal(objects_size, 6);
+    assert_int_equal(loopback.requests, 2);
+    assert_int_equal(objects[3].id, TMB_DEVICE_IDENTIFICATION_MODEL_NAME);
+    assert_int_equal(objects[5].id, 0x81);
+    assert_int_equal(objects[5].length, sizeof(long_value));
+
+    /* unknown objects restart the stream, while specific access reports them */
+    objects_size = 8;
+    assert_int_equal(tmb_read_device_identification(&handle, TMB_READ_DEVICE_ID_REGULAR, 0x04, objects,
+                                                    &objects_size, values, sizeof(values)),
+                     TMB_SUCCESS);
+    assert_int_equal(objects_size, 4);
+    objects_size = 8;
+    assert_int_equal(tmb_read_device_identification(&handle, TMB_READ_DEVICE_ID_SPECIFIC, 0x05, objects,
+                                                    &objects_size, values, sizeof(values)),
+                     TMB_SUCCESS);
+    assert_int_equal(objects_size, 1);
+    assert_string_equal(objects[0].value, "model");
+    objects_size = 8;
+    assert_int_equal(tmb_read_device_identification(&handle, TMB_READ_DEVICE_ID_SPECIFIC, 0x04, objects,
+                                                    &objects_size, values, sizeof(values)),
+                     TMB_E_ILLEGAL_DATA_ADDRESS);
+    objects_size = 2;
+    assert_int_equal(tmb_read_device_identification(&handle, TMB_READ_DEVICE_ID_BASIC, 0, objects, &objects_size,
+                                                    values, sizeof(values)),
+                     TMB_E_NO_MEMORY);
+}
+
+static void test_execute_batch(void **state) {
+    uint16_t registers[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+    tmb_register_bank_t bank;
+    assert_int_equal(tmb_register_bank_init(&bank, 0, registers, 8), TMB_SUCCESS);
+
+    const tmb_callbacks_t bank_callbacks = { .holding_registers = &bank };
+    loopback_t loopback;
+    tmb_transport_t transport;
+    loopback_init(&loopback, &transport, &bank_callbacks);
+
+    tmb_handle_t handle;
+    uint8_t buffer[1024];
+    assert_int_equal(tmb_init(&handle, TMB_MODE_CLIENT, TMB_TRANSPORT_PROTOCOL_TCPIP, buffer, sizeof(buffer),
+                              &transport),
+                     TMB_SUCCESS);
+    assert_int_equal(tmb_client_set_device_address(&handle, 1), TMB_SUCCESS);
+
+    uint16_t values[] = { 0xBEEF };
+    tmb_request_pdu_t requests[] = {
+        { .function_code = TMB_FUNCTION_READ_HOLDING_REGISTERS, .read_holding_registers = { 0, 4 } },
+        { .function_code = TMB_FUNCTION_READ_HOLDING_REGISTERS, .read_holding_registers = { 100, 4 } },
+        { .function_code = TMB_FUNCTION_WRITE_MULTIPLE_REGISTERS, .write_multiple_registers = { 2, 1, 2, values } },
+        { .function_code = TMB_FUNCTION_READ_HOLDING_REGISTERS, .read_holding_registers = { 0, 4 } },
+    };
+    tmb_response_pdu_t responses[4];
+
+    /* an invalid request is detected before sending any */
+    requests[3].read_holding_registers.quantity = 0;
+    assert_int_equal(tmb_client_execute_batch(&handle, requests, responses, 4), TMB_E_ILLEGAL_DATA_VALUE);
+    assert_int_equal(loopback.writes, 0);
+    requests[3].read_holding_registers.quantity = 4;
+
+    /* requests are sent with a single write, and the exception does not stop the batch */
+    assert_int_equal(tmb_client_execute_batch(&handle, requests, responses, 4), TMB_E_ILLEGAL_DATA_ADDRESS);
+    assert_int_equal(loopback.writes, 1);
+    assert_int_equal(loopback.requests, 4);
+    assert_int_equal(responses[1].function_code, TMB_FUNCTION_READ_HOLDING_REGISTERS | 0x80);
+    assert_int_equal(responses[1].exception.exception_code, TMB_E_ILLEGAL_DATA_ADDRESS);
+    assert_int_equal(responses[2].write_multiple_registers.start_address, 2);
+
+    /* the responses are all valid at the end of the batch */
+    assert_int_equal(responses[0].read_holding_registers.register_values[2], 2);
+    assert_int_equal(responses[3].read_holding_registers.register_values[2], 0xBEEF);
+    assert_int_equal(responses[3].read_holding_registers.register_values[3], 3);
+
+    /* nothing is sent if the largest responses don't fit the buffer */
+    assert_int_equal(tmb_init(&handle, TMB_MODE_CLIENT, TMB_TRANSPORT_PROTOCOL_TCPIP, buffer, 56, &transport),
+                     TMB_SUCCESS);
+    assert_int_equal(tmb_client_set_device_address(&handle, 1), TMB_SUCCESS);
+    assert_int_equal(tmb_client_execute_batch(&handle, requests, responses, 4), TMB_E_NO_MEMORY);
+    assert_int_equal(loopback.writes, 1);
+
+    /* a response that does not fit anyway is skipped, to leave the connection in sync */
+    uint16_t read_values[8];
+    assert_int_equal(tmb_init(&handle, TMB_MODE_CLIENT, TMB_TRANSPORT_PROTOCOL_TCPIP, buffer, 20, &transport),
+                     TMB_SUCCESS);
+    assert_int_equal(tmb_client_set_device_address(&handle, 1), TMB_SUCCESS);
+    assert_int_equal(tmb_read_holding_registers(&handle, 0, 8, read_values), TMB_E_NO_MEMORY);
+    assert_int_equal(tmb_read_holding_registers(&handle, 3, 1, read_values), TMB_SUCCESS);
+    assert_int_equal(read_values[0], 3);
+
+    /* on a RTU bus, a device that does not answer or a corrupted response don't stop the batch */
+    assert_int_equal(tmb_init(&loopback.server, TMB_MODE_SERVER, TMB_TRANSPORT_PROTOCOL_RTU, loopback.server_buffer,
+                              sizeof(loopback.server_buffer), &dummy_transport),
+                     TMB_SUCCESS);
+    assert_int_equal(tmb_server_set_callback(&loopback.server, 1, &bank_callbacks), TMB_SUCCESS);
+    transport.read_timeout = loopback_read_timeout;
+    assert_int_equal(tmb_init(&handle, TMB_MODE_CLIENT, TMB_TRANSPORT_PROTOCOL_RTU, buffer, sizeof(buffer),
+                              &transport),
+                     TMB_SUCCESS);
+    assert_int_equal(tmb_client_set_device_address(&handle, 1), TMB_SUCCESS);
+    assert_int_equal(tmb_client_set_response_timeout(&handle, 1000), TMB_SUCCESS);
+    requests[1].read_holding_registers.start_address = 0;
+    requests[2].unit_id = 2;
+    loopback.requests = 0;
+    loopback.corrupted_byte = 4;
+    assert_int_equal(tmb_client_execute_batch(&handle, requests, responses, 4), TMB_E_INVALID_CRC);
+    assert_int_equal(loopback.requests, 4);
+    assert_int_equal(responses[1].read_holding_registers.register_values[3], 3);
+    assert_int_equal(responses[3].read_holding_registers.register_values[2], 0xBEEF);
+
+    /* while a failure of the transport does */
+    loopback.requests = 0;
+    loopback.failing_write = loopback.writes + 2;
+    assert_int_equal(tmb_client_execute_batch(&handle, requests, responses, 4), TMB_E_TRANSPORT);
+    assert_int_equal(loopback.requests, 1);
+}
+
+static void test_unit_id(void **state) {
+    uint16_t registers[2][4] = { { 0x1000, 0x1001, 0x1002, 0x1003 }, { 0x2000, 0x2001, 0x2002, 0x2003 } };
+    tmb_register_bank_t banks[2];
+    assert_int_equal(tmb_register_bank_init(&banks[0], 0, registers[0], 4), TMB_SUCCESS);
+    assert_int_equal(tmb_register_bank_init(&banks[1], 0, registers[1], 4), TMB_SUCCESS);
+
+    /* a gateway, with a device on each of the units 1 and 2 */
+    const tmb_callbacks_t unit_callbacks[2] = { { .holding_registers = &banks[0] },
+                                                { .holding_registers = &banks[1] } };
+    loopback_t loopback;
+    tmb_transport_t transport;
+    loopback_init(&loopback, &transport, &unit_callbacks[0]);
+    assert_int_equal(tmb_server_set_callback(&loopback.server, 2, &unit_callbacks[1]), TMB_SUCCESS);
+
+    tmb_handle_t handle;
+    uint8_t buffer[512];
+    assert_int_equal(tmb_init(&handle, TMB_MODE_CLIENT, TMB_TRANSPORT_PROTOCOL_TCPIP, buffer, sizeof(buffer),
+                              &transport),
+                     TMB_SUCCESS);
+    assert_int_equal(tmb_client_set_device_address(&handle, 1), TMB_SUCCESS);
+
+    tmb_request_pdu_t requests[] = {
+        { .function_code = TMB_FUNCTION_READ_HOLDING_REGISTERS, .read_holding_registers = { 0, 2 } },
+        { .function_code = TMB_FUNCTION_READ_HOLDING_REGISTERS, .unit_id = 2, .read_holding_registers = { 0, 2 } },
+        { .function_code = TMB_FUNCTION_READ_HOLDING_REGISTERS, .unit_id = 1, .read_holding_registers = { 2, 2 } },
+    };
+    tmb_response_pdu_t responses[3];
+    assert_int_equal(tmb_client_execute_batch(&handle, requests, responses, 3), TMB_SUCCESS);
+    assert_int_equal(loopback.writes, 1);
+    assert_int_equal(responses[0].read_holding_registers.register_values[1], 0x1001);
+    assert_int_equal(responses[1].read_holding_registers.register_values[1], 0x2001);
+    assert_int_equal(responses[2].read_holding_registers.register_values[1], 0x1003);
+
+    requests[1].unit_id = TMB_UNIT_ID_BROADCAST + 1;
+    assert_int_equal(tmb_client_execute_batch(&handle, requests, responses, 3), TMB_E_INVALID_ARGUMENTS);
+    assert_int_equal(loopback.writes, 1);
+
+    /* the values written in place go to the unit of the reservation */
+    uint8_t *payload = NULL;
+    assert_int_equal(tmb_client_reserve_registers(&handle, 2, TMB_FUNCTION_WRITE_MULTIPLE_REGISTERS, 1, 1, &payload),
+                     TMB_SUCCESS);
+    memcpy(payload, "\xCA\xFE", 2);
+    assert_int_equal(tmb_client_commit_registers(&handle), TMB_SUCCESS);
+    assert_int_equal(registers[0][1], 0x1001);
+    assert_int_equal(registers[1][1], 0xCAFE);
+
+    assert_int_equal(tmb_client_reserve_registers(&handle, TMB_UNIT_ID_BROADCAST + 1,
+                                                  TMB_FUNCTION_WRITE_MULTIPLE_REGISTERS, 1, 1, &payload),
+                     TMB_E_INVALID_ARGUMENTS);
+}
+
+typedef struct {
+    uint8_t address;
+    uint16_t transaction_identifier;
+    uint8_t pdu[16];
+    size_t pdu_size;
+} parsed_frame_t;
+
+/* feeds the stream to the parser in chunks of the given size, as a transport would */
+static size_t parse_stream(tmb_parser_t *parser, const uint8_t *stream, size_t stream_size, size_t chunk_size,
+                           parsed_frame_t *frames, size_t *errors) {
+    size_t count = 0;
+
+    for (size_t offset = 0; offset < stream_size; offset += chunk_size) {
+        const uint8_t *bytes = &stream[offset];
+        size_t size = stream_size - offset < chunk_size ? stream_size - offset : chunk_size;
+        size_t consumed;
+        tmb_frame_t frame;
+        tmb_error_t error;
+
+        while ((error = tmb_parser_feed(parser, bytes, size, &consumed, &frame)) != TMB_E_INCOMPLETE) {
+            assert_true(consumed <= size);
+            if (error == TMB_SUCCESS) {
+                assert_true(frame.pdu_size <= sizeof(frames[count].pdu));
+                frames[count].address = frame.address;
+                frames[count].transaction_identifier = frame.transaction_identifier;
+                frames[count].pdu_size = frame.pdu_size;
+                memcpy(frames[count].pdu, frame.pdu, frame.pdu_size);
+                count++;
+            } else {
+                (*errors)++;
+            }
+            bytes += consumed;
+            size -= consumed;
+        }
+        assert_int_equal(consumed, size);
+    }
+
+    return count;
+}
+
+static size_t append_crc(uint8_t *adu, size_t size) {
+    uint16_t crc = tmb_crc16(adu, size);
+    adu[size] = crc & 0xFF;
+    adu[size + 1] = crc >> 8;
+
+    return size + 2;
+}
+
+static void test_parser(void **state) {
+    uint8_t buffer[TMB_ADU_ASCII_ADU_MAX_SIZE];
+    tmb_parser_t parser;
+    parsed_frame_t frames[4];
+    size_t errors = 0;
+    assert_int_equal(tmb_parser_init(&parser, TMB_MODE_SERVER, TMB_TRANSPORT_PROTOCOL_RTU, buffer, 16),
+                     TMB_E_INVALID_ARGUMENTS);
+
+    /* RTU requests: read holding registers, then write multiple registers to another device */
+    uint8_t rtu[32] = { 0x01, 0x03, 0x00, 0x00, 0x00, 0x02, 0xC4, 0x0B,
+                        0x02, 0x10, 0x00, 0x01, 0x00, 0x02, 0x04, 0x00, 0x0A, 0x00, 0x0B };
+    size_t rtu_size = append_crc(&rtu[8], 11) + 8;
+    assert_int_equal(tmb_parser_init(&parser, TMB_MODE_SERVER, TMB_TRANSPORT_PROTOCOL_RTU, buffer, sizeof(buffer)),
+                     TMB_SUCCESS);
+
+    /* coalesced frames are returned one at a time, without copying them */
+    size_t consumed;
+    tmb_frame_t frame;
+    assert_int_equal(tmb_parser_feed(&parser, rtu, rtu_size, &consumed, &frame), TMB_SUCCESS);
+    assert_int_equal(consumed, 8);
+    assert_ptr_equal(frame.pdu, &rtu[1]);
+    assert_int_equal(frame.pdu_size, 5);
+    assert_int_equal(tmb_parser_feed(&parser, &rtu[8], rtu_size - 8, &consumed, &frame), TMB_SUCCESS);
+    assert_int_equal(consumed, rtu_size - 8);
+    assert_int_equal(frame.address, 2);
+    assert_int_equal(frame.pdu_size, 10);
+    assert_int_equal(tmb_parser_feed(&parser, NULL, 0, &consumed, &frame), TMB_E_INCOMPLETE);
+
+    /* partial frames are assembled, whatever the size of the chunks */
+    for (size_t chunk_size = 1; chunk_size <= rtu_size; chunk_size++) {
+        assert_int_equal(parse_stream(&parser, rtu, rtu_size, chunk_size, frames, &errors), 2);
+        assert_int_equal(errors, 0);
+        assert_int_equal(frames[0].address, 1);
+        assert_memory_equal(frames[0].pdu, &rtu[1], 5);
+        assert_int_equal(frames[1].address, 2);
+        assert_memory_equal(frames[1].pdu, &rtu[9], 10);
+    }
+
+    /* a corrupted frame is discarded, and the parser finds the next one */
+    rtu[3] ^= 0x01;
+    assert_int_equal(parse_stream(&parser, rtu, rtu_size, 3, frames, &errors), 1);
+    assert_true(errors > 0);
+    assert_int_equal(frames[0].address, 2);
+
+    /* RTU responses: read holding registers, then an exception */
+    uint8_t responses[16] = { 0x01, 0x03, 0x04, 0x00, 0x0A, 0x00, 0x0B };
+    size_t responses_size = append_crc(responses, 7);
+    responses[responses_size] = 0x01;
+    responses[responses_size + 1] = 0x83;
+    responses[responses_size + 2] = TMB_E_ILLEGAL_DATA_ADDRESS;
+    responses_size = append_crc(&responses[responses_size], 3) + responses_size;
+    assert_int_equal(tmb_parser_init(&parser, TMB_MODE_CLIENT, TMB_TRANSPORT_PROTOCOL_RTU, buffer, sizeof(buffer)),
+                     TMB_SUCCESS);
+    errors = 0;
+    assert_int_equal(parse_stream(&parser, responses, responses_size, 1, frames, &errors), 2);
+    assert_int_equal(errors, 0);
+    assert_int_equal(frames[0].pdu_size, 6);
+    assert_int_equal(frames[1].pdu_size, 2);
+    assert_int_equal(frames[1].pdu[1], TMB_E_ILLEGAL_DATA_ADDRESS);
+
+    /* TCP/IP frames are delimited by the MBAP header */
+    const uint8_t tcpip[] = { 0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x00, 0x00, 0x02,
+                              0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0x05, 0x06, 0x00, 0x01, 0x00, 0x03 };
+    assert_int_equal(tmb_parser_init(&parser, TMB_MODE_SERVER, TMB_TRANSPORT_PROTOCOL_TCPIP, buffer, sizeof(buffer)),
+                     TMB_SUCCESS);
+    assert_int_equal(parse_stream(&parser, tcpip, sizeof(tcpip), 5, frames, &errors), 2);
+    assert_int_equal(errors, 0);
+    assert_int_equal(frames[0].transaction_identifier, 1);
+    assert_int_equal(frames[0].address, 1);
+    assert_int_equal(frames[1].transaction_identifier, 2);
+    assert_int_equal(frames[1].address, 5);
+    assert_memory_equal(frames[1].pdu, &tcpip[19], 5);
+
+    /* ASCII frames, with garbage between them and a frame with a wrong LRC */
+    const char *ascii = "xx:010300000002FA\r\n:0106000100030B\r\n\r\n:01060001000 3F5\r\n:01060001000aee\r\n";
+    assert_int_equal(tmb_parser_init(&parser, TMB_MODE_SERVER, TMB_TRANSPORT_PROTOCOL_ASCII, buffer, sizeof(buffer)),
+                     TMB_SUCCESS);
+    assert_int_equal(parse_stream(&parser, (const uint8_t *)ascii, strlen(ascii), 4, frames, &errors), 2);
+    assert_int_equal(errors, 2);
+    assert_int_equal(frames[0].address, 1);
+    assert_int_equal(frames[0].pdu_size, 5);
+    assert_memory_equal(frames[0].pdu, "\x03\x00\x00\x00\x02", 5);
+    assert_memory_equal(frames[1].pdu, "\x06\x00\x01\x00\x0A", 5);
+}
+
+static void test_reserve_registers(void **state) {
+    loopback_t loopback;
+    tmb_transport_t transport;
+    loopback_init(&loopback, &transport, &callbacks);
+
+    tmb_handle_t handle;
+    uint8_t buffer[TMB_ADU_TCPIP_MAX_SIZE];
+    assert_int_equal(tmb_init(&handle, TMB_MODE_CLIENT, TMB_TRANSPORT_PROTOCOL_TCPIP, buffer, sizeof(buffer),
+                              &transport),
+                     TMB_SUCCESS);
+    assert_int_equal(tmb_client_set_device_address(&handle, 1), TMB_SUCCESS);
+
+    /* the values are written directly after the byte count of the request */
+    uint8_t *payload = NULL;
+    assert_int_equal(tmb_client_reserve_registers(&handle, TMB_UNIT_ID_DEFAULT, TMB_FUNCTION_WRITE_MULTIPLE_REGISTERS,
+                                                  3, 2, &payload),
+                     TMB_SUCCESS);
+    assert_ptr_equal(payload, &buffer[13]);
+    memcpy(payload, "\xCA\xFE\xBE\xEF", 4);
+    assert_int_equal(tmb_client_commit_registers(&handle), TMB_SUCCESS);
+    assert_int_equal(loopback.requests, 1);
+    assert_int_equal(registers[3], 0xCAFE);
+    assert_int_equal(registers[4], 0xBEEF);
+
+    /* nothing left to commit */
+    assert_int_equal(tmb_client_commit_registers(&handle), TMB_E_INVALID_ARGUMENTS);
+
+    assert_int_equal(tmb_client_reserve_registers(&handle, TMB_UNIT_ID_DEFAULT, TMB_FUNCTION_WRITE_MULTIPLE_REGISTERS,
+                                                  3, 0, &payload),
+                     TMB_E_ILLEGAL_DATA_VALUE);
+    assert_int_equal(tmb_client_reserve_registers(&handle, TMB_UNIT_ID_DEFAULT, TMB_FUNCTION_READ_HOLDING_REGISTERS,
+                                                  3, 2, &payload),
+                     TMB_E_INVALID_ARGUMENTS);
+
+    /* the server exception is returned by the commit */
+    assert_int_equal(tmb_client_reserve_registers(&handle, TMB_UNIT_ID_DEFAULT, TMB_FUNCTION_WRITE_MULTIPLE_REGISTERS,
+                                                  15, 2, &payload),
+                     TMB_SUCCESS);
+    memset(payload, 0, 4);
+    assert_int_equal(tmb_client_commit_registers(&handle), TMB_E_ILLEGAL_DATA_ADDRESS);
+    assert_int_equal(loopback.requests, 2);
+
+    /* another request overwrites the reserved ADU, thus it can't be committed */
+    assert_int_equal(tmb_client_reserve_registers(&handle, TMB_UNIT_ID_DEFAULT, TMB_FUNCTION_WRITE_MULTIPLE_REGISTERS,
+                                                  3, 2, &payload),
+                     TMB_SUCCESS);
+    uint16_t value = 0;
+    assert_int_equal(tmb_read_holding_registers(&handle, 3, 1, &value), TMB_SUCCESS);
+    assert_int_equal(tmb_client_commit_registers(&handle), TMB_E_INVALID_ARGUMENTS);
+    assert_int_equal(loopback.requests, 3);
+
+    /* the response must echo the start address and the quantity */
+    assert_int_equal(tmb_client_reserve_registers(&handle, TMB_UNIT_ID_DEFAULT, TMB_FUNCTION_WRITE_MULTIPLE_REGISTERS,
+                                                  3, 2, &payload),
+                     TMB_SUCCESS);
+    memcpy(payload, "\xCA\xFE\xBE\xEF", 4);
+    loopback.corrupted_byte = TMB_ADU_TCPIP_HEADER_SIZE + 4;
+    assert_int_equal(tmb_client_commit_registers(&handle), TMB_E_INVALID_RESPONSE);
+}
+
+static uint32_t turnaround_us;
+
+static int silent_read_timeout(void *user_data, uint8_t *buffer, size_t nbyte, uint32_t timeout_us) {
+    turnaround_us += timeout_us;
+
+    return 0;
+}
+
+static size_t silent_reads;
+
+/* a read without timeout on a silent line, that would block forever */
+static int silent_read(void *user_data, uint8_t *buffer, size_t nbyte) {
+    silent_reads++;
+
+    return 0;
+}
+
+static void test_gateway(void **state) {
+    /* a RTU bus, with the device 1 on it */
+    loopback_t loopback;
+    tmb_transport_t transport;
+    loopback_init(&loopback, &transport, &callbacks);
+    assert_int_equal(tmb_init(&loopback.server, TMB_MODE_SERVER, TMB_TRANSPORT_PROTOCOL_RTU, loopback.server_buffer,
+                              sizeof(loopback.server_buffer), &dummy_transport),
+                     TMB_SUCCESS);
+    assert_int_equal(tmb_server_set_callback(&loopback.server, 1, &callbacks), TMB_SUCCESS);
+
+    tmb_handle_t bus;
+    uint8_t bus_buffer[TMB_ADU_RTU_MAX_SIZE];
+    assert_int_equal(tmb_init(&bus, TMB_MODE_CLIENT, TMB_TRANSPORT_PROTOCOL_RTU, bus_buffer, sizeof(bus_buffer),
+                              &transport),
+                     TMB_SUCCESS);
+
+    /* requests to the device 1, to the device 2 that is not there, and broadcast */
+    const uint8_t stream[] = { 0x12, 0x34, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x05, 0x00, 0x02,
+                               0x12, 0x35, 0x00, 0x00, 0x00, 0x06, 0x02, 0x03, 0x00, 0x05, 0x00, 0x02,
+                               0x12, 0x36, 0x00, 0x00, 0x00, 0x06, 0x00, 0x06, 0x00, 0x06, 0xAB, 0xCD };
+    uint8_t parser_buffer[TMB_ADU_TCPIP_MAX_SIZE];
+    tmb_parser_t parser;
+    assert_int_equal(tmb_parser_init(&parser, TMB_MODE_SERVER, TMB_TRANSPORT_PROTOCOL_TCPIP, parser_buffer,
+                                     sizeof(parser_buffer)),
+                     TMB_SUCCESS);
+
+    tmb_gateway_request_t storage[3];
+    tmb_gateway_queue_t queue;
+    assert_int_equal(tmb_gateway_queue_init(&queue, storage, 3), TMB_SUCCESS);
+
+    const uint8_t *bytes = stream;
+    size_t size = sizeof(stream);
+    size_t consumed;
+    tmb_frame_t frame;
+    int context;
+    while (tmb_parser_feed(&parser, bytes, size, &consumed, &frame) == TMB_SUCCESS) {
+        assert_int_equal(tmb_gateway_queue_push(&queue, &frame, &context, 7, 1, 0), TMB_SUCCESS);
+        bytes += consumed;
+        size -= consumed;
+    }
+    assert_int_equal(tmb_gateway_queue_size(&queue), 3);
+    assert_int_equal(tmb_gateway_queue_push(&queue, &frame, &context, 7, 1, 0), TMB_E_NO_MEMORY);
+
+    /* broadcast requests are executed, but have no response. Being writes, they go first */
+    tmb_gateway_request_t request;
+    assert_true(tmb_gateway_queue_pop(&queue, &request, 0));
+    assert_int_equal(tmb_gateway_forward(&bus, &request), TMB_IGNORED);
+    assert_int_equal(registers[6], 0xABCD);
+
+    registers[5] = 0x1122;
+    registers[6] = 0x3344;
+    assert_true(tmb_gateway_queue_pop(&queue, &request, 0));
+    assert_ptr_equal(request.context, &context);
+    assert_int_equal(request.tag, 7);
+    assert_int_equal(tmb_gateway_forward(&bus, &request), TMB_SUCCESS);
+    const uint8_t expected[] = { 0x12, 0x34, 0x00, 0x00, 0x00, 0x07, 0x01, 0x03, 0x04, 0x11, 0x22, 0x33, 0x44 };
+    assert_int_equal(request.size, sizeof(expected));
+    assert_memory_equal(request.adu, expected, sizeof(expected));
+
+    /* no device answers */
+    assert_true(tmb_gateway_queue_pop(&queue, &request, 0));
+    assert_int_equal(tmb_gateway_forward(&bus, &request), TMB_SUCCESS);
+    const uint8_t timeout[] = { 0x12, 0x35, 0x00, 0x00, 0x00, 0x03, 0x02, 0x83,
+                                TMB_E_GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND };
+    assert_int_equal(request.size, sizeof(timeout));
+    assert_memory_equal(request.adu, timeout, sizeof(timeout));
+    assert_int_equal(loopback.requests, 3);
+    assert_false(tmb_gateway_queue_pop(&queue, &request, 0));
+
+    /* a device that never answers: the wait for its response is bounded by the response timeout */
+    transport.read = silent_read;
+    transport.read_timeout = silent_read_timeout;
+    assert_int_equal(tmb_client_set_response_timeout(&bus, 200000), TMB_SUCCESS);
+    assert_int_equal(tmb_parser_feed(&parser, &stream[12], 12, &consumed, &frame), TMB_SUCCESS);
+    assert_int_equal(tmb_gateway_queue_push(&queue, &frame, &context, 7, 1, 0), TMB_SUCCESS);
+    assert_true(tmb_gateway_queue_pop(&queue, &request, 0));
+    turnaround_us = 0;
+    silent_reads = 0;
+    assert_int_equal(tmb_gateway_forward(&bus, &request), TMB_SUCCESS);
+    assert_int_equal(request.size, sizeof(timeout));
+    assert_memory_equal(request.adu, timeout, sizeof(timeout));
+    assert_int_equal(turnaround_us, 200000);
+    assert_int_equal(silent_reads, 0);
+}
+
+static void push_request(tmb_gateway_queue_t *queue, const uint8_t *adu, size_t size, void *context,
+                         uint8_t weight, uint64_t now_us) {
+    uint8_t parser_buffer[TMB_ADU_TCPIP_MAX_SIZE];
+    tmb_parser_t parser;
+    assert_int_equal(tmb_parser_init(&parser, TMB_MODE_SERVER, TMB_TRANSPORT_PROTOCOL_TCPIP, parser_buffer,
+                                     sizeof(parser_buffer)),
+                     TMB_SUCCESS);
+
+    size_t consumed;
+    tmb_frame_t frame;
+    assert_int_equal(tmb_parser_feed(&parser, adu, size, &consumed, &frame), TMB_SUCCESS);
+    assert_int_equal(tmb_gateway_queue_push(queue, &frame, context, 0, weight, now_us), TMB_SUCCESS);
+}
+
+static void test_gateway_scheduler(void **state) {
+    tmb_gateway_request_t storage[8];
+    tmb_gateway_queue_t queue;
+    assert_int_equal(tmb_gateway_queue_init(&queue, storage, 8), TMB_SUCCESS);
+
+    /* a connection sends a burst of reads, then another one sends a read and the first one a write */
+    int first, second;
+    uint8_t read[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x00, 0x00, 0x10 };
+    for (uint8_t i = 1; i <= 4; i++) {
+        read[1] = i;
+        push_request(&queue, read, sizeof(read), &first, 1, 0);
+    }
+    read[1] = 5;
+    push_request(&queue, read, sizeof(read), &second, 1, 10);
+    const uint8_t write[] = { 0x00, 0x06, 0x00, 0x00, 0x00, 0x06, 0x01, 0x06, 0x00, 0x00, 0x00, 0x01 };
+    push_request(&queue, write, sizeof(write), &first, 1, 20);
+    assert_int_equal(queue.metrics[TMB_GATEWAY_LANE_READ].depth, 5);
+    assert_int_equal(queue.metrics[TMB_GATEWAY_LANE_WRITE].depth, 1);
+
+    /* the write first, then the read of the second connection does not wait for the whole burst */
+    const uint8_t expected[] = { 6, 1, 5, 2, 3, 4 };
+    tmb_gateway_request_t request;
+    for (size_t i = 0; i < sizeof(expected); i++) {
+        assert_true(tmb_gateway_queue_pop(&queue, &request, 100 * (i + 1)));
+        assert_int_equal(request.adu[1], expected[i]);
+    }
+    assert_false(tmb_gateway_queue_pop(&queue, &request, 1000));
+
+    const tmb_gateway_lane_metrics_t *metrics = &queue.metrics[TMB_GATEWAY_LANE_READ];
+    assert_int_equal(metrics->depth, 0);
+    assert_int_equal(metrics->max_depth, 5);
+    assert_int_equal(metrics->dispatched, 5);
+    assert_int_equal(metrics->max_wait_us, 600);
+    assert_int_equal(metrics->total_wait_us, 200 + 300 - 10 + 400 + 500 + 600);
+    assert_int_equal(queue.metrics[TMB_GATEWAY_LANE_WRITE].max_wait_us, 100 - 20);
+
+    /* a flow with twice the weight gets twice the share of the bus */
+    for (uint8_t i = 1; i <= 4; i++) {
+        read[1] = i;
+        push_request(&queue, read, sizeof(read), &first, 1, 0);
+        read[1] = 10 + i;
+        push_request(&queue, read, sizeof(read), &second, 2, 0);
+    }
+    const uint8_t weighted[] = { 11, 1, 12, 13, 2, 14, 3, 4 };
+    for (size_t i = 0; i < sizeof(weighted); i++) {
+        assert_true(tmb_gateway_queue_pop(&queue, &request, 0));
+        assert_int_equal(request.adu[1], weighted[i]);
+    }
+}
+
+typedef struct {
+    tmb_gateway_mailbox_t *mailbox;
+    uint8_t unit_id;
+} mailbox_producer_t;
+
+static void *mailbox_produce(void *arg) {
+    mailbox_producer_t *producer = arg;
+    /* read holding registers, the quantity is the sequence number of the request */
+    uint8_t pdu[] = { 0x03, 0x00, 0x00, 0x00, 0x00 };
+    tmb_frame_t frame = { .address = producer->unit_id, .pdu = pdu, .pdu_size = sizeof(pdu) };
+
+    for (uint16_t i = 0; i < 1000; i++) {
+        pdu[3] = i >> 8;
+        pdu[4] = i & 0xFF;
+        while (tmb_gateway_mailbox_push(producer->mailbox, &frame, NULL, 0, 1, 0) != TMB_SUCCESS) {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+static void test_gateway_mailbox(void **state) {
+    tmb_gateway_request_t storage[4];
+    tmb_gateway_mailbox_t mailbox;
+    tmb_gateway_request_t request;
+
+    assert_int_equal(tmb_gateway_mailbox_init(&mailbox, storage, 3), TMB_E_INVALID_ARGUMENTS);
+    assert_int_equal(tmb_gateway_mailbox_init(&mailbox, storage, 4), TMB_SUCCESS);
+    assert_false(tmb_gateway_mailbox_pop(&mailbox, &request));
+
+    /* requests are popped in the order they were pushed, until the mailbox is full */
+    uint8_t read[] = { 0x03, 0x00, 0x00, 0x00, 0x01 };
+    uint8_t write[] = { 0x06, 0x00, 0x00, 0x00, 0x01 };
+    tmb_frame_t frame = { .address = 1, .pdu = read, .pdu_size = sizeof(read) };
+    for (uint8_t i = 0; i < 4; i++) {
+        frame.transaction_identifier = i;
+        assert_int_equal(tmb_gateway_mailbox_push(&mailbox, &frame, NULL, i, 1, 0), TMB_SUCCESS);
+    }
+    frame.pdu = write;
+    assert_int_equal(tmb_gateway_mailbox_push(&mailbox, &frame, NULL, 4, 1, 0), TMB_E_NO_MEMORY);
+    assert_int_equal(mailbox.rejected[TMB_GATEWAY_LANE_WRITE], 1);
+    assert_int_equal(mailbox.rejected[TMB_GATEWAY_LANE_READ], 0);
+
+    for (uint8_t i = 0; i < 2; i++) {
+        assert_true(tmb_gateway_mailbox_pop(&mailbox, &request));
+        assert_int_equal(request.tag, i);
+        assert_int_equal(request.adu[1], i);
+    }
+
+    /* the slots that were popped are reused */
+    assert_int_equal(tmb_gateway_mailbox_push(&mailbox, &frame, NULL, 4, 2, 0), TMB_SUCCESS);
+    for (uint8_t i = 2; i < 5; i++) {
+        assert_true(tmb_gateway_mailbox_pop(&mailbox, &request));
+        assert_int_equal(request.tag, i);
+    }
+    assert_int_equal(request.lane, TMB_GATEWAY_LANE_WRITE);
+    assert_int_equal(request.weight, 2);
+    assert_false(tmb_gateway_mailbox_pop(&mailbox, &request));
+
+    /* with concurrent producers, the requests of each one are popped in order and none is lost */
+    pthread_t threads[4];
+    mailbox_producer_t producers[4];
+    for (uint8_t i = 0; i < 4; i++) {
+        producers[i] = (mailbox_producer_t){ .mailbox = &mailbox, .unit_id = i };
+        assert_int_equal(pthread_create(&threads[i], NULL, mailbox_produce, &producers[i]), 0);
+    }
+
+    uint16_t next[4] = { 0 };
+    size_t popped = 0;
+    while (popped < 4000) {
+        if (!tmb_gateway_mailbox_pop(&mailbox, &request)) {
+            sched_yield();
+            continue;
+        }
+        uint8_t unit_id = request.adu[TMB_ADU_TCPIP_HEADER_SIZE - 1];
+        assert_true(unit_id < 4);
+        assert_int_equal((request.adu[TMB_ADU_TCPIP_HEADER_SIZE + 3] << 8) | request.adu[TMB_ADU_TCPIP_HEADER_SIZE + 4],
+                         next[unit_id]);
+        next[unit_id]++;
+        popped++;
+    }
+
+    for (uint8_t i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    assert_false(tmb_gateway_mailbox_pop(&mailbox, &request));
+}
+
+static void test_gateway_pipeline(void **state) {
+    tmb_gateway_request_t storage[2];
+    tmb_gateway_pipeline_t pipeline;
+    tmb_gateway_request_t *first;
+    tmb_gateway_request_t *second;
+    tmb_gateway_request_t response;
+    int clients[2];
+
+    assert_int_equal(tmb_gateway_pipeline_init(&pipeline, storage, 2), TMB_SUCCESS);
+
+    /* two clients that use the same transaction identifier get different ones on the device */
+    uint8_t pdu[] = { 0x03, 0x00, 0x00, 0x00, 0x01 };
+    tmb_frame_t frame = { .address = 1, .transaction_identifier = 5, .pdu = pdu, .pdu_size = sizeof(pdu) };
+    assert_int_equal(tmb_gateway_pipeline_submit(&pipeline, &frame, &clients[0], 0, 100, &first), TMB_SUCCESS);
+    assert_int_equal(tmb_gateway_pipeline_submit(&pipeline, &frame, &clients[1], 0, 200, &second), TMB_SUCCESS);
+    assert_int_equal(tmb_gateway_pipeline_submit(&pipeline, &frame, &clients[1], 0, 300, &second), TMB_E_NO_MEMORY);
+
+    uint16_t first_id = (first->adu[0] << 8) | first->adu[1];
+    uint16_t second_id = (second->adu[0] << 8) | second->adu[1];
+    assert_int_not_equal(first_id, second_id);
+    assert_int_equal(first->size, TMB_ADU_TCPIP_HEADER_SIZE + sizeof(pdu));
+    assert_memory_equal(&first->adu[TMB_ADU_TCPIP_HEADER_SIZE - 1], "\x01\x03\x00\x00\x00\x01", 6);
+
+    /* the device answers in any order, and the responses get back the identifier of the clients */
+    uint8_t response_pdu[] = { 0x03, 0x02, 0x12, 0x34 };
+    tmb_frame_t device_frame = { .address = 1, .transaction_identifier = second_id, .pdu = response_pdu,
+                                 .pdu_size = sizeof(response_pdu) };
+    assert_int_equal(tmb_gateway_pipeline_complete(&pipeline, &device_frame, &response), TMB_SUCCESS);
+    assert_ptr_equal(response.context, &clients[1]);
+    assert_int_equal(response.size, TMB_ADU_TCPIP_HEADER_SIZE + sizeof(response_pdu));
+    assert_memory_equal(response.adu, "\x00\x05\x00\x00\x00\x05\x01\x03\x02\x12\x34", response.size);
+
+    /* a response that matches no transaction is rejected */
+    assert_int_equal(tmb_gateway_pipeline_complete(&pipeline, &device_frame, &response), TMB_E_INVALID_RESPONSE);
+    device_frame.transaction_identifier = first_id;
+    device_frame.address = 2;
+    assert_int_equal(tmb_gateway_pipeline_complete(&pipeline, &device_frame, &response), TMB_E_INVALID_RESPONSE);
+
+    /* the transactions that time out are answered with an exception */
+    assert_false(tmb_gateway_pipeline_cancel(&pipeline, 100, TMB_E_GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND,
+                                             &response));
+    assert_true(tmb_gateway_pipeline_cancel(&pipeline, 101, TMB_E_GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND,
+                                            &response));
+    assert_ptr_equal(response.context, &clients[0]);
+    assert_memory_equal(response.adu, "\x00\x05\x00\x00\x00\x03\x01\x83\x0B", 9);
+    assert_int_equal(pipeline.size, 0);
+
+    /* a late response to a cancelled transaction is dropped */
+    device_frame.address = 1;
+    assert_int_equal(tmb_gateway_pipeline_complete(&pipeline, &device_frame, &response), TMB_E_INVALID_RESPONSE);
+}
+
+static size_t broadcast_writes;
+
+static tmb_error_t on_write_holding_register_count(void *user_data, uint8_t address, uint16_t reg, uint16_t value) {
+    broadcast_writes++;
+
+    return TMB_SUCCESS;
+}
+
+static void test_broadcast(void **state) {
+    /* a server that serves several addresses with the same callbacks executes a broadcast write once */
+    const tmb_callbacks_t count_callbacks = { .on_write_holding_register = on_write_holding_register_count };
+    tmb_handle_t server;
+    uint8_t server_buffer[TMB_ADU_TCPIP_MAX_SIZE];
+    assert_int_equal(tmb_init(&server, TMB_MODE_SERVER, TMB_TRANSPORT_PROTOCOL_TCPIP, server_buffer,
+                              sizeof(server_buffer), &dummy_transport),
+                     TMB_SUCCESS);
+    assert_int_equal(tmb_server_set_callback(&server, 1, &count_callbacks), TMB_SUCCESS);
+    assert_int_equal(tmb_server_set_callback(&server, 2, &callbacks), TMB_SUCCESS);
+    assert_int_equal(tmb_server_set_callback(&server, 3, &count_callbacks), TMB_SUCCESS);
+    const uint8_t broadcast_write[] = { 0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x00, 0x06, 0x00, 0x03, 0x12, 0x34 };
+    memcpy(server_buffer, broadcast_write, sizeof(broadcast_write));
+    size_t response_size = 0;
+    broadcast_writes = 0;
+    assert_int_equal(tmb_server_process_request(&server, sizeof(broadcast_write), &response_size), TMB_IGNORED);
+    assert_int_equal(broadcast_writes, 1);
+    assert_int_equal(registers[3], 0x1234);
+
+    /* a RTU bus, with the devices 1 and 2 on it */
+    loopback_t loopback;
+    tmb_transport_t transport;
+    loopback_init(&loopback, &transport, &callbacks);
+    assert_int_equal(tmb_init(&loopback.server, TMB_MODE_SERVER, TMB_TRANSPORT_PROTOCOL_RTU, loopback.server_buffer,
+                              sizeof(loopback.server_buffer), &dummy_transport),
+                     TMB_SUCCESS);
+    assert_int_equal(tmb_server_set_callback(&loopback.server, TMB_ADDRESS_ANY, &callbacks), TMB_SUCCESS);
+    transport.read_timeout = silent_read_timeout;
+
+    tmb_handle_t handle;
+    uint8_t buffer[TMB_ADU_RTU_MAX_SIZE];
+    assert_int_equal(tmb_init(&handle, TMB_MODE_CLIENT, TMB_TRANSPORT_PROTOCOL_RTU, buffer, sizeof(buffer), &transport),
+                     TMB_SUCCESS);
+
+    /* a broadcast write is not answered: the client only waits for the turnaround delay */
+    turnaround_us = 0;
+    assert_int_equal(tmb_client_set_device_address(&handle, TMB_ADDRESS_BROADCAST), TMB_SUCCESS);
+    assert_int_equal(tmb_write_single_register(&handle, 3, 0x5555), TMB_SUCCESS);
+    assert_int_equal(registers[3], 0x5555);
+    assert_int_equal(turnaround_us, TMB_CLIENT_DEFAULT_TURNAROUND_DELAY_US);
+
+    /* nothing can be read with a broadcast */
+    uint16_t values[2];
+    assert_int_equal(tmb_read_holding_registers(&handle, 3, 1, values), TMB_E_INVALID_ARGUMENTS);
+    assert_int_equal(loopback.writes, 1);
+
+    /* a fan-out to all the devices is a single broadcast */
+    turnaround_us = 0;
+    assert_int_equal(tmb_client_set_turnaround_delay(&handle, 5000), TMB_SUCCESS);
+    tmb_request_pdu_t request = {
+        .function_code = TMB_FUNCTION_WRITE_SINGLE_REGISTER,
+        .write_single_register = { .address = 4, .value = 0x1234 },
+    };
+    assert_int_equal(tmb_client_fan_out(&handle, &request, NULL, 0, NULL), TMB_SUCCESS);
+    assert_int_equal(loopback.writes, 2);
+    assert_int_equal(registers[4], 0x1234);
+    assert_int_equal(turnaround_us, 5000);
+
+    /* while a fan-out to some of them sends a request to each one, and waits for its response */
+    const uint8_t unit_ids[] = { 1, 2 };
+    tmb_error_t errors[2];
+    request.write_single_register.value = 0x4321;
+    assert_int_equal(tmb_client_fan_out(&handle, &request, unit_ids, 2, errors), TMB_SUCCESS);
+    assert_int_equal(loopback.writes, 4);
+    assert_int_equal(errors[0], TMB_SUCCESS);
+    assert_int_equal(errors[1], TMB_SUCCESS);
+    assert_int_equal(registers[4], 0x4321);
+    assert_int_equal(turnaround_us, 5000);
+
+    request.write_single_register.address = 100;
+    assert_int_equal(tmb_client_fan_out(&handle, &request, unit_ids, 2, errors), TMB_E_ILLEGAL_DATA_ADDRESS);
+    assert_int_equal(errors[1], TMB_E_ILLEGAL_DATA_ADDRESS);
+
+    request.function_code = TMB_FUNCTION_READ_HOLDING_REGISTERS;
+    assert_int_equal(tmb_client_fan_out(&handle, &request, unit_ids, 2, errors), TMB_E_INVALID_ARGUMENTS);
+
+    /* a unit that does not answer does not stop the fan-out */
+    assert_int_equal(tmb_init(&loopback.server, TMB_MODE_SERVER, TMB_TRANSPORT_PROTOCOL_RTU, loopback.server_buffer,
+                              sizeof(loopback.server_buffer), &dummy_transport),
+                     TMB_SUCCESS);
+    assert_int_equal(tmb_server_set_callback(&loopback.server, 1, &callbacks), TMB_SUCCESS);
+    assert_int_equal(tmb_server_set_callback(&loopback.server, 3, &callbacks), TMB_SUCCESS);
+    transport.read_timeout = loopback_read_timeout;
+    assert_int_equal(tmb_client_set_response_timeout(&handle, 1000), TMB_SUCCESS);
+    const uint8_t more_unit_ids[] = { 1, 2, 3 };
+    tmb_error_t more_errors[3];
+    request.function_code = TMB_FUNCTION_WRITE_SINGLE_REGISTER;
+    request.write_single_register.address = 4;
+    loopback.requests = 0;
+    assert_int_equal(tmb_client_fan_out(&handle, &request, more_unit_ids, 3, more_errors), TMB_E_TIMEOUT);
+    assert_int_equal(loopback.requests, 3);
+    assert_int_equal(more_errors[0], TMB_SUCCESS);
+    assert_int_equal(more_errors[1], TMB_E_TIMEOUT);
+    assert_int_equal(more_errors[2], TMB_SUCCESS);
+
+    /* while after a failure of the transport the remaining units are not contacted */
+    more_errors[2] = TMB_E_INCOMPLETE;
+    loopback.failing_write = loopback.writes + 2;
+    assert_int_equal(tmb_client_fan_out(&handle, &request, more_unit_ids, 3, more_errors), TMB_E_TRANSPORT);
+    assert_int_equal(more_errors[0], TMB_SUCCESS);
+    assert_int_equal(more_errors[1], TMB_E_TRANSPORT);
+    assert_int_equal(more_errors[2], TMB_E_INCOMPLETE);
+
+    /* there are no broadcasts without a response on TCP/IP */
+    request.function_code = TMB_FUNCTION_WRITE_SINGLE_REGISTER;
+    handle.encapsulation = TMB_TRANSPORT_PROTOCOL_TCPIP;
+    assert_int_equal(tmb_client_fan_out(&handle, &request, NULL, 0, NULL), TMB_E_INVALID_ARGUMENTS);
+}
+
+static size_t poll_responses;
+
+static void on_poll_response(tmb_poll_task_t *task, tmb_error_t error, const tmb_response_pdu_t *response) {
+    assert_int_equal(error, TMB_SUCCESS);
+    assert_int_equal(response->read_holding_registers.register_values[0], registers[2]);
+    poll_responses++;
+}
+
+static tmb_response_pdu_t poll_error_response;
+
+static void on_poll_error(tmb_poll_task_t *task, tmb_error_t error, const tmb_response_pdu_t *response) {
+    assert_int_not_equal(error, TMB_SUCCESS);
+    memcpy(&poll_error_response, response, sizeof(tmb_response_pdu_t));
+}
+
+static void test_poll_scheduler(void **state) {
+    loopback_t loopback;
+    tmb_transport_t transport;
+    loopback_init(&loopback, &transport, &callbacks);
+
+    tmb_handle_t handle;
+    uint8_t buffer[TMB_ADU_TCPIP_MAX_SIZE];
+    assert_int_equal(tmb_init(&handle, TMB_MODE_CLIENT, TMB_TRANSPORT_PROTOCOL_TCPIP, buffer, sizeof(buffer),
+                              &transport),
+                     TMB_SUCCESS);
+
+    tmb_poll_scheduler_t scheduler;
+    assert_int_equal(tmb_poll_scheduler_init(&scheduler, 1000, 0), TMB_SUCCESS);
+    assert_int_equal(tmb_poll_scheduler_next_due(&scheduler), UINT64_MAX);
+
+    /* a task every 10 ms, and one every 25 ms that starts 5 ms in its period */
+    tmb_poll_task_t tasks[2] = {
+        { .handle = &handle, .period_us = 10000, .on_response = on_poll_response },
+        { .handle = &handle, .period_us = 25000, .phase_us = 5000, .on_response = on_poll_response },
+    };
+    for (size_t i = 0; i < 2; i++) {
+        tasks[i].request = (tmb_request_pdu_t){
+            .function_code = TMB_FUNCTION_READ_HOLDING_REGISTERS,
+            .unit_id = 1,
+            .read_holding_registers = { .start_address = 2, .quantity = 1 },
+        };
+        assert_int_equal(tmb_poll_scheduler_add(&scheduler, &tasks[i], 0), TMB_SUCCESS);
+    }
+    tasks[0].phase_us = tasks[0].period_us;
+    assert_int_equal(tmb_poll_scheduler_add(&scheduler, &tasks[0], 0), TMB_E_INVALID_ARGUMENTS);
+    tasks[0].phase_us = 0;
+
+    uint64_t dispatches[2][16];
+    size_t counts[2] = { 0 };
+    poll_responses = 0;
+    for (uint64_t now_us = 0; now_us < 100000; now_us += 1000) {
+        tmb_poll_task_t *task;
+        while ((task = tmb_poll_scheduler_next(&scheduler, now_us)) != NULL) {
+            size_t index = task - tasks;
+            assert_true(index < 2 && counts[index] < 16);
+            dispatches[index][counts[index]++] = now_us;
+            assert_int_equal(tmb_poll_task_execute(task), TMB_SUCCESS);
+        }
+        assert_true(tmb_poll_scheduler_next_due(&scheduler) > now_us);
+    }
+    assert_int_equal(counts[0], 10);
+    assert_int_equal(counts[1], 4);
+    for (size_t i = 0; i < counts[0]; i++) {
+        assert_int_equal(dispatches[0][i], i * 10000);
+    }
+    for (size_t i = 0; i < counts[1]; i++) {
+        assert_int_equal(dispatches[1][i], 5000 + i * 25000);
+    }
+    assert_int_equal(poll_responses, 14);
+    assert_int_equal(tasks[0].max_jitter_us, 0);
+    assert_int_equal(tmb_poll_scheduler_next_due(&scheduler), 100000);
+
+    /* a task dispatched late reports the delay, and skips the periods it missed */
+    assert_ptr_equal(tmb_poll_scheduler_next(&scheduler, 132000), &tasks[0]);
+    assert_int_equal(tasks[0].last_jitter_us, 32000);
+    assert_int_equal(tasks[0].overruns, 3);
+    assert_int_equal(tasks[0].due_us, 140000);
+    assert_ptr_equal(tmb_poll_scheduler_next(&scheduler, 132000), &tasks[1]);
+    assert_int_equal(tasks[1].last_jitter_us, 27000);
+    assert_int_equal(tasks[1].overruns, 1);
+    assert_null(tmb_poll_scheduler_next(&scheduler, 132000));
+
+    tmb_poll_scheduler_remove(&scheduler, &tasks[0]);
+    tmb_poll_scheduler_remove(&scheduler, &tasks[0]);
+    assert_int_equal(scheduler.size, 1);
+    assert_null(tmb_poll_scheduler_next(&scheduler, 150000));
+    assert_ptr_equal(tmb_poll_scheduler_next(&scheduler, 155000), &tasks[1]);
+    tmb_poll_scheduler_remove(&scheduler, &tasks[1]);
+    assert_int_equal(tmb_poll_scheduler_next_due(&scheduler), UINT64_MAX);
+
+    /* a failed poll passes the exception response, or an empty one if there is none */
+    static const tmb_response_pdu_t empty;
+    tasks[1].on_response = on_poll_error;
+    tasks[1].request.read_holding_registers.start_address = 100;
+    assert_int_equal(tmb_poll_task_execute(&tasks[1]), TMB_E_ILLEGAL_DATA_ADDRESS);
+    assert_int_equal(poll_error_response.function_code, 0x83);
+    assert_int_equal(poll_error_response.exception.exception_code, TMB_E_ILLEGAL_DATA_ADDRESS);
+    loopback.failing_write = loopback.writes + 1;
+    assert_int_equal(tmb_poll_task_execute(&tasks[1]), TMB_E_TRANSPORT);
+    assert_memory_equal(&poll_error_response, &empty, sizeof(empty));
+
+    /* many tasks, some with periods beyond the span of the wheel, are never dispatched early */
+    enum { TASKS = 100000 };
+    tmb_poll_task_t *many = calloc(TASKS, sizeof(tmb_poll_task_t));
+    assert_non_null(many);
+    assert_int_equal(tmb_poll_scheduler_init(&scheduler, 100, 1000), TMB_SUCCESS);
+    for (size_t i = 0; i < TASKS; i++) {
+        many[i].handle = &handle;
+        many[i].period_us = i % 10 == 0 ? 3000000000u : 10000 + (i % 97) * 10000;
+        many[i].phase_us = (i * 7919) % many[i].period_us;
+        assert_int_equal(tmb_poll_scheduler_add(&scheduler, &many[i], 1000), TMB_SUCCESS);
+    }
+
+    size_t dispatched = 0;
+    uint64_t last_us = 0;
+    for (uint64_t now_us = 1000; now_us <= 4000000000u; now_us += now_us < 2000000 ? 700 : 250000000) {
+        last_us = now_us;
+        tmb_poll_task_t *task;
+        while ((task = tmb_poll_scheduler_next(&scheduler, now_us)) != NULL) {
+            /* the due time was moved to the next period */
+            uint64_t due_us = task->due_us - task->period_us * (task->overruns + 1);
+            assert_true(due_us <= now_us);
+            assert_true(task->last_jitter_us < (now_us < 2000000 ? 700 : 250000000));
+            dispatched++;
+        }
+        assert_true(tmb_poll_scheduler_next_due(&scheduler) > now_us);
+
+        /* the overruns are counted once, then each task restarts from its first period */
+        if (now_us < 2000000) {
+            for (size_t i = 0; i < TASKS; i += 997) {
+                assert_int_equal(many[i].overruns, 0);
+                assert_true(many[i].due_us > now_us);
+            }
+        }
+    }
+    assert_true(dispatched > 1000000);
+    for (size_t i = 0; i < TASKS; i += 10) {
+        /* due at the phase, unless it was past when the task was added, then a period later */
+        uint64_t first_us = many[i].phase_us >= 1000 ? many[i].phase_us : many[i].phase_us + many[i].period_us;
+        size_t polls = (first_us <= last_us) + (first_us + many[i].period_us <= last_us);
+        assert_int_equal(many[i].polls, polls);
+    }
+    free(many);
+}
+
+static size_t run_poll_scheduler(tmb_poll_scheduler_t *scheduler, uint64_t from_us, uint64_t to_us,
+                                 uint64_t *dispatches, size_t dispatches_size) {
+    size_t count = 0;
+    for (uint64_t now_us = from_us; now_us < to_us; now_us += 1000) {
+        tmb_poll_task_t *task;
+        while ((task = tmb_poll_scheduler_next(scheduler, now_us)) != NULL) {
+            assert_true(count < dispatches_size);
+            dispatches[count++] = now_us;
+            assert_int_equal(tmb_poll_task_execute(task), TMB_SUCCESS);
+        }
+    }
+
+    return count;
+}
+
+static void test_poll_adaptive(void **state) {
+    loopback_t loopback;
+    tmb_transport_t transport;
+    loopback_init(&loopback, &transport, &callbacks);
+
+    tmb_handle_t handle;
+    uint8_t buffer[TMB_ADU_TCPIP_MAX_SIZE];
+    assert_int_equal(tmb_init(&handle, TMB_MODE_CLIENT, TMB_TRANSPORT_PROTOCOL_TCPIP, buffer, sizeof(buffer),
+                              &transport),
+                     TMB_SUCCESS);
+
+    tmb_poll_scheduler_t scheduler;
+    assert_int_equal(tmb_poll_scheduler_init(&scheduler, 1000, 0), TMB_SUCCESS);
+    tmb_poll_task_t task = {
+        .handle = &handle,
+        .request = {
+            .function_code = TMB_FUNCTION_READ_HOLDING_REGISTERS,
+            .unit_id = 1,
+            .read_holding_registers = { .start_address = 5, .quantity = 2 },
+        },
+        .period_us = 10000,
+        .max_period_us = 5000,
+    };
+    assert_int_equal(tmb_poll_scheduler_add(&scheduler, &task, 0), TMB_E_INVALID_ARGUMENTS);
+    task.max_period_us = 80000;
+    assert_int_equal(tmb_poll_scheduler_add(&scheduler, &task, 0), TMB_SUCCESS);
+
+    /* data that doesn't change is polled less and less often, down to the slowest period */
+    registers[5] = 1;
+    uint64_t dispatches[64];
+    size_t count = run_poll_scheduler(&scheduler, 0, 1000000, dispatches, 64);
+    assert_true(count > 10);
+    assert_int_equal(dispatches[1] - dispatches[0], 10000);
+    for (size_t i = 2; i < count; i++) {
+        assert_true(dispatches[i] - dispatches[i - 1] >= dispatches[i - 1] - dispatches[i - 2]);
+    }
+    assert_int_equal(dispatches[count - 1] - dispatches[count - 2], 80000);
+    assert_int_equal(task.current_period_us, 80000);
+    assert_int_equal(task.changes, 0);
+
+    /* a change is seen by the next poll, that brings back the fastest period */
+    registers[6] = 2;
+    uint64_t last_us = dispatches[count - 1];
+    count = run_poll_scheduler(&scheduler, 1000000, 1200000, dispatches, 64);
+    assert_true(count >= 2);
+    assert_int_equal(dispatches[0], last_us + 80000);
+    assert_int_equal(dispatches[1], dispatches[0] + 10000);
+    assert_int_equal(task.changes, 1);
+
+    /* back off again, then wake the task up on demand */
+    count = run_poll_scheduler(&scheduler, 1200000, 3000000, dispatches, 64);
+    assert_int_equal(task.current_period_us, 80000);
+    assert_int_equal(tmb_poll_scheduler_wake(&scheduler, &task, 3000500), TMB_SUCCESS);
+    assert_int_equal(task.current_period_us, 10000);
+    assert_ptr_equal(tmb_poll_scheduler_next(&scheduler, 3000500), &task);
+    assert_int_equal(task.due_us, 3010000);
+
+    /* even after the scheduler processed the current tick */
+    assert_null(tmb_poll_scheduler_next(&scheduler, 3000700));
+    assert_int_equal(tmb_poll_scheduler_wake(&scheduler, &task, 3000800), TMB_SUCCESS);
+    assert_ptr_equal(tmb_poll_scheduler_next(&scheduler, 3000800), &task);
+    assert_int_equal(task.due_us, 3010000);
+    assert_null(tmb_poll_scheduler_next(&scheduler, 3000900));
+
+    tmb_poll_scheduler_remove(&scheduler, &task);
+    assert_int_equal(tmb_poll_scheduler_wake(&scheduler, &task, 3000500), TMB_E_INVALID_ARGUMENTS);
+}
+
+static size_t block_changes_size;
+
+static void block_on_changes(tmb_poll_task_t *task, const tmb_register_change_t *changes, size_t changes_size) {
+    block_changes_size = changes_size;
+}
+
+static void test_register_block(void **state) {
+    tmb_register_block_t block;
+    uint16_t snapshot[TMB_READ_HOLDING_REGISTER_MAX_QUANTITY];
+    uint16_t values[TMB_READ_HOLDING_REGISTER_MAX_QUANTITY] = { 0 };
+    uint16_t deadbands[TMB_READ_HOLDING_REGISTER_MAX_QUANTITY] = { 0 };
+    tmb_register_change_t changes[TMB_READ_HOLDING_REGISTER_MAX_QUANTITY];
+    size_t changes_size;
+
+    assert_int_equal(tmb_register_block_init(&block, 0, 0, snapshot, NULL, false), TMB_E_INVALID_ARGUMENTS);
+    assert_int_equal(tmb_register_block_init(&block, 0, 126, snapshot, NULL, false), TMB_E_INVALID_ARGUMENTS);
+    assert_int_equal(tmb_register_block_init(&block, 0xfff0, 20, snapshot, NULL, false), TMB_E_INVALID_ARGUMENTS);
+
+    /* 13 registers: a group of 8 and a tail of 5 */
+    assert_int_equal(tmb_register_block_init(&block, 100, 13, snapshot, deadbands, false), TMB_SUCCESS);
+    for (size_t i = 0; i < 13; i++) {
+        values[i] = 1000 + i;
+    }
+    deadbands[3] = 10;
+    deadbands[12] = 10;
+
+    /* the first time all the registers are reported */
+    assert_int_equal(tmb_register_block_diff(&block, values, changes, &changes_size), TMB_SUCCESS);
+    assert_int_equal(changes_size, 13);
+    assert_int_equal(changes[12].address, 112);
+    assert_int_equal(changes[12].value, 1012);
+    assert_int_equal(changes[12].previous, 1012);
+
+    assert_int_equal(tmb_register_block_diff(&block, values, changes, &changes_size), TMB_SUCCESS);
+    assert_int_equal(changes_size, 0);
+
+    /* changes within the deadband are not reported, but add up */
+    values[1] = 2000;
+    values[3] += 10;
+    values[9] -= 1;
+    values[12] -= 6;
+    assert_int_equal(tmb_register_block_diff(&block, values, changes, &changes_size), TMB_SUCCESS);
+    assert_int_equal(changes_size, 2);
+    assert_int_equal(changes[0].address, 101);
+    assert_int_equal(changes[0].previous, 1001);
+    assert_int_equal(changes[0].value, 2000);
+    assert_int_equal(changes[1].address, 109);
+    assert_int_equal(changes[1].value, 1008);
+
+    values[3] += 1;
+    values[12] -= 5;
+    assert_int_equal(tmb_register_block_diff(&block, values, changes, &changes_size), TMB_SUCCESS);
+    assert_int_equal(changes_size, 2);
+    assert_int_equal(changes[0].address, 103);
+    assert_int_equal(changes[0].previous, 1003);
+    assert_int_equal(changes[0].value, 1014);
+    assert_int_equal(changes[1].address, 112);
+    assert_int_equal(changes[1].previous, 1012);
+    assert_int_equal(changes[1].value, 1001);
+
+    /* signed registers take the shortest distance across zero */
+    assert_int_equal(tmb_register_block_init(&block, 0, 125, snapshot, deadbands, true), TMB_SUCCESS);
+    memset(values, 0, sizeof(values));
+    values[3] = 0xfffe;
+    assert_int_equal(tmb_register_block_diff(&block, values, changes, &changes_size), TMB_SUCCESS);
+    assert_int_equal(changes_size, 125);
+    values[3] = 3;
+    assert_int_equal(tmb_register_block_diff(&block, values, changes, &changes_size), TMB_SUCCESS);
+    assert_int_equal(changes_size, 0);
+    values[3] = 9;
+    values[124] = 1;
+    assert_int_equal(tmb_register_block_diff(&block, values, changes, &changes_size), TMB_SUCCESS);
+    assert_int_equal(changes_size, 2);
+    assert_int_equal(changes[0].address, 3);
+    assert_int_equal(changes[1].address, 124);
+
+    /* a poll task reports the changes of its block, and backs off while they are within the deadband */
+    loopback_t loopback;
+    tmb_transport_t transport;
+    loopback_init(&loopback, &transport, &callbacks);
+
+    tmb_handle_t handle;
+    uint8_t buffer[TMB_ADU_TCPIP_MAX_SIZE];
+    assert_int_equal(tmb_init(&handle, TMB_MODE_CLIENT, TMB_TRANSPORT_PROTOCOL_TCPIP, buffer, sizeof(buffer),
+                              &transport),
+                     TMB_SUCCESS);
+
+    tmb_poll_scheduler_t scheduler;
+    assert_int_equal(tmb_poll_scheduler_init(&scheduler, 1000, 0), TMB_SUCCESS);
+    assert_int_equal(tmb_register_block_init(&block, 5, 3, snapshot, deadbands, false), TMB_SUCCESS);
+    deadbands[0] = 100;
+    tmb_poll_task_t task = {
+        .handle = &handle,
+        .request = {
+            .function_code = TMB_FUNCTION_READ_HOLDING_REGISTERS,
+            .unit_id = 1,
+            .read_holding_registers = { .start_address = 5, .quantity = 2 },
+        },
+        .period_us = 10000,
+        .max_period_us = 80000,
+        .block = &block,
+        .on_changes = block_on_changes,
+    };
+    assert_int_equal(tmb_poll_scheduler_add(&scheduler, &task, 0), TMB_E_INVALID_ARGUMENTS);
+    task.request.read_holding_registers.quantity = 3;
+    assert_int_equal(tmb_poll_scheduler_add(&scheduler, &task, 0), TMB_SUCCESS);
+
+    registers[5] = 1;
+    uint64_t dispatches[64];
+    block_changes_size = 0;
+    run_poll_scheduler(&scheduler, 0, 10000, dispatches, 64);
+    assert_int_equal(block_changes_size, 3);
+
+    block_changes_size = 0;
+    registers[5] = 50;
+    run_poll_scheduler(&scheduler, 10000, 1000000, dispatches, 64);
+    assert_int_equal(block_changes_size, 0);
+    assert_int_equal(task.changes, 0);
+    assert_int_equal(task.current_period_us, 80000);
+
+    registers[5] = 200;
+    size_t count = run_poll_scheduler(&scheduler, 1000000, 1100000, dispatches, 64);
+    assert_true(count >= 2);
+    assert_int_equal(dispatches[1], dispatches[0] + 10000);
+    assert_int_equal(block_changes_size, 1);
+    assert_int_equal(task.changes, 1);
+    tmb_poll_scheduler_remove(&scheduler, &task);
+}
+
+typedef struct {
+    tmb_result_ring_t *ring;
+    uint8_t unit_id;
+    size_t *done;
+} result_producer_t;
+
+static void *result_produce(void *arg) {
+    result_producer_t *producer = arg;
+    tmb_request_pdu_t request = {
+        .function_code = TMB_FUNCTION_READ_HOLDING_REGISTERS,
+        .unit_id = producer->unit_id,
+        .read_holding_registers = { .start_address = 0, .quantity = 64 },
+    };
+    uint16_t values[64];
+    tmb_response_pdu_t response = {
+        .function_code = TMB_FUNCTION_READ_HOLDING_REGISTERS,
+        .read_holding_registers = { .byte_count = sizeof(values), .register_values = values },
+    };
+
+    /* the timestamp is the sequence number of the result, and the values are derived from it */
+    for (uint64_t i = 0; i < 5000; i++) {
+        for (uint16_t j = 0; j < 64; j++) {
+            values[j] = i + j;
+        }
+        while (tmb_result_ring_publish(producer->ring, &request, TMB_SUCCESS, &response, i) != TMB_SUCCESS) {
+            sched_yield();
+        }
+    }
+    __atomic_add_fetch(producer->done, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+static void consume_results(tmb_result_ring_t *ring, bool retry) {
+    pthread_t threads[4];
+    result_producer_t producers[4];
+    size_t done = 0;
+    for (uint8_t i = 0; i < 4; i++) {
+        producers[i] = (result_producer_t){ .ring = ring, .unit_id = i, .done = &done };
+        assert_int_equal(pthread_create(&threads[i], NULL, result_produce, &producers[i]), 0);
+    }
+
+    /* the results of each producer are read in order and are never torn */
+    int64_t last[4] = { -1, -1, -1, -1 };
+    size_t consumed = 0;
+    while (true) {
+        /* once the producers are done, what is left in the ring is read */
+        bool finished = __atomic_load_n(&done, __ATOMIC_ACQUIRE) == 4;
+        tmb_poll_result_t result;
+        if (!tmb_result_ring_consume(ring, &result)) {
+            if (finished) {
+                break;
+            }
+            sched_yield();
+            continue;
+        }
+        assert_true(result.unit_id < 4);
+        assert_true((int64_t)result.timestamp_us > last[result.unit_id]);
+        assert_true(retry ? (int64_t)result.timestamp_us == last[result.unit_id] + 1 : true);
+        last[result.unit_id] = result.timestamp_us;
+        assert_int_equal(result.size, 128);
+        for (uint16_t j = 0; j < 64; j++) {
+            assert_int_equal(result.register_values[j], (uint16_t)(result.timestamp_us + j));
+        }
+        consumed++;
+    }
+
+    for (uint8_t i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    assert_int_equal(consumed + (retry ? 0 : ring->dropped), 20000);
+}
+
+static void test_result_ring(void **state) {
+    tmb_poll_result_t storage[64];
+    tmb_result_ring_t ring;
+    tmb_poll_result_t result;
+
+    assert_int_equal(tmb_result_ring_init(&ring, storage, 6, TMB_RESULT_RING_DROP_NEW), TMB_E_INVALID_ARGUMENTS);
+    assert_int_equal(tmb_result_ring_init(&ring, storage, 4, TMB_RESULT_RING_DROP_NEW), TMB_SUCCESS);
+    assert_false(tmb_result_ring_consume(&ring, &result));
+
+    uint16_t values[2] = { 0x1234, 0x5678 };
+    tmb_request_pdu_t request = {
+        .function_code = TMB_FUNCTION_READ_INPUT_REGISTERS,
+        .unit_id = 7,
+        .read_input_registers = { .start_address = 10, .quantity = 2 },
+    };
+    tmb_response_pdu_t response = {
+        .function_code = TMB_FUNCTION_READ_INPUT_REGISTERS,
+        .read_input_registers = { .byte_count = sizeof(values), .register_values = values },
+    };
+
+    /* a full ring drops the new results */
+    for (uint64_t i = 0; i < 4; i++) {
+        assert_int_equal(tmb_result_ring_publish(&ring, &request, TMB_SUCCESS, &response, i), TMB_SUCCESS);
+    }
+    assert_int_equal(tmb_result_ring_publish(&ring, &request, TMB_E_TIMEOUT, NULL, 4), TMB_E_NO_MEMORY);
+    assert_int_equal(ring.dropped, 1);
+
+    assert_true(tmb_result_ring_consume(&ring, &result));
+    assert_int_equal(result.timestamp_us, 0);
+    assert_int_equal(result.error, TMB_SUCCESS);
+    assert_int_equal(result.unit_id, 7);
+    assert_int_equal(result.function_code, TMB_FUNCTION_READ_INPUT_REGISTERS);
+    assert_int_equal(result.start_address, 10);
+    assert_int_equal(result.quantity, 2);
+    assert_int_equal(result.size, 4);
+    assert_int_equal(result.register_values[1], 0x5678);
+
+    assert_int_equal(tmb_result_ring_publish(&ring, &request, TMB_E_TIMEOUT, NULL, 4), TMB_SUCCESS);
+    for (uint64_t i = 1; i < 5; i++) {
+        assert_true(tmb_result_ring_consume(&ring, &result));
+        assert_int_equal(result.timestamp_us, i);
+    }
+    assert_int_equal(result.error, TMB_E_TIMEOUT);
+    assert_int_equal(result.size, 0);
+    assert_false(tmb_result_ring_consume(&ring, &result));
+
+    /* a full ring replaces the oldest results, that the consumer skips */
+    assert_int_equal(tmb_result_ring_init(&ring, storage, 4, TMB_RESULT_RING_OVERWRITE_OLDEST), TMB_SUCCESS);
+    for (uint64_t i = 0; i < 10; i++) {
+        assert_int_equal(tmb_result_ring_publish(&ring, &request, TMB_SUCCESS, &response, i), TMB_SUCCESS);
+    }
+    for (uint64_t i = 6; i < 10; i++) {
+        assert_true(tmb_result_ring_consume(&ring, &result));
+        assert_int_equal(result.timestamp_us, i);
+    }
+    assert_int_equal(ring.dropped, 6);
+    assert_false(tmb_result_ring_consume(&ring, &result));
+
+    /* with concurrent producers */
+    assert_int_equal(tmb_result_ring_init(&ring, storage, 64, TMB_RESULT_RING_DROP_NEW), TMB_SUCCESS);
+    consume_results(&ring, true);
+    assert_int_equal(tmb_result_ring_init(&ring, storage, 64, TMB_RESULT_RING_OVERWRITE_OLDEST), TMB_SUCCESS);
+    consume_results(&ring, false);
+}
+
+/* stores values of the given number of words in the given order, one byte at a time */
+static void encode_words(const uint64_t *values, size_t count, size_t words, tmb_word_order_t order,
+                         uint16_t *registers) {
+    bool low_word_first = order == TMB_WORD_ORDER_CDAB || order == TMB_WORD_ORDER_DCBA;
+    bool swap_bytes = order == TMB_WORD_ORDER_BADC || order == TMB_WORD_ORDER_DCBA;
+    for (size_t i = 0; i < count; i++) {
+        for (size_t j = 0; j < words; j++) {
+            /* j-th word from the most significant one */
+            uint16_t word = values[i] >> (16 * (words - 1 - j));
+            if (swap_bytes) {
+                word = (word << 8) | (word >> 8);
+            }
+            registers[i * words + (low_word_first ? words - 1 - j : j)] = word;
+        }
+    }
+}
+
+static void test_decode_values(void **state) {
+    /* 123.456 is 0x42F6E979 */
+    const uint16_t orders[4][2] = { { 0x42F6, 0xE979 }, { 0xE979, 0x42F6 }, { 0xF642, 0x79E9 }, { 0x79E9, 0xF642 } };
+    const tmb_word_order_t order_values[4] = { TMB_WORD_ORDER_ABCD, TMB_WORD_ORDER_CDAB, TMB_WORD_ORDER_BADC,
+                                               TMB_WORD_ORDER_DCBA };
+    for (size_t i = 0; i < 4; i++) {
+        float value;
+        assert_int_equal(tmb_decode_float(orders[i], 1, order_values[i], &value), TMB_SUCCESS);
+        assert_true(value == 123.456f);
+    }
+
+    const uint16_t big_endian[] = { 0x3FF8, 0x0000, 0x0000, 0x0000, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFE };
+    double doubles[2];
+    assert_int_equal(tmb_decode_double(big_endian, 1, TMB_WORD_ORDER_ABCD, doubles), TMB_SUCCESS);
+    assert_true(doubles[0] == 1.5);
+    int64_t integers[2];
+    assert_int_equal(tmb_decode_int64(big_endian, 2, TMB_WORD_ORDER_ABCD, integers), TMB_SUCCESS);
+    assert_int_equal(integers[1], -2);
+    int32_t integers32[4];
+    assert_int_equal(tmb_decode_int32(big_endian, 4, TMB_WORD_ORDER_ABCD, integers32), TMB_SUCCESS);
+    assert_int_equal(integers32[0], 0x3FF80000);
+    assert_int_equal(integers32[3], -2);
+
+    float value;
+    assert_int_equal(tmb_decode_float(NULL, 1, TMB_WORD_ORDER_ABCD, &value), TMB_E_INVALID_ARGUMENTS);
+    assert_int_equal(tmb_decode_uint32(big_endian, 1, 4, (uint32_t *)integers32), TMB_E_INVALID_ARGUMENTS);
+
+    /* long scans are decoded in blocks, and what is left one value at a time */
+    uint64_t expected[61];
+    for (size_t i = 0; i < 61; i++) {
+        expected[i] = 0x0123456789ABCDEFull * (i + 1);
+    }
+    uint16_t registers[61 * 4];
+    uint32_t decoded32[61];
+    uint64_t decoded64[61];
+    for (size_t i = 0; i < 4; i++) {
+        uint64_t expected32[61];
+        for (size_t j = 0; j < 61; j++) {
+            expected32[j] = (uint32_t)expected[j];
+        }
+        encode_words(expected32, 61, 2, order_values[i], registers);
+        assert_int_equal(tmb_decode_uint32(registers, 61, order_values[i], decoded32), TMB_SUCCESS);
+        for (size_t j = 0; j < 61; j++) {
+            assert_int_equal(decoded32[j], expected32[j]);
+        }
+
+        encode_words(expected, 61, 4, order_values[i], registers);
+        assert_int_equal(tmb_decode_int64(registers, 61, order_values[i], (int64_t *)decoded64), TMB_SUCCESS);
+        for (size_t j = 0; j < 61; j++) {
+            assert_int_equal(decoded64[j], expected[j]);
+        }
+    }
+}
+
+#ifdef TMB_LINUX_SUPPORTED
+
+#include <signal.h>
+#include <sys/wait.h>
+
+static tmb_error_t on_tcp_worker_init(void *user_data, size_t worker, tmb_handle_t *handle) {
+    return tmb_server_set_callback(handle, 1, &callbacks);
+}
+
+/* a port that no one listens on, picked by the kernel for a socket bound to port 0 */
+static uint16_t tcp_free_port(void) {
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr = { .s_addr = htonl(INADDR_LOOPBACK) },
+    };
+    socklen_t addr_size = sizeof(addr);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert_true(fd >= 0);
+    assert_int_equal(bind(fd, (const struct sockaddr *)&addr, sizeof(addr)), 0);
+    assert_int_equal(getsockname(fd, (struct sockaddr *)&addr, &addr_size), 0);
+    close(fd);
+
+    return ntohs(addr.sin_port);
+}
+
+/* connects to the server, that may be still starting, with a small receive buffer */
+static int tcp_server_connect(uint16_t port) {
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr = { .s_addr = htonl(INADDR_LOOPBACK) },
+    };
+
+    for (int attempt = 0; attempt < 100; attempt++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        assert_true(fd >= 0);
+
+        /* don't wait forever on a stalled server */
+        int buffer_size = 4096;
+        struct timeval timeout = { .tv_sec = 2 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        if (connect(fd, (const struct sockaddr *)&addr, sizeof(addr)) == 0) {
+            return fd;
+        }
+        close(fd);
+        usleep(10000);
+    }
+
+    assert_true(false);
+
+    return -1;
+}
+
+static void test_tcp_server(void **state) {
+    /* the server runs forever, on a single worker: it is run by a child process, that is killed at the end */
+    tmb_posix_tcp_server_config_t config = TMB_POSIX_TCP_SERVER_CONFIG_DEFAULT;
+    config.port = tcp_free_port();
+    config.on_worker_init = on_tcp_worker_init;
+    registers[0] = 0x1234;
+    pid_t server = fork();
+    assert_true(server >= 0);
+    if (server == 0) {
+        tmb_posix_tcp_server_run(&config);
+        _exit(EXIT_FAILURE);
+    }
+
+    const uint8_t request[] = { 0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x00, 0x00, 0x10 };
+    uint8_t requests[100 * sizeof(request)];
+    for (size_t i = 0; i < 100; i++) {
+        memcpy(&requests[i * sizeof(request)], request, sizeof(request));
+    }
+
+    /* a client that pipelines requests and never reads the responses: it is disconnected once they fill
+     * the socket buffers */
+    int slow = tcp_server_connect(config.port);
+    size_t sent = 0;
+    while (sent < 100000 && send(slow, requests, sizeof(requests), MSG_NOSIGNAL) == sizeof(requests)) {
+        sent++;
+    }
+    assert_true(sent < 100000);
+
+    /* the worker serves the other clients meanwhile */
+    int fd = tcp_server_connect(config.port);
+    assert_int_equal(send(fd, request, sizeof(request), MSG_NOSIGNAL), sizeof(request));
+    uint8_t response[TMB_ADU_TCPIP_HEADER_SIZE + 2 + 32];
+    size_t received = 0;
+    while (received < sizeof(response)) {
+        ssize_t nbytes = recv(fd, &response[received], sizeof(response) - received, 0);
+        assert_true(nbytes > 0);
+        received += nbytes;
+    }
+    assert_memory_equal(response, "\x00\x01\x00\x00\x00\x23\x01\x03\x20\x12\x34", 11);
+
+    close(fd);
+    close(slow);
+    kill(server, SIGKILL);
+    waitpid(server, NULL, 0);
+}
+
+#endif /* TMB_LINUX_SUPPORTED */
+
+int main() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_read_holding_registers_rtu),
+        cmocka_unit_test(test_write_multiple_registers_tcpip),
+        cmocka_unit_test(test_exception_response),
+        cmocka_unit_test(test_register_bank),
+        cmocka_unit_test(test_register_bank_concurrent_update),
+        cmocka_unit_test(test_response_cache),
+        cmocka_unit_test(test_rtu_timing),
+        cmocka_unit_test(test_rtu_receive_frame),
+        cmocka_unit_test(test_diagnostics),
+        cmocka_unit_test(test_read_write_multiple_registers),
+        cmocka_unit_test(test_mask_write_register),
+        cmocka_unit_test(test_file_records),
+        cmocka_unit_test(test_fifo_queue),
+        cmocka_unit_test(test_device_identification),
+        cmocka_unit_test(test_execute_batch),
+        cmocka_unit_test(test_unit_id),
+        cmocka_unit_test(test_parser),
+        cmocka_unit_test(test_reserve_registers),
+        cmocka_unit_test(test_gateway),
+        cmocka_unit_test(test_gateway_scheduler),
+        cmocka_unit_test(test_gateway_mailbox),
+        cmocka_unit_test(test_gateway_pipeline),
+        cmocka_unit_test(test_broadcast),
+        cmocka_unit_test(test_poll_scheduler),
+        cmocka_unit_test(test_poll_adaptive),
+        cmocka_unit_test(test_register_block),
+        cmocka_unit_test(test_result_ring),
+        cmocka_unit_test(test_decode_values),
+#ifdef TMB_LINUX_SUPPORTED
+        cmocka_unit_test(test_tcp_server),
+#endif
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -17,6 +17,14 @@ extern "C" {
 #include <stdint.h>
 #include <stdbool.h>
 
+/*
+ * Define TMB_ENABLE_CONCURRENCY before including this file to use the library from more threads: the
+ * register banks and the response caches become safe to share between them, and the structures made
+ * for that (gateway mailboxes, result rings) and the multi-threaded servers of Linux are available.
+ * It needs atomic operations, from the GCC or clang builtins or from the TMB_ATOMIC_* macros defined
+ * before the implementation. Otherwise no compiler extension is needed, and all is used from a single thread.
+ */
+
 /* constant definitions */
 
 /**
@@ -37,6 +45,24 @@ extern "C" {
  */
 #define TMB_ADDRESS_ANY 256
 
+/**
+ * Unit identifier of the requests sent to the device address of the client
+ * handle, see tmb_client_set_device_address(). Zero-initialized requests have it.
+ */
+#define TMB_UNIT_ID_DEFAULT 0
+
+/**
+ * Unit identifier of the requests that are broadcast, whatever the device
+ * address of the client handle.
+ */
+#define TMB_UNIT_ID_BROADCAST 256
+
+/**
+ * Default time a client waits after a broadcast request, before sending the next request,
+ * in microseconds. See tmb_client_set_turnaround_delay()
+ */
+#define TMB_CLIENT_DEFAULT_TURNAROUND_DELAY_US 100000
+
 /** Default port for Modbus TCP/IP */
 #define TMB_DEFAULT_TCP_IP_PORT 502
 
@@ -72,6 +98,41 @@ extern "C" {
 #define TMB_WRITE_MULTIPLE_REGISTERS_MIN_QUANTITY 1
 #define TMB_WRITE_MULTIPLE_REGISTERS_MAX_QUANTITY 123
 
+#define TMB_READ_WRITE_MULTIPLE_REGISTERS_READ_MIN_QUANTITY 1
+#define TMB_READ_WRITE_MULTIPLE_REGISTERS_READ_MAX_QUANTITY 125
+#define TMB_READ_WRITE_MULTIPLE_REGISTERS_WRITE_MIN_QUANTITY 1
+#define TMB_READ_WRITE_MULTIPLE_REGISTERS_WRITE_MAX_QUANTITY 121
+
+#define TMB_READ_FIFO_QUEUE_MAX_COUNT 31
+
+#define TMB_FILE_RECORD_REFERENCE_TYPE 6
+#define TMB_FILE_RECORD_MAX_RECORD_NUMBER 0x270F
+#define TMB_READ_FILE_RECORD_MIN_BYTE_COUNT 0x07
+#define TMB_READ_FILE_RECORD_MAX_BYTE_COUNT 0xF5
+#define TMB_WRITE_FILE_RECORD_MIN_BYTE_COUNT 0x09
+#define TMB_WRITE_FILE_RECORD_MAX_BYTE_COUNT 0xFB
+
+#define TMB_MEI_TYPE_READ_DEVICE_IDENTIFICATION 0x0E
+/** Maximum length of the value of an identification object, so that it fits a response alone */
+#define TMB_DEVICE_IDENTIFICATION_MAX_OBJECT_LENGTH (TMB_PDU_MAX_SIZE - 7 - 2)
+#define TMB_DEVICE_IDENTIFICATION_MORE_FOLLOWS 0xFF
+#define TMB_DEVICE_IDENTIFICATION_VENDOR_NAME 0x00
+#define TMB_DEVICE_IDENTIFICATION_PRODUCT_CODE 0x01
+#define TMB_DEVICE_IDENTIFICATION_MAJOR_MINOR_REVISION 0x02
+#define TMB_DEVICE_IDENTIFICATION_VENDOR_URL 0x03
+#define TMB_DEVICE_IDENTIFICATION_PRODUCT_NAME 0x04
+#define TMB_DEVICE_IDENTIFICATION_MODEL_NAME 0x05
+#define TMB_DEVICE_IDENTIFICATION_USER_APPLICATION_NAME 0x06
+
+/** Maximum number of requests a client keeps in flight when pipelining on TCP/IP */
+#define TMB_CLIENT_PIPELINE_DEPTH 4
+
+/** Number of events kept in the communication event log, as defined by the standard */
+#define TMB_COM_EVENT_LOG_SIZE 64
+
+/** Status word of FC11/FC12 responses when a previous command is still being processed */
+#define TMB_COM_EVENT_STATUS_BUSY 0xFFFF
+
 /** Checks if a specified tmb_error_t is a Modbus Exception code */
 #define TMB_ERROR_IS_MODBUS_EXCEPTION(error) (error > 0 && error < 256)
 
@@ -205,6 +266,15 @@ enum tmb_error {
     TMB_E_SERIAL_CONFIGURATION_FAILED,
 
     TMB_E_INVALID_CRC,
+
+    /** TCP socket bind or listen error */
+    TMB_E_TCP_BIND_FAILED,
+
+    /** The response does not match the request it should answer */
+    TMB_E_INVALID_RESPONSE,
+
+    /** More bytes are needed to complete the frame */
+    TMB_E_INCOMPLETE,
 };
 
 /**
@@ -258,18 +328,153 @@ typedef struct {
      * \brief Function to write bytes to the transport
      */
     int (*write)(void *user_data, const uint8_t *buffer, size_t nbyte);
+
+    /**
+     * \brief Optional function to read bytes from the transport, waiting at most the specified time
+     *      for them to arrive. Required to delimit RTU frames by the silent intervals on the line
+     * \param user_data pointer to the user_data param in this struct
+     * \param buffer pointer to the buffer to read into
+     * \param nbyte number of bytes to read
+     * \param timeout_us maximum time to wait for the first byte, in microseconds
+     * \returns the number of bytes read, 0 if no byte arrived in time, or a negative value in case of a failure
+     */
+    int (*read_timeout)(void *user_data, uint8_t *buffer, size_t nbyte, uint32_t timeout_us);
+
+    /** RTU inter-character timeout (t1.5), in microseconds. See tmb_rtu_get_timing() */
+    uint32_t rtu_t15_us;
+
+    /** RTU inter-frame delay (t3.5), in microseconds. See tmb_rtu_get_timing() */
+    uint32_t rtu_t35_us;
 } tmb_transport_t;
 
+/**
+ * \typedef tmb_register_bank_t
+ * \brief A block of contiguous registers that can be updated by a producer thread
+ *      while being served by one or more Modbus server threads, with TMB_ENABLE_CONCURRENCY.
+ *      Readers never block: they retry if an update happened while they were copying
+ *      the registers, thus they never observe a partially applied update.
+ *      Must be initialized with tmb_register_bank_init()
+ */
+typedef struct {
+    /** Address of the first register of the bank */
+    uint16_t start_address;
+
+    /** Number of registers of the bank */
+    uint32_t quantity;
+
+    /** Storage of the registers, provided by the user */
+    uint16_t *registers;
+
+    /** Sequence counter, that is odd while an update is in progress */
+    uint32_t sequence;
+
+    /** Lock that serializes the writers. Readers never take it */
+    uint8_t writer_lock;
+} tmb_register_bank_t;
+
+/**
+ * \typedef tmb_file_record_t
+ * \brief A group of consecutive records of a file, as transferred by the Read File Record (FC20)
+ *      and Write File Record (FC21) functions
+ */
+typedef struct {
+    /** Number of the file, between 1 and 0xFFFF */
+    uint16_t file_number;
+
+    /** Number of the first record, between 0 and 0x270F */
+    uint16_t record_number;
+
+    /** Number of records */
+    uint16_t record_length;
+
+    /** Values of the records: where to store them when reading, the ones to write when writing */
+    uint16_t *values;
+} tmb_file_record_t;
+
+/**
+ * \typedef tmb_device_identification_object_t
+ * \brief An object of the device identification, as read by the Read Device Identification (FC43/14) function
+ */
+typedef struct {
+    /** Identifier of the object, see TMB_DEVICE_IDENTIFICATION_VENDOR_NAME and following */
+    uint8_t id;
+
+    /** Length of the value, in bytes */
+    uint8_t length;
+
+    /** Value of the object, usually an ASCII string */
+    const char *value;
+} tmb_device_identification_object_t;
+
+/**
+ * \typedef tmb_device_identification_t
+ * \brief Identification objects of a server, serialized once by tmb_device_identification_init() in the
+ *      format of the response, so that the server answers a request with a single copy.
+ *      Must be treated as a black-box.
+ */
+typedef struct {
+    /** Objects serialized as id, length and value, sorted by id */
+    const uint8_t *objects;
+
+    /** Offset in objects of the first object whose id is greater than or equal to the index */
+    uint16_t offsets[256];
+
+    /** Number of bytes of the serialized objects */
+    uint16_t size;
+
+    /** Conformity level reported in the responses */
+    uint8_t conformity_level;
+} tmb_device_identification_t;
+
 /**
  * \brief Collection of callbacks for the Modbus server
  */
 typedef struct {
     void *user_data;
 
+    /** If not NULL, holding registers are served from this bank instead of the callbacks */
+    tmb_register_bank_t *holding_registers;
+
+    /** If not NULL, input registers are served from this bank instead of the callbacks */
+    tmb_register_bank_t *input_registers;
+
     tmb_error_t (*on_read_holding_register)(void *user_data, uint8_t address, uint16_t reg, uint16_t *value);
     tmb_error_t (*on_write_holding_register)(void *user_data, uint8_t address, uint16_t reg, uint16_t value);
+    tmb_error_t (*on_read_input_register)(void *user_data, uint8_t address, uint16_t reg, uint16_t *value);
+    tmb_error_t (*on_read_coil)(void *user_data, uint8_t address, uint16_t coil, bool *value);
+    tmb_error_t (*on_write_coil)(void *user_data, uint8_t address, uint16_t coil, bool value);
+    tmb_error_t (*on_read_discrete_input)(void *user_data, uint8_t address, uint16_t input, bool *value);
+    tmb_error_t (*on_read_file_record)(void *user_data, uint8_t address, uint16_t file_number, uint16_t record_number,
+                                       uint16_t record_length, uint16_t *values);
+    tmb_error_t (*on_write_file_record)(void *user_data, uint8_t address, uint16_t file_number,
+                                        uint16_t record_number, uint16_t record_length, const uint16_t *values);
+
+    /** Removes up to TMB_READ_FIFO_QUEUE_MAX_COUNT values from the queue, oldest first, and stores their number */
+    tmb_error_t (*on_read_fifo_queue)(void *user_data, uint8_t address, uint16_t fifo_address, uint16_t *values,
+                                      uint16_t *count);
+
+    /** If not NULL, Read Device Identification (FC43/14) requests are served from these objects */
+    const tmb_device_identification_t *device_identification;
 } tmb_callbacks_t;
 
+/**
+ * \typedef tmb_fifo_ring_t
+ * \brief Ring buffer where tmb_drain_fifo_queue() stores the values read from a FIFO queue.
+ *      Not thread-safe: values shall be popped by the same thread that drains the queue.
+ *      Must be initialized with tmb_fifo_ring_init()
+ */
+typedef struct {
+    /** Storage of the values, provided by the user */
+    uint16_t *values;
+
+    /** Number of values that fit the storage */
+    size_t capacity;
+
+    /** Number of values pushed and popped since the initialization */
+    size_t write_count;
+    size_t read_count;
+} tmb_fifo_ring_t;
+
 /* private types */
 
 /**
@@ -299,6 +504,110 @@ typedef enum {
     TMB_FUNCTION_ENCAPSULATED_TRANSPORT = 43,
 } tmb_function_t;
 
+/**
+ * \typedef tmb_diagnostic_sub_function_t
+ * \brief Sub-function codes of the Diagnostics (FC8) function
+ * \note Refer to the Modbus protocol specification for their explanation
+ */
+typedef enum {
+    TMB_DIAGNOSTIC_RETURN_QUERY_DATA = 0x00,
+    TMB_DIAGNOSTIC_RESTART_COMMUNICATIONS_OPTION = 0x01,
+    TMB_DIAGNOSTIC_RETURN_DIAGNOSTIC_REGISTER = 0x02,
+    TMB_DIAGNOSTIC_FORCE_LISTEN_ONLY_MODE = 0x04,
+    TMB_DIAGNOSTIC_CLEAR_COUNTERS_AND_DIAGNOSTIC_REGISTER = 0x0A,
+    TMB_DIAGNOSTIC_RETURN_BUS_MESSAGE_COUNT = 0x0B,
+    TMB_DIAGNOSTIC_RETURN_BUS_COMMUNICATION_ERROR_COUNT = 0x0C,
+    TMB_DIAGNOSTIC_RETURN_BUS_EXCEPTION_ERROR_COUNT = 0x0D,
+    TMB_DIAGNOSTIC_RETURN_SERVER_MESSAGE_COUNT = 0x0E,
+    TMB_DIAGNOSTIC_RETURN_SERVER_NO_RESPONSE_COUNT = 0x0F,
+    TMB_DIAGNOSTIC_RETURN_SERVER_NAK_COUNT = 0x10,
+    TMB_DIAGNOSTIC_RETURN_SERVER_BUSY_COUNT = 0x11,
+    TMB_DIAGNOSTIC_RETURN_BUS_CHARACTER_OVERRUN_COUNT = 0x12,
+    TMB_DIAGNOSTIC_CLEAR_OVERRUN_COUNTER_AND_FLAG = 0x14,
+} tmb_diagnostic_sub_function_t;
+
+/**
+ * \typedef tmb_read_device_id_code_t
+ * \brief Access types of the Read Device Identification (FC43/14) function
+ */
+typedef enum {
+    /** Stream access to the basic objects: vendor name, product code and revision */
+    TMB_READ_DEVICE_ID_BASIC = 0x01,
+
+    /** Stream access to the basic and regular objects */
+    TMB_READ_DEVICE_ID_REGULAR = 0x02,
+
+    /** Stream access to the basic, regular and extended objects */
+    TMB_READ_DEVICE_ID_EXTENDED = 0x03,
+
+    /** Access to one specific object */
+    TMB_READ_DEVICE_ID_SPECIFIC = 0x04,
+} tmb_read_device_id_code_t;
+
+/**
+ * \typedef tmb_statistics_t
+ * \brief Communication counters of a handle, as defined by the standard for the Diagnostics
+ *      function. A client handle counts the responses it receives, their CRC errors and exceptions.
+ */
+typedef struct {
+    /** Messages detected on the bus, including the ones not addressed to this device */
+    uint16_t bus_message_count;
+
+    /** Messages received with a CRC error */
+    uint16_t bus_communication_error_count;
+
+    /** Exception responses sent (server) or received (client) */
+    uint16_t exception_error_count;
+
+    /** Messages addressed to this server, including broadcast ones */
+    uint16_t server_message_count;
+
+    /** Messages addressed to this server that were not answered */
+    uint16_t server_no_response_count;
+
+    /** Negative acknowledge exceptions sent */
+    uint16_t server_nak_count;
+
+    /** Server busy exceptions sent */
+    uint16_t server_busy_count;
+
+    /** Messages that could not be handled because of a character overrun */
+    uint16_t bus_character_overrun_count;
+
+    /** Messages completed successfully (communication event counter of FC11) */
+    uint16_t event_count;
+
+    /** Communication event log of FC12, as a ring buffer */
+    uint8_t events[TMB_COM_EVENT_LOG_SIZE];
+
+    /** Position of the next event to write in the log */
+    uint8_t events_head;
+
+    /** Number of valid events in the log */
+    uint8_t events_size;
+} tmb_statistics_t;
+
+/**
+ * \typedef tmb_com_event_log_t
+ * \brief The communication event log, as returned by the Get Comm Event Log (FC12) function
+ */
+typedef struct {
+    /** TMB_COM_EVENT_STATUS_BUSY if the device is processing a previous command, 0 otherwise */
+    uint16_t status;
+
+    /** Communication event counter, as returned by FC11 */
+    uint16_t event_count;
+
+    /** Number of messages processed by the device */
+    uint16_t message_count;
+
+    /** Number of events */
+    uint8_t events_size;
+
+    /** Events, starting from the most recent one */
+    uint8_t events[TMB_COM_EVENT_LOG_SIZE];
+} tmb_com_event_log_t;
+
 /**
  * \typedef tmb_req_pdu_t
  * \brief A Modbus request PDU, as defined by the standard
@@ -307,6 +616,11 @@ typedef struct {
     /* Modbus function code */
     uint8_t function_code;
 
+    /** Device the client sends the request to: between 1 and 255 (serial devices use 1 to 247),
+     *  TMB_UNIT_ID_BROADCAST or TMB_UNIT_ID_DEFAULT. Allows a single connection to a gateway to reach
+     *  all the devices behind it */
+    uint16_t unit_id;
+
     union {
         struct {
             /** Address to start read from */
@@ -383,9 +697,130 @@ typedef struct {
             /** Register values */
             const uint16_t *values;
         } write_multiple_registers;
+
+        struct {
+            /** Diagnostic sub-function code, see tmb_diagnostic_sub_function_t */
+            uint16_t sub_function;
+
+            /** Data of the sub-function */
+            uint16_t data;
+        } diagnostic;
+
+        struct {
+            /** Address to start read from */
+            uint16_t read_start_address;
+
+            /** Number of registers to read. Must be between 1 and 125 */
+            uint16_t read_quantity;
+
+            /** Address to start write from */
+            uint16_t write_start_address;
+
+            /** Number of registers to write. Must be between 1 and 121 */
+            uint16_t write_quantity;
+
+            /** Number of bytes to write */
+            uint8_t write_byte_count;
+
+            /** Register values to write */
+            const uint16_t *write_values;
+        } read_write_multiple_registers;
+
+        struct {
+            /** Address of the register to modify */
+            uint16_t address;
+
+            /** Mask of the bits of the register to keep */
+            uint16_t and_mask;
+
+            /** Value of the bits of the register to change */
+            uint16_t or_mask;
+        } mask_write_register;
+
+        struct {
+            /** Number of bytes of the sub-requests */
+            uint8_t byte_count;
+
+            /** Sub-requests, 7 bytes each: reference type, file number, record number and record length */
+            const uint8_t *sub_requests;
+        } read_file_record;
+
+        struct {
+            /** Number of bytes of the sub-requests */
+            uint8_t byte_count;
+
+            /** Sub-requests: reference type, file number, record number, record length and record data */
+            const uint8_t *sub_requests;
+        } write_file_record;
+
+        struct {
+            /** Address of the FIFO queue */
+            uint16_t fifo_pointer_address;
+        } read_fifo_queue;
+
+        struct {
+            /** MEI type, shall be TMB_MEI_TYPE_READ_DEVICE_IDENTIFICATION */
+            uint8_t mei_type;
+
+            /** Access type, see tmb_read_device_id_code_t */
+            uint8_t read_device_id_code;
+
+            /** Object to read, or to start the stream from */
+            uint8_t object_id;
+        } read_device_identification;
     };
 } tmb_request_pdu_t;
 
+/**
+ * \typedef tmb_response_cache_entry_t
+ * \brief An entry of the server response cache. Must be treated as a black-box.
+ */
+typedef struct {
+    /** Generation of the cache when the entry was stored, 0 if the entry is empty */
+    uint32_t generation;
+
+    /** Register bank the response was read from, if any, and its sequence at that time */
+    const tmb_register_bank_t *bank;
+    uint32_t bank_sequence;
+
+    /** The request that produced the response */
+    uint8_t address;
+    uint8_t function_code;
+    uint16_t start_address;
+    uint16_t quantity;
+
+    /** The serialized response ADU */
+    uint16_t size;
+    uint8_t adu[TMB_ADU_TCPIP_MAX_SIZE];
+} tmb_response_cache_entry_t;
+
+/**
+ * \typedef tmb_response_cache_t
+ * \brief Cache of serialized responses to read requests, that allows a server to answer
+ *      clients that poll the same registers without rebuilding the response.
+ *      Entries are invalidated by the writes processed by the server and by
+ *      tmb_response_cache_tick(). Must be initialized with tmb_response_cache_init()
+ */
+typedef struct {
+    /** Entries of the cache, provided by the user */
+    tmb_response_cache_entry_t *entries;
+
+    /** Number of entries */
+    size_t capacity;
+
+    /** Current generation, incremented to invalidate all the entries */
+    uint32_t generation;
+
+    /** Generation used instead of the own one, if shared with other caches by tmb_response_cache_share() */
+    uint32_t *shared_generation;
+
+    /** Number of requests answered from the cache */
+    uint32_t hits;
+
+    /** Number of cacheable requests that were not found in the cache */
+    uint32_t misses;
+} tmb_response_cache_t;
+
 /**
  * \typedef tmb_handle_t
  * \brief An handle to the Tiny Modbus instance. This is here only
@@ -411,6 +846,9 @@ typedef struct {
     /** Current transport */
     const tmb_transport_t *transport;
 
+    /** Communication counters */
+    tmb_statistics_t statistics;
+
     union {
         /** client-specific state */
         struct {
@@ -419,6 +857,18 @@ typedef struct {
             tmb_request_pdu_t request;
 
             uint16_t last_transaction_identifier;
+
+            /** size of the ADU started by tmb_client_reserve_registers(), 0 if none */
+            size_t reserved_size;
+
+            /** transaction identifier of the reserved ADU */
+            uint16_t reserved_transaction_identifier;
+
+            /** time to wait after a broadcast request, in microseconds */
+            uint32_t turnaround_delay_us;
+
+            /** time to wait for each read of a response, in microseconds, 0 to wait forever */
+            uint32_t response_timeout_us;
         } client;
 
         /** server-specific state */
@@ -427,6 +877,12 @@ typedef struct {
                 uint16_t address;
                 const tmb_callbacks_t *callbacks;
             } callbacks[TMB_SERVER_MAX_ADDRESSES];
+
+            /** optional cache of the responses to read requests */
+            tmb_response_cache_t *response_cache;
+
+            /** true if the server was put in listen only mode by the Diagnostics function */
+            bool listen_only;
         } server;
     };
 
@@ -500,6 +956,113 @@ typedef struct {
             /** Number of coils to write. Must be between 1 and 1968 */
             uint16_t quantity;
         } write_multiple_registers;
+
+        struct {
+            /** Diagnostic sub-function code, echoed from the request */
+            uint16_t sub_function;
+
+            /** Data returned by the sub-function */
+            uint16_t data;
+        } diagnostic;
+
+        struct {
+            /** Status word, TMB_COM_EVENT_STATUS_BUSY if a previous command is being processed */
+            uint16_t status;
+
+            /** Communication event counter */
+            uint16_t event_count;
+        } get_com_event_counter;
+
+        struct {
+            /** Number of bytes in the response */
+            uint8_t byte_count;
+
+            /** Status word, TMB_COM_EVENT_STATUS_BUSY if a previous command is being processed */
+            uint16_t status;
+
+            /** Communication event counter */
+            uint16_t event_count;
+
+            /** Number of messages processed by the device */
+            uint16_t message_count;
+
+            /** Events, starting from the most recent one. There are byte_count - 6 of them */
+            const uint8_t *events;
+        } get_com_event_log;
+
+        struct {
+            /** Number of bytes in the response */
+            uint8_t byte_count;
+
+            /** Values of the registers read */
+            const uint16_t *register_values;
+        } read_write_multiple_registers;
+
+        struct {
+            /** Address of the register modified */
+            uint16_t address;
+
+            /** Mask of the bits of the register kept */
+            uint16_t and_mask;
+
+            /** Value of the bits of the register changed */
+            uint16_t or_mask;
+        } mask_write_register;
+
+        struct {
+            /** Number of bytes of the sub-responses */
+            uint8_t byte_count;
+
+            /** Sub-responses: length, reference type and record data */
+            const uint8_t *sub_responses;
+        } read_file_record;
+
+        struct {
+            /** Number of bytes of the sub-requests */
+            uint8_t byte_count;
+
+            /** Sub-requests, echoed from the request */
+            const uint8_t *sub_requests;
+        } write_file_record;
+
+        struct {
+            /** Number of bytes that follow, that are the FIFO count and the values */
+            uint16_t byte_count;
+
+            /** Number of values read, at most 31 */
+            uint16_t fifo_count;
+
+            /** Values read from the queue, oldest first */
+            const uint16_t *values;
+        } read_fifo_queue;
+
+        struct {
+            /** MEI type, echoed from the request */
+            uint8_t mei_type;
+
+            /** Access type, echoed from the request */
+            uint8_t read_device_id_code;
+
+            /** Identification level of the device and type of supported access */
+            uint8_t conformity_level;
+
+            /** TMB_DEVICE_IDENTIFICATION_MORE_FOLLOWS if the objects do not fit a single response */
+            uint8_t more_follows;
+
+            /** Object to start the next request from, when more follows */
+            uint8_t next_object_id;
+
+            /** Number of objects in the response */
+            uint8_t number_of_objects;
+
+            /** Objects, serialized as id, length and value */
+            const uint8_t *objects;
+        } read_device_identification;
+
+        struct {
+            /** Exception code returned by the server, when function_code has the exception bit set */
+            uint8_t exception_code;
+        } exception;
     };
 } tmb_response_pdu_t;
 
@@ -540,336 +1103,1947 @@ typedef struct {
     };
 } tmb_message_t;
 
-/* public methods */
-
 /**
- * \brief Initializes the specified Tiny Modbus handle
- * \param handle the handle to initialize
- * \param mode the mode of operation (client or server)
- * \param encapsulation the encapsulation to be used
- * \param transport the transport to be used. The transport struct shall live for the
- *      whole duration of the handle
- * \returns TMB_SUCCESS if initialized successfully, otherwise TMB_INVALID_ARG
+ * \typedef tmb_parser_t
+ * \brief Incremental parser that splits a stream of bytes in Modbus frames
  */
-tmb_error_t tmb_init(tmb_handle_t *handle, tmb_mode_t mode, tmb_transport_protocol_t encapsulation, uint8_t *buffer,
-                     size_t buffer_size, const tmb_transport_t *transport);
+typedef struct {
+    /** TMB_MODE_SERVER to parse requests, TMB_MODE_CLIENT to parse responses */
+    tmb_mode_t mode;
+
+    /** The encapsulation of the frames */
+    tmb_transport_protocol_t encapsulation;
+
+    /** Buffer where the frames that span more than one call to tmb_parser_feed() are assembled */
+    uint8_t *buffer;
+
+    /** Size of the buffer */
+    size_t buffer_size;
+
+    /** Number of bytes of the current frame that are in the buffer */
+    size_t size;
+} tmb_parser_t;
 
 /**
- * \brief Sets the slave address ID
- * \param handle handle to the Modbus instance
- * \param address address of the slave
- * \returns TMB_SUCCESS or TMB_INVALID_ARGUMENTS
+ * \typedef tmb_frame_t
+ * \brief A complete and verified frame returned by tmb_parser_feed()
  */
-tmb_error_t tmb_client_set_device_address(tmb_handle_t *handle, uint8_t address);
+typedef struct {
+    /** The device address (RTU, ASCII) or unit identifier (TCP/IP) */
+    uint8_t address;
+
+    /** The transaction identifier (TCP/IP only) */
+    uint16_t transaction_identifier;
+
+    /** The PDU of the frame, starting with the function code */
+    const uint8_t *pdu;
+
+    /** Size of the PDU */
+    size_t pdu_size;
+} tmb_frame_t;
 
 /**
- * \brief Validate the given request object.
- * \param request the request to validate
- * \returns TMB_SUCCESS if the request is valid, otherwise an appropriate error code
+ * \typedef tmb_gateway_request_t
+ * \brief A request received by a gateway, waiting to be forwarded to a bus
  */
-tmb_error_t tmb_request_validate(const tmb_request_pdu_t *request);
+typedef struct {
+    /** Opaque reference to where the response shall be sent (e.g. the client connection) */
+    void *context;
 
-tmb_error_t tmb_client_send_request(tmb_handle_t *handle, const tmb_request_pdu_t *request,
-                                    tmb_response_pdu_t *response);
+    /** Opaque value stored with the context, e.g. to tell apart connections that reuse the same context */
+    uint32_t tag;
 
-tmb_error_t tmb_read_coils(tmb_handle_t *handle, uint16_t start_address, uint16_t quantity, uint8_t *values);
+    /** Size of the ADU, 0 for a free slot of a queue */
+    size_t size;
 
-tmb_error_t tmb_read_discrete_inputs(tmb_handle_t *handle, uint16_t start_address, uint16_t quantity, uint8_t *values);
+    /** Time the request was queued at, in microseconds */
+    uint64_t queue_time_us;
 
-tmb_error_t tmb_read_holding_registers(tmb_handle_t *handle, uint16_t start_address, uint16_t quantity,
-                                       uint16_t *values);
+    /* scheduling state, managed by the queue */
+    uint8_t lane;
+    uint8_t weight;
+    uint64_t finish_tag;
+    uint64_t sequence;
 
-tmb_error_t tmb_read_input_registers(tmb_handle_t *handle, uint16_t start_address, uint16_t quantity, uint16_t *values);
+    /* position of a mailbox the slot is ready for, managed by the mailbox */
+    size_t turn;
 
-tmb_error_t tmb_write_single_coil(tmb_handle_t *handle, uint16_t address, uint16_t value);
+    /* transaction identifier the request was received with, managed by the pipeline */
+    uint16_t transaction_identifier;
 
-tmb_error_t tmb_write_single_register(tmb_handle_t *handle, uint16_t address, uint16_t value);
+    /** TCP/IP ADU of the request, that tmb_gateway_forward() replaces with the one of the response */
+    uint8_t adu[TMB_ADU_TCPIP_MAX_SIZE];
+} tmb_gateway_request_t;
 
-tmb_error_t tmb_write_multiple_coils(tmb_handle_t *handle, uint16_t start_address, uint16_t quantity,
-                                     const uint8_t *values);
+/**
+ * \typedef tmb_gateway_lane_t
+ * \brief Priority lanes of a gateway queue. A lane is served only when the ones before it are empty
+ */
+typedef enum {
+    /** Requests that write to the devices */
+    TMB_GATEWAY_LANE_WRITE,
 
-tmb_error_t tmb_write_multiple_registers(tmb_handle_t *handle, uint16_t start_address, uint16_t quantity,
-                                         const uint16_t *values);
+    /** All the other requests */
+    TMB_GATEWAY_LANE_READ,
+
+    TMB_GATEWAY_LANES,
+} tmb_gateway_lane_t;
 
 /**
- * \brief Sets the callback to use for server communication
- * \param handle The Modbus handle to be used
- * \param address The address that this callbacks respond to. A Modbus
- *      server can respond to more than one address, in this case call
- *      this function multiple times. Use TMB_ADDRESS_ANY for calling the
- *      callbacks for messages that arrive on any address.
- * \param callbacks The callback object. If NULL, removes the association
- *      with the specified server. They must be allocated to a memory buffer
- *      that shall live trough the whole time these callbacks are needed.
+ * \typedef tmb_gateway_lane_metrics_t
+ * \brief Counters of a lane of a gateway queue, to size the buses
  */
-tmb_error_t tmb_server_set_callback(tmb_handle_t *handle, uint16_t address, const tmb_callbacks_t *callbacks);
+typedef struct {
+    /** Number of requests waiting */
+    size_t depth;
 
-/**
- * \brief Run a Modbus server iteration, processing one message
- * \param handle the handle to the Modbus server
- * \returns TMB_SUCCESS if the request completed successfully, otherwise an error code
- */
-tmb_error_t tmb_server_run_iteration(tmb_handle_t *handle);
+    /** Maximum number of requests that waited at the same time */
+    size_t max_depth;
 
-/**
- * \brief Run the Modbus server forever, serving one request after another
- * \param handle the handle to the Modbus server
- * \return a failure code in case the server is unable to run. If no error,
- *      this function runs forever thus TMB_SUCCESS is never returned.
- */
-tmb_error_t tmb_server_run_forever(tmb_handle_t *handle);
+    /** Number of requests dispatched to the bus */
+    uint64_t dispatched;
+
+    /** Number of requests rejected since the queue was full */
+    uint64_t rejected;
+
+    /** Sum of the times the dispatched requests waited, in microseconds */
+    uint64_t total_wait_us;
+
+    /** Longest time a dispatched request waited, in microseconds */
+    uint64_t max_wait_us;
+} tmb_gateway_lane_metrics_t;
 
 /**
- * \brief Returns a string representation of the provided error code
- * \param error the error code to convert
- * \returns a pointer to a static memory buffer containing the string
- *      representation of the error
+ * \typedef tmb_gateway_queue_t
+ * \brief Queue of the requests waiting for a bus. Writes are served before reads, while each lane
+ *      shares the bus between the flows of requests (a flow being the requests of a connection to
+ *      a unit) with weighted fair queuing: a flow gets a share of the bus proportional to its weight,
+ *      estimated with the characters its requests and responses take on the line.
+ *      Requests of the same flow and lane are served in order of arrival.
+ *      Not thread-safe: producer and consumer shall be serialized by the caller.
+ *      Must be initialized with tmb_gateway_queue_init()
  */
-const char *tmb_strerror(tmb_error_t error);
+typedef struct {
+    /** Storage of the requests, provided by the user */
+    tmb_gateway_request_t *requests;
 
-/* optional functions for POSIX OS */
+    /** Number of requests that fit the storage */
+    size_t capacity;
 
-#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+    /** Number of requests in the queue */
+    size_t size;
 
-#define TMB_POSIX_SUPPORTED
+    /** Virtual time of each lane, that is the finish tag of the last request dispatched from it */
+    uint64_t virtual_time[TMB_GATEWAY_LANES];
 
-typedef enum {
-    TMB_SERIAL_PARITY_NONE,
-    TMB_SERIAL_PARITY_EVEN = 'E',
-    TMB_SERIAL_PARITY_ODD = 'O',
-} tmb_serial_parity_t;
+    /** Number of requests pushed since the initialization */
+    uint64_t sequence;
 
-typedef enum {
-    TMB_SERIAL_DATA_BITS_7 = 7,
-    TMB_SERIAL_DATA_BITS_8,
-} tmb_serial_data_bits_t;
+    /** Counters of each lane */
+    tmb_gateway_lane_metrics_t metrics[TMB_GATEWAY_LANES];
+} tmb_gateway_queue_t;
 
-typedef enum {
-    TMB_SERIAL_STOP_BITS_1 = 1,
-    TMB_SERIAL_STOP_BITS_2,
-} tmb_serial_stop_bits_t;
+#ifdef TMB_ENABLE_CONCURRENCY
 
+/**
+ * \typedef tmb_gateway_mailbox_t
+ * \brief Bounded lock-free queue that hands requests from many producer threads (e.g. the ones
+ *      serving the client connections) to the single consumer thread of a bus, in order of arrival.
+ *      Must be initialized with tmb_gateway_mailbox_init()
+ */
 typedef struct {
-    const char *device;
-    uint32_t baudrate;
-    tmb_serial_data_bits_t data_bits;
-    tmb_serial_stop_bits_t stop_bits;
-    tmb_serial_parity_t parity;
-} tmb_posix_transport_serial_config_t;
+    /** Storage of the requests, provided by the user */
+    tmb_gateway_request_t *requests;
 
-typedef struct {
-    const char *host;
-    uint16_t port;
-} tmb_posix_transport_tcp_config_t;
+    /** Number of requests that fit the storage, a power of 2 */
+    size_t capacity;
 
+    /** Next position to write, shared by the producers */
+    size_t write_index;
+
+    /** Next position to read, owned by the consumer */
+    size_t read_index;
+
+    /** Number of requests of each lane rejected since the mailbox was full */
+    uint64_t rejected[TMB_GATEWAY_LANES];
+} tmb_gateway_mailbox_t;
+
+#endif /* TMB_ENABLE_CONCURRENCY */
+
+/**
+ * \typedef tmb_gateway_pipeline_t
+ * \brief Transactions in flight on a TCP/IP connection to a device, that is shared by many clients.
+ *      Each request is given a transaction identifier that is unique on the connection, and the one
+ *      it was received with is restored in its response: the device can answer in any order.
+ *      Not thread-safe. Must be initialized with tmb_gateway_pipeline_init()
+ */
 typedef struct {
-    tmb_transport_protocol_t transport_protocol;
-    union {
-        tmb_posix_transport_serial_config_t serial;
-        tmb_posix_transport_tcp_config_t tcp;
-    };
-} tmb_posix_transport_config_t;
+    /** Storage of the transactions, provided by the user. The ones in flight have a size other than 0 */
+    tmb_gateway_request_t *requests;
 
-#define TMB_POSIX_TRANSPORT_SERIAL_CONFIG_DEFAULT \
-    ((tmb_posix_transport_serial_config_t){       \
-            .device = "/dev/ttyUSB0",             \
-            .baudrate = 9600,                     \
-            .data_bits = TMB_SERIAL_DATA_BITS_8,  \
-            .parity = TMB_SERIAL_PARITY_NONE,     \
-            .stop_bits = TMB_SERIAL_STOP_BITS_1,  \
-    })
+    /** Number of transactions that fit the storage */
+    size_t capacity;
 
-#define TMB_POSIX_TRANSPORT_TCP_CONFIG_DEFAULT \
-    ((tmb_posix_transport_tcp_config_t){ .host = "localhost", .port = TMB_DEFAULT_TCP_IP_PORT })
+    /** Number of transactions in flight */
+    size_t size;
+
+    /** Transaction identifier of the next request */
+    uint16_t next_transaction_identifier;
+} tmb_gateway_pipeline_t;
 
 /**
- * \brief Initializes a new TCP/IP transport using POSIX sockets
- * \param config configuration for the transport
- * \param[out] transport on successful completion a pointer to the allocated transport instance
- * \returns TMB_SUCCESS, or an appropriate error code
+ * \typedef tmb_register_change_t
+ * \brief A register that changed, reported by tmb_register_block_diff()
  */
-tmb_error_t tmb_posix_transport_new(const tmb_posix_transport_config_t *config, tmb_transport_t **transport);
+typedef struct {
+    /** Address of the register */
+    uint16_t address;
+
+    /** Value reported the previous time */
+    uint16_t previous;
+
+    /** Value read */
+    uint16_t value;
+} tmb_register_change_t;
 
 /**
- * \brief Closes a POSIX transport and frees all the allocated resources
+ * \typedef tmb_register_block_t
+ * \brief A block of registers that are read periodically, of which only the changes are reported.
+ *      Keeps the value of each register reported last, thus a register that drifts slowly is
+ *      reported once it moves away from it by more than its deadband.
+ *      Must be initialized with tmb_register_block_init()
  */
-void tmb_posix_transport_free(tmb_transport_t *transport);
+typedef struct {
+    /** Address of the first register */
+    uint16_t start_address;
 
-#endif
+    /** Number of registers, at most TMB_READ_HOLDING_REGISTER_MAX_QUANTITY */
+    uint16_t quantity;
 
-/* In only one C file, define this macro to include the implementation code */
-#ifdef TMB_IMPLEMENTATION
+    /** Values reported last, provided by the user */
+    uint16_t *snapshot;
 
-#include <string.h>
+    /** Optional maximum difference of each register that is not reported, provided by the user */
+    const uint16_t *deadbands;
 
-/* private macro definitions */
-#define TMB_ON_FALSE_RETURN(check, error) \
-    do {                                  \
-        if (!(check)) {                   \
-            return (error);               \
-        }                                 \
-    } while (false)
+    /** True if the registers are signed (two's complement) when applying the deadbands */
+    bool is_signed;
 
-#define TMB_ERROR_CHECK(expression)         \
-    do {                                    \
-        tmb_error_t __error = (expression); \
-        if (__error != TMB_SUCCESS) {       \
-            return __error;                 \
-        }                                   \
-    } while (false)
+    /** False until the first values are compared, that are all reported */
+    bool has_snapshot;
+} tmb_register_block_t;
 
-static const uint8_t TMB_ADU_ASCII_START_BYTE[] = { ':' };
-static const uint8_t TMB_ADU_ASCII_END_BYTES[] = { '\r', '\n' };
+/**
+ * \typedef tmb_word_order_t
+ * \brief How a value wider than a register is stored in consecutive registers. The letters name the
+ *      bytes of a 32 bit value, from the most significant one, in the order they are transmitted.
+ *      A 64 bit value follows the same order of words and of bytes within each word
+ */
+typedef enum {
+    /** Most significant word first, most significant byte of each word first (big endian) */
+    TMB_WORD_ORDER_ABCD,
 
-#define TMB_ADU_TCPIP_SIZE_OFFSET 4
-#define TMB_TO_HEX(i) ((i) <= 9 ? '0' + (i) : 'A' - 10 + (i))
-#define TMB_UINT16(buffer, i) ((buffer[i] << 8) | buffer[i + 1])
-#define TMB_RESPONSE_LOOKAHEAD_BYTES 2
+    /** Least significant word first, most significant byte of each word first */
+    TMB_WORD_ORDER_CDAB,
 
-/* private types */
-typedef struct {
-    tmb_transport_protocol_t encapsulation;
-    size_t capacity;
-    size_t size;
-    uint8_t *buffer;
-} tmb_adu_t;
+    /** Most significant word first, least significant byte of each word first */
+    TMB_WORD_ORDER_BADC,
 
-/* private constants */
+    /** Least significant word first, least significant byte of each word first (little endian) */
+    TMB_WORD_ORDER_DCBA,
+} tmb_word_order_t;
 
-static const uint16_t crc16_table[] = {
-    0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241, 0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1,
-    0xC481, 0x0440, 0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40, 0x0A00, 0xCAC1, 0xCB81, 0x0B40,
-    0xC901, 0x09C0, 0x0880, 0xC841, 0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40, 0x1E00, 0xDEC1,
-    0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41, 0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
-    0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040, 0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1,
-    0xF281, 0x3240, 0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441, 0x3C00, 0xFCC1, 0xFD81, 0x3D40,
-    0xFF01, 0x3FC0, 0x3E80, 0xFE41, 0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840, 0x2800, 0xE8C1,
-    0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41, 0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
-    0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640, 0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0,
-    0x2080, 0xE041, 0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240, 0x6600, 0xA6C1, 0xA781, 0x6740,
-    0xA501, 0x65C0, 0x6480, 0xA441, 0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41, 0xAA01, 0x6AC0,
-    0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840, 0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
-    0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40, 0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1,
-    0xB681, 0x7640, 0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041, 0x5000, 0x90C1, 0x9181, 0x5140,
-    0x9301, 0x53C0, 0x5280, 0x9241, 0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440, 0x9C01, 0x5CC0,
-    0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40, 0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
-    0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40, 0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0,
-    0x4C80, 0x8C41, 0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641, 0x8201, 0x42C0, 0x4380, 0x8341,
-    0x4100, 0x81C1, 0x8081, 0x4040,
-};
+/** Number of levels of the timer wheel of a poll scheduler */
+#define TMB_POLL_WHEEL_LEVELS 4
 
-/* private functions */
+/** Number of slots of each level of the timer wheel, a power of 2 */
+#define TMB_POLL_WHEEL_SLOTS 64
 
-static uint16_t tmb_crc16(const uint8_t *buffer, size_t buffer_size) {
-    uint16_t crc = 0xFFFF;
+/** Number of polls in a row that return the same data, after which an adaptive task doubles its period */
+#define TMB_POLL_BACKOFF_POLLS 3
 
-    for (size_t i = 0; i < buffer_size; i++) {
-        uint8_t byte = buffer[i] ^ crc;
-        crc >>= 8;
-        crc ^= crc16_table[byte];
-    }
+typedef struct tmb_poll_task tmb_poll_task_t;
+typedef struct tmb_poll_scheduler tmb_poll_scheduler_t;
 
-    return crc;
-}
+/**
+ * \typedef tmb_poll_task_t
+ * \brief A request that a poll scheduler sends periodically. The fields up to user_data are set by
+ *      the user before adding the task to the scheduler, the others are managed by the scheduler
+ */
+struct tmb_poll_task {
+    /** Client handle the request is sent with */
+    tmb_handle_t *handle;
 
-static uint8_t tmb_lrc(const uint8_t *buffer, size_t buffer_size) {
-    uint8_t lrc = 0;
-    for (size_t i = 0; i < buffer_size; i++) {
-        lrc += buffer[i];
-    }
+    /** The request, with the unit, the function and the range to poll */
+    tmb_request_pdu_t request;
 
-    return -lrc;
-}
+    /** Period of the task, in microseconds. The fastest one, for an adaptive task */
+    uint32_t period_us;
 
-static tmb_error_t tmb_adu_add_uint8(tmb_adu_t *adu, uint8_t data) {
-    switch (adu->encapsulation) {
-    case TMB_TRANSPORT_PROTOCOL_RTU:
-    case TMB_TRANSPORT_PROTOCOL_TCPIP:
-        TMB_ON_FALSE_RETURN(adu->size < adu->capacity, TMB_E_NO_MEMORY);
+    /**
+     * Slowest period of an adaptive task, in microseconds, or 0 to poll always every period_us.
+     * A task that reads the same data TMB_POLL_BACKOFF_POLLS times in a row doubles its period, up to
+     * this one, and goes back to period_us as soon as the data changes (or it is woken up with
+     * tmb_poll_scheduler_wake()). Once the period changes, the task no longer keeps to its phase
+     */
+    uint32_t max_period_us;
 
-        adu->buffer[adu->size++] = data;
-        break;
-    case TMB_TRANSPORT_PROTOCOL_ASCII:
-        TMB_ON_FALSE_RETURN(adu->size + 1 < adu->capacity, TMB_E_NO_MEMORY);
-        adu->buffer[adu->size++] = TMB_TO_HEX((data & 0xF0) >> 4);
-        adu->buffer[adu->size++] = TMB_TO_HEX(data & 0x0F);
-        break;
-    }
+    /**
+     * Offset of the task in its period, in microseconds: the task is due at the times that are
+     * phase_us plus a multiple of period_us. Spreads the tasks that have the same period
+     */
+    uint32_t phase_us;
 
-    return TMB_SUCCESS;
-}
+    /**
+     * \brief Optional function called by tmb_poll_task_execute() with the result of each poll
+     * \param task the task
+     * \param error the result of the request
+     * \param response the response, valid until the next request on the handle. After a failure it
+     *      holds the function and exception codes of an exception response, and is zeroed otherwise
+     */
+    void (*on_response)(tmb_poll_task_t *task, tmb_error_t error, const tmb_response_pdu_t *response);
 
-static tmb_error_t tmb_adu_add_uint16_be(tmb_adu_t *adu, uint16_t data) {
-    TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, (data >> 8) & 0xFF));
-    TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, data & 0xFF));
+    /**
+     * Optional block compared with the registers read by the request, that shall be a read of
+     * holding or input registers of the same range. A change beyond the deadband, rather than any
+     * change, brings an adaptive task back to its fastest period
+     */
+    tmb_register_block_t *block;
 
-    return TMB_SUCCESS;
-}
+    /**
+     * \brief Optional function called by tmb_poll_task_execute() with the registers of the block
+     *      that changed, if any
+     * \param task the task
+     * \param changes the registers that changed
+     * \param changes_size number of registers that changed
+     */
+    void (*on_changes)(tmb_poll_task_t *task, const tmb_register_change_t *changes, size_t changes_size);
 
-static tmb_error_t tmb_adu_add_uint16_le(tmb_adu_t *adu, uint16_t data) {
-    TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, data & 0xFF));
-    TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, (data >> 8) & 0xFF));
+    /** User data pointer, not used by the scheduler */
+    void *user_data;
 
-    return TMB_SUCCESS;
-}
+    /** Time the task is due, in microseconds */
+    uint64_t due_us;
 
-static tmb_error_t tmb_adu_add_bytes(tmb_adu_t *adu, const uint8_t *bytes, size_t bytes_size) {
-    TMB_ERROR_CHECK(adu->capacity - adu->size >= bytes_size);
+    /** Number of times the task was dispatched */
+    uint64_t polls;
 
-    memcpy(&adu->buffer[adu->size], bytes, bytes_size);
-    adu->size += bytes_size;
+    /** Number of periods skipped, since the task was dispatched one or more periods late */
+    uint64_t overruns;
 
-    return TMB_SUCCESS;
-}
+    /** Delay of the last dispatch after the time it was due, in microseconds */
+    uint64_t last_jitter_us;
 
-static tmb_error_t tmb_adu_init(tmb_adu_t *adu, uint8_t *buffer, size_t buffer_size,
-                                tmb_transport_protocol_t encapsulation, uint16_t transaction_identifier,
-                                uint8_t device_address) {
-    memset(adu, 0, sizeof(tmb_adu_t));
+    /** Longest delay of a dispatch, in microseconds */
+    uint64_t max_jitter_us;
 
-    adu->encapsulation = encapsulation;
-    adu->capacity = buffer_size;
-    adu->buffer = buffer;
+    /** Sum of the delays of the dispatches, in microseconds */
+    uint64_t total_jitter_us;
 
-    switch (encapsulation) {
-    case TMB_TRANSPORT_PROTOCOL_ASCII:
-        /* add ascii start byte */
-        TMB_ERROR_CHECK(tmb_adu_add_bytes(adu, TMB_ADU_ASCII_START_BYTE, sizeof(TMB_ADU_ASCII_START_BYTE)));
+    /** Number of polls that read different data than the previous one (beyond the deadbands of the block) */
+    uint64_t changes;
 
-        /* fall trough */
-    case TMB_TRANSPORT_PROTOCOL_RTU:
-        TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, device_address));
-        break;
+    /** Current period, in microseconds */
+    uint32_t current_period_us;
 
-    case TMB_TRANSPORT_PROTOCOL_TCPIP:
-        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, transaction_identifier));
-        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, TMB_MODBUS_PROTOCOL_IDENTIFIER));
+    /* change detection state, managed by tmb_poll_task_execute() */
+    uint32_t unchanged_polls;
+    uint64_t data_hash;
+    bool has_data;
 
-        /* placeholder for real size, that will be populated later, when known */
-        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, 0));
+    /* position in the timer wheel, managed by the scheduler */
+    tmb_poll_scheduler_t *scheduler;
+    uint64_t last_due_us;
+    uint64_t expires_tick;
+    uint8_t level;
+    uint8_t slot;
+    tmb_poll_task_t *next;
+    tmb_poll_task_t **pprev;
+};
 
-        TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, device_address));
-        break;
-    }
+/**
+ * \typedef tmb_poll_scheduler_t
+ * \brief Dispatches periodic tasks at the times they are due. The tasks are kept in a hierarchical
+ *      timer wheel: adding, removing and dispatching a task take constant time whatever the number
+ *      of tasks, and the ticks without due tasks are skipped. The scheduler doesn't read any clock,
+ *      the time is given by the caller. Not thread-safe: a scheduler per bus is the intended use,
+ *      each one served by the thread of its bus. Must be initialized with tmb_poll_scheduler_init()
+ */
+struct tmb_poll_scheduler {
+    /** Resolution of the scheduler, in microseconds */
+    uint32_t tick_us;
 
-    return TMB_SUCCESS;
-}
+    /** First tick not processed yet */
+    uint64_t current_tick;
 
-static tmb_error_t tmb_adu_finalize(tmb_adu_t *adu) {
-    switch (adu->encapsulation) {
-    case TMB_TRANSPORT_PROTOCOL_TCPIP: {
-        uint16_t size = adu->size;
+    /** Number of tasks in the scheduler */
+    size_t size;
 
-        adu->buffer[TMB_ADU_TCPIP_SIZE_OFFSET] = (size >> 8) * 0xff;
-        adu->buffer[TMB_ADU_TCPIP_SIZE_OFFSET + 1] = size & 0xff;
-        break;
-    }
+    /** Lists of the tasks of each slot of the wheel */
+    tmb_poll_task_t *slots[TMB_POLL_WHEEL_LEVELS][TMB_POLL_WHEEL_SLOTS];
 
-    case TMB_TRANSPORT_PROTOCOL_RTU:
-        TMB_ERROR_CHECK(tmb_adu_add_uint16_le(adu, tmb_crc16(adu->buffer, adu->size)));
-        break;
+    /** Slots of each level that are not empty, a bit each */
+    uint64_t occupied[TMB_POLL_WHEEL_LEVELS];
+};
 
-    case TMB_TRANSPORT_PROTOCOL_ASCII:
+#ifdef TMB_ENABLE_CONCURRENCY
+
+/**
+ * \typedef tmb_result_ring_policy_t
+ * \brief What a result ring does with a result published while it is full
+ */
+typedef enum {
+    /** The new result is discarded, the consumer reads all the results published before it */
+    TMB_RESULT_RING_DROP_NEW,
+
+    /** The oldest result not read yet is replaced, the consumer skips it */
+    TMB_RESULT_RING_OVERWRITE_OLDEST,
+} tmb_result_ring_policy_t;
+
+/**
+ * \typedef tmb_poll_result_t
+ * \brief The result of a poll, as published in a result ring
+ */
+typedef struct {
+    /** Time the result was published with, in microseconds */
+    uint64_t timestamp_us;
+
+    /** Result of the request */
+    tmb_error_t error;
+
+    /** Unit identifier of the request */
+    uint16_t unit_id;
+
+    /** Function code of the request */
+    uint8_t function_code;
+
+    /** Address of the first coil, input or register read */
+    uint16_t start_address;
+
+    /** Number of coils, inputs or registers read */
+    uint16_t quantity;
+
+    /** Number of bytes of data read, 0 if the request failed */
+    uint16_t size;
+
+    union {
+        /** Values of the registers read, for TMB_FUNCTION_READ_HOLDING_REGISTERS,
+         *  TMB_FUNCTION_READ_INPUT_REGISTERS and TMB_FUNCTION_READ_WRITE_MULTIPLE_REGISTERS */
+        uint16_t register_values[TMB_READ_HOLDING_REGISTER_MAX_QUANTITY];
+
+        /** Status of the coils or inputs read, a bit each, for TMB_FUNCTION_READ_COILS and
+         *  TMB_FUNCTION_READ_DISCRETE_INPUTS */
+        uint8_t status[(TMB_READ_COIL_MAX_QUANTITY + 7) / 8];
+    };
+
+    /* twice the position of the ring the slot holds, plus 1 while it is written, managed by the ring */
+    size_t turn;
+} tmb_poll_result_t;
+
+/**
+ * \typedef tmb_result_ring_t
+ * \brief Bounded lock-free queue that delivers the results of polls from any number of poller threads
+ *      to a consumer thread (e.g. a historian or an HMI), without locks or allocations. Producers
+ *      never wait for the consumer: when the ring is full, its policy discards either the new result
+ *      or the oldest one. Use a ring per consumer. Must be initialized with tmb_result_ring_init()
+ * \note with TMB_RESULT_RING_OVERWRITE_OLDEST, a producer that gets to a slot still being written
+ *      by a producer of the previous round of the ring (that the others went around meanwhile) waits
+ *      for it to complete the copy of its result, yielding the processor. A ring with more slots
+ *      than the results published while a producer may be preempted never waits
+ */
+typedef struct {
+    /** Storage of the results, provided by the user */
+    tmb_poll_result_t *results;
+
+    /** Number of results that fit the storage, a power of 2 */
+    size_t capacity;
+
+    /** What to do when the ring is full */
+    tmb_result_ring_policy_t policy;
+
+    /** Next position to write, shared by the producers */
+    size_t write_index;
+
+    /** Next position to read, owned by the consumer */
+    size_t read_index;
+
+    /** Number of results discarded since the ring was full */
+    uint64_t dropped;
+} tmb_result_ring_t;
+
+#endif /* TMB_ENABLE_CONCURRENCY */
+
+/* public methods */
+
+/**
+ * \brief Initializes the specified Tiny Modbus handle
+ * \param handle the handle to initialize
+ * \param mode the mode of operation (client or server)
+ * \param encapsulation the encapsulation to be used
+ * \param transport the transport to be used. The transport struct shall live for the
+ *      whole duration of the handle
+ * \returns TMB_SUCCESS if initialized successfully, otherwise TMB_INVALID_ARG
+ */
+tmb_error_t tmb_init(tmb_handle_t *handle, tmb_mode_t mode, tmb_transport_protocol_t encapsulation, uint8_t *buffer,
+                     size_t buffer_size, const tmb_transport_t *transport);
+
+/**
+ * \brief Sets the slave address ID
+ * \param handle handle to the Modbus instance
+ * \param address address of the slave
+ * \returns TMB_SUCCESS or TMB_INVALID_ARGUMENTS
+ */
+tmb_error_t tmb_client_set_device_address(tmb_handle_t *handle, uint8_t address);
+
+/**
+ * \brief Sets the time the client waits after a broadcast request, to let the devices process it
+ *      before the next request. Broadcast requests (the ones to the address TMB_ADDRESS_BROADCAST)
+ *      are only allowed for write functions, and on RTU and ASCII they are not answered: the client
+ *      returns as soon as the delay is over, without waiting for a response.
+ *      The client waits with the read_timeout function of the transport, if any,
+ *      discarding the bytes received meanwhile
+ * \param handle handle to the Modbus client
+ * \param delay_us the delay, in microseconds. TMB_CLIENT_DEFAULT_TURNAROUND_DELAY_US by default
+ * \returns TMB_SUCCESS or TMB_INVALID_ARGUMENTS
+ */
+tmb_error_t tmb_client_set_turnaround_delay(tmb_handle_t *handle, uint32_t delay_us);
+
+/**
+ * \brief Sets the maximum time the client waits for the bytes of a response, with the read_timeout
+ *      function of the transport (without it, the client waits forever). A response that doesn't
+ *      arrive in time fails with TMB_E_TIMEOUT
+ * \param handle handle to the Modbus client
+ * \param timeout_us the timeout, in microseconds, or 0 to wait forever, that is the default
+ * \returns TMB_SUCCESS or TMB_INVALID_ARGUMENTS
+ */
+tmb_error_t tmb_client_set_response_timeout(tmb_handle_t *handle, uint32_t timeout_us);
+
+/**
+ * \brief Validate the given request object.
+ * \param request the request to validate
+ * \returns TMB_SUCCESS if the request is valid, otherwise an appropriate error code
+ */
+tmb_error_t tmb_request_validate(const tmb_request_pdu_t *request);
+
+tmb_error_t tmb_client_send_request(tmb_handle_t *handle, const tmb_request_pdu_t *request,
+                                    tmb_response_pdu_t *response);
+
+/**
+ * \brief Executes a group of requests, validating all of them before sending any. On TCP/IP the
+ *      requests are sent back to back with a single write, then the responses are read in order.
+ *      On RTU and ASCII each request is sent as soon as the previous one is answered.
+ * \param handle the handle to the Modbus client. Its buffer must fit the largest responses of all the
+ *      requests (and, on TCP/IP, all the requests), since the responses reference it: otherwise
+ *      TMB_E_NO_MEMORY is returned before sending anything
+ * \param requests the requests to execute
+ * \param[out] responses the responses, in the order of the requests. A response to which the server
+ *      returned an exception has the exception bit set in its function code
+ * \param requests_size number of requests
+ * \returns TMB_SUCCESS if all the requests succeeded, otherwise the error of the first one that failed.
+ *      After a failed request the following ones are executed anyway, unless the transport failed
+ *      or, on TCP/IP, a response timed out
+ */
+tmb_error_t tmb_client_execute_batch(tmb_handle_t *handle, const tmb_request_pdu_t *requests,
+                                     tmb_response_pdu_t *responses, size_t requests_size);
+
+/**
+ * \brief Sends the same write request to many units. On RTU and ASCII, a request to all the devices
+ *      of the bus is a single broadcast followed by the turnaround delay (see
+ *      tmb_client_set_turnaround_delay()), that takes a fraction of the time of writing to each
+ *      device in turn. Otherwise each unit gets its own request, in order.
+ * \param handle the handle to the Modbus client
+ * \param request the write request, whose unit_id is ignored
+ * \param unit_ids the units to write to, or NULL to write to all the devices of the bus,
+ *      which is only possible on RTU and ASCII
+ * \param unit_ids_size number of units
+ * \param[out] errors optional, the result of the request to each unit. The results of the units
+ *      that are not contacted after a failure of the transport are left untouched
+ * \returns TMB_SUCCESS if all the units were written, otherwise the error of the first one that failed.
+ *      After a unit failed the following ones are written anyway, unless the transport failed
+ */
+tmb_error_t tmb_client_fan_out(tmb_handle_t *handle, const tmb_request_pdu_t *request, const uint8_t *unit_ids,
+                               size_t unit_ids_size, tmb_error_t *errors);
+
+tmb_error_t tmb_read_coils(tmb_handle_t *handle, uint16_t start_address, uint16_t quantity, uint8_t *values);
+
+tmb_error_t tmb_read_discrete_inputs(tmb_handle_t *handle, uint16_t start_address, uint16_t quantity, uint8_t *values);
+
+tmb_error_t tmb_read_holding_registers(tmb_handle_t *handle, uint16_t start_address, uint16_t quantity,
+                                       uint16_t *values);
+
+tmb_error_t tmb_read_input_registers(tmb_handle_t *handle, uint16_t start_address, uint16_t quantity, uint16_t *values);
+
+tmb_error_t tmb_write_single_coil(tmb_handle_t *handle, uint16_t address, uint16_t value);
+
+tmb_error_t tmb_write_single_register(tmb_handle_t *handle, uint16_t address, uint16_t value);
+
+tmb_error_t tmb_write_multiple_coils(tmb_handle_t *handle, uint16_t start_address, uint16_t quantity,
+                                     const uint8_t *values);
+
+tmb_error_t tmb_write_multiple_registers(tmb_handle_t *handle, uint16_t start_address, uint16_t quantity,
+                                         const uint16_t *values);
+
+/**
+ * \brief Starts a write of multiple coils (FC15) or registers (FC16) of which the values are written
+ *      directly in the request ADU, in the handle buffer. Must be followed by tmb_client_commit_registers(),
+ *      with no other requests in between. Not supported with ASCII encapsulation
+ * \param handle the handle to the Modbus client
+ * \param unit_id the device to write to, as the unit_id of tmb_request_pdu_t: TMB_UNIT_ID_DEFAULT
+ *      writes to the device address of the handle
+ * \param function_code TMB_FUNCTION_WRITE_MULTIPLE_COILS or TMB_FUNCTION_WRITE_MULTIPLE_REGISTERS
+ * \param start_address address of the first coil or register to write
+ * \param quantity number of coils or registers to write
+ * \param[out] payload where the caller writes the values, in the format of the protocol: registers
+ *      big endian, coils packed 8 per byte starting from the least significant bit
+ * \returns TMB_SUCCESS or an error code
+ */
+tmb_error_t tmb_client_reserve_registers(tmb_handle_t *handle, uint16_t unit_id, tmb_function_t function_code,
+                                         uint16_t start_address, uint16_t quantity, uint8_t **payload);
+
+/**
+ * \brief Completes the request started with tmb_client_reserve_registers(), then sends it and waits for the response
+ * \param handle the handle to the Modbus client
+ * \returns TMB_SUCCESS or an error code
+ */
+tmb_error_t tmb_client_commit_registers(tmb_handle_t *handle);
+
+/**
+ * \brief Writes and then reads multiple holding registers in a single transaction (FC23)
+ * \param handle the handle to the Modbus client
+ * \param read_start_address address of the first register to read
+ * \param read_quantity number of registers to read, between 1 and 125
+ * \param[out] read_values where to store the registers read
+ * \param write_start_address address of the first register to write
+ * \param write_quantity number of registers to write, between 1 and 121
+ * \param write_values the values to write, that the server writes before reading
+ * \returns TMB_SUCCESS or an error code
+ */
+tmb_error_t tmb_read_write_multiple_registers(tmb_handle_t *handle, uint16_t read_start_address,
+                                              uint16_t read_quantity, uint16_t *read_values,
+                                              uint16_t write_start_address, uint16_t write_quantity,
+                                              const uint16_t *write_values);
+
+/**
+ * \brief Modifies bits of a holding register without reading it first (FC22). The server
+ *      sets the register to (value & and_mask) | (or_mask & ~and_mask)
+ * \param handle the handle to the Modbus client
+ * \param address address of the register to modify
+ * \param and_mask bits of the register to keep
+ * \param or_mask value of the bits of the register to change
+ * \returns TMB_SUCCESS or an error code
+ */
+tmb_error_t tmb_mask_write_register(tmb_handle_t *handle, uint16_t address, uint16_t and_mask, uint16_t or_mask);
+
+/**
+ * \brief Reads groups of file records (FC20). As many groups as possible are packed in each request,
+ *      and groups that don't fit a single request are split across more of them.
+ *      On TCP/IP up to TMB_CLIENT_PIPELINE_DEPTH requests are kept in flight
+ * \param handle the handle to the Modbus client
+ * \param records the groups of records to read, with the values where to store them
+ * \param records_size number of groups
+ * \returns TMB_SUCCESS or the error of the first request that failed. After a failure no more requests
+ *      are sent, while the ones in flight are still received, unless the transport failed or, on TCP/IP,
+ *      a response timed out
+ */
+tmb_error_t tmb_read_file_records(tmb_handle_t *handle, const tmb_file_record_t *records, size_t records_size);
+
+/**
+ * \brief Writes groups of file records (FC21), packed and pipelined like tmb_read_file_records()
+ * \param handle the handle to the Modbus client
+ * \param records the groups of records to write, with their values
+ * \param records_size number of groups
+ * \returns TMB_SUCCESS or the error of the first request that failed, as tmb_read_file_records()
+ */
+tmb_error_t tmb_write_file_records(tmb_handle_t *handle, const tmb_file_record_t *records, size_t records_size);
+
+/**
+ * \brief Reads consecutive records of a file, up to a whole file, with as few requests as possible
+ * \param handle the handle to the Modbus client
+ * \param file_number the file to read
+ * \param record_number the first record to read
+ * \param quantity number of records to read
+ * \param[out] values where to store the records
+ * \returns TMB_SUCCESS or an error code
+ */
+tmb_error_t tmb_read_file(tmb_handle_t *handle, uint16_t file_number, uint16_t record_number, uint16_t quantity,
+                          uint16_t *values);
+
+/**
+ * \brief Writes consecutive records of a file, up to a whole file, with as few requests as possible
+ * \param handle the handle to the Modbus client
+ * \param file_number the file to write
+ * \param record_number the first record to write
+ * \param quantity number of records to write
+ * \param values the records to write
+ * \returns TMB_SUCCESS or an error code
+ */
+tmb_error_t tmb_write_file(tmb_handle_t *handle, uint16_t file_number, uint16_t record_number, uint16_t quantity,
+                           const uint16_t *values);
+
+/**
+ * \brief Reads the values of a FIFO queue (FC24), removing them from the queue
+ * \param handle the handle to the Modbus client
+ * \param fifo_address address of the FIFO queue
+ * \param[out] values where to store the values, must fit TMB_READ_FIFO_QUEUE_MAX_COUNT of them
+ * \param[out] count number of values read
+ * \returns TMB_SUCCESS or an error code
+ */
+tmb_error_t tmb_read_fifo_queue(tmb_handle_t *handle, uint16_t fifo_address, uint16_t *values, uint16_t *count);
+
+/**
+ * \brief Initializes a ring buffer for tmb_drain_fifo_queue()
+ * \param ring the ring to initialize
+ * \param values storage for the values, that shall live for the whole duration of the ring
+ * \param capacity number of values that fit the storage
+ * \returns TMB_SUCCESS or TMB_E_INVALID_ARGUMENTS
+ */
+tmb_error_t tmb_fifo_ring_init(tmb_fifo_ring_t *ring, uint16_t *values, size_t capacity);
+
+/**
+ * \brief Returns the number of values stored in the ring
+ */
+size_t tmb_fifo_ring_size(const tmb_fifo_ring_t *ring);
+
+/**
+ * \brief Removes values from the ring, oldest first
+ * \param ring the ring to pop from
+ * \param[out] values where to store the values
+ * \param max_count maximum number of values to pop
+ * \returns the number of values popped
+ */
+size_t tmb_fifo_ring_pop(tmb_fifo_ring_t *ring, uint16_t *values, size_t max_count);
+
+/**
+ * \brief Reads a FIFO queue back to back until it is empty, storing its values in the ring.
+ *      A read is only issued when the ring has room for a full response, so values removed
+ *      from the queue are never lost. On TCP/IP reads are pipelined while the queue has values
+ * \param handle the handle to the Modbus client
+ * \param fifo_address address of the FIFO queue
+ * \param ring where to store the values
+ * \param[out] drained number of values stored in the ring, may be NULL
+ * \returns TMB_SUCCESS when the queue is empty or the ring is full, or the error of the first read that
+ *      failed. After a failure no more reads are sent, while the ones in flight are still received,
+ *      as tmb_read_file_records() does
+ */
+tmb_error_t tmb_drain_fifo_queue(tmb_handle_t *handle, uint16_t fifo_address, tmb_fifo_ring_t *ring,
+                                 size_t *drained);
+
+/**
+ * \brief Reads the identification objects of the server (FC43/14). On stream access, the objects that
+ *      do not fit a single response are read with more requests, until the server has no more to send
+ * \param handle the handle to the Modbus client
+ * \param read_device_id_code the access type, see tmb_read_device_id_code_t
+ * \param object_id the object to read on specific access, the object to start from on stream access
+ * \param[out] objects where to store the objects read
+ * \param[in,out] objects_size the number of objects that fit objects, then the number of objects read
+ * \param[out] values where to store the values of the objects, each one terminated by a NUL character
+ * \param values_size size of the values buffer
+ * \returns TMB_SUCCESS or an error code, TMB_E_NO_MEMORY if the objects do not fit the buffers
+ */
+tmb_error_t tmb_read_device_identification(tmb_handle_t *handle, uint8_t read_device_id_code, uint8_t object_id,
+                                           tmb_device_identification_object_t *objects, size_t *objects_size,
+                                           char *values, size_t values_size);
+
+/**
+ * \brief Executes a Diagnostics (FC8) sub-function on the server
+ * \param handle the handle to the Modbus client
+ * \param sub_function the sub-function to execute, see tmb_diagnostic_sub_function_t
+ * \param data the data of the sub-function request
+ * \param[out] result the data returned by the server, may be NULL
+ * \returns TMB_SUCCESS or an error code
+ */
+tmb_error_t tmb_diagnostic(tmb_handle_t *handle, uint16_t sub_function, uint16_t data, uint16_t *result);
+
+/**
+ * \brief Reads the communication event counter of the server (FC11)
+ * \param handle the handle to the Modbus client
+ * \param[out] status the status word of the server
+ * \param[out] event_count the communication event counter of the server
+ * \returns TMB_SUCCESS or an error code
+ */
+tmb_error_t tmb_get_com_event_counter(tmb_handle_t *handle, uint16_t *status, uint16_t *event_count);
+
+/**
+ * \brief Reads the communication event log of the server (FC12)
+ * \param handle the handle to the Modbus client
+ * \param[out] log where to store the event log
+ * \returns TMB_SUCCESS or an error code
+ */
+tmb_error_t tmb_get_com_event_log(tmb_handle_t *handle, tmb_com_event_log_t *log);
+
+/**
+ * \brief Returns the communication counters of the handle, without sending any request
+ * \param handle the handle to read the counters of
+ * \param[out] statistics where to copy the counters
+ * \returns TMB_SUCCESS or TMB_E_INVALID_ARGUMENTS
+ */
+tmb_error_t tmb_get_statistics(const tmb_handle_t *handle, tmb_statistics_t *statistics);
+
+/**
+ * \brief Clears the communication counters and the event log of the handle
+ * \param handle the handle to clear the counters of
+ * \returns TMB_SUCCESS or TMB_E_INVALID_ARGUMENTS
+ */
+tmb_error_t tmb_clear_statistics(tmb_handle_t *handle);
+
+/**
+ * \brief Sets the callback to use for server communication
+ * \param handle The Modbus handle to be used
+ * \param address The address that this callbacks respond to. A Modbus
+ *      server can respond to more than one address, in this case call
+ *      this function multiple times. Use TMB_ADDRESS_ANY for calling the
+ *      callbacks for messages that arrive on any address.
+ * \param callbacks The callback object. If NULL, removes the association
+ *      with the specified server. They must be allocated to a memory buffer
+ *      that shall live trough the whole time these callbacks are needed.
+ */
+tmb_error_t tmb_server_set_callback(tmb_handle_t *handle, uint16_t address, const tmb_callbacks_t *callbacks);
+
+/**
+ * \brief Initializes the identification objects served by a server, serializing them in the storage
+ * \param identification the identification to initialize
+ * \param objects the objects, in any order. The basic ones (vendor name, product code and revision) are mandatory
+ * \param objects_size number of objects
+ * \param storage where to serialize the objects, that shall live for the whole duration of the identification.
+ *      Each object takes its length plus 2 bytes
+ * \param storage_size size of the storage
+ * \returns TMB_SUCCESS, TMB_E_NO_MEMORY if the objects do not fit the storage or TMB_E_INVALID_ARGUMENTS
+ */
+tmb_error_t tmb_device_identification_init(tmb_device_identification_t *identification,
+                                           const tmb_device_identification_object_t *objects, size_t objects_size,
+                                           uint8_t *storage, size_t storage_size);
+
+/**
+ * \brief Computes the RTU silent intervals for a serial line, as defined by the standard
+ * \param baudrate the baudrate of the serial line
+ * \param bits_per_character number of bits of a character, including start, parity and stop bits
+ * \param[out] t15_us the inter-character timeout (t1.5), in microseconds
+ * \param[out] t35_us the inter-frame delay (t3.5), in microseconds
+ * \returns TMB_SUCCESS or TMB_E_INVALID_ARGUMENTS
+ */
+tmb_error_t tmb_rtu_get_timing(uint32_t baudrate, uint8_t bits_per_character, uint32_t *t15_us, uint32_t *t35_us);
+
+/**
+ * \brief Receives a RTU frame, delimiting it by the silent interval (t3.5) that follows it rather
+ *      than by its content, thus also frames of unknown or corrupted requests are delimited correctly.
+ *      Useful to implement servers and bus monitors that must not lose the synchronization.
+ * \param transport the transport to read from, that must implement read_timeout and have the
+ *      RTU timings set
+ * \param buffer where to store the frame
+ * \param buffer_size size of the buffer
+ * \param[out] frame_size size of the received frame
+ * \returns TMB_SUCCESS if a frame was received, TMB_E_INVALID_CRC if the frame is corrupted,
+ *      TMB_E_NO_MEMORY if the frame doesn't fit the buffer (in both cases the whole frame
+ *      is discarded), or another error code
+ */
+tmb_error_t tmb_rtu_receive_frame(const tmb_transport_t *transport, uint8_t *buffer, size_t buffer_size,
+                                  size_t *frame_size);
+
+/**
+ * \brief Initializes a register bank
+ * \param bank the bank to initialize
+ * \param start_address address of the first register of the bank
+ * \param registers storage for the registers, that shall live for the whole duration of the bank
+ * \param quantity number of registers of the bank
+ * \returns TMB_SUCCESS or TMB_E_INVALID_ARGUMENTS
+ */
+tmb_error_t tmb_register_bank_init(tmb_register_bank_t *bank, uint16_t start_address, uint16_t *registers,
+                                   uint32_t quantity);
+
+/**
+ * \brief Reads a consistent snapshot of registers from the bank, without blocking the writers
+ * \param bank the bank to read from
+ * \param start_address address of the first register to read
+ * \param quantity number of registers to read
+ * \param[out] values where to store the registers
+ * \returns TMB_SUCCESS, or TMB_E_ILLEGAL_DATA_ADDRESS if the range is not in the bank
+ */
+tmb_error_t tmb_register_bank_read(tmb_register_bank_t *bank, uint16_t start_address, uint16_t quantity,
+                                   uint16_t *values);
+
+/**
+ * \brief Writes registers to the bank as a single update, that readers observe either
+ *      completely or not at all
+ * \param bank the bank to write to
+ * \param start_address address of the first register to write
+ * \param quantity number of registers to write
+ * \param values the values to write
+ * \returns TMB_SUCCESS, or TMB_E_ILLEGAL_DATA_ADDRESS if the range is not in the bank
+ */
+tmb_error_t tmb_register_bank_write(tmb_register_bank_t *bank, uint16_t start_address, uint16_t quantity,
+                                    const uint16_t *values);
+
+/**
+ * \brief Starts an in-place update of the bank, for producers that update registers
+ *      that are not contiguous. Must be followed by tmb_register_bank_end_update()
+ * \param bank the bank to update
+ * \returns a pointer to the registers of the bank, indexed from its start address
+ */
+uint16_t *tmb_register_bank_begin_update(tmb_register_bank_t *bank);
+
+/**
+ * \brief Ends an update started with tmb_register_bank_begin_update(), publishing it to the readers
+ * \param bank the bank being updated
+ */
+void tmb_register_bank_end_update(tmb_register_bank_t *bank);
+
+/**
+ * \brief Initializes a response cache
+ * \param cache the cache to initialize
+ * \param entries storage for the entries, that shall live for the whole duration of the cache
+ * \param capacity number of entries
+ * \returns TMB_SUCCESS or TMB_E_INVALID_ARGUMENTS
+ */
+tmb_error_t tmb_response_cache_init(tmb_response_cache_t *cache, tmb_response_cache_entry_t *entries,
+                                    size_t capacity);
+
+/**
+ * \brief Invalidates all the entries of the cache. Call it each time the values served by
+ *      the callbacks change (e.g. at each scan tick of the application).
+ *      With TMB_ENABLE_CONCURRENCY, it is safe to call this function from a thread other than the server one.
+ * \param cache the cache to invalidate
+ */
+void tmb_response_cache_tick(tmb_response_cache_t *cache);
+
+/**
+ * \brief Makes a cache share the generation of another one, thus a tick of either of them, or a write
+ *      processed by a server that uses either of them, invalidates the entries of both. Gives each
+ *      worker of a sharded server its own cache, that never serves a response older than a write
+ *      processed by another worker. Shall be called before the caches are used
+ * \param cache the cache that takes the generation of the other one
+ * \param other the cache, or a cache of the group of caches, to share the generation with
+ * \returns TMB_SUCCESS or TMB_E_INVALID_ARGUMENTS
+ */
+tmb_error_t tmb_response_cache_share(tmb_response_cache_t *cache, tmb_response_cache_t *other);
+
+/**
+ * \brief Sets the cache used by the server to answer read requests (FC1 to FC4).
+ *      Responses read from a register bank are invalidated automatically when
+ *      the bank is updated.
+ * \param handle the handle to the Modbus server
+ * \param cache the cache to use, or NULL to disable caching. A cache must not be
+ *      shared between handles used by different threads: give each handle its own cache,
+ *      and make them share their generation with tmb_response_cache_share()
+ * \returns TMB_SUCCESS or an error code
+ */
+tmb_error_t tmb_server_set_response_cache(tmb_handle_t *handle, tmb_response_cache_t *cache);
+
+/**
+ * \brief Process a complete request ADU that is stored in the handle buffer,
+ *      replacing it with the response ADU to be sent back to the client
+ * \param handle the handle to the Modbus server
+ * \param request_size size of the request ADU in the handle buffer
+ * \param[out] response_size size of the response ADU written in the handle buffer
+ * \returns TMB_SUCCESS if a response has to be sent, TMB_IGNORED if the request
+ *      does not need a response (e.g. not addressed to this server, or broadcast),
+ *      otherwise an error code
+ * \note this function does not use the transport, thus it can be used to integrate
+ *      the server with an external event loop
+ */
+tmb_error_t tmb_server_process_request(tmb_handle_t *handle, size_t request_size, size_t *response_size);
+
+/**
+ * \brief Run a Modbus server iteration, processing one message
+ * \param handle the handle to the Modbus server
+ * \returns TMB_SUCCESS if the request completed successfully, otherwise an error code
+ */
+tmb_error_t tmb_server_run_iteration(tmb_handle_t *handle);
+
+/**
+ * \brief Run the Modbus server forever, serving one request after another
+ * \param handle the handle to the Modbus server
+ * \return a failure code in case the server is unable to run. If no error,
+ *      this function runs forever thus TMB_SUCCESS is never returned.
+ */
+tmb_error_t tmb_server_run_forever(tmb_handle_t *handle);
+
+/**
+ * \brief Initializes a frame parser
+ * \param parser the parser to initialize
+ * \param mode TMB_MODE_SERVER to parse requests, TMB_MODE_CLIENT to parse responses
+ * \param encapsulation the encapsulation of the frames
+ * \param buffer buffer to assemble the frames received in pieces, that shall live for the whole
+ *      duration of the parser. It shall fit the largest ADU of the encapsulation
+ * \param buffer_size size of the buffer
+ * \returns TMB_SUCCESS or TMB_E_INVALID_ARGUMENTS
+ */
+tmb_error_t tmb_parser_init(tmb_parser_t *parser, tmb_mode_t mode, tmb_transport_protocol_t encapsulation,
+                            uint8_t *buffer, size_t buffer_size);
+
+/**
+ * \brief Feeds bytes received from the transport to the parser, returning the first complete frame.
+ *      The bytes that follow the frame are not consumed: call again with them (or with no bytes,
+ *      since the parser may hold a frame already) until TMB_E_INCOMPLETE is returned.
+ *      A RTU or TCP/IP frame received in a single piece is returned without being copied,
+ *      thus the frame references the bytes fed; otherwise it references the parser buffer.
+ *      In both cases it is valid until the next call. ASCII frames are always decoded in the buffer.
+ * \param parser the parser
+ * \param bytes the bytes received, may be NULL if size is 0
+ * \param size number of bytes received
+ * \param[out] consumed number of bytes consumed, including the ones stored in the parser buffer
+ * \param[out] frame the frame, when TMB_SUCCESS is returned
+ * \returns TMB_SUCCESS if a frame is complete, TMB_E_INCOMPLETE if all the bytes have been consumed
+ *      without completing a frame, otherwise the error of a discarded frame (e.g. TMB_E_INVALID_CRC).
+ *      On error RTU and TCP/IP frames are discarded one byte at a time, to find the start of the next
+ *      frame; a TCP/IP stream cannot be resynchronized reliably, and should be closed
+ */
+tmb_error_t tmb_parser_feed(tmb_parser_t *parser, const uint8_t *bytes, size_t size, size_t *consumed,
+                            tmb_frame_t *frame);
+
+/**
+ * \brief Initializes a gateway request from a frame received by a parser
+ * \param request the request to initialize
+ * \param frame the request frame
+ * \param context where to send the response, stored in the request
+ * \param tag value stored in the request along with the context
+ * \returns TMB_SUCCESS or TMB_E_INVALID_ARGUMENTS
+ */
+tmb_error_t tmb_gateway_request_init(tmb_gateway_request_t *request, const tmb_frame_t *frame, void *context,
+                                     uint32_t tag);
+
+/**
+ * \brief Initializes a gateway queue
+ * \param queue the queue to initialize
+ * \param requests storage for the requests, that shall live for the whole duration of the queue
+ * \param capacity number of requests that fit the storage
+ * \returns TMB_SUCCESS or TMB_E_INVALID_ARGUMENTS
+ */
+tmb_error_t tmb_gateway_queue_init(tmb_gateway_queue_t *queue, tmb_gateway_request_t *requests, size_t capacity);
+
+/**
+ * \brief Returns the number of requests in the queue
+ */
+size_t tmb_gateway_queue_size(const tmb_gateway_queue_t *queue);
+
+/**
+ * \brief Queues a request, received as a frame by a TCP/IP server parser
+ * \param queue the queue
+ * \param frame the request
+ * \param context where to send the response, stored in the request
+ * \param tag value stored in the request along with the context
+ * \param weight weight of the flow of the request, from 1 to 255
+ * \param now_us current time in microseconds, from any monotonic clock
+ * \returns TMB_SUCCESS, or TMB_E_NO_MEMORY if the queue is full
+ */
+tmb_error_t tmb_gateway_queue_push(tmb_gateway_queue_t *queue, const tmb_frame_t *frame, void *context,
+                                   uint32_t tag, uint8_t weight, uint64_t now_us);
+
+/**
+ * \brief Queues a request popped from a mailbox, with the weight and the time it was pushed with
+ * \param queue the queue
+ * \param request the request
+ * \returns TMB_SUCCESS, or TMB_E_NO_MEMORY if the queue is full
+ */
+tmb_error_t tmb_gateway_queue_push_request(tmb_gateway_queue_t *queue, const tmb_gateway_request_t *request);
+
+/**
+ * \brief Removes from the queue the request to forward next
+ * \param queue the queue
+ * \param[out] request where to copy the request
+ * \param now_us current time in microseconds, from the clock used to push
+ * \returns true if a request was popped, false if the queue is empty
+ */
+bool tmb_gateway_queue_pop(tmb_gateway_queue_t *queue, tmb_gateway_request_t *request, uint64_t now_us);
+
+#ifdef TMB_ENABLE_CONCURRENCY
+
+/**
+ * \brief Initializes a gateway mailbox
+ * \param mailbox the mailbox to initialize
+ * \param requests storage for the requests, that shall live for the whole duration of the mailbox
+ * \param capacity number of requests that fit the storage, that shall be a power of 2
+ * \returns TMB_SUCCESS or TMB_E_INVALID_ARGUMENTS
+ */
+tmb_error_t tmb_gateway_mailbox_init(tmb_gateway_mailbox_t *mailbox, tmb_gateway_request_t *requests,
+                                     size_t capacity);
+
+/**
+ * \brief Hands a request to the consumer of the mailbox. Safe to call from any number of threads
+ * \param mailbox the mailbox
+ * \param frame the request, received by a TCP/IP server parser
+ * \param context where to send the response, stored in the request
+ * \param tag value stored in the request along with the context
+ * \param weight weight of the flow of the request, from 1 to 255
+ * \param now_us current time in microseconds, from any monotonic clock
+ * \returns TMB_SUCCESS, or TMB_E_NO_MEMORY if the mailbox is full
+ */
+tmb_error_t tmb_gateway_mailbox_push(tmb_gateway_mailbox_t *mailbox, const tmb_frame_t *frame, void *context,
+                                     uint32_t tag, uint8_t weight, uint64_t now_us);
+
+/**
+ * \brief Removes the oldest request from the mailbox. Shall be called by a single thread
+ * \param mailbox the mailbox
+ * \param[out] request where to copy the request
+ * \returns true if a request was popped, false if the mailbox is empty
+ */
+bool tmb_gateway_mailbox_pop(tmb_gateway_mailbox_t *mailbox, tmb_gateway_request_t *request);
+
+#endif /* TMB_ENABLE_CONCURRENCY */
+
+/**
+ * \brief Initializes a gateway pipeline
+ * \param pipeline the pipeline to initialize
+ * \param requests storage for the transactions, that shall live for the whole duration of the pipeline
+ * \param capacity number of transactions that fit the storage, at most 65536
+ * \returns TMB_SUCCESS or TMB_E_INVALID_ARGUMENTS
+ */
+tmb_error_t tmb_gateway_pipeline_init(tmb_gateway_pipeline_t *pipeline, tmb_gateway_request_t *requests,
+                                      size_t capacity);
+
+/**
+ * \brief Starts a transaction, rewriting the transaction identifier of the request
+ * \param pipeline the pipeline
+ * \param frame the request, received by a TCP/IP server parser
+ * \param context where to send the response, stored in the request
+ * \param tag value stored in the request along with the context
+ * \param now_us current time in microseconds, from any monotonic clock
+ * \param[out] request the transaction, whose ADU is the request to send to the device
+ * \returns TMB_SUCCESS, or TMB_E_NO_MEMORY if the pipeline is full
+ */
+tmb_error_t tmb_gateway_pipeline_submit(tmb_gateway_pipeline_t *pipeline, const tmb_frame_t *frame, void *context,
+                                        uint32_t tag, uint64_t now_us, tmb_gateway_request_t **request);
+
+/**
+ * \brief Completes the transaction of a response received from the device
+ * \param pipeline the pipeline
+ * \param frame the response, received by a TCP/IP client parser
+ * \param[out] response where to copy the transaction, whose ADU is the response to send to the client
+ * \returns TMB_SUCCESS, or TMB_E_INVALID_RESPONSE if no transaction in flight matches the response
+ *      (e.g. one that was cancelled)
+ */
+tmb_error_t tmb_gateway_pipeline_complete(tmb_gateway_pipeline_t *pipeline, const tmb_frame_t *frame,
+                                          tmb_gateway_request_t *response);
+
+/**
+ * \brief Cancels the oldest transaction started before a deadline, replacing it with an exception response
+ * \param pipeline the pipeline
+ * \param deadline_us the transactions started at this time or later are kept, UINT64_MAX to cancel all of them
+ * \param exception_code the exception to return, e.g. TMB_E_GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND
+ * \param[out] response where to copy the transaction, whose ADU is the response to send to the client
+ * \returns true if a transaction was cancelled, false otherwise
+ */
+bool tmb_gateway_pipeline_cancel(tmb_gateway_pipeline_t *pipeline, uint64_t deadline_us, tmb_error_t exception_code,
+                                 tmb_gateway_request_t *response);
+
+/**
+ * \brief Replaces the request with the exception response to it
+ * \param request the request
+ * \param exception_code the exception to return, e.g. TMB_E_GATEWAY_PATH_UNAVAILABLE
+ */
+void tmb_gateway_request_set_exception(tmb_gateway_request_t *request, tmb_error_t exception_code);
+
+/**
+ * \brief Forwards a request on a bus, re-encapsulating it for the bus, and replaces it with the
+ *      response, that keeps the transaction identifier of the request.
+ *      If the device does not answer (or answers with a corrupted frame) the response is
+ *      the exception TMB_E_GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND: set a response timeout on
+ *      the handle (see tmb_client_set_response_timeout()), since a silent device is detected
+ *      only when the wait for its response is bounded
+ * \param handle the client handle of the bus (RTU or TCP/IP)
+ * \param request the request, replaced by the response
+ * \returns TMB_SUCCESS if there is a response to send, TMB_IGNORED for broadcast requests
+ *      to a serial bus, that have no response, otherwise an error code
+ */
+tmb_error_t tmb_gateway_forward(tmb_handle_t *handle, tmb_gateway_request_t *request);
+
+/**
+ * \brief Initializes a register block
+ * \param block the block to initialize
+ * \param start_address address of the first register
+ * \param quantity number of registers, from 1 to TMB_READ_HOLDING_REGISTER_MAX_QUANTITY
+ * \param snapshot storage for the values of the registers, that shall live for the whole duration of the block
+ * \param deadbands optional deadband of each register, NULL to report any change
+ * \param is_signed true if the registers are signed
+ * \returns TMB_SUCCESS or TMB_E_INVALID_ARGUMENTS
+ */
+tmb_error_t tmb_register_block_init(tmb_register_block_t *block, uint16_t start_address, uint16_t quantity,
+                                    uint16_t *snapshot, const uint16_t *deadbands, bool is_signed);
+
+/**
+ * \brief Compares the values read with the ones reported last, and reports the registers that changed
+ *      by more than their deadband. The first time, all the registers are reported
+ * \param block the block
+ * \param values the values of the registers of the block, as decoded in a response
+ * \param[out] changes the registers that changed, in order of address. Shall fit the registers of the block
+ * \param[out] changes_size number of registers that changed
+ * \returns TMB_SUCCESS or TMB_E_INVALID_ARGUMENTS
+ */
+tmb_error_t tmb_register_block_diff(tmb_register_block_t *block, const uint16_t *values,
+                                    tmb_register_change_t *changes, size_t *changes_size);
+
+/**
+ * \brief Decodes 32 bit floating point values, each one stored in 2 consecutive registers
+ * \param registers the registers, as decoded in a response (e.g. register_values)
+ * \param count number of values to decode, thus half the number of registers
+ * \param order how the values are stored in the registers
+ * \param[out] values the values
+ * \returns TMB_SUCCESS or TMB_E_INVALID_ARGUMENTS
+ */
+tmb_error_t tmb_decode_float(const uint16_t *registers, size_t count, tmb_word_order_t order, float *values);
+
+/**
+ * \brief Decodes 32 bit signed integers, each one stored in 2 consecutive registers
+ * \see tmb_decode_float()
+ */
+tmb_error_t tmb_decode_int32(const uint16_t *registers, size_t count, tmb_word_order_t order, int32_t *values);
+
+/**
+ * \brief Decodes 32 bit unsigned integers, each one stored in 2 consecutive registers
+ * \see tmb_decode_float()
+ */
+tmb_error_t tmb_decode_uint32(const uint16_t *registers, size_t count, tmb_word_order_t order, uint32_t *values);
+
+/**
+ * \brief Decodes 64 bit signed integers, each one stored in 4 consecutive registers
+ * \see tmb_decode_float()
+ */
+tmb_error_t tmb_decode_int64(const uint16_t *registers, size_t count, tmb_word_order_t order, int64_t *values);
+
+/**
+ * \brief Decodes 64 bit floating point values, each one stored in 4 consecutive registers
+ * \see tmb_decode_float()
+ */
+tmb_error_t tmb_decode_double(const uint16_t *registers, size_t count, tmb_word_order_t order, double *values);
+
+/**
+ * \brief Initializes a poll scheduler
+ * \param scheduler the scheduler to initialize
+ * \param tick_us resolution of the scheduler, in microseconds. Tasks are dispatched up to a tick late
+ * \param now_us current time in microseconds, from the clock used for all the calls to the scheduler
+ * \returns TMB_SUCCESS or TMB_E_INVALID_ARGUMENTS
+ */
+tmb_error_t tmb_poll_scheduler_init(tmb_poll_scheduler_t *scheduler, uint32_t tick_us, uint64_t now_us);
+
+/**
+ * \brief Adds a task to the scheduler, due at the first time from now that matches its period and phase
+ * \param scheduler the scheduler
+ * \param task the task, that shall live until it is removed
+ * \param now_us current time in microseconds
+ * \returns TMB_SUCCESS or TMB_E_INVALID_ARGUMENTS
+ */
+tmb_error_t tmb_poll_scheduler_add(tmb_poll_scheduler_t *scheduler, tmb_poll_task_t *task, uint64_t now_us);
+
+/**
+ * \brief Removes a task from the scheduler
+ * \param scheduler the scheduler
+ * \param task the task
+ */
+void tmb_poll_scheduler_remove(tmb_poll_scheduler_t *scheduler, tmb_poll_task_t *task);
+
+/**
+ * \brief Returns a task that is due, updating its statistics and scheduling its next poll.
+ *      Shall be called until it returns NULL, executing each task returned
+ * \param scheduler the scheduler
+ * \param now_us current time in microseconds
+ * \returns the task, or NULL if none is due
+ */
+tmb_poll_task_t *tmb_poll_scheduler_next(tmb_poll_scheduler_t *scheduler, uint64_t now_us);
+
+/**
+ * \brief Returns a time, not later than the next task is due, to wait for before calling
+ *      tmb_poll_scheduler_next() again
+ * \param scheduler the scheduler
+ * \returns the time in microseconds, UINT64_MAX if there are no tasks
+ */
+uint64_t tmb_poll_scheduler_next_due(const tmb_poll_scheduler_t *scheduler);
+
+/**
+ * \brief Makes a task due now, and brings an adaptive task back to its fastest period,
+ *      e.g. when its data is needed right away. The next call to tmb_poll_scheduler_next() returns
+ *      it, even in the same tick as the previous one
+ * \param scheduler the scheduler
+ * \param task a task of the scheduler
+ * \param now_us current time in microseconds
+ * \returns TMB_SUCCESS or TMB_E_INVALID_ARGUMENTS
+ */
+tmb_error_t tmb_poll_scheduler_wake(tmb_poll_scheduler_t *scheduler, tmb_poll_task_t *task, uint64_t now_us);
+
+/**
+ * \brief Sends the request of a task, and passes the response to its on_response function.
+ *      The data read is compared with the one of the previous poll, to adapt the period of the task
+ * \param task the task returned by tmb_poll_scheduler_next()
+ * \returns the result of the request
+ */
+tmb_error_t tmb_poll_task_execute(tmb_poll_task_t *task);
+
+#ifdef TMB_ENABLE_CONCURRENCY
+
+/**
+ * \brief Initializes a result ring
+ * \param ring the ring to initialize
+ * \param results storage for the results, that shall live for the whole duration of the ring
+ * \param capacity number of results that fit the storage, that shall be a power of 2
+ * \param policy what to do when the ring is full
+ * \returns TMB_SUCCESS or TMB_E_INVALID_ARGUMENTS
+ */
+tmb_error_t tmb_result_ring_init(tmb_result_ring_t *ring, tmb_poll_result_t *results, size_t capacity,
+                                 tmb_result_ring_policy_t policy);
+
+/**
+ * \brief Publishes the result of a poll to the consumer of the ring. Safe to call from any number of
+ *      threads, e.g. from the on_response function of the poll tasks
+ * \param ring the ring
+ * \param request the request of the poll
+ * \param error the result of the request
+ * \param response the response, of which the data read is copied if error is TMB_SUCCESS
+ * \param timestamp_us time of the result in microseconds, from any clock
+ * \returns TMB_SUCCESS, or TMB_E_NO_MEMORY if the ring is full and its policy is TMB_RESULT_RING_DROP_NEW
+ */
+tmb_error_t tmb_result_ring_publish(tmb_result_ring_t *ring, const tmb_request_pdu_t *request, tmb_error_t error,
+                                    const tmb_response_pdu_t *response, uint64_t timestamp_us);
+
+/**
+ * \brief Removes the oldest result from the ring. Shall be called by a single thread
+ * \param ring the ring
+ * \param[out] result where to copy the result
+ * \returns true if a result was read, false if the ring is empty
+ */
+bool tmb_result_ring_consume(tmb_result_ring_t *ring, tmb_poll_result_t *result);
+
+#endif /* TMB_ENABLE_CONCURRENCY */
+
+/**
+ * \brief Returns a string representation of the provided error code
+ * \param error the error code to convert
+ * \returns a pointer to a static memory buffer containing the string
+ *      representation of the error
+ */
+const char *tmb_strerror(tmb_error_t error);
+
+/* optional functions for POSIX OS */
+
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+
+#define TMB_POSIX_SUPPORTED
+
+typedef enum {
+    TMB_SERIAL_PARITY_NONE,
+    TMB_SERIAL_PARITY_EVEN = 'E',
+    TMB_SERIAL_PARITY_ODD = 'O',
+} tmb_serial_parity_t;
+
+typedef enum {
+    TMB_SERIAL_DATA_BITS_7 = 7,
+    TMB_SERIAL_DATA_BITS_8,
+} tmb_serial_data_bits_t;
+
+typedef enum {
+    TMB_SERIAL_STOP_BITS_1 = 1,
+    TMB_SERIAL_STOP_BITS_2,
+} tmb_serial_stop_bits_t;
+
+typedef struct {
+    const char *device;
+    uint32_t baudrate;
+    tmb_serial_data_bits_t data_bits;
+    tmb_serial_stop_bits_t stop_bits;
+    tmb_serial_parity_t parity;
+} tmb_posix_transport_serial_config_t;
+
+typedef struct {
+    const char *host;
+    uint16_t port;
+} tmb_posix_transport_tcp_config_t;
+
+typedef struct {
+    tmb_transport_protocol_t transport_protocol;
+    union {
+        tmb_posix_transport_serial_config_t serial;
+        tmb_posix_transport_tcp_config_t tcp;
+    };
+} tmb_posix_transport_config_t;
+
+#define TMB_POSIX_TRANSPORT_SERIAL_CONFIG_DEFAULT \
+    ((tmb_posix_transport_serial_config_t){       \
+            .device = "/dev/ttyUSB0",             \
+            .baudrate = 9600,                     \
+            .data_bits = TMB_SERIAL_DATA_BITS_8,  \
+            .parity = TMB_SERIAL_PARITY_NONE,     \
+            .stop_bits = TMB_SERIAL_STOP_BITS_1,  \
+    })
+
+#define TMB_POSIX_TRANSPORT_TCP_CONFIG_DEFAULT \
+    ((tmb_posix_transport_tcp_config_t){ .host = "localhost", .port = TMB_DEFAULT_TCP_IP_PORT })
+
+/**
+ * \brief Initializes a new TCP/IP transport using POSIX sockets
+ * \param config configuration for the transport
+ * \param[out] transport on successful completion a pointer to the allocated transport instance
+ * \returns TMB_SUCCESS, or an appropriate error code
+ */
+tmb_error_t tmb_posix_transport_new(const tmb_posix_transport_config_t *config, tmb_transport_t **transport);
+
+/**
+ * \brief Closes a POSIX transport and frees all the allocated resources
+ */
+void tmb_posix_transport_free(tmb_transport_t *transport);
+
+/* the servers of Linux are multi-threaded */
+#if defined(__linux__) && defined(TMB_ENABLE_CONCURRENCY)
+
+#define TMB_LINUX_SUPPORTED
+
+typedef struct {
+    /** Address to listen on, or NULL to listen on all the interfaces */
+    const char *host;
+
+    /** TCP port to listen on */
+    uint16_t port;
+
+    /** Number of worker threads. Each worker has its own listening socket and event loop */
+    size_t workers;
+
+    /** Maximum number of connections that each worker can serve at the same time */
+    size_t max_connections;
+
+    /** User data pointer that is passed to on_worker_init */
+    void *user_data;
+
+    /**
+     * \brief Function called by each worker to configure its own private handle
+     * \param user_data pointer to the user_data param in this struct
+     * \param worker index of the worker, from 0 to workers - 1
+     * \param handle the handle of the worker, already initialized in server mode.
+     *      Use tmb_server_set_callback() to configure it
+     * \note callbacks are invoked concurrently by all the workers, thus any
+     *      state that they share must be safe to access from multiple threads.
+     *      Likewise, each worker needs its own response cache: initialize the caches
+     *      and share their generation with tmb_response_cache_share() before running the
+     *      server, so that a write processed by a worker invalidates the caches of all of them
+     */
+    tmb_error_t (*on_worker_init)(void *user_data, size_t worker, tmb_handle_t *handle);
+} tmb_posix_tcp_server_config_t;
+
+#define TMB_POSIX_TCP_SERVER_CONFIG_DEFAULT                                                               \
+    ((tmb_posix_tcp_server_config_t){                                                                     \
+            .host = NULL, .port = TMB_DEFAULT_TCP_IP_PORT, .workers = 1, .max_connections = 64, \
+    })
+
+/**
+ * \brief Runs a Modbus TCP/IP server sharded across multiple worker threads.
+ *      Each worker listens on its own socket bound to the same port (SO_REUSEPORT),
+ *      thus the kernel distributes the incoming connections between them, and
+ *      serves its connections with its own epoll instance and tmb_handle_t.
+ *      No lock is taken by the library while serving a request, and no socket operation blocks:
+ *      a client that doesn't read its responses is disconnected, rather than stalling its worker.
+ * \param config configuration of the server
+ * \return a failure code in case the server is unable to run. If no error,
+ *      this function runs forever thus TMB_SUCCESS is never returned.
+ */
+tmb_error_t tmb_posix_tcp_server_run(const tmb_posix_tcp_server_config_t *config);
+
+/**
+ * \typedef tmb_posix_tcp_gateway_route_t
+ * \brief A range of unit identifiers served by a bus of a gateway
+ */
+typedef struct {
+    /** First unit identifier of the range */
+    uint8_t first_unit_id;
+
+    /** Last unit identifier of the range, included */
+    uint8_t last_unit_id;
+
+    /** Index of the bus of the units */
+    size_t bus;
+} tmb_posix_tcp_gateway_route_t;
+
+typedef struct {
+    /** Address to listen on, or NULL to listen on all the interfaces */
+    const char *host;
+
+    /** TCP port to listen on */
+    uint16_t port;
+
+    /** Number of worker threads serving the client connections, as in tmb_posix_tcp_server_run() */
+    size_t workers;
+
+    /** Maximum number of client connections that each worker can serve at the same time */
+    size_t max_connections;
+
+    /**
+     * Client handles of the buses, already initialized (e.g. in RTU mode on a transport
+     * returned by tmb_posix_transport_new()). Each bus is served by its own thread
+     */
+    tmb_handle_t **buses;
+
+    /** Number of buses */
+    size_t buses_size;
+
+    /**
+     * Number of requests that each bus can queue. When the queue of a bus is full, the requests
+     * to it are answered with the exception TMB_E_SLAVE_DEVICE_BUSY
+     */
+    size_t queue_capacity;
+
+    /**
+     * Time to wait for a response, in milliseconds, that is set as the response timeout of the buses
+     * (see tmb_client_set_response_timeout()). 0 to wait forever, that lets a silent device hold its bus
+     */
+    uint32_t timeout_ms;
+
+    /**
+     * Routing table, that selects the bus of each unit: the first range that contains the unit wins.
+     * Requests to the units that are in no range are answered with the exception
+     * TMB_E_GATEWAY_PATH_UNAVAILABLE. If the table is empty, all the units are on the first bus
+     */
+    const tmb_posix_tcp_gateway_route_t *routes;
+
+    /** Number of ranges of the routing table */
+    size_t routes_size;
+
+    /** User data pointer that is passed to the callbacks */
+    void *user_data;
+
+    /**
+     * \brief Function that returns the weight of the requests to a unit. Each connection gets a share
+     *      of the bus proportional to the weight of the units it is talking to. If NULL, all the
+     *      units have the same weight. See tmb_gateway_queue_t
+     * \param user_data pointer to the user_data param in this struct
+     * \param unit_id the unit identifier of the request
+     * \returns the weight, from 1 to 255
+     */
+    uint8_t (*weight)(void *user_data, uint8_t unit_id);
+
+    /**
+     * \brief Optional function called by the thread of a bus after each request it forwards
+     * \param user_data pointer to the user_data param in this struct
+     * \param bus the index of the bus
+     * \param metrics the counters of the lanes of the bus, indexed by tmb_gateway_lane_t
+     */
+    void (*on_metrics)(void *user_data, size_t bus, const tmb_gateway_lane_metrics_t *metrics);
+} tmb_posix_tcp_gateway_config_t;
+
+#define TMB_POSIX_TCP_GATEWAY_CONFIG_DEFAULT                                                          \
+    ((tmb_posix_tcp_gateway_config_t){                                                                \
+            .host = NULL, .port = TMB_DEFAULT_TCP_IP_PORT, .workers = 1, .max_connections = 64,         \
+            .queue_capacity = 16, .timeout_ms = 1000,                                                 \
+    })
+
+/**
+ * \brief Runs a Modbus TCP/IP to RTU gateway that owns one or more buses. The workers (the first
+ *      being the calling thread) accept the connections and hand their requests to the bus of their
+ *      unit through a lock-free mailbox, while each bus forwards its requests from its own I/O
+ *      thread: a slow or silent device delays only the requests to its bus.
+ *      Devices that don't answer in time are reported to the client with the exception
+ *      TMB_E_GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND
+ * \param config configuration of the gateway
+ * \return a failure code in case the gateway is unable to run. If no error,
+ *      this function runs forever thus TMB_SUCCESS is never returned.
+ */
+tmb_error_t tmb_posix_tcp_gateway_run(const tmb_posix_tcp_gateway_config_t *config);
+
+/**
+ * \typedef tmb_posix_tcp_proxy_device_t
+ * \brief A Modbus TCP/IP device behind a proxy
+ */
+typedef struct {
+    /** Host name or address of the device */
+    const char *host;
+
+    /** TCP port of the device */
+    uint16_t port;
+} tmb_posix_tcp_proxy_device_t;
+
+typedef struct {
+    /** Address to listen on, or NULL to listen on all the interfaces */
+    const char *host;
+
+    /** TCP port to listen on */
+    uint16_t port;
+
+    /** Maximum number of client connections served at the same time */
+    size_t max_connections;
+
+    /** The devices, each one reached through a single connection */
+    const tmb_posix_tcp_proxy_device_t *devices;
+
+    /** Number of devices */
+    size_t devices_size;
+
+    /**
+     * Routing table, as in tmb_posix_tcp_gateway_config_t, where the bus of a range is the index
+     * of its device. If the table is empty, all the units are on the first device
+     */
+    const tmb_posix_tcp_gateway_route_t *routes;
+
+    /** Number of ranges of the routing table */
+    size_t routes_size;
+
+    /**
+     * Maximum number of transactions in flight on the connection to a device. When it is reached,
+     * the requests to the device are answered with the exception TMB_E_SLAVE_DEVICE_BUSY
+     */
+    size_t max_pending;
+
+    /**
+     * Time to wait for a response, in milliseconds. Also the time to wait before connecting again
+     * to a device that can't be reached
+     */
+    uint32_t timeout_ms;
+} tmb_posix_tcp_proxy_config_t;
+
+#define TMB_POSIX_TCP_PROXY_CONFIG_DEFAULT                                                             \
+    ((tmb_posix_tcp_proxy_config_t){                                                                   \
+            .host = NULL, .port = TMB_DEFAULT_TCP_IP_PORT, .max_connections = 64, .max_pending = 16,     \
+            .timeout_ms = 1000,                                                                        \
+    })
+
+/**
+ * \brief Runs a Modbus TCP/IP proxy, that serves any number of clients with a single connection to
+ *      each device: the requests of all the clients are pipelined on it, with their transaction
+ *      identifiers rewritten (see tmb_gateway_pipeline_t). The device is connected on the first
+ *      request and again after a failure, that is reported to the client with the exception
+ *      TMB_E_GATEWAY_PATH_UNAVAILABLE, while the requests that are not answered in time get
+ *      TMB_E_GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND. All the connections are served by the calling thread
+ * \param config configuration of the proxy
+ * \return a failure code in case the proxy is unable to run. If no error,
+ *      this function runs forever thus TMB_SUCCESS is never returned.
+ */
+tmb_error_t tmb_posix_tcp_proxy_run(const tmb_posix_tcp_proxy_config_t *config);
+
+#endif /* __linux__ && TMB_ENABLE_CONCURRENCY */
+
+#endif
+
+/* In only one C file, define this macro to include the implementation code */
+#ifdef TMB_IMPLEMENTATION
+
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#define TMB_SSE2_SUPPORTED
+#include <emmintrin.h>
+#endif
+
+/* atomic operations on plain integers, shared by the threads of the lock-free structures. Other compilers
+ * can define all these macros before including the implementation */
+#ifndef TMB_ATOMIC_LOAD
+#if !defined(TMB_ENABLE_CONCURRENCY)
+/* nothing is shared between threads: plain operations do, on any compiler */
+#define TMB_ATOMIC_RELAXED 0
+#define TMB_ATOMIC_ACQUIRE 0
+#define TMB_ATOMIC_RELEASE 0
+#define TMB_ATOMIC_LOAD(ptr, order) (*(ptr))
+#define TMB_ATOMIC_STORE(ptr, value, order) ((void)(*(ptr) = (value)))
+#define TMB_ATOMIC_ADD_FETCH(ptr, value, order) (*(ptr) += (value))
+#define TMB_ATOMIC_TEST_AND_SET(ptr, order) (*(ptr) != 0 || (*(ptr) = 1) == 0)
+#define TMB_ATOMIC_CLEAR(ptr, order) ((void)(*(ptr) = 0))
+#define TMB_ATOMIC_FENCE(order) ((void)0)
+#elif defined(__GNUC__) || defined(__clang__)
+#define TMB_ATOMIC_RELAXED __ATOMIC_RELAXED
+#define TMB_ATOMIC_ACQUIRE __ATOMIC_ACQUIRE
+#define TMB_ATOMIC_RELEASE __ATOMIC_RELEASE
+#define TMB_ATOMIC_LOAD(ptr, order) __atomic_load_n(ptr, order)
+#define TMB_ATOMIC_STORE(ptr, value, order) __atomic_store_n(ptr, value, order)
+#define TMB_ATOMIC_FETCH_ADD(ptr, value, order) __atomic_fetch_add(ptr, value, order)
+#define TMB_ATOMIC_ADD_FETCH(ptr, value, order) __atomic_add_fetch(ptr, value, order)
+#define TMB_ATOMIC_COMPARE_EXCHANGE(ptr, expected, desired, weak, success, failure) \
+    __atomic_compare_exchange_n(ptr, expected, desired, weak, success, failure)
+#define TMB_ATOMIC_TEST_AND_SET(ptr, order) __atomic_test_and_set(ptr, order)
+#define TMB_ATOMIC_CLEAR(ptr, order) __atomic_clear(ptr, order)
+#define TMB_ATOMIC_FENCE(order) __atomic_thread_fence(order)
+#else
+#error "TMB_ENABLE_CONCURRENCY needs atomic operations: define the TMB_ATOMIC_* macros for this compiler"
+#endif
+#endif
+
+/* gives way to the thread that a busy wait is waiting for */
+#ifndef TMB_SPIN_YIELD
+#if defined(TMB_POSIX_SUPPORTED)
+#include <sched.h>
+#define TMB_SPIN_YIELD() sched_yield()
+#elif defined(TMB_SSE2_SUPPORTED)
+#define TMB_SPIN_YIELD() _mm_pause()
+#else
+#define TMB_SPIN_YIELD() ((void)0)
+#endif
+#endif
+
+/* number of trailing zero bits of a non-zero 64-bit value */
+#ifndef TMB_CTZ64
+#if defined(__GNUC__) || defined(__clang__)
+#define TMB_CTZ64(value) ((unsigned)__builtin_ctzll(value))
+#else
+#define TMB_CTZ64(value) tmb_ctz64(value)
+
+static unsigned tmb_ctz64(uint64_t value) {
+    /* the lowest bit set, multiplied by a de Bruijn sequence, leaves a different pattern in the top 6 bits */
+    static const uint8_t positions[64] = {
+        0,  1,  48, 2,  57, 49, 28, 3,  61, 58, 50, 42, 38, 29, 17, 4,  62, 55, 59, 36, 53, 51,
+        43, 22, 45, 39, 33, 30, 24, 18, 12, 5,  63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21,
+        44, 32, 23, 11, 46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19, 9,  13, 8,  7,  6,
+    };
+
+    return positions[((value & (~value + 1)) * UINT64_C(0x03F79D71B4CB0A89)) >> 58];
+}
+#endif
+#endif
+
+/* private macro definitions */
+#define TMB_ON_FALSE_RETURN(check, error) \
+    do {                                  \
+        if (!(check)) {                   \
+            return (error);               \
+        }                                 \
+    } while (false)
+
+#define TMB_ERROR_CHECK(expression)         \
+    do {                                    \
+        tmb_error_t __error = (expression); \
+        if (__error != TMB_SUCCESS) {       \
+            return __error;                 \
+        }                                   \
+    } while (false)
+
+#ifdef TMB_DEBUG
+#include <stdio.h>
+#define TMB_LOG(...) fprintf(stderr, __VA_ARGS__)
+#else
+#define TMB_LOG(...) \
+    do {             \
+    } while (false)
+#endif
+
+static const uint8_t TMB_ADU_ASCII_START_BYTE[] = { ':' };
+static const uint8_t TMB_ADU_ASCII_END_BYTES[] = { '\r', '\n' };
+
+#define TMB_ADU_TCPIP_SIZE_OFFSET 4
+#define TMB_TO_HEX(i) ((i) <= 9 ? '0' + (i) : 'A' - 10 + (i))
+#define TMB_UINT16(buffer, i) ((buffer[i] << 8) | buffer[i + 1])
+#define TMB_RESPONSE_LOOKAHEAD_BYTES 2
+#define TMB_ADU_TCPIP_HEADER_SIZE 7
+
+/* bits of the communication event log entries, as defined by the standard */
+#define TMB_COM_EVENT_RECEIVE 0x80
+#define TMB_COM_EVENT_RECEIVE_COMMUNICATION_ERROR 0x02
+#define TMB_COM_EVENT_RECEIVE_CHARACTER_OVERRUN 0x10
+#define TMB_COM_EVENT_RECEIVE_LISTEN_ONLY 0x20
+#define TMB_COM_EVENT_RECEIVE_BROADCAST 0x40
+#define TMB_COM_EVENT_SEND 0x40
+#define TMB_COM_EVENT_SEND_READ_EXCEPTION 0x01
+#define TMB_COM_EVENT_SEND_ABORT_EXCEPTION 0x02
+#define TMB_COM_EVENT_SEND_BUSY_EXCEPTION 0x04
+#define TMB_COM_EVENT_SEND_NAK_EXCEPTION 0x08
+#define TMB_COM_EVENT_SEND_LISTEN_ONLY 0x20
+#define TMB_COM_EVENT_LISTEN_ONLY_MODE 0x04
+#define TMB_COM_EVENT_RESTART 0x00
+
+/* exception code 7, not part of tmb_error_t */
+#define TMB_EXCEPTION_NEGATIVE_ACKNOWLEDGE 7
+
+/* sub-requests that fit a Read File Record request, the ones of a Write File Record are less */
+#define TMB_FILE_RECORD_MAX_SUB_REQUESTS (TMB_READ_FILE_RECORD_MAX_BYTE_COUNT / 7)
+
+/* private types */
+typedef struct {
+    tmb_transport_protocol_t encapsulation;
+    size_t capacity;
+    size_t size;
+    uint8_t *buffer;
+} tmb_adu_t;
+
+/* position in a list of file record groups, as they are transferred */
+typedef struct {
+    size_t index;
+    uint16_t offset;
+} tmb_file_cursor_t;
+
+/* types of the fields that follow the function code in a PDU */
+typedef enum {
+    /* terminates the list of fields */
+    TMB_FIELD_END = 0,
+
+    /* a byte, stored in an uint8_t */
+    TMB_FIELD_UINT8,
+
+    /* a big endian word, stored in an uint16_t */
+    TMB_FIELD_UINT16,
+
+    /* number of bytes of the PDU that follow it, in a byte or in a big endian word */
+    TMB_FIELD_BYTE_COUNT8,
+    TMB_FIELD_BYTE_COUNT16,
+
+    /* the rest of the PDU, referenced as bytes or as words converted in place to host order */
+    TMB_FIELD_BYTES,
+    TMB_FIELD_WORDS,
+} tmb_field_type_t;
+
+/* a field of a PDU, and the offset where it is stored in tmb_request_pdu_t or tmb_response_pdu_t */
+typedef struct {
+    uint8_t type;
+    uint8_t member;
+} tmb_field_t;
+
+/* limits of a quantity of a request */
+typedef struct {
+    /* offset of the quantity in tmb_request_pdu_t, 0 if there is no limit */
+    uint8_t member;
+    uint16_t min;
+    uint16_t max;
+
+    /* if not 0, bits taken by each value in the payload, that the byte count shall match */
+    uint8_t value_bits;
+} tmb_quantity_limit_t;
+
+#define TMB_FUNCTION_MAX_FIELDS 8
+
+/* what the codec knows about a function code */
+typedef struct {
+    /* fields of the request and of the response, after the function code */
+    tmb_field_t request[TMB_FUNCTION_MAX_FIELDS];
+    tmb_field_t response[TMB_FUNCTION_MAX_FIELDS];
+
+    tmb_quantity_limit_t quantities[2];
+
+    /* true if the function modifies the data of the server */
+    bool write;
+
+    /* checks that are not expressed by the limits, may be NULL */
+    tmb_error_t (*check_request)(const tmb_request_pdu_t *request);
+    tmb_error_t (*check_response)(const tmb_response_pdu_t *response);
+
+    /* size of a response that has no byte count, may be NULL. See tmb_get_response_size() */
+    size_t (*response_size)(const uint8_t *pdu, size_t available);
+} tmb_function_descriptor_t;
+
+/* private constants */
+
+static const uint16_t crc16_table[] = {
+    0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241, 0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1,
+    0xC481, 0x0440, 0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40, 0x0A00, 0xCAC1, 0xCB81, 0x0B40,
+    0xC901, 0x09C0, 0x0880, 0xC841, 0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40, 0x1E00, 0xDEC1,
+    0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41, 0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+    0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040, 0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1,
+    0xF281, 0x3240, 0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441, 0x3C00, 0xFCC1, 0xFD81, 0x3D40,
+    0xFF01, 0x3FC0, 0x3E80, 0xFE41, 0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840, 0x2800, 0xE8C1,
+    0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41, 0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+    0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640, 0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0,
+    0x2080, 0xE041, 0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240, 0x6600, 0xA6C1, 0xA781, 0x6740,
+    0xA501, 0x65C0, 0x6480, 0xA441, 0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41, 0xAA01, 0x6AC0,
+    0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840, 0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+    0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40, 0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1,
+    0xB681, 0x7640, 0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041, 0x5000, 0x90C1, 0x9181, 0x5140,
+    0x9301, 0x53C0, 0x5280, 0x9241, 0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440, 0x9C01, 0x5CC0,
+    0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40, 0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+    0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40, 0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0,
+    0x4C80, 0x8C41, 0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641, 0x8201, 0x42C0, 0x4380, 0x8341,
+    0x4100, 0x81C1, 0x8081, 0x4040,
+};
+
+/* private functions */
+
+static uint16_t tmb_crc16(const uint8_t *buffer, size_t buffer_size) {
+    uint16_t crc = 0xFFFF;
+
+    for (size_t i = 0; i < buffer_size; i++) {
+        uint8_t byte = buffer[i] ^ crc;
+        crc >>= 8;
+        crc ^= crc16_table[byte];
+    }
+
+    return crc;
+}
+
+static uint8_t tmb_lrc(const uint8_t *buffer, size_t buffer_size) {
+    uint8_t lrc = 0;
+    for (size_t i = 0; i < buffer_size; i++) {
+        lrc += buffer[i];
+    }
+
+    return -lrc;
+}
+
+static tmb_error_t tmb_adu_add_uint8(tmb_adu_t *adu, uint8_t data) {
+    switch (adu->encapsulation) {
+    case TMB_TRANSPORT_PROTOCOL_RTU:
+    case TMB_TRANSPORT_PROTOCOL_TCPIP:
+        TMB_ON_FALSE_RETURN(adu->size < adu->capacity, TMB_E_NO_MEMORY);
+
+        adu->buffer[adu->size++] = data;
+        break;
+    case TMB_TRANSPORT_PROTOCOL_ASCII:
+        TMB_ON_FALSE_RETURN(adu->size + 1 < adu->capacity, TMB_E_NO_MEMORY);
+        adu->buffer[adu->size++] = TMB_TO_HEX((data & 0xF0) >> 4);
+        adu->buffer[adu->size++] = TMB_TO_HEX(data & 0x0F);
+        break;
+    }
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_adu_add_uint16_be(tmb_adu_t *adu, uint16_t data) {
+    TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, (data >> 8) & 0xFF));
+    TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, data & 0xFF));
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_adu_add_uint16_le(tmb_adu_t *adu, uint16_t data) {
+    TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, data & 0xFF));
+    TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, (data >> 8) & 0xFF));
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_adu_add_bytes(tmb_adu_t *adu, const uint8_t *bytes, size_t bytes_size) {
+    TMB_ON_FALSE_RETURN(adu->capacity - adu->size >= bytes_size, TMB_E_NO_MEMORY);
+
+    memcpy(&adu->buffer[adu->size], bytes, bytes_size);
+    adu->size += bytes_size;
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_adu_init(tmb_adu_t *adu, uint8_t *buffer, size_t buffer_size,
+                                tmb_transport_protocol_t encapsulation, uint16_t transaction_identifier,
+                                uint8_t device_address) {
+    memset(adu, 0, sizeof(tmb_adu_t));
+
+    adu->encapsulation = encapsulation;
+    adu->capacity = buffer_size;
+    adu->buffer = buffer;
+
+    switch (encapsulation) {
+    case TMB_TRANSPORT_PROTOCOL_ASCII:
+        /* add ascii start byte */
+        TMB_ERROR_CHECK(tmb_adu_add_bytes(adu, TMB_ADU_ASCII_START_BYTE, sizeof(TMB_ADU_ASCII_START_BYTE)));
+
+        /* fall trough */
+    case TMB_TRANSPORT_PROTOCOL_RTU:
+        TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, device_address));
+        break;
+
+    case TMB_TRANSPORT_PROTOCOL_TCPIP:
+        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, transaction_identifier));
+        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, TMB_MODBUS_PROTOCOL_IDENTIFIER));
+
+        /* placeholder for real size, that will be populated later, when known */
+        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, 0));
+
+        TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, device_address));
+        break;
+    }
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_adu_finalize(tmb_adu_t *adu) {
+    switch (adu->encapsulation) {
+    case TMB_TRANSPORT_PROTOCOL_TCPIP: {
+        /* the length field counts the bytes that follow it, that are the unit identifier and the PDU */
+        uint16_t size = adu->size - TMB_ADU_TCPIP_SIZE_OFFSET - 2;
+
+        adu->buffer[TMB_ADU_TCPIP_SIZE_OFFSET] = (size >> 8) & 0xff;
+        adu->buffer[TMB_ADU_TCPIP_SIZE_OFFSET + 1] = size & 0xff;
+        break;
+    }
+
+    case TMB_TRANSPORT_PROTOCOL_RTU:
+        TMB_ERROR_CHECK(tmb_adu_add_uint16_le(adu, tmb_crc16(adu->buffer, adu->size)));
+        break;
+
+    case TMB_TRANSPORT_PROTOCOL_ASCII:
         TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, tmb_lrc(adu->buffer, adu->size)));
         TMB_ERROR_CHECK(tmb_adu_add_bytes(adu, TMB_ADU_ASCII_END_BYTES, sizeof(TMB_ADU_ASCII_END_BYTES)));
         break;
@@ -878,851 +3052,5759 @@ static tmb_error_t tmb_adu_finalize(tmb_adu_t *adu) {
     return TMB_SUCCESS;
 }
 
-static tmb_error_t tmb_adu_serialize_request(tmb_adu_t *adu, const tmb_request_pdu_t *request) {
-    tmb_adu_add_uint8(adu, request->function_code);
+/* checks of the functions that are not expressed by the descriptors */
+
+static tmb_error_t tmb_write_single_coil_check(const tmb_request_pdu_t *request) {
+    TMB_ON_FALSE_RETURN(request->write_single_coil.value == TMB_WRITE_SINGLE_COIL_TRUE_VALUE ||
+                                request->write_single_coil.value == TMB_WRITE_SINGLE_COIL_FALSE_VALUE,
+                        TMB_E_ILLEGAL_DATA_VALUE);
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_read_file_record_check(const tmb_request_pdu_t *request) {
+    TMB_ON_FALSE_RETURN(TMB_READ_FILE_RECORD_MIN_BYTE_COUNT <= request->read_file_record.byte_count &&
+                                request->read_file_record.byte_count <= TMB_READ_FILE_RECORD_MAX_BYTE_COUNT &&
+                                request->read_file_record.byte_count % 7 == 0,
+                        TMB_E_ILLEGAL_DATA_VALUE);
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_write_file_record_check(const tmb_request_pdu_t *request) {
+    TMB_ON_FALSE_RETURN(TMB_WRITE_FILE_RECORD_MIN_BYTE_COUNT <= request->write_file_record.byte_count &&
+                                request->write_file_record.byte_count <= TMB_WRITE_FILE_RECORD_MAX_BYTE_COUNT,
+                        TMB_E_ILLEGAL_DATA_VALUE);
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_read_device_identification_check(const tmb_request_pdu_t *request) {
+    /* other MEI types, as CANopen General Reference, are not supported */
+    TMB_ON_FALSE_RETURN(request->read_device_identification.mei_type == TMB_MEI_TYPE_READ_DEVICE_IDENTIFICATION,
+                        TMB_E_ILLEGAL_FUNCTION);
+    TMB_ON_FALSE_RETURN(TMB_READ_DEVICE_ID_BASIC <= request->read_device_identification.read_device_id_code &&
+                                request->read_device_identification.read_device_id_code <=
+                                        TMB_READ_DEVICE_ID_SPECIFIC,
+                        TMB_E_ILLEGAL_DATA_VALUE);
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_get_com_event_log_response_check(const tmb_response_pdu_t *response) {
+    TMB_ON_FALSE_RETURN(response->get_com_event_log.byte_count - 6 <= TMB_COM_EVENT_LOG_SIZE,
+                        TMB_E_INVALID_ARGUMENTS);
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_read_fifo_queue_response_check(const tmb_response_pdu_t *response) {
+    TMB_ON_FALSE_RETURN(response->read_fifo_queue.fifo_count <= TMB_READ_FIFO_QUEUE_MAX_COUNT &&
+                                response->read_fifo_queue.byte_count == 2 + response->read_fifo_queue.fifo_count * 2,
+                        TMB_E_INVALID_ARGUMENTS);
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_read_device_identification_response_check(const tmb_response_pdu_t *response) {
+    TMB_ON_FALSE_RETURN(response->read_device_identification.mei_type == TMB_MEI_TYPE_READ_DEVICE_IDENTIFICATION,
+                        TMB_E_INVALID_ARGUMENTS);
+
+    return TMB_SUCCESS;
+}
+
+static size_t tmb_read_device_identification_response_size(const uint8_t *pdu, size_t available) {
+    /* there is no byte count: the size of each object is known after receiving its id and length */
+    size_t size = 7;
+    if (available < size) {
+        return size;
+    }
+    for (uint8_t i = 0; i < pdu[6]; i++) {
+        if (available < size + 2) {
+            return size + 2;
+        }
+        size += 2 + pdu[size + 1];
+    }
+
+    return size;
+}
+
+#define TMB_REQUEST_FIELD(type, member) { TMB_FIELD_##type, offsetof(tmb_request_pdu_t, member) }
+#define TMB_RESPONSE_FIELD(type, member) { TMB_FIELD_##type, offsetof(tmb_response_pdu_t, member) }
+#define TMB_QUANTITY_LIMIT(member, min, max, value_bits) \
+    { offsetof(tmb_request_pdu_t, member), min, max, value_bits }
+
+/* the codec of the implemented function codes, indexed by function code */
+static const tmb_function_descriptor_t tmb_functions[] = {
+    [TMB_FUNCTION_READ_COILS] = {
+        .request = {
+            TMB_REQUEST_FIELD(UINT16, read_coils.start_address),
+            TMB_REQUEST_FIELD(UINT16, read_coils.quantity),
+        },
+        .response = {
+            TMB_RESPONSE_FIELD(BYTE_COUNT8, read_coils.byte_count),
+            TMB_RESPONSE_FIELD(BYTES, read_coils.coil_status),
+        },
+        .quantities = {
+            TMB_QUANTITY_LIMIT(read_coils.quantity, TMB_READ_COIL_MIN_QUANTITY, TMB_READ_COIL_MAX_QUANTITY, 0),
+        },
+    },
+    [TMB_FUNCTION_READ_DISCRETE_INPUTS] = {
+        .request = {
+            TMB_REQUEST_FIELD(UINT16, read_discrete_inputs.start_address),
+            TMB_REQUEST_FIELD(UINT16, read_discrete_inputs.quantity),
+        },
+        .response = {
+            TMB_RESPONSE_FIELD(BYTE_COUNT8, read_discrete_inputs.byte_count),
+            TMB_RESPONSE_FIELD(BYTES, read_discrete_inputs.input_status),
+        },
+        .quantities = {
+            TMB_QUANTITY_LIMIT(read_discrete_inputs.quantity, TMB_READ_DISCRETE_INPUT_MIN_QUANTITY,
+                               TMB_READ_DISCRETE_INPUT_MAX_QUANTITY, 0),
+        },
+    },
+    [TMB_FUNCTION_READ_HOLDING_REGISTERS] = {
+        .request = {
+            TMB_REQUEST_FIELD(UINT16, read_holding_registers.start_address),
+            TMB_REQUEST_FIELD(UINT16, read_holding_registers.quantity),
+        },
+        .response = {
+            TMB_RESPONSE_FIELD(BYTE_COUNT8, read_holding_registers.byte_count),
+            TMB_RESPONSE_FIELD(WORDS, read_holding_registers.register_values),
+        },
+        .quantities = {
+            TMB_QUANTITY_LIMIT(read_holding_registers.quantity, TMB_READ_HOLDING_REGISTER_MIN_QUANTITY,
+                               TMB_READ_HOLDING_REGISTER_MAX_QUANTITY, 0),
+        },
+    },
+    [TMB_FUNCTION_READ_INPUT_REGISTERS] = {
+        .request = {
+            TMB_REQUEST_FIELD(UINT16, read_input_registers.start_address),
+            TMB_REQUEST_FIELD(UINT16, read_input_registers.quantity),
+        },
+        .response = {
+            TMB_RESPONSE_FIELD(BYTE_COUNT8, read_input_registers.byte_count),
+            TMB_RESPONSE_FIELD(WORDS, read_input_registers.register_values),
+        },
+        .quantities = {
+            TMB_QUANTITY_LIMIT(read_input_registers.quantity, TMB_READ_INPUT_REGISTER_MIN_QUANTITY,
+                               TMB_READ_INPUT_REGISTER_MAX_QUANTITY, 0),
+        },
+    },
+    [TMB_FUNCTION_WRITE_SINGLE_COIL] = {
+        .request = {
+            TMB_REQUEST_FIELD(UINT16, write_single_coil.address),
+            TMB_REQUEST_FIELD(UINT16, write_single_coil.value),
+        },
+        .response = {
+            TMB_RESPONSE_FIELD(UINT16, write_single_coil.address),
+            TMB_RESPONSE_FIELD(UINT16, write_single_coil.value),
+        },
+        .write = true,
+        .check_request = tmb_write_single_coil_check,
+    },
+    [TMB_FUNCTION_WRITE_SINGLE_REGISTER] = {
+        .request = {
+            TMB_REQUEST_FIELD(UINT16, write_single_register.address),
+            TMB_REQUEST_FIELD(UINT16, write_single_register.value),
+        },
+        .response = {
+            TMB_RESPONSE_FIELD(UINT16, write_single_register.address),
+            TMB_RESPONSE_FIELD(UINT16, write_single_register.value),
+        },
+        .write = true,
+    },
+    [TMB_FUNCTION_DIAGNOSTIC] = {
+        .request = {
+            TMB_REQUEST_FIELD(UINT16, diagnostic.sub_function),
+            TMB_REQUEST_FIELD(UINT16, diagnostic.data),
+        },
+        .response = {
+            TMB_RESPONSE_FIELD(UINT16, diagnostic.sub_function),
+            TMB_RESPONSE_FIELD(UINT16, diagnostic.data),
+        },
+    },
+    [TMB_FUNCTION_GET_COM_EVENT_COUNTER] = {
+        .response = {
+            TMB_RESPONSE_FIELD(UINT16, get_com_event_counter.status),
+            TMB_RESPONSE_FIELD(UINT16, get_com_event_counter.event_count),
+        },
+    },
+    [TMB_FUNCTION_GET_COM_EVENT_LOG] = {
+        .response = {
+            TMB_RESPONSE_FIELD(BYTE_COUNT8, get_com_event_log.byte_count),
+            TMB_RESPONSE_FIELD(UINT16, get_com_event_log.status),
+            TMB_RESPONSE_FIELD(UINT16, get_com_event_log.event_count),
+            TMB_RESPONSE_FIELD(UINT16, get_com_event_log.message_count),
+            TMB_RESPONSE_FIELD(BYTES, get_com_event_log.events),
+        },
+        .check_response = tmb_get_com_event_log_response_check,
+    },
+    [TMB_FUNCTION_WRITE_MULTIPLE_COILS] = {
+        .request = {
+            TMB_REQUEST_FIELD(UINT16, write_multiple_coils.start_address),
+            TMB_REQUEST_FIELD(UINT16, write_multiple_coils.quantity),
+            TMB_REQUEST_FIELD(BYTE_COUNT8, write_multiple_coils.byte_count),
+            TMB_REQUEST_FIELD(BYTES, write_multiple_coils.values),
+        },
+        .response = {
+            TMB_RESPONSE_FIELD(UINT16, write_multiple_coils.start_address),
+            TMB_RESPONSE_FIELD(UINT16, write_multiple_coils.quantity),
+        },
+        .quantities = {
+            TMB_QUANTITY_LIMIT(write_multiple_coils.quantity, TMB_WRITE_MULTIPLE_COILS_MIN_QUANTITY,
+                               TMB_WRITE_MULTIPLE_COILS_MAX_QUANTITY, 1),
+        },
+        .write = true,
+    },
+    [TMB_FUNCTION_WRITE_MULTIPLE_REGISTERS] = {
+        .request = {
+            TMB_REQUEST_FIELD(UINT16, write_multiple_registers.start_address),
+            TMB_REQUEST_FIELD(UINT16, write_multiple_registers.quantity),
+            TMB_REQUEST_FIELD(BYTE_COUNT8, write_multiple_registers.byte_count),
+            TMB_REQUEST_FIELD(WORDS, write_multiple_registers.values),
+        },
+        .response = {
+            TMB_RESPONSE_FIELD(UINT16, write_multiple_registers.start_address),
+            TMB_RESPONSE_FIELD(UINT16, write_multiple_registers.quantity),
+        },
+        .quantities = {
+            TMB_QUANTITY_LIMIT(write_multiple_registers.quantity, TMB_WRITE_MULTIPLE_REGISTERS_MIN_QUANTITY,
+                               TMB_WRITE_MULTIPLE_REGISTERS_MAX_QUANTITY, 16),
+        },
+        .write = true,
+    },
+    [TMB_FUNCTION_READ_FILE_RECORD] = {
+        .request = {
+            TMB_REQUEST_FIELD(BYTE_COUNT8, read_file_record.byte_count),
+            TMB_REQUEST_FIELD(BYTES, read_file_record.sub_requests),
+        },
+        .response = {
+            TMB_RESPONSE_FIELD(BYTE_COUNT8, read_file_record.byte_count),
+            TMB_RESPONSE_FIELD(BYTES, read_file_record.sub_responses),
+        },
+        .check_request = tmb_read_file_record_check,
+    },
+    [TMB_FUNCTION_WRITE_FILE_RECORD] = {
+        .request = {
+            TMB_REQUEST_FIELD(BYTE_COUNT8, write_file_record.byte_count),
+            TMB_REQUEST_FIELD(BYTES, write_file_record.sub_requests),
+        },
+        .response = {
+            TMB_RESPONSE_FIELD(BYTE_COUNT8, write_file_record.byte_count),
+            TMB_RESPONSE_FIELD(BYTES, write_file_record.sub_requests),
+        },
+        .write = true,
+        .check_request = tmb_write_file_record_check,
+    },
+    [TMB_FUNCTION_MASK_WRITE_REGISTER] = {
+        .request = {
+            TMB_REQUEST_FIELD(UINT16, mask_write_register.address),
+            TMB_REQUEST_FIELD(UINT16, mask_write_register.and_mask),
+            TMB_REQUEST_FIELD(UINT16, mask_write_register.or_mask),
+        },
+        .response = {
+            TMB_RESPONSE_FIELD(UINT16, mask_write_register.address),
+            TMB_RESPONSE_FIELD(UINT16, mask_write_register.and_mask),
+            TMB_RESPONSE_FIELD(UINT16, mask_write_register.or_mask),
+        },
+        .write = true,
+    },
+    [TMB_FUNCTION_READ_WRITE_MULTIPLE_REGISTERS] = {
+        .request = {
+            TMB_REQUEST_FIELD(UINT16, read_write_multiple_registers.read_start_address),
+            TMB_REQUEST_FIELD(UINT16, read_write_multiple_registers.read_quantity),
+            TMB_REQUEST_FIELD(UINT16, read_write_multiple_registers.write_start_address),
+            TMB_REQUEST_FIELD(UINT16, read_write_multiple_registers.write_quantity),
+            TMB_REQUEST_FIELD(BYTE_COUNT8, read_write_multiple_registers.write_byte_count),
+            TMB_REQUEST_FIELD(WORDS, read_write_multiple_registers.write_values),
+        },
+        .response = {
+            TMB_RESPONSE_FIELD(BYTE_COUNT8, read_write_multiple_registers.byte_count),
+            TMB_RESPONSE_FIELD(WORDS, read_write_multiple_registers.register_values),
+        },
+        .quantities = {
+            TMB_QUANTITY_LIMIT(read_write_multiple_registers.read_quantity,
+                               TMB_READ_WRITE_MULTIPLE_REGISTERS_READ_MIN_QUANTITY,
+                               TMB_READ_WRITE_MULTIPLE_REGISTERS_READ_MAX_QUANTITY, 0),
+            TMB_QUANTITY_LIMIT(read_write_multiple_registers.write_quantity,
+                               TMB_READ_WRITE_MULTIPLE_REGISTERS_WRITE_MIN_QUANTITY,
+                               TMB_READ_WRITE_MULTIPLE_REGISTERS_WRITE_MAX_QUANTITY, 16),
+        },
+        .write = true,
+    },
+    [TMB_FUNCTION_READ_FIFO_QUEUE] = {
+        .request = {
+            TMB_REQUEST_FIELD(UINT16, read_fifo_queue.fifo_pointer_address),
+        },
+        .response = {
+            TMB_RESPONSE_FIELD(BYTE_COUNT16, read_fifo_queue.byte_count),
+            TMB_RESPONSE_FIELD(UINT16, read_fifo_queue.fifo_count),
+            TMB_RESPONSE_FIELD(WORDS, read_fifo_queue.values),
+        },
+        .check_response = tmb_read_fifo_queue_response_check,
+    },
+    [TMB_FUNCTION_ENCAPSULATED_TRANSPORT] = {
+        .request = {
+            TMB_REQUEST_FIELD(UINT8, read_device_identification.mei_type),
+            TMB_REQUEST_FIELD(UINT8, read_device_identification.read_device_id_code),
+            TMB_REQUEST_FIELD(UINT8, read_device_identification.object_id),
+        },
+        .response = {
+            TMB_RESPONSE_FIELD(UINT8, read_device_identification.mei_type),
+            TMB_RESPONSE_FIELD(UINT8, read_device_identification.read_device_id_code),
+            TMB_RESPONSE_FIELD(UINT8, read_device_identification.conformity_level),
+            TMB_RESPONSE_FIELD(UINT8, read_device_identification.more_follows),
+            TMB_RESPONSE_FIELD(UINT8, read_device_identification.next_object_id),
+            TMB_RESPONSE_FIELD(UINT8, read_device_identification.number_of_objects),
+            TMB_RESPONSE_FIELD(BYTES, read_device_identification.objects),
+        },
+        .check_request = tmb_read_device_identification_check,
+        .check_response = tmb_read_device_identification_response_check,
+        .response_size = tmb_read_device_identification_response_size,
+    },
+};
+
+static const tmb_function_descriptor_t *tmb_function_get(uint8_t function_code) {
+    if (function_code >= sizeof(tmb_functions) / sizeof(tmb_functions[0])) {
+        return NULL;
+    }
+
+    /* every response has a field, thus entries without one are function codes not implemented */
+    const tmb_function_descriptor_t *function = &tmb_functions[function_code];
+    return function->response[0].type != TMB_FIELD_END ? function : NULL;
+}
+
+static bool tmb_function_is_write(uint8_t function_code) {
+    const tmb_function_descriptor_t *function = tmb_function_get(function_code);
+    return function != NULL && function->write;
+}
+
+/**
+ * Returns the size of a PDU made of the given fields, of which the first available bytes are known. When
+ * the size depends on bytes not received yet, returns more than available: the bytes to receive before
+ * asking again. With no bytes available, returns the size of the header, up to the byte count.
+ */
+static size_t tmb_fields_size(const tmb_field_t *fields, const uint8_t *pdu, size_t available) {
+    size_t offset = 1;
+    for (; fields->type != TMB_FIELD_END; fields++) {
+        switch (fields->type) {
+        case TMB_FIELD_UINT8:
+            offset += 1;
+            break;
+
+        case TMB_FIELD_UINT16:
+            offset += 2;
+            break;
+
+        case TMB_FIELD_BYTE_COUNT8:
+            if (available < offset + 1) {
+                return offset + 1;
+            }
+            return offset + 1 + pdu[offset];
+
+        case TMB_FIELD_BYTE_COUNT16:
+            if (available < offset + 2) {
+                return offset + 2;
+            }
+            return offset + 2 + TMB_UINT16(pdu, offset);
+
+        default:
+            /* a payload always follows its byte count */
+            return offset;
+        }
+    }
+
+    return offset;
+}
+
+static size_t tmb_fields_byte_count(const tmb_field_t *fields, const void *pdu) {
+    for (; fields->type != TMB_FIELD_END; fields++) {
+        const void *member = (const uint8_t *)pdu + fields->member;
+        if (fields->type == TMB_FIELD_BYTE_COUNT8) {
+            return *(const uint8_t *)member;
+        }
+        if (fields->type == TMB_FIELD_BYTE_COUNT16) {
+            return *(const uint16_t *)member;
+        }
+    }
+
+    return 0;
+}
+
+static tmb_error_t tmb_fields_encode(tmb_adu_t *adu, const tmb_field_t *fields, const void *pdu) {
+    size_t offset = 1;
+
+    /* size of the PDU, known after its byte count */
+    size_t size = 0;
+
+    for (; fields->type != TMB_FIELD_END; fields++) {
+        const void *member = (const uint8_t *)pdu + fields->member;
+        switch (fields->type) {
+        case TMB_FIELD_UINT8:
+            TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, *(const uint8_t *)member));
+            offset += 1;
+            break;
+
+        case TMB_FIELD_UINT16:
+            TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, *(const uint16_t *)member));
+            offset += 2;
+            break;
+
+        case TMB_FIELD_BYTE_COUNT8:
+            TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, *(const uint8_t *)member));
+            offset += 1;
+            size = offset + *(const uint8_t *)member;
+            break;
+
+        case TMB_FIELD_BYTE_COUNT16:
+            TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, *(const uint16_t *)member));
+            offset += 2;
+            size = offset + *(const uint16_t *)member;
+            break;
+
+        case TMB_FIELD_BYTES:
+            TMB_ON_FALSE_RETURN(offset <= size, TMB_E_INVALID_ARGUMENTS);
+            TMB_ERROR_CHECK(tmb_adu_add_bytes(adu, *(const uint8_t *const *)member, size - offset));
+            offset = size;
+            break;
+
+        case TMB_FIELD_WORDS: {
+            TMB_ON_FALSE_RETURN(offset <= size, TMB_E_INVALID_ARGUMENTS);
+            const uint16_t *words = *(const uint16_t *const *)member;
+            for (size_t i = 0; i < (size - offset) / 2; i++) {
+                TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, words[i]));
+            }
+            offset = size;
+            break;
+        }
+        }
+    }
+
+    return TMB_SUCCESS;
+}
+
+static uint16_t *tmb_get_buffer_uint16(uint8_t *buffer, size_t buffer_size) {
+    uint16_t *result = (uint16_t *)buffer;
+
+    for (size_t i = 0; i + 1 < buffer_size; i += 2) {
+        uint16_t value = (buffer[i] << 8) | buffer[i + 1];
+
+        result[i / 2] = value;
+    }
+
+    return result;
+}
+
+static tmb_error_t tmb_fields_decode(const tmb_field_t *fields, void *pdu, uint8_t *buffer, size_t size) {
+    size_t offset = 1;
+    for (; fields->type != TMB_FIELD_END; fields++) {
+        void *member = (uint8_t *)pdu + fields->member;
+        switch (fields->type) {
+        case TMB_FIELD_UINT8:
+        case TMB_FIELD_BYTE_COUNT8:
+            TMB_ON_FALSE_RETURN(offset + 1 <= size, TMB_E_INVALID_ARGUMENTS);
+            *(uint8_t *)member = buffer[offset];
+            offset += 1;
+            break;
+
+        case TMB_FIELD_UINT16:
+        case TMB_FIELD_BYTE_COUNT16:
+            TMB_ON_FALSE_RETURN(offset + 2 <= size, TMB_E_INVALID_ARGUMENTS);
+            *(uint16_t *)member = TMB_UINT16(buffer, offset);
+            offset += 2;
+            break;
+
+        case TMB_FIELD_BYTES:
+            TMB_ON_FALSE_RETURN(offset <= size, TMB_E_INVALID_ARGUMENTS);
+            *(const uint8_t **)member = &buffer[offset];
+            offset = size;
+            break;
+
+        case TMB_FIELD_WORDS:
+            TMB_ON_FALSE_RETURN(offset <= size, TMB_E_INVALID_ARGUMENTS);
+            *(const uint16_t **)member = tmb_get_buffer_uint16(&buffer[offset], size - offset);
+            offset = size;
+            break;
+        }
+    }
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_adu_serialize_request(tmb_adu_t *adu, const tmb_request_pdu_t *request) {
+    const tmb_function_descriptor_t *function = tmb_function_get(request->function_code);
+    TMB_ON_FALSE_RETURN(function != NULL, TMB_E_ILLEGAL_FUNCTION);
+
+    TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, request->function_code));
+
+    return tmb_fields_encode(adu, function->request, request);
+}
+
+/**
+ * Returns the size of a response PDU of which the first available bytes are known. When the size
+ * depends on bytes not received yet, returns more than available: the bytes to receive before asking again.
+ */
+static size_t tmb_get_response_size(const uint8_t *pdu, size_t available) {
+    if (TMB_IS_FUNCTION_EXCEPTION_CODE(pdu[0])) {
+        /* Exception PDU has a size of 2 */
+        return 2;
+    }
+
+    const tmb_function_descriptor_t *function = tmb_function_get(pdu[0]);
+    if (function == NULL) {
+        /* nothing more to receive, parsing the response reports the unknown function */
+        return available;
+    }
+
+    if (function->response_size != NULL) {
+        return function->response_size(pdu, available);
+    }
+
+    return tmb_fields_size(function->response, pdu, available);
+}
+
+static tmb_error_t tmb_response_parse(tmb_response_pdu_t *response, uint8_t *buffer, size_t buffer_size) {
+    TMB_ON_FALSE_RETURN(buffer != NULL && buffer_size >= 2, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(!TMB_IS_FUNCTION_EXCEPTION_CODE(buffer[0]), TMB_E_INVALID_ARGUMENTS);
+
+    const tmb_function_descriptor_t *function = tmb_function_get(buffer[0]);
+    TMB_ON_FALSE_RETURN(function != NULL, TMB_E_ILLEGAL_FUNCTION);
+
+    size_t size = tmb_get_response_size(buffer, buffer_size);
+    TMB_ON_FALSE_RETURN(size <= buffer_size, TMB_E_INVALID_ARGUMENTS);
+
+    response->function_code = buffer[0];
+    TMB_ERROR_CHECK(tmb_fields_decode(function->response, response, buffer, size));
+    if (function->check_response != NULL) {
+        TMB_ERROR_CHECK(function->check_response(response));
+    }
+
+    return TMB_SUCCESS;
+}
+
+static size_t tmb_get_request_header_size(uint8_t function_code) {
+    const tmb_function_descriptor_t *function = tmb_function_get(function_code);
+    if (function == NULL) {
+        /* codes not implemented */
+        return 0;
+    }
+
+    /* the fixed fields, up to the byte count if there is one */
+    return tmb_fields_size(function->request, NULL, 0);
+}
+
+static size_t tmb_get_request_size(const uint8_t *header) {
+    /* the whole header is known, thus the size is never more than available */
+    return tmb_fields_size(tmb_functions[header[0]].request, header, SIZE_MAX);
+}
+
+static tmb_error_t tmb_request_parse(tmb_request_pdu_t *request, uint8_t *buffer, size_t buffer_size) {
+    TMB_ON_FALSE_RETURN(buffer != NULL && buffer_size >= 1, TMB_E_INVALID_ARGUMENTS);
+
+    size_t header_size = tmb_get_request_header_size(buffer[0]);
+    TMB_ON_FALSE_RETURN(header_size != 0, TMB_E_ILLEGAL_FUNCTION);
+    TMB_ON_FALSE_RETURN(header_size <= buffer_size, TMB_E_ILLEGAL_DATA_VALUE);
+    TMB_ON_FALSE_RETURN(tmb_get_request_size(buffer) == buffer_size, TMB_E_ILLEGAL_DATA_VALUE);
+
+    request->function_code = buffer[0];
+
+    return tmb_fields_decode(tmb_functions[buffer[0]].request, request, buffer, buffer_size);
+}
+
+static tmb_error_t tmb_send(tmb_handle_t *handle, const uint8_t *buffer, size_t buffer_size) {
+    TMB_LOG("sending: ");
+    for (size_t i = 0; i < buffer_size; i++) {
+        TMB_LOG("%02X ", buffer[i]);
+    }
+    TMB_LOG("\n");
+
+    size_t transmitted_bytes = 0;
+    while (transmitted_bytes < buffer_size) {
+        /* write may send less bytes than requested. In this case, repeat the operation */
+        int nbytes = handle->transport->write(handle->transport->user_data, buffer + transmitted_bytes,
+                                              buffer_size - transmitted_bytes);
+        if (nbytes <= 0) {
+            return TMB_E_TRANSPORT;
+        }
+        transmitted_bytes += nbytes;
+    }
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_receive(tmb_handle_t *handle, uint8_t *buffer, size_t buffer_size) {
+    TMB_LOG("receiving %zu bytes\n", buffer_size);
+
+    const tmb_transport_t *transport = handle->transport;
+    uint32_t timeout_us = 0;
+    if (handle->mode == TMB_MODE_CLIENT && transport->read_timeout != NULL) {
+        timeout_us = handle->client.response_timeout_us;
+    }
+
+    size_t received_bytes = 0;
+    while (received_bytes < buffer_size) {
+        /* read may return less bytes than requested. In this case, repeat the operation */
+        int nbytes;
+        if (timeout_us > 0) {
+            nbytes = transport->read_timeout(transport->user_data, buffer + received_bytes,
+                                             buffer_size - received_bytes, timeout_us);
+            TMB_ON_FALSE_RETURN(nbytes != 0, TMB_E_TIMEOUT);
+        } else {
+            nbytes = transport->read(transport->user_data, buffer + received_bytes, buffer_size - received_bytes);
+        }
+        TMB_LOG("received %d bytes\n", nbytes);
+
+        if (nbytes <= 0) {
+            return TMB_E_TRANSPORT;
+        }
+        received_bytes += nbytes;
+    }
+
+    return TMB_SUCCESS;
+}
+
+/* receives the given number of bytes, and drops them */
+static tmb_error_t tmb_receive_discard(tmb_handle_t *handle, size_t size) {
+    uint8_t discarded[16];
+    while (size > 0) {
+        size_t chunk_size = size < sizeof(discarded) ? size : sizeof(discarded);
+        TMB_ERROR_CHECK(tmb_receive(handle, discarded, chunk_size));
+        size -= chunk_size;
+    }
+
+    return TMB_SUCCESS;
+}
+
+/* public functions implementation */
+
+tmb_error_t tmb_init(tmb_handle_t *handle, tmb_mode_t mode, tmb_transport_protocol_t encapsulation, uint8_t *buffer,
+                     size_t buffer_size, const tmb_transport_t *transport) {
+    TMB_ON_FALSE_RETURN(handle != NULL, TMB_E_INVALID_ARGUMENTS);
+    memset(handle, 0, sizeof(tmb_handle_t));
+
+    TMB_ON_FALSE_RETURN(buffer != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(transport != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(transport->read != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(transport->write != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(encapsulation != TMB_TRANSPORT_PROTOCOL_ASCII, TMB_E_NOT_IMPLEMENTED);
+
+    handle->buffer = buffer;
+    handle->buffer_size = buffer_size;
+    handle->mode = mode;
+    handle->encapsulation = encapsulation;
+    handle->transport = transport;
+    handle->is_valid = true;
+
+    if (mode == TMB_MODE_CLIENT) {
+        handle->client.turnaround_delay_us = TMB_CLIENT_DEFAULT_TURNAROUND_DELAY_US;
+    }
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_rtu_get_timing(uint32_t baudrate, uint8_t bits_per_character, uint32_t *t15_us, uint32_t *t35_us) {
+    TMB_ON_FALSE_RETURN(baudrate > 0 && bits_per_character > 0, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(t15_us != NULL && t35_us != NULL, TMB_E_INVALID_ARGUMENTS);
+
+    if (baudrate > 19200) {
+        /* the standard recommends fixed values for baudrates greater than 19200 */
+        *t15_us = 750;
+        *t35_us = 1750;
+    } else {
+        *t15_us = ((uint64_t)bits_per_character * 1500000 + baudrate - 1) / baudrate;
+        *t35_us = ((uint64_t)bits_per_character * 3500000 + baudrate - 1) / baudrate;
+    }
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_rtu_discard_until_silence(const tmb_transport_t *transport) {
+    uint8_t discarded[32];
+
+    while (true) {
+        int nbytes = transport->read_timeout(transport->user_data, discarded, sizeof(discarded), transport->rtu_t35_us);
+        TMB_ON_FALSE_RETURN(nbytes >= 0, TMB_E_TRANSPORT);
+
+        if (nbytes == 0) {
+            return TMB_SUCCESS;
+        }
+    }
+}
+
+tmb_error_t tmb_rtu_receive_frame(const tmb_transport_t *transport, uint8_t *buffer, size_t buffer_size,
+                                  size_t *frame_size) {
+    TMB_ON_FALSE_RETURN(transport != NULL && buffer != NULL && frame_size != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(transport->read_timeout != NULL, TMB_E_NOT_IMPLEMENTED);
+    TMB_ON_FALSE_RETURN(transport->rtu_t15_us > 0 && transport->rtu_t35_us >= transport->rtu_t15_us,
+                        TMB_E_INVALID_ARGUMENTS);
+
+    /* wait, without timeout, for the first byte of the frame. As for tmb_receive(), a blocking read that
+     * returns nothing means that the line was closed (e.g. an USB adapter unplugged) */
+    int nbytes = transport->read(transport->user_data, buffer, buffer_size);
+    TMB_ON_FALSE_RETURN(nbytes > 0, TMB_E_TRANSPORT);
+    size_t size = nbytes;
+
+    while (true) {
+        if (size == buffer_size) {
+            /* frame too long for the buffer (or garbage on the line): discard all of it */
+            TMB_ERROR_CHECK(tmb_rtu_discard_until_silence(transport));
+
+            return TMB_E_NO_MEMORY;
+        }
+
+        nbytes = transport->read_timeout(transport->user_data, &buffer[size], buffer_size - size,
+                                         transport->rtu_t15_us);
+        TMB_ON_FALSE_RETURN(nbytes >= 0, TMB_E_TRANSPORT);
+        if (nbytes > 0) {
+            size += nbytes;
+            continue;
+        }
+
+        /* no character for t1.5: the frame ends, unless the line is not silent for the whole t3.5.
+         * Characters that arrive between t1.5 and t3.5 are kept, since buffering of the OS and of
+         * USB adapters often introduces such gaps: a frame really interrupted fails the CRC check */
+        nbytes = transport->read_timeout(transport->user_data, &buffer[size], buffer_size - size,
+                                         transport->rtu_t35_us - transport->rtu_t15_us);
+        TMB_ON_FALSE_RETURN(nbytes >= 0, TMB_E_TRANSPORT);
+        if (nbytes == 0) {
+            break;
+        }
+        size += nbytes;
+    }
+
+    TMB_ON_FALSE_RETURN(size >= 1 + 1 + TMB_ADU_CRC_LENGTH, TMB_E_INVALID_CRC);
+
+    uint16_t crc = tmb_crc16(buffer, size - TMB_ADU_CRC_LENGTH);
+    TMB_ON_FALSE_RETURN(buffer[size - 2] == (crc & 0xFF) && buffer[size - 1] == ((crc >> 8) & 0xFF),
+                        TMB_E_INVALID_CRC);
+
+    *frame_size = size;
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_request_validate(const tmb_request_pdu_t *request) {
+    TMB_ON_FALSE_RETURN(request != NULL, TMB_E_INVALID_ARGUMENTS);
+
+    const tmb_function_descriptor_t *function = tmb_function_get(request->function_code);
+    TMB_ON_FALSE_RETURN(function != NULL, TMB_E_ILLEGAL_FUNCTION);
+
+    for (size_t i = 0; i < sizeof(function->quantities) / sizeof(function->quantities[0]); i++) {
+        const tmb_quantity_limit_t *limit = &function->quantities[i];
+        if (limit->member == 0) {
+            break;
+        }
+
+        uint16_t quantity = *(const uint16_t *)((const uint8_t *)request + limit->member);
+        TMB_ON_FALSE_RETURN(limit->min <= quantity && quantity <= limit->max, TMB_E_ILLEGAL_DATA_VALUE);
+
+        /* the payload shall contain exactly the values */
+        size_t byte_count = ((size_t)quantity * limit->value_bits + 7) / 8;
+        TMB_ON_FALSE_RETURN(limit->value_bits == 0 || tmb_fields_byte_count(function->request, request) == byte_count,
+                            TMB_E_ILLEGAL_DATA_VALUE);
+    }
+
+    if (function->check_request != NULL) {
+        TMB_ERROR_CHECK(function->check_request(request));
+    }
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_client_validate_request(const tmb_request_pdu_t *request) {
+    TMB_ERROR_CHECK(tmb_request_validate(request));
+    TMB_ON_FALSE_RETURN(request->unit_id <= TMB_UNIT_ID_BROADCAST, TMB_E_INVALID_ARGUMENTS);
+
+    return TMB_SUCCESS;
+}
+
+static uint8_t tmb_client_get_device_address(const tmb_handle_t *handle, const tmb_request_pdu_t *request) {
+    if (request->unit_id == TMB_UNIT_ID_BROADCAST) {
+        return TMB_ADDRESS_BROADCAST;
+    }
+
+    return request->unit_id != TMB_UNIT_ID_DEFAULT ? request->unit_id : handle->client.device_address;
+}
+
+/* returns true if the request has no response, since it is broadcast on a serial line */
+static bool tmb_client_is_broadcast(const tmb_handle_t *handle, uint8_t device_address) {
+    return device_address == TMB_ADDRESS_BROADCAST && handle->encapsulation != TMB_TRANSPORT_PROTOCOL_TCPIP;
+}
+
+/* holds the bus after a broadcast request, while the devices process it */
+static tmb_error_t tmb_client_wait_turnaround(tmb_handle_t *handle) {
+    const tmb_transport_t *transport = handle->transport;
+    if (transport->read_timeout == NULL || handle->client.turnaround_delay_us == 0) {
+        return TMB_SUCCESS;
+    }
+
+    /* nobody shall answer: whatever is received is discarded, until the line is silent again */
+    uint8_t discarded[32];
+    uint32_t timeout_us = handle->client.turnaround_delay_us;
+    while (true) {
+        int nbytes = transport->read_timeout(transport->user_data, discarded, sizeof(discarded), timeout_us);
+        TMB_ON_FALSE_RETURN(nbytes >= 0, TMB_E_TRANSPORT);
+
+        if (nbytes == 0) {
+            return TMB_SUCCESS;
+        }
+        timeout_us = transport->rtu_t35_us > 0 ? transport->rtu_t35_us : handle->client.turnaround_delay_us;
+    }
+}
+
+static tmb_error_t tmb_client_serialize_request(tmb_handle_t *handle, const tmb_request_pdu_t *request,
+                                                uint8_t *buffer, size_t buffer_size, uint16_t *transaction_identifier,
+                                                size_t *size) {
+    /* pre-validate the request, to avoid sending invalid requests to the server */
+    TMB_ERROR_CHECK(tmb_client_validate_request(request));
+
+    uint8_t device_address = tmb_client_get_device_address(handle, request);
+
+    /* devices don't answer a broadcast on a serial line, thus it can't read anything */
+    TMB_ON_FALSE_RETURN(!tmb_client_is_broadcast(handle, device_address) ||
+                            tmb_function_is_write(request->function_code),
+                        TMB_E_INVALID_ARGUMENTS);
+
+    /* the request overwrites an ADU reserved with tmb_client_reserve_registers(), that can't be committed anymore */
+    handle->client.reserved_size = 0;
+
+    /* constructs request PDU */
+    *transaction_identifier = handle->client.last_transaction_identifier++;
+    tmb_adu_t adu;
+    TMB_ERROR_CHECK(tmb_adu_init(&adu, buffer, buffer_size, handle->encapsulation, *transaction_identifier,
+                                 device_address));
+    TMB_ERROR_CHECK(tmb_adu_serialize_request(&adu, request));
+    TMB_ERROR_CHECK(tmb_adu_finalize(&adu));
+
+    *size = adu.size;
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_client_write_request(tmb_handle_t *handle, const tmb_request_pdu_t *request,
+                                           uint16_t *transaction_identifier) {
+    size_t size = 0;
+    TMB_ERROR_CHECK(tmb_client_serialize_request(handle, request, handle->buffer, handle->buffer_size,
+                                                 transaction_identifier, &size));
+
+    /* send request to transport */
+    return tmb_send(handle, handle->buffer, size);
+}
+
+/**
+ * Reads a response in the given buffer, that the parsed response references.
+ * Stores in adu_size the number of bytes of the buffer it takes, if not NULL.
+ * If response is NULL the response is not parsed, thus the buffer is left as received.
+ */
+static tmb_error_t tmb_client_read_response(tmb_handle_t *handle, uint8_t *buffer, size_t buffer_size,
+                                            uint16_t transaction_identifier, tmb_response_pdu_t *response,
+                                            size_t *adu_size) {
+    size_t response_offset = 0;
+    if (handle->encapsulation == TMB_TRANSPORT_PROTOCOL_RTU || handle->encapsulation == TMB_TRANSPORT_PROTOCOL_ASCII) {
+        response_offset = 1;
+    } else {
+        response_offset = 7;
+    }
+
+    /* the server here processed the response. Peek 2 bytes from the response
+     * to know their status (success/failure) and size, then read the whole response */
+    TMB_ON_FALSE_RETURN(response_offset + TMB_RESPONSE_LOOKAHEAD_BYTES <= buffer_size, TMB_E_NO_MEMORY);
+    TMB_ERROR_CHECK(tmb_receive(handle, buffer, response_offset + TMB_RESPONSE_LOOKAHEAD_BYTES));
+
+    handle->statistics.bus_message_count++;
+
+    if (handle->encapsulation == TMB_TRANSPORT_PROTOCOL_TCPIP) {
+        /* a response that does not fit is skipped, to leave the connection in sync with the following ones */
+        size_t tcpip_size = TMB_ADU_TCPIP_SIZE_OFFSET + 2 + TMB_UINT16(buffer, TMB_ADU_TCPIP_SIZE_OFFSET);
+        if (tcpip_size > buffer_size) {
+            TMB_ERROR_CHECK(
+                tmb_receive_discard(handle, tcpip_size - response_offset - TMB_RESPONSE_LOOKAHEAD_BYTES));
+            return TMB_E_NO_MEMORY;
+        }
+    }
+
+    /* the size of some responses is only known after receiving more of them */
+    size_t lookahead = TMB_RESPONSE_LOOKAHEAD_BYTES;
+    size_t response_size;
+    while ((response_size = tmb_get_response_size(&buffer[response_offset], lookahead)) > lookahead) {
+        TMB_ON_FALSE_RETURN(response_offset + response_size <= buffer_size, TMB_E_NO_MEMORY);
+        TMB_ERROR_CHECK(tmb_receive(handle, &buffer[response_offset + lookahead], response_size - lookahead));
+        lookahead = response_size;
+    }
+
+    if (handle->encapsulation == TMB_TRANSPORT_PROTOCOL_RTU || handle->encapsulation == TMB_TRANSPORT_PROTOCOL_ASCII) {
+        response_size += TMB_ADU_CRC_LENGTH;
+    }
+
+    if (response_size > lookahead) {
+        TMB_ON_FALSE_RETURN(response_offset + response_size <= buffer_size, TMB_E_NO_MEMORY);
+
+        /* read remaining bytes */
+        TMB_ERROR_CHECK(tmb_receive(handle, buffer + lookahead + response_offset, response_size - lookahead));
+    }
+
+    TMB_LOG("response: ");
+    for (size_t i = 0; i < response_size + response_offset; i++) {
+        TMB_LOG("%02x ", buffer[i]);
+    }
+    TMB_LOG("\n");
+
+    if (handle->encapsulation == TMB_TRANSPORT_PROTOCOL_RTU) {
+        uint16_t crc = tmb_crc16(buffer, response_offset + response_size - TMB_ADU_CRC_LENGTH);
+        TMB_LOG("crc = %04x\n", crc);
+
+        if (buffer[response_offset + response_size - 2] != (crc & 0xFF) ||
+            buffer[response_offset + response_size - 1] != ((crc >> 8) & 0xFF)) {
+            /* the size of the response may have been read wrong: skip what remains of it */
+            if (handle->transport->read_timeout != NULL && handle->transport->rtu_t35_us > 0) {
+                TMB_ERROR_CHECK(tmb_rtu_discard_until_silence(handle->transport));
+            }
+            handle->statistics.bus_communication_error_count++;
+
+            return TMB_E_INVALID_CRC;
+        }
+    }
+
+    if (adu_size != NULL) {
+        *adu_size = response_offset + response_size;
+    }
+
+    if (handle->encapsulation == TMB_TRANSPORT_PROTOCOL_TCPIP) {
+        /* responses come in the order of the requests, even when more requests are in flight.
+         * The whole response is read anyway, to leave the connection in sync */
+        TMB_ON_FALSE_RETURN(TMB_UINT16(buffer, 0) == transaction_identifier, TMB_E_INVALID_RESPONSE);
+    }
+
+    if (TMB_IS_FUNCTION_EXCEPTION_CODE(buffer[response_offset])) {
+        /* an exception occurred. Return an error, that is the exception code returned by the server */
+        handle->statistics.exception_error_count++;
+
+        uint8_t exception_code = buffer[response_offset + 1];
+        if (response != NULL) {
+            response->function_code = buffer[response_offset];
+            response->exception.exception_code = exception_code;
+        }
+        if (exception_code != 0) {
+            return (tmb_error_t)exception_code;
+        }
+
+        /* function code says an error is occurred, but exception code is 0. Should not happen! */
+        return TMB_FAILURE;
+    }
+
+    /* now I have the whole response in the buffer. Need to parse it. */
+    if (response == NULL) {
+        return TMB_SUCCESS;
+    }
+    TMB_ERROR_CHECK(tmb_response_parse(response, &buffer[response_offset], response_size));
+    handle->statistics.event_count++;
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_client_send_request(tmb_handle_t *handle, const tmb_request_pdu_t *request,
+                                    tmb_response_pdu_t *response) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+    TMB_ON_FALSE_RETURN(request != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(response != NULL, TMB_E_INVALID_ARGUMENTS);
+
+    uint16_t transaction_identifier = 0;
+    TMB_ERROR_CHECK(tmb_client_write_request(handle, request, &transaction_identifier));
+
+    if (tmb_client_is_broadcast(handle, tmb_client_get_device_address(handle, request))) {
+        /* there is no response: return an empty one */
+        memset(response, 0, sizeof(tmb_response_pdu_t));
+        response->function_code = request->function_code;
+
+        return tmb_client_wait_turnaround(handle);
+    }
+
+    return tmb_client_read_response(handle, handle->buffer, handle->buffer_size, transaction_identifier, response,
+                                    NULL);
+}
+
+/**
+ * Tells if the client can go on with the requests after one failed with the given error, the policy of all
+ * the helpers that send more requests. Only a failure of the transport leaves nothing to talk to, while with
+ * more requests in flight a timeout leaves the connection out of sync, since the rest of the response may come.
+ */
+static bool tmb_client_is_recoverable(tmb_error_t error, bool pipelined) {
+    return error != TMB_E_TRANSPORT && (!pipelined || error != TMB_E_TIMEOUT);
+}
+
+/**
+ * Returns the largest size of the response ADU to the given request, as tmb_client_read_response()
+ * stores it. The responses whose size depends on the data of the server count as the largest PDU.
+ */
+static size_t tmb_client_get_response_max_size(const tmb_handle_t *handle, const tmb_request_pdu_t *request) {
+    size_t pdu_size;
+    switch (request->function_code) {
+    case TMB_FUNCTION_READ_COILS:
+        pdu_size = 2 + (request->read_coils.quantity + 7) / 8;
+        break;
+    case TMB_FUNCTION_READ_DISCRETE_INPUTS:
+        pdu_size = 2 + (request->read_discrete_inputs.quantity + 7) / 8;
+        break;
+    case TMB_FUNCTION_READ_HOLDING_REGISTERS:
+        pdu_size = 2 + request->read_holding_registers.quantity * 2;
+        break;
+    case TMB_FUNCTION_READ_INPUT_REGISTERS:
+        pdu_size = 2 + request->read_input_registers.quantity * 2;
+        break;
+    case TMB_FUNCTION_READ_WRITE_MULTIPLE_REGISTERS:
+        pdu_size = 2 + request->read_write_multiple_registers.read_quantity * 2;
+        break;
+    case TMB_FUNCTION_WRITE_SINGLE_COIL:
+    case TMB_FUNCTION_WRITE_SINGLE_REGISTER:
+    case TMB_FUNCTION_WRITE_MULTIPLE_COILS:
+    case TMB_FUNCTION_WRITE_MULTIPLE_REGISTERS:
+        pdu_size = 5;
+        break;
+    case TMB_FUNCTION_MASK_WRITE_REGISTER:
+        pdu_size = 7;
+        break;
+    default:
+        pdu_size = TMB_PDU_MAX_SIZE;
+        break;
+    }
+
+    if (handle->encapsulation == TMB_TRANSPORT_PROTOCOL_TCPIP) {
+        return TMB_ADU_TCPIP_HEADER_SIZE + pdu_size;
+    }
+
+    return 1 + pdu_size + TMB_ADU_CRC_LENGTH;
+}
+
+tmb_error_t tmb_client_execute_batch(tmb_handle_t *handle, const tmb_request_pdu_t *requests,
+                                     tmb_response_pdu_t *responses, size_t requests_size) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+    TMB_ON_FALSE_RETURN((requests != NULL && responses != NULL) || requests_size == 0, TMB_E_INVALID_ARGUMENTS);
+
+    /* nothing is sent if a request is not valid */
+    for (size_t i = 0; i < requests_size; i++) {
+        TMB_ERROR_CHECK(tmb_client_validate_request(&requests[i]));
+    }
+
+    /* the responses are stored one after another: nothing is sent if they may not fit */
+    size_t responses_size = 0;
+    for (size_t i = 0; i < requests_size; i++) {
+        if (!tmb_client_is_broadcast(handle, tmb_client_get_device_address(handle, &requests[i]))) {
+            responses_size += tmb_client_get_response_max_size(handle, &requests[i]);
+        }
+    }
+    TMB_ON_FALSE_RETURN(responses_size <= handle->buffer_size, TMB_E_NO_MEMORY);
+
+    bool pipelined = handle->encapsulation == TMB_TRANSPORT_PROTOCOL_TCPIP;
+    uint16_t first_transaction_identifier = handle->client.last_transaction_identifier;
+    size_t offset = 0;
+    if (pipelined) {
+        /* serialize the requests back to back, then send all of them at once */
+        for (size_t i = 0; i < requests_size; i++) {
+            uint16_t transaction_identifier = 0;
+            size_t size = 0;
+            TMB_ERROR_CHECK(tmb_client_serialize_request(handle, &requests[i], &handle->buffer[offset],
+                                                         handle->buffer_size - offset, &transaction_identifier,
+                                                         &size));
+            offset += size;
+        }
+        TMB_ERROR_CHECK(tmb_send(handle, handle->buffer, offset));
+        offset = 0;
+    }
+
+    /* each response is stored after the previous one, since the parsed responses reference the buffer */
+    tmb_error_t error = TMB_SUCCESS;
+    for (size_t i = 0; i < requests_size; i++) {
+        uint16_t transaction_identifier = first_transaction_identifier + i;
+        if (!pipelined) {
+            size_t size = 0;
+            TMB_ERROR_CHECK(tmb_client_serialize_request(handle, &requests[i], &handle->buffer[offset],
+                                                         handle->buffer_size - offset, &transaction_identifier,
+                                                         &size));
+            TMB_ERROR_CHECK(tmb_send(handle, &handle->buffer[offset], size));
+
+            if (tmb_client_is_broadcast(handle, tmb_client_get_device_address(handle, &requests[i]))) {
+                memset(&responses[i], 0, sizeof(tmb_response_pdu_t));
+                responses[i].function_code = requests[i].function_code;
+                TMB_ERROR_CHECK(tmb_client_wait_turnaround(handle));
+                continue;
+            }
+        }
+
+        size_t size = 0;
+        tmb_error_t response_error = tmb_client_read_response(handle, &handle->buffer[offset],
+                                                              handle->buffer_size - offset, transaction_identifier,
+                                                              &responses[i], &size);
+        if (error == TMB_SUCCESS) {
+            error = response_error;
+        }
+        if (!tmb_client_is_recoverable(response_error, pipelined)) {
+            return error;
+        }
+
+        offset += size;
+    }
+
+    return error;
+}
+
+tmb_error_t tmb_client_set_device_address(tmb_handle_t *handle, uint8_t address) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+
+    handle->client.device_address = address;
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_client_set_turnaround_delay(tmb_handle_t *handle, uint32_t delay_us) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+
+    handle->client.turnaround_delay_us = delay_us;
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_client_set_response_timeout(tmb_handle_t *handle, uint32_t timeout_us) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+
+    handle->client.response_timeout_us = timeout_us;
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_client_fan_out(tmb_handle_t *handle, const tmb_request_pdu_t *request, const uint8_t *unit_ids,
+                               size_t unit_ids_size, tmb_error_t *errors) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+    TMB_ON_FALSE_RETURN(request != NULL && tmb_function_is_write(request->function_code), TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(unit_ids != NULL || unit_ids_size == 0, TMB_E_INVALID_ARGUMENTS);
+
+    tmb_request_pdu_t unit_request = *request;
+    tmb_response_pdu_t response;
+    if (unit_ids == NULL) {
+        /* only serial lines have broadcast requests without a response */
+        TMB_ON_FALSE_RETURN(handle->encapsulation != TMB_TRANSPORT_PROTOCOL_TCPIP, TMB_E_INVALID_ARGUMENTS);
+
+        unit_request.unit_id = TMB_UNIT_ID_BROADCAST;
+        return tmb_client_send_request(handle, &unit_request, &response);
+    }
+
+    tmb_error_t error = TMB_SUCCESS;
+    for (size_t i = 0; i < unit_ids_size; i++) {
+        /* the unit identifier 0 is the broadcast address, not the default one */
+        unit_request.unit_id = unit_ids[i] != TMB_ADDRESS_BROADCAST ? unit_ids[i] : TMB_UNIT_ID_BROADCAST;
+        tmb_error_t unit_error = tmb_client_send_request(handle, &unit_request, &response);
+        if (errors != NULL) {
+            errors[i] = unit_error;
+        }
+        if (error == TMB_SUCCESS) {
+            error = unit_error;
+        }
+        if (!tmb_client_is_recoverable(unit_error, false)) {
+            /* the transport failed: the remaining units can't be reached either */
+            return error;
+        }
+    }
+
+    return error;
+}
+
+tmb_error_t tmb_read_coils(tmb_handle_t *handle, uint16_t start_address, uint16_t quantity, uint8_t *values) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(values != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+
+    tmb_request_pdu_t request = {
+        .function_code = TMB_FUNCTION_READ_COILS,
+        .read_coils = {
+            .start_address = start_address,
+            .quantity = quantity,
+        },
+    };
+
+    tmb_response_pdu_t response;
+    TMB_ERROR_CHECK(tmb_client_send_request(handle, &request, &response));
+
+    memcpy(values, response.read_coils.coil_status, response.read_coils.byte_count);
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_read_discrete_inputs(tmb_handle_t *handle, uint16_t start_address, uint16_t quantity, uint8_t *values) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(values != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+
+    tmb_request_pdu_t request = {
+        .function_code = TMB_FUNCTION_READ_DISCRETE_INPUTS,
+        .read_discrete_inputs = {
+            .start_address = start_address,
+            .quantity = quantity,
+        },
+    };
+
+    tmb_response_pdu_t response;
+    TMB_ERROR_CHECK(tmb_client_send_request(handle, &request, &response));
+
+    memcpy(values, response.read_discrete_inputs.input_status, response.read_discrete_inputs.byte_count);
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_read_holding_registers(tmb_handle_t *handle, uint16_t start_address, uint16_t quantity,
+                                       uint16_t *values) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(values != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+
+    tmb_request_pdu_t request = {
+        .function_code = TMB_FUNCTION_READ_HOLDING_REGISTERS,
+        .read_holding_registers = {
+            .start_address = start_address,
+            .quantity = quantity,
+        },
+    };
+
+    tmb_response_pdu_t response;
+    TMB_ERROR_CHECK(tmb_client_send_request(handle, &request, &response));
+
+    memcpy(values, response.read_holding_registers.register_values, response.read_holding_registers.byte_count);
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_read_input_registers(tmb_handle_t *handle, uint16_t start_address, uint16_t quantity,
+                                     uint16_t *values) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(values != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+
+    tmb_request_pdu_t request = {
+        .function_code = TMB_FUNCTION_READ_INPUT_REGISTERS,
+        .read_input_registers = {
+            .quantity = quantity,
+            .start_address = start_address,
+        },
+    };
+
+    tmb_response_pdu_t response;
+    TMB_ERROR_CHECK(tmb_client_send_request(handle, &request, &response));
+
+    memcpy(values, response.read_input_registers.register_values, response.read_holding_registers.byte_count);
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_write_single_coil(tmb_handle_t *handle, uint16_t address, uint16_t value) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+
+    tmb_request_pdu_t request = {
+        .function_code = TMB_FUNCTION_WRITE_SINGLE_COIL,
+        .write_single_coil = {
+            .address = address,
+            .value = value,
+        },
+    };
+
+    tmb_response_pdu_t response;
+    TMB_ERROR_CHECK(tmb_client_send_request(handle, &request, &response));
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_write_single_register(tmb_handle_t *handle, uint16_t address, uint16_t value) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+
+    tmb_request_pdu_t request = {
+        .function_code = TMB_FUNCTION_WRITE_SINGLE_REGISTER,
+        .write_single_register = {
+            .address = address,
+            .value = value,
+        },
+    };
+
+    tmb_response_pdu_t response;
+    TMB_ERROR_CHECK(tmb_client_send_request(handle, &request, &response));
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_write_multiple_coils(tmb_handle_t *handle, uint16_t start_address, uint16_t quantity,
+                                     const uint8_t *values) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+
+    tmb_request_pdu_t request = {
+        .function_code = TMB_FUNCTION_WRITE_MULTIPLE_COILS,
+        .write_multiple_coils = {
+            .start_address = start_address,
+            .quantity = quantity,
+            .byte_count = quantity / 8 + (quantity % 8 != 0),
+            .values = values,
+        },
+    };
+
+    tmb_response_pdu_t response;
+    TMB_ERROR_CHECK(tmb_client_send_request(handle, &request, &response));
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_write_multiple_registers(tmb_handle_t *handle, uint16_t start_address, uint16_t quantity,
+                                         const uint16_t *values) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+
+    tmb_request_pdu_t request = {
+        .function_code = TMB_FUNCTION_WRITE_MULTIPLE_REGISTERS,
+        .write_multiple_registers = {
+            .start_address = start_address,
+            .quantity = quantity,
+            .byte_count = quantity * 2,
+            .values = values,
+        },
+    };
+
+    tmb_response_pdu_t response;
+    TMB_ERROR_CHECK(tmb_client_send_request(handle, &request, &response));
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_client_reserve_registers(tmb_handle_t *handle, uint16_t unit_id, tmb_function_t function_code,
+                                         uint16_t start_address, uint16_t quantity, uint8_t **payload) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+    TMB_ON_FALSE_RETURN(payload != NULL, TMB_E_INVALID_ARGUMENTS);
+
+    /* the values of an ASCII ADU are hex encoded, thus they cannot be written in place */
+    TMB_ON_FALSE_RETURN(handle->encapsulation != TMB_TRANSPORT_PROTOCOL_ASCII, TMB_E_NOT_IMPLEMENTED);
+
+    tmb_request_pdu_t request = { .function_code = function_code, .unit_id = unit_id };
+    switch (function_code) {
+    case TMB_FUNCTION_WRITE_MULTIPLE_COILS:
+        request.write_multiple_coils.start_address = start_address;
+        request.write_multiple_coils.quantity = quantity;
+        request.write_multiple_coils.byte_count = (quantity + 7) / 8;
+        break;
+
+    case TMB_FUNCTION_WRITE_MULTIPLE_REGISTERS:
+        request.write_multiple_registers.start_address = start_address;
+        request.write_multiple_registers.quantity = quantity;
+        request.write_multiple_registers.byte_count = quantity * 2;
+        break;
+
+    default:
+        return TMB_E_INVALID_ARGUMENTS;
+    }
+
+    /* the values are not known yet, but their size is */
+    TMB_ERROR_CHECK(tmb_client_validate_request(&request));
+
+    /* both requests have the same layout: start address, quantity, byte count and values */
+    uint16_t transaction_identifier = handle->client.last_transaction_identifier++;
+    uint8_t byte_count = request.write_multiple_registers.byte_count;
+    tmb_adu_t adu;
+    TMB_ERROR_CHECK(tmb_adu_init(&adu, handle->buffer, handle->buffer_size, handle->encapsulation,
+                                 transaction_identifier, tmb_client_get_device_address(handle, &request)));
+    TMB_ERROR_CHECK(tmb_adu_add_uint8(&adu, function_code));
+    TMB_ERROR_CHECK(tmb_adu_add_uint16_be(&adu, start_address));
+    TMB_ERROR_CHECK(tmb_adu_add_uint16_be(&adu, quantity));
+    TMB_ERROR_CHECK(tmb_adu_add_uint8(&adu, byte_count));
+
+    /* leave room for the CRC, added by the commit */
+    TMB_ON_FALSE_RETURN(adu.size + byte_count + TMB_ADU_CRC_LENGTH <= adu.capacity, TMB_E_NO_MEMORY);
+
+    *payload = &adu.buffer[adu.size];
+    handle->client.reserved_size = adu.size + byte_count;
+    handle->client.reserved_transaction_identifier = transaction_identifier;
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_client_commit_registers(tmb_handle_t *handle) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+    TMB_ON_FALSE_RETURN(handle->client.reserved_size != 0, TMB_E_INVALID_ARGUMENTS);
+
+    tmb_adu_t adu = {
+        .encapsulation = handle->encapsulation,
+        .capacity = handle->buffer_size,
+        .size = handle->client.reserved_size,
+        .buffer = handle->buffer,
+    };
+    handle->client.reserved_size = 0;
+
+    /* the response echoes the start address and the quantity, that follow the function code */
+    size_t pdu_offset = handle->encapsulation == TMB_TRANSPORT_PROTOCOL_TCPIP ? TMB_ADU_TCPIP_HEADER_SIZE : 1;
+    uint16_t start_address = TMB_UINT16(adu.buffer, pdu_offset + 1);
+    uint16_t quantity = TMB_UINT16(adu.buffer, pdu_offset + 3);
+
+    /* the device address, or the unit identifier on TCP/IP, precedes the function code */
+    uint8_t device_address = adu.buffer[pdu_offset - 1];
+
+    /* the payload is in place: only the CRC or the MBAP length is missing */
+    TMB_ERROR_CHECK(tmb_adu_finalize(&adu));
+    TMB_ERROR_CHECK(tmb_send(handle, adu.buffer, adu.size));
+
+    if (tmb_client_is_broadcast(handle, device_address)) {
+        return tmb_client_wait_turnaround(handle);
+    }
+
+    /* both responses have the same layout */
+    tmb_response_pdu_t response;
+    TMB_ERROR_CHECK(tmb_client_read_response(handle, handle->buffer, handle->buffer_size,
+                                             handle->client.reserved_transaction_identifier, &response, NULL));
+    TMB_ON_FALSE_RETURN(response.write_multiple_registers.start_address == start_address &&
+                                response.write_multiple_registers.quantity == quantity,
+                        TMB_E_INVALID_RESPONSE);
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_read_write_multiple_registers(tmb_handle_t *handle, uint16_t read_start_address,
+                                              uint16_t read_quantity, uint16_t *read_values,
+                                              uint16_t write_start_address, uint16_t write_quantity,
+                                              const uint16_t *write_values) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(read_values != NULL && write_values != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+
+    tmb_request_pdu_t request = {
+        .function_code = TMB_FUNCTION_READ_WRITE_MULTIPLE_REGISTERS,
+        .read_write_multiple_registers = {
+            .read_start_address = read_start_address,
+            .read_quantity = read_quantity,
+            .write_start_address = write_start_address,
+            .write_quantity = write_quantity,
+            .write_byte_count = write_quantity * 2,
+            .write_values = write_values,
+        },
+    };
+
+    tmb_response_pdu_t response;
+    TMB_ERROR_CHECK(tmb_client_send_request(handle, &request, &response));
+    TMB_ON_FALSE_RETURN(response.read_write_multiple_registers.byte_count == read_quantity * 2,
+                        TMB_E_INVALID_RESPONSE);
+
+    memcpy(read_values, response.read_write_multiple_registers.register_values,
+           response.read_write_multiple_registers.byte_count);
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_mask_write_register(tmb_handle_t *handle, uint16_t address, uint16_t and_mask, uint16_t or_mask) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+
+    tmb_request_pdu_t request = {
+        .function_code = TMB_FUNCTION_MASK_WRITE_REGISTER,
+        .mask_write_register = {
+            .address = address,
+            .and_mask = and_mask,
+            .or_mask = or_mask,
+        },
+    };
+
+    tmb_response_pdu_t response;
+    TMB_ERROR_CHECK(tmb_client_send_request(handle, &request, &response));
+
+    return TMB_SUCCESS;
+}
+
+static size_t tmb_file_records_pack(const tmb_file_record_t *records, size_t records_size, bool write,
+                                    tmb_file_cursor_t *cursor, tmb_file_record_t *chunks) {
+    size_t chunks_size = 0;
+    size_t request_bytes = 0;
+    size_t response_bytes = 0;
+
+    while (cursor->index < records_size) {
+        const tmb_file_record_t *record = &records[cursor->index];
+        if (cursor->offset == record->record_length) {
+            cursor->index++;
+            cursor->offset = 0;
+            continue;
+        }
+
+        /* each sub-request takes 7 bytes plus, when writing, its data. Each sub-response 2 bytes plus its data */
+        size_t available = 0;
+        if (write) {
+            if (request_bytes + 7 + 2 > TMB_WRITE_FILE_RECORD_MAX_BYTE_COUNT) {
+                break;
+            }
+            available = (TMB_WRITE_FILE_RECORD_MAX_BYTE_COUNT - request_bytes - 7) / 2;
+        } else {
+            if (request_bytes + 7 > TMB_READ_FILE_RECORD_MAX_BYTE_COUNT ||
+                response_bytes + 2 + 2 > TMB_READ_FILE_RECORD_MAX_BYTE_COUNT) {
+                break;
+            }
+            available = (TMB_READ_FILE_RECORD_MAX_BYTE_COUNT - response_bytes - 2) / 2;
+        }
+
+        uint16_t length = record->record_length - cursor->offset;
+        if (length > available) {
+            length = available;
+        }
+
+        tmb_file_record_t *chunk = &chunks[chunks_size++];
+        chunk->file_number = record->file_number;
+        chunk->record_number = record->record_number + cursor->offset;
+        chunk->record_length = length;
+        chunk->values = &record->values[cursor->offset];
+
+        request_bytes += write ? 7 + length * 2 : 7;
+        response_bytes += 2 + length * 2;
+        cursor->offset += length;
+    }
+
+    return chunks_size;
+}
+
+static tmb_error_t tmb_file_records_encode(const tmb_file_record_t *chunks, size_t chunks_size, bool write,
+                                           uint8_t *buffer, size_t buffer_size, uint8_t *byte_count) {
+    tmb_adu_t sub_requests = {
+        .capacity = buffer_size,
+        .buffer = buffer,
+    };
+
+    for (size_t i = 0; i < chunks_size; i++) {
+        TMB_ERROR_CHECK(tmb_adu_add_uint8(&sub_requests, TMB_FILE_RECORD_REFERENCE_TYPE));
+        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(&sub_requests, chunks[i].file_number));
+        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(&sub_requests, chunks[i].record_number));
+        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(&sub_requests, chunks[i].record_length));
+        for (uint16_t j = 0; write && j < chunks[i].record_length; j++) {
+            TMB_ERROR_CHECK(tmb_adu_add_uint16_be(&sub_requests, chunks[i].values[j]));
+        }
+    }
+    *byte_count = sub_requests.size;
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_file_records_decode(const tmb_file_record_t *chunks, size_t chunks_size,
+                                           const tmb_response_pdu_t *response) {
+    const uint8_t *sub_responses = response->read_file_record.sub_responses;
+    size_t offset = 0;
+
+    for (size_t i = 0; i < chunks_size; i++) {
+        size_t length = 1 + chunks[i].record_length * 2;
+        TMB_ON_FALSE_RETURN(offset + 1 + length <= response->read_file_record.byte_count, TMB_E_INVALID_RESPONSE);
+        TMB_ON_FALSE_RETURN(sub_responses[offset] == length, TMB_E_INVALID_RESPONSE);
+        TMB_ON_FALSE_RETURN(sub_responses[offset + 1] == TMB_FILE_RECORD_REFERENCE_TYPE, TMB_E_INVALID_RESPONSE);
+
+        for (uint16_t j = 0; j < chunks[i].record_length; j++) {
+            chunks[i].values[j] = TMB_UINT16(sub_responses, offset + 2 + j * 2);
+        }
+        offset += 1 + length;
+    }
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_client_transfer_file_records(tmb_handle_t *handle, uint8_t function_code,
+                                                    const tmb_file_record_t *records, size_t records_size) {
+    bool write = function_code == TMB_FUNCTION_WRITE_FILE_RECORD;
+    size_t depth = handle->encapsulation == TMB_TRANSPORT_PROTOCOL_TCPIP ? TMB_CLIENT_PIPELINE_DEPTH : 1;
+
+    /* position of each request in flight, to know where to store its response */
+    tmb_file_cursor_t in_flight[TMB_CLIENT_PIPELINE_DEPTH];
+    uint16_t transaction_identifiers[TMB_CLIENT_PIPELINE_DEPTH];
+    size_t head = 0;
+    size_t count = 0;
+
+    tmb_file_cursor_t cursor = { 0 };
+    tmb_file_record_t chunks[TMB_FILE_RECORD_MAX_SUB_REQUESTS];
+    uint8_t sub_requests[TMB_WRITE_FILE_RECORD_MAX_BYTE_COUNT];
+    tmb_error_t error = TMB_SUCCESS;
+
+    while (true) {
+        while (error == TMB_SUCCESS && count < depth) {
+            tmb_file_cursor_t start = cursor;
+            size_t chunks_size = tmb_file_records_pack(records, records_size, write, &cursor, chunks);
+            if (chunks_size == 0) {
+                break;
+            }
+
+            uint8_t byte_count = 0;
+            error = tmb_file_records_encode(chunks, chunks_size, write, sub_requests, sizeof(sub_requests),
+                                            &byte_count);
+            if (error != TMB_SUCCESS) {
+                break;
+            }
+
+            tmb_request_pdu_t request = { .function_code = function_code };
+            if (write) {
+                request.write_file_record.byte_count = byte_count;
+                request.write_file_record.sub_requests = sub_requests;
+            } else {
+                request.read_file_record.byte_count = byte_count;
+                request.read_file_record.sub_requests = sub_requests;
+            }
+
+            size_t slot = (head + count) % depth;
+            in_flight[slot] = start;
+            error = tmb_client_write_request(handle, &request, &transaction_identifiers[slot]);
+            if (error != TMB_SUCCESS) {
+                break;
+            }
+            count++;
+        }
+
+        if (count == 0) {
+            return error;
+        }
+
+        /* after an error, the responses still in flight are drained, to leave the connection in sync */
+        tmb_response_pdu_t response;
+        tmb_error_t response_error = tmb_client_read_response(handle, handle->buffer, handle->buffer_size,
+                                                              transaction_identifiers[head], &response, NULL);
+        if (response_error == TMB_SUCCESS && !write) {
+            tmb_file_cursor_t start = in_flight[head];
+            size_t chunks_size = tmb_file_records_pack(records, records_size, write, &start, chunks);
+            response_error = tmb_file_records_decode(chunks, chunks_size, &response);
+        }
+        if (error == TMB_SUCCESS) {
+            error = response_error;
+        }
+        if (!tmb_client_is_recoverable(response_error, depth > 1)) {
+            return error;
+        }
+
+        head = (head + 1) % depth;
+        count--;
+    }
+}
+
+tmb_error_t tmb_read_file_records(tmb_handle_t *handle, const tmb_file_record_t *records, size_t records_size) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(records != NULL || records_size == 0, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+
+    return tmb_client_transfer_file_records(handle, TMB_FUNCTION_READ_FILE_RECORD, records, records_size);
+}
+
+tmb_error_t tmb_write_file_records(tmb_handle_t *handle, const tmb_file_record_t *records, size_t records_size) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(records != NULL || records_size == 0, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+
+    return tmb_client_transfer_file_records(handle, TMB_FUNCTION_WRITE_FILE_RECORD, records, records_size);
+}
+
+tmb_error_t tmb_read_file(tmb_handle_t *handle, uint16_t file_number, uint16_t record_number, uint16_t quantity,
+                          uint16_t *values) {
+    TMB_ON_FALSE_RETURN(values != NULL, TMB_E_INVALID_ARGUMENTS);
+
+    tmb_file_record_t record = {
+        .file_number = file_number,
+        .record_number = record_number,
+        .record_length = quantity,
+        .values = values,
+    };
+
+    return tmb_read_file_records(handle, &record, 1);
+}
+
+tmb_error_t tmb_write_file(tmb_handle_t *handle, uint16_t file_number, uint16_t record_number, uint16_t quantity,
+                           const uint16_t *values) {
+    TMB_ON_FALSE_RETURN(values != NULL, TMB_E_INVALID_ARGUMENTS);
+
+    /* values are only read when writing */
+    tmb_file_record_t record = {
+        .file_number = file_number,
+        .record_number = record_number,
+        .record_length = quantity,
+        .values = (uint16_t *)values,
+    };
+
+    return tmb_write_file_records(handle, &record, 1);
+}
+
+tmb_error_t tmb_read_fifo_queue(tmb_handle_t *handle, uint16_t fifo_address, uint16_t *values, uint16_t *count) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(values != NULL && count != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+
+    tmb_request_pdu_t request = {
+        .function_code = TMB_FUNCTION_READ_FIFO_QUEUE,
+        .read_fifo_queue = {
+            .fifo_pointer_address = fifo_address,
+        },
+    };
+
+    tmb_response_pdu_t response;
+    TMB_ERROR_CHECK(tmb_client_send_request(handle, &request, &response));
+
+    *count = response.read_fifo_queue.fifo_count;
+    memcpy(values, response.read_fifo_queue.values, response.read_fifo_queue.fifo_count * sizeof(uint16_t));
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_fifo_ring_init(tmb_fifo_ring_t *ring, uint16_t *values, size_t capacity) {
+    TMB_ON_FALSE_RETURN(ring != NULL && values != NULL && capacity > 0, TMB_E_INVALID_ARGUMENTS);
+
+    memset(ring, 0, sizeof(tmb_fifo_ring_t));
+    ring->values = values;
+    ring->capacity = capacity;
+
+    return TMB_SUCCESS;
+}
+
+size_t tmb_fifo_ring_size(const tmb_fifo_ring_t *ring) {
+    return ring->write_count - ring->read_count;
+}
+
+size_t tmb_fifo_ring_pop(tmb_fifo_ring_t *ring, uint16_t *values, size_t max_count) {
+    size_t count = 0;
+    while (count < max_count && ring->read_count != ring->write_count) {
+        values[count++] = ring->values[ring->read_count++ % ring->capacity];
+    }
+
+    return count;
+}
+
+tmb_error_t tmb_drain_fifo_queue(tmb_handle_t *handle, uint16_t fifo_address, tmb_fifo_ring_t *ring,
+                                 size_t *drained) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(ring != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+
+    size_t depth = handle->encapsulation == TMB_TRANSPORT_PROTOCOL_TCPIP ? TMB_CLIENT_PIPELINE_DEPTH : 1;
+    uint16_t transaction_identifiers[TMB_CLIENT_PIPELINE_DEPTH];
+    size_t head = 0;
+    size_t count = 0;
+    size_t total = 0;
+    bool empty = false;
+    tmb_error_t error = TMB_SUCCESS;
+
+    tmb_request_pdu_t request = {
+        .function_code = TMB_FUNCTION_READ_FIFO_QUEUE,
+        .read_fifo_queue = {
+            .fifo_pointer_address = fifo_address,
+        },
+    };
+
+    while (true) {
+        /* every read in flight may return a full response: issue one only if the ring can store all of them */
+        while (error == TMB_SUCCESS && !empty && count < depth &&
+               ring->capacity - tmb_fifo_ring_size(ring) >= (count + 1) * TMB_READ_FIFO_QUEUE_MAX_COUNT) {
+            /* on failure the reads in flight are still received below, to leave the connection in sync */
+            error = tmb_client_write_request(handle, &request, &transaction_identifiers[(head + count) % depth]);
+            if (error != TMB_SUCCESS) {
+                break;
+            }
+            count++;
+        }
+
+        if (count == 0) {
+            break;
+        }
+
+        tmb_response_pdu_t response;
+        tmb_error_t response_error = tmb_client_read_response(handle, handle->buffer, handle->buffer_size,
+                                                              transaction_identifiers[head], &response, NULL);
+        if (response_error == TMB_SUCCESS) {
+            for (uint16_t i = 0; i < response.read_fifo_queue.fifo_count; i++) {
+                ring->values[ring->write_count++ % ring->capacity] = response.read_fifo_queue.values[i];
+            }
+            total += response.read_fifo_queue.fifo_count;
+
+            /* a response that is not full means that the queue was emptied */
+            empty = empty || response.read_fifo_queue.fifo_count < TMB_READ_FIFO_QUEUE_MAX_COUNT;
+        } else if (error == TMB_SUCCESS) {
+            error = response_error;
+        }
+        if (!tmb_client_is_recoverable(response_error, depth > 1)) {
+            break;
+        }
+
+        head = (head + 1) % depth;
+        count--;
+    }
+
+    if (drained != NULL) {
+        *drained = total;
+    }
+
+    return error;
+}
+
+tmb_error_t tmb_read_device_identification(tmb_handle_t *handle, uint8_t read_device_id_code, uint8_t object_id,
+                                           tmb_device_identification_object_t *objects, size_t *objects_size,
+                                           char *values, size_t values_size) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(objects != NULL && objects_size != NULL && values != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+
+    tmb_request_pdu_t request = {
+        .function_code = TMB_FUNCTION_ENCAPSULATED_TRANSPORT,
+        .read_device_identification = {
+            .mei_type = TMB_MEI_TYPE_READ_DEVICE_IDENTIFICATION,
+            .read_device_id_code = read_device_id_code,
+            .object_id = object_id,
+        },
+    };
+
+    size_t capacity = *objects_size;
+    size_t values_used = 0;
+    bool more_follows;
+    *objects_size = 0;
+    do {
+        tmb_response_pdu_t response;
+        TMB_ERROR_CHECK(tmb_client_send_request(handle, &request, &response));
+
+        /* copy the objects out of the handle buffer, that the next request overwrites */
+        const uint8_t *object = response.read_device_identification.objects;
+        for (uint8_t i = 0; i < response.read_device_identification.number_of_objects; i++) {
+            uint8_t length = object[1];
+            TMB_ON_FALSE_RETURN(*objects_size < capacity && values_used + length + 1 <= values_size, TMB_E_NO_MEMORY);
+
+            memcpy(&values[values_used], &object[2], length);
+            values[values_used + length] = '\0';
+            objects[*objects_size].id = object[0];
+            objects[*objects_size].length = length;
+            objects[*objects_size].value = &values[values_used];
+
+            (*objects_size)++;
+            values_used += length + 1;
+            object += 2 + length;
+        }
+
+        more_follows = read_device_id_code != TMB_READ_DEVICE_ID_SPECIFIC &&
+                       response.read_device_identification.more_follows == TMB_DEVICE_IDENTIFICATION_MORE_FOLLOWS;
+        if (more_follows) {
+            /* the stream shall advance at each response, otherwise it would never end */
+            TMB_ON_FALSE_RETURN(response.read_device_identification.number_of_objects > 0 &&
+                                        response.read_device_identification.next_object_id >
+                                                objects[*objects_size - 1].id,
+                                TMB_E_INVALID_RESPONSE);
+            request.read_device_identification.object_id = response.read_device_identification.next_object_id;
+        }
+    } while (more_follows);
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_diagnostic(tmb_handle_t *handle, uint16_t sub_function, uint16_t data, uint16_t *result) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+
+    tmb_request_pdu_t request = {
+        .function_code = TMB_FUNCTION_DIAGNOSTIC,
+        .diagnostic = {
+            .sub_function = sub_function,
+            .data = data,
+        },
+    };
+
+    tmb_response_pdu_t response;
+    TMB_ERROR_CHECK(tmb_client_send_request(handle, &request, &response));
+    TMB_ON_FALSE_RETURN(response.diagnostic.sub_function == sub_function, TMB_E_INVALID_RESPONSE);
+
+    if (result != NULL) {
+        *result = response.diagnostic.data;
+    }
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_get_com_event_counter(tmb_handle_t *handle, uint16_t *status, uint16_t *event_count) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(status != NULL && event_count != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+
+    tmb_request_pdu_t request = {
+        .function_code = TMB_FUNCTION_GET_COM_EVENT_COUNTER,
+    };
+
+    tmb_response_pdu_t response;
+    TMB_ERROR_CHECK(tmb_client_send_request(handle, &request, &response));
+
+    *status = response.get_com_event_counter.status;
+    *event_count = response.get_com_event_counter.event_count;
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_get_com_event_log(tmb_handle_t *handle, tmb_com_event_log_t *log) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(log != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+
+    tmb_request_pdu_t request = {
+        .function_code = TMB_FUNCTION_GET_COM_EVENT_LOG,
+    };
+
+    tmb_response_pdu_t response;
+    TMB_ERROR_CHECK(tmb_client_send_request(handle, &request, &response));
+
+    log->status = response.get_com_event_log.status;
+    log->event_count = response.get_com_event_log.event_count;
+    log->message_count = response.get_com_event_log.message_count;
+    log->events_size = response.get_com_event_log.byte_count - 6;
+    memcpy(log->events, response.get_com_event_log.events, log->events_size);
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_get_statistics(const tmb_handle_t *handle, tmb_statistics_t *statistics) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(statistics != NULL, TMB_E_INVALID_ARGUMENTS);
+
+    *statistics = handle->statistics;
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_clear_statistics(tmb_handle_t *handle) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+
+    memset(&handle->statistics, 0, sizeof(handle->statistics));
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_register_bank_check_range(const tmb_register_bank_t *bank, uint16_t start_address,
+                                                 uint16_t quantity) {
+    TMB_ON_FALSE_RETURN(start_address >= bank->start_address, TMB_E_ILLEGAL_DATA_ADDRESS);
+    TMB_ON_FALSE_RETURN((uint32_t)start_address - bank->start_address + quantity <= bank->quantity,
+                        TMB_E_ILLEGAL_DATA_ADDRESS);
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_register_bank_init(tmb_register_bank_t *bank, uint16_t start_address, uint16_t *registers,
+                                   uint32_t quantity) {
+    TMB_ON_FALSE_RETURN(bank != NULL && registers != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN((uint32_t)start_address + quantity <= UINT16_MAX + 1, TMB_E_INVALID_ARGUMENTS);
+
+    memset(bank, 0, sizeof(tmb_register_bank_t));
+    bank->start_address = start_address;
+    bank->quantity = quantity;
+    bank->registers = registers;
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_register_bank_read(tmb_register_bank_t *bank, uint16_t start_address, uint16_t quantity,
+                                   uint16_t *values) {
+    TMB_ON_FALSE_RETURN(bank != NULL && values != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ERROR_CHECK(tmb_register_bank_check_range(bank, start_address, quantity));
+
+    const uint16_t *registers = &bank->registers[start_address - bank->start_address];
+    uint32_t sequence;
+    do {
+        /* wait for the update in progress, if any, to complete, giving way to the writer */
+        while ((sequence = TMB_ATOMIC_LOAD(&bank->sequence, TMB_ATOMIC_ACQUIRE)) & 1) {
+            TMB_SPIN_YIELD();
+        }
+
+        memcpy(values, registers, quantity * sizeof(uint16_t));
+
+        /* retry if the registers were updated while being copied */
+        TMB_ATOMIC_FENCE(TMB_ATOMIC_ACQUIRE);
+    } while (TMB_ATOMIC_LOAD(&bank->sequence, TMB_ATOMIC_RELAXED) != sequence);
+
+    return TMB_SUCCESS;
+}
+
+uint16_t *tmb_register_bank_begin_update(tmb_register_bank_t *bank) {
+    while (TMB_ATOMIC_TEST_AND_SET(&bank->writer_lock, TMB_ATOMIC_ACQUIRE)) {
+        /* another writer is updating the bank, and may have been preempted */
+        TMB_SPIN_YIELD();
+    }
+
+    TMB_ATOMIC_STORE(&bank->sequence, bank->sequence + 1, TMB_ATOMIC_RELAXED);
+    TMB_ATOMIC_FENCE(TMB_ATOMIC_RELEASE);
+
+    return bank->registers;
+}
+
+void tmb_register_bank_end_update(tmb_register_bank_t *bank) {
+    TMB_ATOMIC_STORE(&bank->sequence, bank->sequence + 1, TMB_ATOMIC_RELEASE);
+    TMB_ATOMIC_CLEAR(&bank->writer_lock, TMB_ATOMIC_RELEASE);
+}
+
+tmb_error_t tmb_register_bank_write(tmb_register_bank_t *bank, uint16_t start_address, uint16_t quantity,
+                                    const uint16_t *values) {
+    TMB_ON_FALSE_RETURN(bank != NULL && values != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ERROR_CHECK(tmb_register_bank_check_range(bank, start_address, quantity));
+
+    uint16_t *registers = tmb_register_bank_begin_update(bank);
+    memcpy(&registers[start_address - bank->start_address], values, quantity * sizeof(uint16_t));
+    tmb_register_bank_end_update(bank);
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_response_cache_init(tmb_response_cache_t *cache, tmb_response_cache_entry_t *entries,
+                                    size_t capacity) {
+    TMB_ON_FALSE_RETURN(cache != NULL && entries != NULL && capacity > 0, TMB_E_INVALID_ARGUMENTS);
+
+    memset(cache, 0, sizeof(tmb_response_cache_t));
+    memset(entries, 0, capacity * sizeof(tmb_response_cache_entry_t));
+    cache->entries = entries;
+    cache->capacity = capacity;
+
+    /* generation 0 marks the empty entries */
+    cache->generation = 1;
+
+    return TMB_SUCCESS;
+}
+
+static uint32_t *tmb_response_cache_generation(tmb_response_cache_t *cache) {
+    return cache->shared_generation != NULL ? cache->shared_generation : &cache->generation;
+}
+
+void tmb_response_cache_tick(tmb_response_cache_t *cache) {
+    uint32_t *generation = tmb_response_cache_generation(cache);
+    if (TMB_ATOMIC_ADD_FETCH(generation, 1, TMB_ATOMIC_RELEASE) == 0) {
+        TMB_ATOMIC_ADD_FETCH(generation, 1, TMB_ATOMIC_RELEASE);
+    }
+}
+
+tmb_error_t tmb_response_cache_share(tmb_response_cache_t *cache, tmb_response_cache_t *other) {
+    TMB_ON_FALSE_RETURN(cache != NULL && other != NULL && cache != other, TMB_E_INVALID_ARGUMENTS);
+
+    cache->shared_generation = tmb_response_cache_generation(other);
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_server_set_response_cache(tmb_handle_t *handle, tmb_response_cache_t *cache) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_SERVER, TMB_E_INVALID_MODE);
+
+    handle->server.response_cache = cache;
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_server_set_callback(tmb_handle_t *handle, uint16_t address, const tmb_callbacks_t *callbacks) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(address <= TMB_ADDRESS_ANY, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_SERVER, TMB_E_INVALID_MODE);
+
+    size_t first_available_idx = SIZE_MAX;
+    for (size_t i = 0; i < TMB_SERVER_MAX_ADDRESSES; i++) {
+        if (handle->server.callbacks[i].address == address) {
+            /* replace existing entry */
+            handle->server.callbacks[i].callbacks = callbacks;
+
+            return TMB_SUCCESS;
+        }
+
+        if (handle->server.callbacks[i].callbacks == NULL) {
+            /* record first existing entry*/
+            first_available_idx = i;
+        }
+    }
+
+    if (first_available_idx < TMB_SERVER_MAX_ADDRESSES) {
+        /* write to the first existing entry */
+        handle->server.callbacks[first_available_idx].address = address;
+        handle->server.callbacks[first_available_idx].callbacks = callbacks;
+
+        return TMB_SUCCESS;
+    }
+
+    /* no slot available found */
+    return TMB_E_NO_MEMORY;
+}
+
+static const tmb_callbacks_t *tmb_server_get_callbacks(const tmb_handle_t *handle, uint8_t address) {
+    const tmb_callbacks_t *any_address_callbacks = NULL;
+
+    for (size_t i = 0; i < TMB_SERVER_MAX_ADDRESSES; i++) {
+        if (handle->server.callbacks[i].callbacks == NULL) {
+            continue;
+        }
+
+        if (handle->server.callbacks[i].address == address) {
+            return handle->server.callbacks[i].callbacks;
+        }
+
+        if (handle->server.callbacks[i].address == TMB_ADDRESS_ANY) {
+            any_address_callbacks = handle->server.callbacks[i].callbacks;
+        }
+    }
+
+    return any_address_callbacks;
+}
+
+static tmb_error_t tmb_server_check_range(uint16_t start_address, uint16_t quantity) {
+    TMB_ON_FALSE_RETURN((uint32_t)start_address + quantity <= UINT16_MAX + 1, TMB_E_ILLEGAL_DATA_ADDRESS);
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_server_read_bits(const tmb_callbacks_t *callbacks, uint8_t address,
+                                        tmb_error_t (*on_read)(void *, uint8_t, uint16_t, bool *),
+                                        uint16_t start_address, uint16_t quantity, tmb_adu_t *adu) {
+    TMB_ON_FALSE_RETURN(on_read != NULL, TMB_E_ILLEGAL_FUNCTION);
+    TMB_ERROR_CHECK(tmb_server_check_range(start_address, quantity));
+
+    uint8_t byte_count = quantity / 8 + (quantity % 8 != 0);
+    TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, byte_count));
+
+    for (uint16_t i = 0; i < byte_count; i++) {
+        uint8_t byte = 0;
+        for (uint16_t bit = 0; bit < 8 && i * 8 + bit < quantity; bit++) {
+            bool value = false;
+            TMB_ERROR_CHECK(on_read(callbacks->user_data, address, start_address + i * 8 + bit, &value));
+            byte |= value << bit;
+        }
+        TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, byte));
+    }
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_server_read_registers(const tmb_callbacks_t *callbacks, uint8_t address,
+                                             tmb_register_bank_t *bank,
+                                             tmb_error_t (*on_read)(void *, uint8_t, uint16_t, uint16_t *),
+                                             uint16_t start_address, uint16_t quantity, tmb_adu_t *adu) {
+    if (bank != NULL) {
+        /* a snapshot of the bank is taken, so the response never mixes old and new values */
+        uint16_t values[TMB_READ_HOLDING_REGISTER_MAX_QUANTITY];
+        TMB_ON_FALSE_RETURN(quantity <= TMB_READ_HOLDING_REGISTER_MAX_QUANTITY, TMB_E_ILLEGAL_DATA_VALUE);
+        TMB_ERROR_CHECK(tmb_register_bank_read(bank, start_address, quantity, values));
+
+        TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, quantity * 2));
+        for (uint16_t i = 0; i < quantity; i++) {
+            TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, values[i]));
+        }
+
+        return TMB_SUCCESS;
+    }
+
+    TMB_ON_FALSE_RETURN(on_read != NULL, TMB_E_ILLEGAL_FUNCTION);
+    TMB_ERROR_CHECK(tmb_server_check_range(start_address, quantity));
+    TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, quantity * 2));
+
+    for (uint16_t i = 0; i < quantity; i++) {
+        uint16_t value = 0;
+        TMB_ERROR_CHECK(on_read(callbacks->user_data, address, start_address + i, &value));
+        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, value));
+    }
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_server_read_write_registers(const tmb_callbacks_t *callbacks, uint8_t address,
+                                                   const tmb_request_pdu_t *request, tmb_adu_t *adu) {
+    uint16_t read_start_address = request->read_write_multiple_registers.read_start_address;
+    uint16_t read_quantity = request->read_write_multiple_registers.read_quantity;
+    uint16_t write_start_address = request->read_write_multiple_registers.write_start_address;
+    uint16_t write_quantity = request->read_write_multiple_registers.write_quantity;
+    const uint16_t *write_values = request->read_write_multiple_registers.write_values;
+    uint16_t values[TMB_READ_WRITE_MULTIPLE_REGISTERS_READ_MAX_QUANTITY];
+
+    tmb_register_bank_t *bank = callbacks->holding_registers;
+    if (bank != NULL) {
+        TMB_ERROR_CHECK(tmb_register_bank_check_range(bank, read_start_address, read_quantity));
+        TMB_ERROR_CHECK(tmb_register_bank_check_range(bank, write_start_address, write_quantity));
+
+        /* write and read in the same update, so no other writer can interleave between them */
+        uint16_t *registers = tmb_register_bank_begin_update(bank);
+        memcpy(&registers[write_start_address - bank->start_address], write_values, write_quantity * sizeof(uint16_t));
+        memcpy(values, &registers[read_start_address - bank->start_address], read_quantity * sizeof(uint16_t));
+        tmb_register_bank_end_update(bank);
+    } else {
+        TMB_ON_FALSE_RETURN(callbacks->on_write_holding_register != NULL, TMB_E_ILLEGAL_FUNCTION);
+        TMB_ON_FALSE_RETURN(callbacks->on_read_holding_register != NULL, TMB_E_ILLEGAL_FUNCTION);
+        TMB_ERROR_CHECK(tmb_server_check_range(read_start_address, read_quantity));
+        TMB_ERROR_CHECK(tmb_server_check_range(write_start_address, write_quantity));
+
+        for (uint16_t i = 0; i < write_quantity; i++) {
+            TMB_ERROR_CHECK(callbacks->on_write_holding_register(callbacks->user_data, address,
+                                                                 write_start_address + i, write_values[i]));
+        }
+        for (uint16_t i = 0; i < read_quantity; i++) {
+            TMB_ERROR_CHECK(callbacks->on_read_holding_register(callbacks->user_data, address,
+                                                                read_start_address + i, &values[i]));
+        }
+    }
+
+    TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, read_quantity * 2));
+    for (uint16_t i = 0; i < read_quantity; i++) {
+        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, values[i]));
+    }
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_server_mask_write_register(const tmb_callbacks_t *callbacks, uint8_t address,
+                                                  const tmb_request_pdu_t *request, tmb_adu_t *adu) {
+    uint16_t register_address = request->mask_write_register.address;
+    uint16_t and_mask = request->mask_write_register.and_mask;
+    uint16_t or_mask = request->mask_write_register.or_mask;
+
+    tmb_register_bank_t *bank = callbacks->holding_registers;
+    if (bank != NULL) {
+        TMB_ERROR_CHECK(tmb_register_bank_check_range(bank, register_address, 1));
+
+        /* the read-modify-write is done in a single update, so no other writer can interleave */
+        uint16_t *registers = tmb_register_bank_begin_update(bank);
+        uint16_t *value = &registers[register_address - bank->start_address];
+        *value = (*value & and_mask) | (or_mask & ~and_mask);
+        tmb_register_bank_end_update(bank);
+    } else {
+        TMB_ON_FALSE_RETURN(callbacks->on_read_holding_register != NULL, TMB_E_ILLEGAL_FUNCTION);
+        TMB_ON_FALSE_RETURN(callbacks->on_write_holding_register != NULL, TMB_E_ILLEGAL_FUNCTION);
+
+        uint16_t value = 0;
+        TMB_ERROR_CHECK(callbacks->on_read_holding_register(callbacks->user_data, address, register_address, &value));
+        TMB_ERROR_CHECK(callbacks->on_write_holding_register(callbacks->user_data, address, register_address,
+                                                             (value & and_mask) | (or_mask & ~and_mask)));
+    }
+
+    TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, register_address));
+    TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, and_mask));
+    TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, or_mask));
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_server_check_file_record(uint8_t reference_type, uint16_t file_number, uint16_t record_number,
+                                                uint16_t record_length) {
+    TMB_ON_FALSE_RETURN(reference_type == TMB_FILE_RECORD_REFERENCE_TYPE, TMB_E_ILLEGAL_DATA_ADDRESS);
+    TMB_ON_FALSE_RETURN(file_number != 0, TMB_E_ILLEGAL_DATA_ADDRESS);
+    TMB_ON_FALSE_RETURN((uint32_t)record_number + record_length <= TMB_FILE_RECORD_MAX_RECORD_NUMBER + 1,
+                        TMB_E_ILLEGAL_DATA_ADDRESS);
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_server_read_file_record(const tmb_callbacks_t *callbacks, uint8_t address,
+                                               const tmb_request_pdu_t *request, tmb_adu_t *adu) {
+    TMB_ON_FALSE_RETURN(callbacks->on_read_file_record != NULL, TMB_E_ILLEGAL_FUNCTION);
+
+    /* the response is built over the request: keep a copy of the sub-requests */
+    uint8_t sub_requests[TMB_READ_FILE_RECORD_MAX_BYTE_COUNT];
+    uint8_t byte_count = request->read_file_record.byte_count;
+    memcpy(sub_requests, request->read_file_record.sub_requests, byte_count);
+
+    size_t response_bytes = 0;
+    for (size_t i = 0; i < byte_count; i += 7) {
+        TMB_ERROR_CHECK(tmb_server_check_file_record(sub_requests[i], TMB_UINT16(sub_requests, i + 1),
+                                                     TMB_UINT16(sub_requests, i + 3), TMB_UINT16(sub_requests, i + 5)));
+        response_bytes += 2 + TMB_UINT16(sub_requests, i + 5) * 2;
+    }
+    TMB_ON_FALSE_RETURN(response_bytes <= TMB_READ_FILE_RECORD_MAX_BYTE_COUNT, TMB_E_ILLEGAL_DATA_VALUE);
+
+    TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, response_bytes));
+    for (size_t i = 0; i < byte_count; i += 7) {
+        uint16_t record_length = TMB_UINT16(sub_requests, i + 5);
+        uint16_t values[(TMB_READ_FILE_RECORD_MAX_BYTE_COUNT - 2) / 2];
+        TMB_ERROR_CHECK(callbacks->on_read_file_record(callbacks->user_data, address, TMB_UINT16(sub_requests, i + 1),
+                                                       TMB_UINT16(sub_requests, i + 3), record_length, values));
+
+        TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, 1 + record_length * 2));
+        TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, TMB_FILE_RECORD_REFERENCE_TYPE));
+        for (uint16_t j = 0; j < record_length; j++) {
+            TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, values[j]));
+        }
+    }
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_server_write_file_record(const tmb_callbacks_t *callbacks, uint8_t address,
+                                                const tmb_request_pdu_t *request, tmb_adu_t *adu) {
+    TMB_ON_FALSE_RETURN(callbacks->on_write_file_record != NULL, TMB_E_ILLEGAL_FUNCTION);
+
+    /* the response, that echoes the request, is built over it: keep a copy of the sub-requests */
+    uint8_t sub_requests[TMB_WRITE_FILE_RECORD_MAX_BYTE_COUNT];
+    uint8_t byte_count = request->write_file_record.byte_count;
+    memcpy(sub_requests, request->write_file_record.sub_requests, byte_count);
+
+    /* check all the sub-requests before writing any of them */
+    size_t offset = 0;
+    while (offset < byte_count) {
+        TMB_ON_FALSE_RETURN(offset + 7 <= byte_count, TMB_E_ILLEGAL_DATA_VALUE);
+        uint16_t record_length = TMB_UINT16(sub_requests, offset + 5);
+        TMB_ON_FALSE_RETURN(offset + 7 + record_length * 2 <= byte_count, TMB_E_ILLEGAL_DATA_VALUE);
+        TMB_ERROR_CHECK(tmb_server_check_file_record(sub_requests[offset], TMB_UINT16(sub_requests, offset + 1),
+                                                     TMB_UINT16(sub_requests, offset + 3), record_length));
+        offset += 7 + record_length * 2;
+    }
+
+    for (offset = 0; offset < byte_count;) {
+        uint16_t record_length = TMB_UINT16(sub_requests, offset + 5);
+        uint16_t values[(TMB_WRITE_FILE_RECORD_MAX_BYTE_COUNT - 7) / 2];
+        for (uint16_t j = 0; j < record_length; j++) {
+            values[j] = TMB_UINT16(sub_requests, offset + 7 + j * 2);
+        }
+        TMB_ERROR_CHECK(callbacks->on_write_file_record(callbacks->user_data, address,
+                                                        TMB_UINT16(sub_requests, offset + 1),
+                                                        TMB_UINT16(sub_requests, offset + 3), record_length, values));
+        offset += 7 + record_length * 2;
+    }
+
+    TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, byte_count));
+    TMB_ERROR_CHECK(tmb_adu_add_bytes(adu, sub_requests, byte_count));
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_server_read_fifo_queue(const tmb_callbacks_t *callbacks, uint8_t address,
+                                              const tmb_request_pdu_t *request, tmb_adu_t *adu) {
+    TMB_ON_FALSE_RETURN(callbacks->on_read_fifo_queue != NULL, TMB_E_ILLEGAL_FUNCTION);
+
+    uint16_t values[TMB_READ_FIFO_QUEUE_MAX_COUNT];
+    uint16_t count = 0;
+    TMB_ERROR_CHECK(callbacks->on_read_fifo_queue(callbacks->user_data, address,
+                                                  request->read_fifo_queue.fifo_pointer_address, values, &count));
+    TMB_ON_FALSE_RETURN(count <= TMB_READ_FIFO_QUEUE_MAX_COUNT, TMB_E_ILLEGAL_DATA_VALUE);
+
+    TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, 2 + count * 2));
+    TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, count));
+    for (uint16_t i = 0; i < count; i++) {
+        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, values[i]));
+    }
+
+    return TMB_SUCCESS;
+}
+
+/** Id that follows the last object of each stream access, indexed by read device id code */
+static const uint16_t tmb_device_identification_stream_end[] = {0, 0x03, 0x80, 0x100};
+
+static tmb_error_t tmb_server_read_device_identification(const tmb_callbacks_t *callbacks,
+                                                         const tmb_request_pdu_t *request, tmb_adu_t *adu) {
+    const tmb_device_identification_t *identification = callbacks->device_identification;
+    TMB_ON_FALSE_RETURN(identification != NULL, TMB_E_ILLEGAL_FUNCTION);
+
+    uint8_t read_device_id_code = request->read_device_identification.read_device_id_code;
+    uint8_t object_id = request->read_device_identification.object_id;
+    const uint8_t *objects = identification->objects;
+    uint16_t start = identification->offsets[object_id];
+    bool found = start < identification->size && objects[start] == object_id;
+
+    uint16_t end;
+    if (read_device_id_code == TMB_READ_DEVICE_ID_SPECIFIC) {
+        TMB_ON_FALSE_RETURN(found, TMB_E_ILLEGAL_DATA_ADDRESS);
+        end = start + 2 + objects[start + 1];
+    } else {
+        uint16_t end_id = tmb_device_identification_stream_end[read_device_id_code];
+        end = end_id < 256 ? identification->offsets[end_id] : identification->size;
+        if (!found || start >= end) {
+            /* unknown objects restart the stream from the first one, as defined by the standard */
+            start = 0;
+        }
+    }
+
+    /* the objects are stored as they are sent: find how many fit the response, then copy them at once */
+    uint16_t size = 0;
+    uint8_t number_of_objects = 0;
+    while (start + size < end && size + 2 + objects[start + size + 1] <= TMB_PDU_MAX_SIZE - 7) {
+        size += 2 + objects[start + size + 1];
+        number_of_objects++;
+    }
+    bool more_follows = start + size < end;
+
+    TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, TMB_MEI_TYPE_READ_DEVICE_IDENTIFICATION));
+    TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, read_device_id_code));
+    TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, identification->conformity_level));
+    TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, more_follows ? TMB_DEVICE_IDENTIFICATION_MORE_FOLLOWS : 0));
+    TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, more_follows ? objects[start + size] : 0));
+    TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, number_of_objects));
+    TMB_ERROR_CHECK(tmb_adu_add_bytes(adu, &objects[start], size));
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_device_identification_init(tmb_device_identification_t *identification,
+                                           const tmb_device_identification_object_t *objects, size_t objects_size,
+                                           uint8_t *storage, size_t storage_size) {
+    TMB_ON_FALSE_RETURN(identification != NULL && storage != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(objects != NULL || objects_size == 0, TMB_E_INVALID_ARGUMENTS);
+
+    memset(identification, 0, sizeof(tmb_device_identification_t));
+
+    /* serialize the objects sorted by id, recording where each id starts */
+    size_t size = 0;
+    uint8_t read_device_id_code = TMB_READ_DEVICE_ID_BASIC;
+    for (uint16_t id = 0; id < 256; id++) {
+        identification->offsets[id] = size;
+
+        const tmb_device_identification_object_t *object = NULL;
+        for (size_t i = 0; i < objects_size; i++) {
+            if (objects[i].id == id) {
+                TMB_ON_FALSE_RETURN(object == NULL, TMB_E_INVALID_ARGUMENTS);
+                object = &objects[i];
+            }
+        }
+
+        if (object == NULL) {
+            /* the basic objects are mandatory */
+            TMB_ON_FALSE_RETURN(id > TMB_DEVICE_IDENTIFICATION_MAJOR_MINOR_REVISION, TMB_E_INVALID_ARGUMENTS);
+            continue;
+        }
+
+        TMB_ON_FALSE_RETURN(object->length <= TMB_DEVICE_IDENTIFICATION_MAX_OBJECT_LENGTH, TMB_E_INVALID_ARGUMENTS);
+        TMB_ON_FALSE_RETURN(object->value != NULL || object->length == 0, TMB_E_INVALID_ARGUMENTS);
+        TMB_ON_FALSE_RETURN(size + 2 + object->length <= storage_size, TMB_E_NO_MEMORY);
+
+        storage[size++] = id;
+        storage[size++] = object->length;
+        if (object->length > 0) {
+            memcpy(&storage[size], object->value, object->length);
+        }
+        size += object->length;
+
+        while (id >= tmb_device_identification_stream_end[read_device_id_code]) {
+            read_device_id_code++;
+        }
+    }
+
+    identification->objects = storage;
+    identification->size = size;
+
+    /* the conformity level is the widest stream access, with the bit telling specific access is supported */
+    identification->conformity_level = 0x80 | read_device_id_code;
+
+    return TMB_SUCCESS;
+}
+
+static void tmb_statistics_add_event(tmb_statistics_t *statistics, uint8_t event) {
+    statistics->events[statistics->events_head] = event;
+    statistics->events_head = (statistics->events_head + 1) % TMB_COM_EVENT_LOG_SIZE;
+    if (statistics->events_size < TMB_COM_EVENT_LOG_SIZE) {
+        statistics->events_size++;
+    }
+}
+
+static void tmb_statistics_clear_counters(tmb_statistics_t *statistics) {
+    statistics->bus_message_count = 0;
+    statistics->bus_communication_error_count = 0;
+    statistics->exception_error_count = 0;
+    statistics->server_message_count = 0;
+    statistics->server_no_response_count = 0;
+    statistics->server_nak_count = 0;
+    statistics->server_busy_count = 0;
+    statistics->bus_character_overrun_count = 0;
+    statistics->event_count = 0;
+}
+
+static tmb_error_t tmb_server_diagnostic(tmb_handle_t *handle, const tmb_request_pdu_t *request, tmb_adu_t *adu) {
+    tmb_statistics_t *statistics = &handle->statistics;
+    uint16_t data = request->diagnostic.data;
+
+    switch (request->diagnostic.sub_function) {
+    case TMB_DIAGNOSTIC_RETURN_QUERY_DATA:
+        break;
+
+    case TMB_DIAGNOSTIC_RESTART_COMMUNICATIONS_OPTION:
+        TMB_ON_FALSE_RETURN(data == 0x0000 || data == 0xFF00, TMB_E_ILLEGAL_DATA_VALUE);
+        if (data == 0xFF00) {
+            statistics->events_head = 0;
+            statistics->events_size = 0;
+        }
+        tmb_statistics_clear_counters(statistics);
+        tmb_statistics_add_event(statistics, TMB_COM_EVENT_RESTART);
+        if (handle->server.listen_only) {
+            /* the server leaves listen only mode without answering */
+            handle->server.listen_only = false;
+            return TMB_IGNORED;
+        }
+        break;
+
+    case TMB_DIAGNOSTIC_RETURN_DIAGNOSTIC_REGISTER:
+        data = 0;
+        break;
+
+    case TMB_DIAGNOSTIC_FORCE_LISTEN_ONLY_MODE:
+        handle->server.listen_only = true;
+        tmb_statistics_add_event(statistics, TMB_COM_EVENT_LISTEN_ONLY_MODE);
+        return TMB_IGNORED;
+
+    case TMB_DIAGNOSTIC_CLEAR_COUNTERS_AND_DIAGNOSTIC_REGISTER:
+        tmb_statistics_clear_counters(statistics);
+        break;
+
+    case TMB_DIAGNOSTIC_RETURN_BUS_MESSAGE_COUNT:
+        data = statistics->bus_message_count;
+        break;
+
+    case TMB_DIAGNOSTIC_RETURN_BUS_COMMUNICATION_ERROR_COUNT:
+        data = statistics->bus_communication_error_count;
+        break;
+
+    case TMB_DIAGNOSTIC_RETURN_BUS_EXCEPTION_ERROR_COUNT:
+        data = statistics->exception_error_count;
+        break;
+
+    case TMB_DIAGNOSTIC_RETURN_SERVER_MESSAGE_COUNT:
+        data = statistics->server_message_count;
+        break;
+
+    case TMB_DIAGNOSTIC_RETURN_SERVER_NO_RESPONSE_COUNT:
+        data = statistics->server_no_response_count;
+        break;
+
+    case TMB_DIAGNOSTIC_RETURN_SERVER_NAK_COUNT:
+        data = statistics->server_nak_count;
+        break;
+
+    case TMB_DIAGNOSTIC_RETURN_SERVER_BUSY_COUNT:
+        data = statistics->server_busy_count;
+        break;
+
+    case TMB_DIAGNOSTIC_RETURN_BUS_CHARACTER_OVERRUN_COUNT:
+        data = statistics->bus_character_overrun_count;
+        break;
+
+    case TMB_DIAGNOSTIC_CLEAR_OVERRUN_COUNTER_AND_FLAG:
+        statistics->bus_character_overrun_count = 0;
+        break;
+
+    default:
+        return TMB_E_ILLEGAL_FUNCTION;
+    }
+
+    TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, request->diagnostic.sub_function));
+    TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, data));
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_server_get_com_event_log(const tmb_statistics_t *statistics, tmb_adu_t *adu) {
+    TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, 6 + statistics->events_size));
+    TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, 0));
+    TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, statistics->event_count));
+    TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, statistics->bus_message_count));
+
+    /* the most recent event comes first */
+    for (size_t i = 1; i <= statistics->events_size; i++) {
+        size_t index = (statistics->events_head + TMB_COM_EVENT_LOG_SIZE - i) % TMB_COM_EVENT_LOG_SIZE;
+        TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, statistics->events[index]));
+    }
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_server_execute(tmb_handle_t *handle, const tmb_callbacks_t *callbacks, uint8_t address,
+                                      const tmb_request_pdu_t *request, tmb_adu_t *adu) {
+    TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, request->function_code));
+
+    switch (request->function_code) {
+    case TMB_FUNCTION_READ_COILS:
+        TMB_ERROR_CHECK(tmb_server_read_bits(callbacks, address, callbacks->on_read_coil,
+                                             request->read_coils.start_address, request->read_coils.quantity, adu));
+        break;
+
+    case TMB_FUNCTION_READ_DISCRETE_INPUTS:
+        TMB_ERROR_CHECK(tmb_server_read_bits(callbacks, address, callbacks->on_read_discrete_input,
+                                             request->read_discrete_inputs.start_address,
+                                             request->read_discrete_inputs.quantity, adu));
+        break;
+
+    case TMB_FUNCTION_READ_HOLDING_REGISTERS:
+        TMB_ERROR_CHECK(tmb_server_read_registers(callbacks, address, callbacks->holding_registers,
+                                                  callbacks->on_read_holding_register,
+                                                  request->read_holding_registers.start_address,
+                                                  request->read_holding_registers.quantity, adu));
+        break;
+
+    case TMB_FUNCTION_READ_INPUT_REGISTERS:
+        TMB_ERROR_CHECK(tmb_server_read_registers(callbacks, address, callbacks->input_registers,
+                                                  callbacks->on_read_input_register,
+                                                  request->read_input_registers.start_address,
+                                                  request->read_input_registers.quantity, adu));
+        break;
+
+    case TMB_FUNCTION_WRITE_SINGLE_COIL:
+        TMB_ON_FALSE_RETURN(callbacks->on_write_coil != NULL, TMB_E_ILLEGAL_FUNCTION);
+        TMB_ERROR_CHECK(callbacks->on_write_coil(callbacks->user_data, address, request->write_single_coil.address,
+                                                 request->write_single_coil.value == TMB_WRITE_SINGLE_COIL_TRUE_VALUE));
+        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, request->write_single_coil.address));
+        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, request->write_single_coil.value));
+        break;
+
+    case TMB_FUNCTION_WRITE_SINGLE_REGISTER:
+        if (callbacks->holding_registers != NULL) {
+            TMB_ERROR_CHECK(tmb_register_bank_write(callbacks->holding_registers,
+                                                    request->write_single_register.address, 1,
+                                                    &request->write_single_register.value));
+        } else {
+            TMB_ON_FALSE_RETURN(callbacks->on_write_holding_register != NULL, TMB_E_ILLEGAL_FUNCTION);
+            TMB_ERROR_CHECK(callbacks->on_write_holding_register(callbacks->user_data, address,
+                                                                 request->write_single_register.address,
+                                                                 request->write_single_register.value));
+        }
+        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, request->write_single_register.address));
+        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, request->write_single_register.value));
+        break;
+
+    case TMB_FUNCTION_WRITE_MULTIPLE_COILS:
+        TMB_ON_FALSE_RETURN(callbacks->on_write_coil != NULL, TMB_E_ILLEGAL_FUNCTION);
+        TMB_ERROR_CHECK(tmb_server_check_range(request->write_multiple_coils.start_address,
+                                               request->write_multiple_coils.quantity));
+        for (uint16_t i = 0; i < request->write_multiple_coils.quantity; i++) {
+            bool value = (request->write_multiple_coils.values[i / 8] >> (i % 8)) & 1;
+            TMB_ERROR_CHECK(callbacks->on_write_coil(callbacks->user_data, address,
+                                                     request->write_multiple_coils.start_address + i, value));
+        }
+        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, request->write_multiple_coils.start_address));
+        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, request->write_multiple_coils.quantity));
+        break;
+
+    case TMB_FUNCTION_WRITE_MULTIPLE_REGISTERS:
+        if (callbacks->holding_registers != NULL) {
+            TMB_ERROR_CHECK(tmb_register_bank_write(callbacks->holding_registers,
+                                                    request->write_multiple_registers.start_address,
+                                                    request->write_multiple_registers.quantity,
+                                                    request->write_multiple_registers.values));
+        } else {
+            TMB_ON_FALSE_RETURN(callbacks->on_write_holding_register != NULL, TMB_E_ILLEGAL_FUNCTION);
+            TMB_ERROR_CHECK(tmb_server_check_range(request->write_multiple_registers.start_address,
+                                                   request->write_multiple_registers.quantity));
+            for (uint16_t i = 0; i < request->write_multiple_registers.quantity; i++) {
+                TMB_ERROR_CHECK(callbacks->on_write_holding_register(
+                        callbacks->user_data, address, request->write_multiple_registers.start_address + i,
+                        request->write_multiple_registers.values[i]));
+            }
+        }
+        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, request->write_multiple_registers.start_address));
+        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, request->write_multiple_registers.quantity));
+        break;
+
+    case TMB_FUNCTION_READ_WRITE_MULTIPLE_REGISTERS:
+        TMB_ERROR_CHECK(tmb_server_read_write_registers(callbacks, address, request, adu));
+        break;
+
+    case TMB_FUNCTION_MASK_WRITE_REGISTER:
+        TMB_ERROR_CHECK(tmb_server_mask_write_register(callbacks, address, request, adu));
+        break;
+
+    case TMB_FUNCTION_READ_FILE_RECORD:
+        TMB_ERROR_CHECK(tmb_server_read_file_record(callbacks, address, request, adu));
+        break;
+
+    case TMB_FUNCTION_WRITE_FILE_RECORD:
+        TMB_ERROR_CHECK(tmb_server_write_file_record(callbacks, address, request, adu));
+        break;
+
+    case TMB_FUNCTION_READ_FIFO_QUEUE:
+        TMB_ERROR_CHECK(tmb_server_read_fifo_queue(callbacks, address, request, adu));
+        break;
+
+    case TMB_FUNCTION_ENCAPSULATED_TRANSPORT:
+        TMB_ERROR_CHECK(tmb_server_read_device_identification(callbacks, request, adu));
+        break;
+
+    case TMB_FUNCTION_DIAGNOSTIC:
+        TMB_ERROR_CHECK(tmb_server_diagnostic(handle, request, adu));
+        break;
+
+    case TMB_FUNCTION_GET_COM_EVENT_COUNTER:
+        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, 0));
+        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, handle->statistics.event_count));
+        break;
+
+    case TMB_FUNCTION_GET_COM_EVENT_LOG:
+        TMB_ERROR_CHECK(tmb_server_get_com_event_log(&handle->statistics, adu));
+        break;
+
+    default:
+        return TMB_E_ILLEGAL_FUNCTION;
+    }
+
+    return TMB_SUCCESS;
+}
+
+static tmb_response_cache_entry_t *tmb_response_cache_get_entry(tmb_response_cache_t *cache, uint8_t address,
+                                                                const uint8_t *pdu, size_t pdu_size) {
+    /* only read requests, that have a fixed size, are cached */
+    switch (pdu[0]) {
+    case TMB_FUNCTION_READ_COILS:
+    case TMB_FUNCTION_READ_DISCRETE_INPUTS:
+    case TMB_FUNCTION_READ_HOLDING_REGISTERS:
+    case TMB_FUNCTION_READ_INPUT_REGISTERS:
+        if (pdu_size != 5) {
+            return NULL;
+        }
+        break;
+
+    default:
+        return NULL;
+    }
+
+    uint32_t key = ((uint32_t)address << 24) ^ ((uint32_t)pdu[0] << 16) ^ TMB_UINT16(pdu, 1);
+    uint32_t hash = (key * 2654435761u) ^ TMB_UINT16(pdu, 3);
+
+    return &cache->entries[hash % cache->capacity];
+}
+
+static bool tmb_response_cache_entry_is_valid(tmb_response_cache_t *cache, const tmb_response_cache_entry_t *entry,
+                                              uint8_t address, const uint8_t *pdu) {
+    if (entry->generation != TMB_ATOMIC_LOAD(tmb_response_cache_generation(cache), TMB_ATOMIC_ACQUIRE)) {
+        return false;
+    }
+
+    if (entry->address != address || entry->function_code != pdu[0] || entry->start_address != TMB_UINT16(pdu, 1) ||
+        entry->quantity != TMB_UINT16(pdu, 3)) {
+        return false;
+    }
+
+    return entry->bank == NULL || entry->bank_sequence == TMB_ATOMIC_LOAD(&entry->bank->sequence, TMB_ATOMIC_ACQUIRE);
+}
+
+static void tmb_response_cache_store(tmb_response_cache_entry_t *entry, uint32_t generation, uint8_t address,
+                                     const tmb_request_pdu_t *request, const tmb_register_bank_t *bank,
+                                     uint32_t bank_sequence, const tmb_adu_t *adu) {
+    if (adu->size > sizeof(entry->adu)) {
+        return;
+    }
+
+    entry->generation = generation;
+    entry->bank = bank;
+    entry->bank_sequence = bank_sequence;
+    entry->address = address;
+    entry->function_code = request->function_code;
+    /* start address and quantity are at the same position for all the read requests */
+    entry->start_address = request->read_coils.start_address;
+    entry->quantity = request->read_coils.quantity;
+    entry->size = adu->size;
+    memcpy(entry->adu, adu->buffer, adu->size);
+}
+
+static tmb_error_t tmb_server_receive_request(tmb_handle_t *handle, size_t *request_size) {
+    uint8_t *buffer = handle->buffer;
+    size_t size = 0;
+
+    switch (handle->encapsulation) {
+    case TMB_TRANSPORT_PROTOCOL_RTU: {
+        if (handle->transport->read_timeout != NULL && handle->transport->rtu_t35_us > 0) {
+            /* delimit the frame by the silent intervals, thus requests with an unknown size are answered */
+            TMB_ERROR_CHECK(tmb_rtu_receive_frame(handle->transport, buffer, handle->buffer_size, &size));
+            break;
+        }
+
+        /* read device address and function code, then the header that contains the size of the request */
+        TMB_ERROR_CHECK(tmb_receive(handle, buffer, 2));
+
+        size_t header_size = tmb_get_request_header_size(buffer[1]);
+        TMB_ON_FALSE_RETURN(header_size != 0, TMB_E_ILLEGAL_FUNCTION);
+        TMB_ON_FALSE_RETURN(1 + header_size <= handle->buffer_size, TMB_E_NO_MEMORY);
+        TMB_ERROR_CHECK(tmb_receive(handle, &buffer[2], header_size - 1));
+
+        size = 1 + tmb_get_request_size(&buffer[1]) + TMB_ADU_CRC_LENGTH;
+        TMB_ON_FALSE_RETURN(size <= handle->buffer_size, TMB_E_NO_MEMORY);
+        TMB_ERROR_CHECK(tmb_receive(handle, &buffer[1 + header_size], size - 1 - header_size));
+        break;
+    }
+
+    case TMB_TRANSPORT_PROTOCOL_TCPIP:
+        /* the MBAP header contains the size of the request */
+        TMB_ON_FALSE_RETURN(TMB_ADU_TCPIP_HEADER_SIZE <= handle->buffer_size, TMB_E_NO_MEMORY);
+        TMB_ERROR_CHECK(tmb_receive(handle, buffer, TMB_ADU_TCPIP_HEADER_SIZE));
+
+        size = TMB_ADU_TCPIP_SIZE_OFFSET + 2 + TMB_UINT16(buffer, TMB_ADU_TCPIP_SIZE_OFFSET);
+        TMB_ON_FALSE_RETURN(size > TMB_ADU_TCPIP_HEADER_SIZE, TMB_E_TRANSPORT);
+        TMB_ON_FALSE_RETURN(size <= handle->buffer_size, TMB_E_NO_MEMORY);
+        TMB_ERROR_CHECK(tmb_receive(handle, &buffer[TMB_ADU_TCPIP_HEADER_SIZE], size - TMB_ADU_TCPIP_HEADER_SIZE));
+        break;
+
+    case TMB_TRANSPORT_PROTOCOL_ASCII:
+        return TMB_E_NOT_IMPLEMENTED;
+    }
+
+    *request_size = size;
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_server_process_request(tmb_handle_t *handle, size_t request_size, size_t *response_size) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_SERVER, TMB_E_INVALID_MODE);
+    TMB_ON_FALSE_RETURN(response_size != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(request_size <= handle->buffer_size, TMB_E_INVALID_ARGUMENTS);
+
+    uint8_t *buffer = handle->buffer;
+    tmb_statistics_t *statistics = &handle->statistics;
+    uint16_t transaction_identifier = 0;
+    size_t pdu_offset = 0;
+    size_t pdu_size = 0;
+
+    switch (handle->encapsulation) {
+    case TMB_TRANSPORT_PROTOCOL_RTU: {
+        TMB_ON_FALSE_RETURN(request_size >= 2 + TMB_ADU_CRC_LENGTH, TMB_E_INVALID_ARGUMENTS);
+
+        uint16_t crc = tmb_crc16(buffer, request_size - TMB_ADU_CRC_LENGTH);
+        if (buffer[request_size - 2] != (crc & 0xFF) || buffer[request_size - 1] != ((crc >> 8) & 0xFF)) {
+            statistics->bus_message_count++;
+            statistics->bus_communication_error_count++;
+            tmb_statistics_add_event(statistics, TMB_COM_EVENT_RECEIVE | TMB_COM_EVENT_RECEIVE_COMMUNICATION_ERROR);
+
+            return TMB_E_INVALID_CRC;
+        }
+
+        pdu_offset = 1;
+        pdu_size = request_size - 1 - TMB_ADU_CRC_LENGTH;
+        break;
+    }
+
+    case TMB_TRANSPORT_PROTOCOL_TCPIP:
+        /* the header is longer than the length field and what precedes it, thus the length can't underflow */
+        TMB_ON_FALSE_RETURN(request_size > TMB_ADU_TCPIP_HEADER_SIZE, TMB_E_INVALID_ARGUMENTS);
+        TMB_ON_FALSE_RETURN(TMB_UINT16(buffer, 2) == TMB_MODBUS_PROTOCOL_IDENTIFIER, TMB_E_INVALID_ARGUMENTS);
+        TMB_ON_FALSE_RETURN((size_t)TMB_UINT16(buffer, TMB_ADU_TCPIP_SIZE_OFFSET) ==
+                                    (size_t)(request_size - TMB_ADU_TCPIP_SIZE_OFFSET - 2),
+                            TMB_E_INVALID_ARGUMENTS);
+
+        transaction_identifier = TMB_UINT16(buffer, 0);
+        pdu_offset = TMB_ADU_TCPIP_HEADER_SIZE;
+        pdu_size = request_size - TMB_ADU_TCPIP_HEADER_SIZE;
+        break;
+
+    case TMB_TRANSPORT_PROTOCOL_ASCII:
+        return TMB_E_NOT_IMPLEMENTED;
+    }
+
+    uint8_t address = buffer[pdu_offset - 1];
+    uint8_t function_code = buffer[pdu_offset];
+    tmb_response_cache_t *cache = handle->server.response_cache;
+    bool listen_only = handle->server.listen_only;
+    uint8_t receive_event = TMB_COM_EVENT_RECEIVE | (listen_only ? TMB_COM_EVENT_RECEIVE_LISTEN_ONLY : 0);
+
+    statistics->bus_message_count++;
+
+    if (address == TMB_ADDRESS_BROADCAST) {
+        statistics->server_message_count++;
+        statistics->server_no_response_count++;
+        tmb_statistics_add_event(statistics, receive_event | TMB_COM_EVENT_RECEIVE_BROADCAST);
+
+        /* broadcast requests are executed by every server, and never answered */
+        tmb_request_pdu_t request;
+        if (!listen_only && tmb_request_parse(&request, &buffer[pdu_offset], pdu_size) == TMB_SUCCESS &&
+            tmb_request_validate(&request) == TMB_SUCCESS && tmb_function_is_write(function_code)) {
+            for (size_t i = 0; i < TMB_SERVER_MAX_ADDRESSES; i++) {
+                const tmb_callbacks_t *callbacks = handle->server.callbacks[i].callbacks;
+
+                /* the same callbacks registered for several addresses are the same server: write once */
+                bool executed = false;
+                for (size_t j = 0; j < i && !executed; j++) {
+                    executed = handle->server.callbacks[j].callbacks == callbacks;
+                }
+
+                if (callbacks != NULL && !executed) {
+                    tmb_adu_t adu;
+                    TMB_ERROR_CHECK(tmb_adu_init(&adu, buffer, handle->buffer_size, handle->encapsulation,
+                                                 transaction_identifier, address));
+                    tmb_server_execute(handle, callbacks, address, &request, &adu);
+                }
+            }
+            statistics->event_count++;
+
+            if (cache != NULL) {
+                tmb_response_cache_tick(cache);
+            }
+        }
+
+        return TMB_IGNORED;
+    }
+
+    const tmb_callbacks_t *callbacks = tmb_server_get_callbacks(handle, address);
+    if (callbacks == NULL) {
+        /* request not addressed to this server */
+        return TMB_IGNORED;
+    }
+
+    statistics->server_message_count++;
+    tmb_statistics_add_event(statistics, receive_event);
+
+    /* in listen only mode, only the restart communications option diagnostic is executed */
+    if (listen_only && !(function_code == TMB_FUNCTION_DIAGNOSTIC && pdu_size == 5 &&
+                         TMB_UINT16(buffer, pdu_offset + 1) == TMB_DIAGNOSTIC_RESTART_COMMUNICATIONS_OPTION)) {
+        statistics->server_no_response_count++;
+
+        return TMB_IGNORED;
+    }
+
+    tmb_response_cache_entry_t *cache_entry = NULL;
+    uint32_t generation = 0;
+    const tmb_register_bank_t *bank = NULL;
+    uint32_t bank_sequence = 0;
+    if (cache != NULL) {
+        cache_entry = tmb_response_cache_get_entry(cache, address, &buffer[pdu_offset], pdu_size);
+    }
+
+    if (cache_entry != NULL) {
+        if (tmb_response_cache_entry_is_valid(cache, cache_entry, address, &buffer[pdu_offset])) {
+            cache->hits++;
+
+            /* the stored response only differs from the one to send for the transaction identifier */
+            memcpy(buffer, cache_entry->adu, cache_entry->size);
+            if (handle->encapsulation == TMB_TRANSPORT_PROTOCOL_TCPIP) {
+                buffer[0] = (transaction_identifier >> 8) & 0xFF;
+                buffer[1] = transaction_identifier & 0xFF;
+            }
+            *response_size = cache_entry->size;
+
+            statistics->event_count++;
+            tmb_statistics_add_event(statistics, TMB_COM_EVENT_SEND);
+
+            return TMB_SUCCESS;
+        }
+        cache->misses++;
+
+        /* take the generation and the sequence before reading, so ticks and updates done while reading
+         * make the entry stale */
+        generation = TMB_ATOMIC_LOAD(tmb_response_cache_generation(cache), TMB_ATOMIC_ACQUIRE);
+        if (function_code == TMB_FUNCTION_READ_HOLDING_REGISTERS) {
+            bank = callbacks->holding_registers;
+        } else if (function_code == TMB_FUNCTION_READ_INPUT_REGISTERS) {
+            bank = callbacks->input_registers;
+        }
+        if (bank != NULL) {
+            bank_sequence = TMB_ATOMIC_LOAD(&bank->sequence, TMB_ATOMIC_ACQUIRE);
+        }
+    }
+
+    tmb_request_pdu_t request;
+    tmb_error_t error = tmb_request_parse(&request, &buffer[pdu_offset], pdu_size);
+    if (error == TMB_SUCCESS) {
+        error = tmb_request_validate(&request);
+    }
+
+    tmb_adu_t adu;
+    TMB_ERROR_CHECK(
+            tmb_adu_init(&adu, buffer, handle->buffer_size, handle->encapsulation, transaction_identifier, address));
+
+    if (error == TMB_SUCCESS) {
+        error = tmb_server_execute(handle, callbacks, address, &request, &adu);
+    }
+
+    if (error == TMB_IGNORED) {
+        statistics->server_no_response_count++;
+
+        return TMB_IGNORED;
+    }
+
+    uint8_t send_event = TMB_COM_EVENT_SEND;
+    if (error != TMB_SUCCESS) {
+        /* discard the partial response and replace it with an exception */
+        adu.size = pdu_offset;
+
+        uint8_t exception_code = TMB_ERROR_IS_MODBUS_EXCEPTION(error) ? error : TMB_E_SLAVE_DEVICE_FAILURE;
+        TMB_ERROR_CHECK(tmb_adu_add_uint8(&adu, function_code | 0x80));
+        TMB_ERROR_CHECK(tmb_adu_add_uint8(&adu, exception_code));
+
+        statistics->exception_error_count++;
+        if (exception_code <= TMB_E_ILLEGAL_DATA_VALUE) {
+            send_event |= TMB_COM_EVENT_SEND_READ_EXCEPTION;
+        } else if (exception_code == TMB_E_SLAVE_DEVICE_FAILURE) {
+            send_event |= TMB_COM_EVENT_SEND_ABORT_EXCEPTION;
+        } else if (exception_code == TMB_E_ACKNOWLEDGE || exception_code == TMB_E_SLAVE_DEVICE_BUSY) {
+            send_event |= TMB_COM_EVENT_SEND_BUSY_EXCEPTION;
+            statistics->server_busy_count += exception_code == TMB_E_SLAVE_DEVICE_BUSY;
+        } else if (exception_code == TMB_EXCEPTION_NEGATIVE_ACKNOWLEDGE) {
+            send_event |= TMB_COM_EVENT_SEND_NAK_EXCEPTION;
+            statistics->server_nak_count++;
+        }
+    } else if (function_code != TMB_FUNCTION_GET_COM_EVENT_COUNTER) {
+        statistics->event_count++;
+    }
+    tmb_statistics_add_event(statistics, send_event);
+
+    TMB_ERROR_CHECK(tmb_adu_finalize(&adu));
+    *response_size = adu.size;
+
+    if (cache != NULL && error == TMB_SUCCESS) {
+        if (tmb_function_is_write(function_code)) {
+            tmb_response_cache_tick(cache);
+        } else if (cache_entry != NULL && (bank_sequence & 1) == 0) {
+            tmb_response_cache_store(cache_entry, generation, address, &request, bank, bank_sequence, &adu);
+        }
+    }
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_server_run_iteration(tmb_handle_t *handle) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_SERVER, TMB_E_INVALID_MODE);
+
+    size_t request_size = 0;
+    tmb_error_t error = tmb_server_receive_request(handle, &request_size);
+    if (error == TMB_E_INVALID_CRC) {
+        /* the frame was delimited by the silent intervals, but is corrupted */
+        handle->statistics.bus_message_count++;
+        handle->statistics.bus_communication_error_count++;
+        tmb_statistics_add_event(&handle->statistics,
+                                 TMB_COM_EVENT_RECEIVE | TMB_COM_EVENT_RECEIVE_COMMUNICATION_ERROR);
+    }
+    TMB_ERROR_CHECK(error);
+
+    size_t response_size = 0;
+    error = tmb_server_process_request(handle, request_size, &response_size);
+    if (error == TMB_IGNORED) {
+        return TMB_SUCCESS;
+    }
+    TMB_ERROR_CHECK(error);
+
+    return tmb_send(handle, handle->buffer, response_size);
+}
+
+tmb_error_t tmb_server_run_forever(tmb_handle_t *handle) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+
+    while (true) {
+        tmb_server_run_iteration(handle);
+    }
+}
+
+tmb_error_t tmb_parser_init(tmb_parser_t *parser, tmb_mode_t mode, tmb_transport_protocol_t encapsulation,
+                            uint8_t *buffer, size_t buffer_size) {
+    TMB_ON_FALSE_RETURN(parser != NULL && buffer != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(mode == TMB_MODE_CLIENT || mode == TMB_MODE_SERVER, TMB_E_INVALID_ARGUMENTS);
+
+    switch (encapsulation) {
+    case TMB_TRANSPORT_PROTOCOL_RTU:
+        TMB_ON_FALSE_RETURN(buffer_size >= TMB_ADU_RTU_MAX_SIZE, TMB_E_INVALID_ARGUMENTS);
+        break;
+
+    case TMB_TRANSPORT_PROTOCOL_ASCII:
+        TMB_ON_FALSE_RETURN(buffer_size >= TMB_ADU_ASCII_ADU_MAX_SIZE, TMB_E_INVALID_ARGUMENTS);
+        break;
+
+    case TMB_TRANSPORT_PROTOCOL_TCPIP:
+        TMB_ON_FALSE_RETURN(buffer_size >= TMB_ADU_TCPIP_MAX_SIZE, TMB_E_INVALID_ARGUMENTS);
+        break;
+
+    default:
+        return TMB_E_INVALID_ARGUMENTS;
+    }
+
+    parser->mode = mode;
+    parser->encapsulation = encapsulation;
+    parser->buffer = buffer;
+    parser->buffer_size = buffer_size;
+    parser->size = 0;
+
+    return TMB_SUCCESS;
+}
+
+/**
+ * Computes the size of the RTU or TCP/IP frame of which the first available bytes are known. When the
+ * size depends on bytes not received yet, returns more than available: the bytes to receive before asking again.
+ */
+static tmb_error_t tmb_parser_get_frame_size(const tmb_parser_t *parser, const uint8_t *adu, size_t available,
+                                             size_t *size) {
+    if (parser->encapsulation == TMB_TRANSPORT_PROTOCOL_TCPIP) {
+        if (available < TMB_ADU_TCPIP_HEADER_SIZE) {
+            *size = TMB_ADU_TCPIP_HEADER_SIZE;
+            return TMB_SUCCESS;
+        }
+
+        /* the length counts the unit identifier and the PDU, that has at least the function code */
+        uint16_t length = TMB_UINT16(adu, TMB_ADU_TCPIP_SIZE_OFFSET);
+        TMB_ON_FALSE_RETURN(TMB_UINT16(adu, 2) == TMB_MODBUS_PROTOCOL_IDENTIFIER, TMB_E_TRANSPORT);
+        TMB_ON_FALSE_RETURN(length >= 2 && length <= 1 + TMB_PDU_MAX_SIZE, TMB_E_TRANSPORT);
+
+        *size = TMB_ADU_TCPIP_SIZE_OFFSET + 2 + length;
+        return TMB_SUCCESS;
+    }
+
+    /* RTU frames are delimited by the silence of the line, that is not known here: the size of
+     * the frame is derived from the function code, as the client and the server do */
+    if (available < 2) {
+        *size = 2;
+        return TMB_SUCCESS;
+    }
+
+    const uint8_t *pdu = &adu[1];
+    if (parser->mode == TMB_MODE_CLIENT) {
+        TMB_ON_FALSE_RETURN(TMB_IS_FUNCTION_EXCEPTION_CODE(pdu[0]) || tmb_function_get(pdu[0]) != NULL,
+                            TMB_E_ILLEGAL_FUNCTION);
+
+        *size = 1 + tmb_get_response_size(pdu, available - 1) + TMB_ADU_CRC_LENGTH;
+        return TMB_SUCCESS;
+    }
+
+    size_t header_size = tmb_get_request_header_size(pdu[0]);
+    TMB_ON_FALSE_RETURN(header_size != 0, TMB_E_ILLEGAL_FUNCTION);
+
+    if (1 + header_size > available) {
+        *size = 1 + header_size;
+    } else {
+        *size = 1 + tmb_get_request_size(pdu) + TMB_ADU_CRC_LENGTH;
+    }
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_parser_get_frame(const tmb_parser_t *parser, const uint8_t *adu, size_t size,
+                                        tmb_frame_t *frame) {
+    if (parser->encapsulation == TMB_TRANSPORT_PROTOCOL_TCPIP) {
+        frame->address = adu[TMB_ADU_TCPIP_HEADER_SIZE - 1];
+        frame->transaction_identifier = TMB_UINT16(adu, 0);
+        frame->pdu = &adu[TMB_ADU_TCPIP_HEADER_SIZE];
+        frame->pdu_size = size - TMB_ADU_TCPIP_HEADER_SIZE;
+
+        return TMB_SUCCESS;
+    }
+
+    uint16_t crc = tmb_crc16(adu, size - TMB_ADU_CRC_LENGTH);
+    TMB_ON_FALSE_RETURN(adu[size - 2] == (crc & 0xFF) && adu[size - 1] == ((crc >> 8) & 0xFF), TMB_E_INVALID_CRC);
+
+    frame->address = adu[0];
+    frame->transaction_identifier = 0;
+    frame->pdu = &adu[1];
+    frame->pdu_size = size - 1 - TMB_ADU_CRC_LENGTH;
+
+    return TMB_SUCCESS;
+}
+
+static int tmb_from_hex(uint8_t c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+
+    return -1;
+}
+
+static tmb_error_t tmb_parser_feed_ascii(tmb_parser_t *parser, const uint8_t *bytes, size_t size, size_t *consumed,
+                                         tmb_frame_t *frame) {
+    uint8_t *buffer = parser->buffer;
+
+    for (size_t i = 0; i < size; i++) {
+        if (bytes[i] == TMB_ADU_ASCII_START_BYTE[0]) {
+            /* a start character always begins a new frame, dropping an incomplete one */
+            parser->size = 0;
+        } else if (parser->size == 0) {
+            /* garbage between frames */
+            continue;
+        }
+
+        if (parser->size == parser->buffer_size) {
+            parser->size = 0;
+            *consumed = i + 1;
+
+            return TMB_E_NO_MEMORY;
+        }
+
+        buffer[parser->size++] = bytes[i];
+        if (bytes[i] != TMB_ADU_ASCII_END_BYTES[1] || buffer[parser->size - 2] != TMB_ADU_ASCII_END_BYTES[0]) {
+            continue;
+        }
+
+        /* decode in place the characters between the start and the end ones: address, PDU and LRC */
+        size_t characters = parser->size - sizeof(TMB_ADU_ASCII_START_BYTE) - sizeof(TMB_ADU_ASCII_END_BYTES);
+        parser->size = 0;
+        *consumed = i + 1;
+        TMB_ON_FALSE_RETURN(characters % 2 == 0 && characters >= 2 * 3, TMB_E_INVALID_CRC);
+
+        size_t adu_size = characters / 2;
+        for (size_t j = 0; j < adu_size; j++) {
+            int high = tmb_from_hex(buffer[1 + 2 * j]);
+            int low = tmb_from_hex(buffer[2 + 2 * j]);
+            TMB_ON_FALSE_RETURN(high >= 0 && low >= 0, TMB_E_INVALID_CRC);
+
+            buffer[j] = (high << 4) | low;
+        }
+        TMB_ON_FALSE_RETURN(tmb_lrc(buffer, adu_size - 1) == buffer[adu_size - 1], TMB_E_INVALID_CRC);
+
+        frame->address = buffer[0];
+        frame->transaction_identifier = 0;
+        frame->pdu = &buffer[1];
+        frame->pdu_size = adu_size - 2;
+
+        return TMB_SUCCESS;
+    }
+
+    *consumed = size;
+
+    return TMB_E_INCOMPLETE;
+}
+
+tmb_error_t tmb_parser_feed(tmb_parser_t *parser, const uint8_t *bytes, size_t size, size_t *consumed,
+                            tmb_frame_t *frame) {
+    TMB_ON_FALSE_RETURN(parser != NULL && consumed != NULL && frame != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(bytes != NULL || size == 0, TMB_E_INVALID_ARGUMENTS);
+
+    if (parser->encapsulation == TMB_TRANSPORT_PROTOCOL_ASCII) {
+        return tmb_parser_feed_ascii(parser, bytes, size, consumed, frame);
+    }
+
+    tmb_error_t error;
+    size_t frame_size;
+
+    if (parser->size == 0 && size > 0) {
+        /* the usual case: a whole frame fed at once is returned without copying it */
+        error = tmb_parser_get_frame_size(parser, bytes, size, &frame_size);
+        if (error == TMB_SUCCESS && frame_size <= size) {
+            error = tmb_parser_get_frame(parser, bytes, frame_size, frame);
+            if (error == TMB_SUCCESS) {
+                *consumed = frame_size;
+
+                return TMB_SUCCESS;
+            }
+        }
+
+        if (error != TMB_SUCCESS) {
+            /* drop the first byte, the next frame may start in the following ones */
+            *consumed = 1;
+
+            return error;
+        }
+    }
+
+    /* copy in the buffer the bytes of the current frame only, leaving the following ones to the caller */
+    size_t used = 0;
+    while ((error = tmb_parser_get_frame_size(parser, parser->buffer, parser->size, &frame_size)) == TMB_SUCCESS &&
+           frame_size > parser->size) {
+        if (frame_size > parser->buffer_size) {
+            error = TMB_E_NO_MEMORY;
+            break;
+        }
+
+        if (used == size) {
+            *consumed = used;
+
+            return TMB_E_INCOMPLETE;
+        }
+
+        size_t n = frame_size - parser->size < size - used ? frame_size - parser->size : size - used;
+        memcpy(&parser->buffer[parser->size], &bytes[used], n);
+        parser->size += n;
+        used += n;
+    }
+
+    *consumed = used;
+    if (error == TMB_SUCCESS) {
+        error = tmb_parser_get_frame(parser, parser->buffer, frame_size, frame);
+        if (error == TMB_SUCCESS) {
+            /* the frame references the buffer, that is reused from the next call */
+            parser->size = 0;
+
+            return TMB_SUCCESS;
+        }
+    }
+
+    /* drop the first byte, the next frame may start in the following ones */
+    parser->size--;
+    memmove(parser->buffer, &parser->buffer[1], parser->size);
+
+    return error;
+}
+
+tmb_error_t tmb_gateway_request_init(tmb_gateway_request_t *request, const tmb_frame_t *frame, void *context,
+                                     uint32_t tag) {
+    TMB_ON_FALSE_RETURN(request != NULL && frame != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(frame->pdu_size >= 1 && frame->pdu_size <= TMB_PDU_MAX_SIZE, TMB_E_INVALID_ARGUMENTS);
+
+    request->context = context;
+    request->tag = tag;
+
+    /* the request is stored as a TCP/IP ADU whatever the encapsulation it was received with */
+    tmb_adu_t adu;
+    TMB_ERROR_CHECK(tmb_adu_init(&adu, request->adu, sizeof(request->adu), TMB_TRANSPORT_PROTOCOL_TCPIP,
+                                 frame->transaction_identifier, frame->address));
+    TMB_ERROR_CHECK(tmb_adu_add_bytes(&adu, frame->pdu, frame->pdu_size));
+    TMB_ERROR_CHECK(tmb_adu_finalize(&adu));
+    request->size = adu.size;
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_gateway_queue_init(tmb_gateway_queue_t *queue, tmb_gateway_request_t *requests, size_t capacity) {
+    TMB_ON_FALSE_RETURN(queue != NULL && requests != NULL && capacity > 0, TMB_E_INVALID_ARGUMENTS);
+
+    memset(queue, 0, sizeof(tmb_gateway_queue_t));
+    queue->requests = requests;
+    queue->capacity = capacity;
+    for (size_t i = 0; i < capacity; i++) {
+        requests[i].size = 0;
+    }
+
+    return TMB_SUCCESS;
+}
+
+size_t tmb_gateway_queue_size(const tmb_gateway_queue_t *queue) {
+    return queue->size;
+}
+
+/* characters that a request and its response take on the bus, that are its cost for the scheduler */
+static uint32_t tmb_gateway_request_cost(const tmb_gateway_request_t *request) {
+    const uint8_t *pdu = &request->adu[TMB_ADU_TCPIP_HEADER_SIZE];
+    size_t pdu_size = request->size - TMB_ADU_TCPIP_HEADER_SIZE;
+
+    /* address and CRC of both the frames, and a response as long as the typical write one */
+    uint32_t cost = 2 * (1 + TMB_ADU_CRC_LENGTH) + pdu_size + 5;
+    if (pdu_size < 5) {
+        return cost;
+    }
+
+    uint16_t quantity = TMB_UINT16(pdu, 3);
+    switch (pdu[0]) {
+    case TMB_FUNCTION_READ_COILS:
+    case TMB_FUNCTION_READ_DISCRETE_INPUTS:
+        return cost + (quantity + 7) / 8;
+
+    case TMB_FUNCTION_READ_HOLDING_REGISTERS:
+    case TMB_FUNCTION_READ_INPUT_REGISTERS:
+    case TMB_FUNCTION_READ_WRITE_MULTIPLE_REGISTERS:
+        return cost + quantity * 2;
+
+    default:
+        return cost;
+    }
+}
+
+static uint8_t tmb_gateway_lane(uint8_t function_code) {
+    return tmb_function_is_write(function_code) ? TMB_GATEWAY_LANE_WRITE : TMB_GATEWAY_LANE_READ;
+}
+
+static void tmb_gateway_request_copy(tmb_gateway_request_t *destination, const tmb_gateway_request_t *source) {
+    destination->context = source->context;
+    destination->tag = source->tag;
+    destination->size = source->size;
+    destination->queue_time_us = source->queue_time_us;
+    destination->lane = source->lane;
+    destination->weight = source->weight;
+    destination->finish_tag = source->finish_tag;
+    destination->sequence = source->sequence;
+    destination->transaction_identifier = source->transaction_identifier;
+    memcpy(destination->adu, source->adu, source->size);
+}
+
+/* returns a free slot for a request of the lane, or NULL if the queue is full */
+static tmb_gateway_request_t *tmb_gateway_queue_reserve(tmb_gateway_queue_t *queue, uint8_t lane) {
+    if (queue->size == queue->capacity) {
+        queue->metrics[lane].rejected++;
+
+        return NULL;
+    }
+
+    for (size_t i = 0; i < queue->capacity; i++) {
+        if (queue->requests[i].size == 0) {
+            return &queue->requests[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* tags a request just stored in a slot of the queue */
+static void tmb_gateway_queue_schedule(tmb_gateway_queue_t *queue, tmb_gateway_request_t *request) {
+    uint8_t lane = request->lane;
+    uint8_t unit_id = request->adu[TMB_ADU_TCPIP_HEADER_SIZE - 1];
+
+    /* a flow starts from its last request still waiting in the lane, or from the virtual time when
+     * it has none: a flow that was idle gets no credit for the time it did not use the bus */
+    uint64_t start = queue->virtual_time[lane];
+    for (size_t i = 0; i < queue->capacity; i++) {
+        const tmb_gateway_request_t *slot = &queue->requests[i];
+        if (slot != request && slot->size != 0 && slot->lane == lane && slot->context == request->context &&
+            slot->tag == request->tag && slot->adu[TMB_ADU_TCPIP_HEADER_SIZE - 1] == unit_id &&
+            slot->finish_tag > start) {
+            start = slot->finish_tag;
+        }
+    }
+
+    request->finish_tag = start + ((uint64_t)tmb_gateway_request_cost(request) << 8) / request->weight;
+    request->sequence = queue->sequence++;
+
+    queue->size++;
+    tmb_gateway_lane_metrics_t *metrics = &queue->metrics[lane];
+    metrics->depth++;
+    if (metrics->depth > metrics->max_depth) {
+        metrics->max_depth = metrics->depth;
+    }
+}
+
+tmb_error_t tmb_gateway_queue_push(tmb_gateway_queue_t *queue, const tmb_frame_t *frame, void *context,
+                                   uint32_t tag, uint8_t weight, uint64_t now_us) {
+    TMB_ON_FALSE_RETURN(queue != NULL && frame != NULL && frame->pdu_size >= 1, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(weight > 0, TMB_E_INVALID_ARGUMENTS);
+
+    uint8_t lane = tmb_gateway_lane(frame->pdu[0]);
+    tmb_gateway_request_t *request = tmb_gateway_queue_reserve(queue, lane);
+    TMB_ON_FALSE_RETURN(request != NULL, TMB_E_NO_MEMORY);
+
+    TMB_ERROR_CHECK(tmb_gateway_request_init(request, frame, context, tag));
+    request->queue_time_us = now_us;
+    request->lane = lane;
+    request->weight = weight;
+    tmb_gateway_queue_schedule(queue, request);
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_gateway_queue_push_request(tmb_gateway_queue_t *queue, const tmb_gateway_request_t *request) {
+    TMB_ON_FALSE_RETURN(queue != NULL && request != NULL && request->weight > 0, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(request->size > TMB_ADU_TCPIP_HEADER_SIZE && request->size <= TMB_ADU_TCPIP_MAX_SIZE,
+                        TMB_E_INVALID_ARGUMENTS);
+
+    uint8_t lane = tmb_gateway_lane(request->adu[TMB_ADU_TCPIP_HEADER_SIZE]);
+    tmb_gateway_request_t *slot = tmb_gateway_queue_reserve(queue, lane);
+    TMB_ON_FALSE_RETURN(slot != NULL, TMB_E_NO_MEMORY);
+
+    tmb_gateway_request_copy(slot, request);
+    slot->lane = lane;
+    tmb_gateway_queue_schedule(queue, slot);
+
+    return TMB_SUCCESS;
+}
+
+bool tmb_gateway_queue_pop(tmb_gateway_queue_t *queue, tmb_gateway_request_t *request, uint64_t now_us) {
+    if (queue->size == 0) {
+        return false;
+    }
+
+    /* the request with the lowest finish tag of the first lane that is not empty, the oldest on a tie */
+    tmb_gateway_request_t *next = NULL;
+    for (size_t i = 0; i < queue->capacity; i++) {
+        tmb_gateway_request_t *slot = &queue->requests[i];
+        if (slot->size == 0) {
+            continue;
+        }
+
+        if (next == NULL || slot->lane < next->lane ||
+            (slot->lane == next->lane && (slot->finish_tag < next->finish_tag ||
+                                          (slot->finish_tag == next->finish_tag && slot->sequence < next->sequence)))) {
+            next = slot;
+        }
+    }
+
+    queue->virtual_time[next->lane] = next->finish_tag;
+    queue->size--;
+
+    uint64_t wait_us = now_us > next->queue_time_us ? now_us - next->queue_time_us : 0;
+    tmb_gateway_lane_metrics_t *metrics = &queue->metrics[next->lane];
+    metrics->depth--;
+    metrics->dispatched++;
+    metrics->total_wait_us += wait_us;
+    if (wait_us > metrics->max_wait_us) {
+        metrics->max_wait_us = wait_us;
+    }
+
+    tmb_gateway_request_copy(request, next);
+    next->size = 0;
+
+    return true;
+}
+
+#ifdef TMB_ENABLE_CONCURRENCY
+
+tmb_error_t tmb_gateway_mailbox_init(tmb_gateway_mailbox_t *mailbox, tmb_gateway_request_t *requests,
+                                     size_t capacity) {
+    TMB_ON_FALSE_RETURN(mailbox != NULL && requests != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(capacity > 0 && (capacity & (capacity - 1)) == 0, TMB_E_INVALID_ARGUMENTS);
+
+    memset(mailbox, 0, sizeof(tmb_gateway_mailbox_t));
+    mailbox->requests = requests;
+    mailbox->capacity = capacity;
+    for (size_t i = 0; i < capacity; i++) {
+        requests[i].turn = i;
+    }
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_gateway_mailbox_push(tmb_gateway_mailbox_t *mailbox, const tmb_frame_t *frame, void *context,
+                                     uint32_t tag, uint8_t weight, uint64_t now_us) {
+    TMB_ON_FALSE_RETURN(mailbox != NULL && frame != NULL && weight > 0, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(frame->pdu_size >= 1 && frame->pdu_size <= TMB_PDU_MAX_SIZE, TMB_E_INVALID_ARGUMENTS);
+
+    /* a slot is free for the position p when its turn is p, and holds the request of p when it is p + 1.
+     * Producers claim a position moving the write index forward, then publish the request in its slot */
+    uint8_t lane = tmb_gateway_lane(frame->pdu[0]);
+    size_t position = TMB_ATOMIC_LOAD(&mailbox->write_index, TMB_ATOMIC_RELAXED);
+    tmb_gateway_request_t *slot;
+    while (true) {
+        slot = &mailbox->requests[position & (mailbox->capacity - 1)];
+        size_t turn = TMB_ATOMIC_LOAD(&slot->turn, TMB_ATOMIC_ACQUIRE);
+        if (turn == position) {
+            if (TMB_ATOMIC_COMPARE_EXCHANGE(&mailbox->write_index, &position, position + 1, true, TMB_ATOMIC_RELAXED,
+                                            TMB_ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if ((ptrdiff_t)(turn - position) < 0) {
+            /* the slot still holds the request of the previous round */
+            TMB_ATOMIC_ADD_FETCH(&mailbox->rejected[lane], 1, TMB_ATOMIC_RELAXED);
+
+            return TMB_E_NO_MEMORY;
+        } else {
+            position = TMB_ATOMIC_LOAD(&mailbox->write_index, TMB_ATOMIC_RELAXED);
+        }
+    }
+
+    /* can't fail, since the frame has been checked above */
+    tmb_gateway_request_init(slot, frame, context, tag);
+    slot->queue_time_us = now_us;
+    slot->lane = lane;
+    slot->weight = weight;
+    TMB_ATOMIC_STORE(&slot->turn, position + 1, TMB_ATOMIC_RELEASE);
+
+    return TMB_SUCCESS;
+}
+
+bool tmb_gateway_mailbox_pop(tmb_gateway_mailbox_t *mailbox, tmb_gateway_request_t *request) {
+    size_t position = mailbox->read_index;
+    tmb_gateway_request_t *slot = &mailbox->requests[position & (mailbox->capacity - 1)];
+    if (TMB_ATOMIC_LOAD(&slot->turn, TMB_ATOMIC_ACQUIRE) != position + 1) {
+        return false;
+    }
+
+    tmb_gateway_request_copy(request, slot);
+    TMB_ATOMIC_STORE(&slot->turn, position + mailbox->capacity, TMB_ATOMIC_RELEASE);
+    mailbox->read_index = position + 1;
+
+    return true;
+}
+
+#endif /* TMB_ENABLE_CONCURRENCY */
+
+tmb_error_t tmb_gateway_pipeline_init(tmb_gateway_pipeline_t *pipeline, tmb_gateway_request_t *requests,
+                                      size_t capacity) {
+    TMB_ON_FALSE_RETURN(pipeline != NULL && requests != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(capacity > 0 && capacity <= 65536, TMB_E_INVALID_ARGUMENTS);
+
+    memset(pipeline, 0, sizeof(tmb_gateway_pipeline_t));
+    pipeline->requests = requests;
+    pipeline->capacity = capacity;
+    for (size_t i = 0; i < capacity; i++) {
+        requests[i].size = 0;
+    }
+
+    return TMB_SUCCESS;
+}
+
+static tmb_gateway_request_t *tmb_gateway_pipeline_find(tmb_gateway_pipeline_t *pipeline,
+                                                        uint16_t transaction_identifier) {
+    for (size_t i = 0; i < pipeline->capacity; i++) {
+        tmb_gateway_request_t *request = &pipeline->requests[i];
+        if (request->size != 0 && ((request->adu[0] << 8) | request->adu[1]) == transaction_identifier) {
+            return request;
+        }
+    }
+
+    return NULL;
+}
+
+tmb_error_t tmb_gateway_pipeline_submit(tmb_gateway_pipeline_t *pipeline, const tmb_frame_t *frame, void *context,
+                                        uint32_t tag, uint64_t now_us, tmb_gateway_request_t **request) {
+    TMB_ON_FALSE_RETURN(pipeline != NULL && frame != NULL && request != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(pipeline->size < pipeline->capacity, TMB_E_NO_MEMORY);
+
+    tmb_gateway_request_t *slot = NULL;
+    for (size_t i = 0; i < pipeline->capacity && slot == NULL; i++) {
+        if (pipeline->requests[i].size == 0) {
+            slot = &pipeline->requests[i];
+        }
+    }
+
+    /* the identifiers are used in turn, thus a late response to a cancelled transaction is unlikely
+     * to match a new one */
+    uint16_t transaction_identifier = pipeline->next_transaction_identifier++;
+    while (tmb_gateway_pipeline_find(pipeline, transaction_identifier) != NULL) {
+        transaction_identifier = pipeline->next_transaction_identifier++;
+    }
+
+    tmb_frame_t upstream = *frame;
+    upstream.transaction_identifier = transaction_identifier;
+    TMB_ERROR_CHECK(tmb_gateway_request_init(slot, &upstream, context, tag));
+    slot->transaction_identifier = frame->transaction_identifier;
+    slot->queue_time_us = now_us;
+    pipeline->size++;
+    *request = slot;
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_gateway_pipeline_complete(tmb_gateway_pipeline_t *pipeline, const tmb_frame_t *frame,
+                                          tmb_gateway_request_t *response) {
+    TMB_ON_FALSE_RETURN(pipeline != NULL && frame != NULL && response != NULL, TMB_E_INVALID_ARGUMENTS);
+
+    tmb_gateway_request_t *request = tmb_gateway_pipeline_find(pipeline, frame->transaction_identifier);
+    TMB_ON_FALSE_RETURN(request != NULL && request->adu[TMB_ADU_TCPIP_HEADER_SIZE - 1] == frame->address,
+                        TMB_E_INVALID_RESPONSE);
+
+    /* the response is forwarded with the transaction identifier of the request */
+    tmb_frame_t downstream = *frame;
+    downstream.transaction_identifier = request->transaction_identifier;
+    tmb_error_t error = tmb_gateway_request_init(response, &downstream, request->context, request->tag);
+    response->transaction_identifier = request->transaction_identifier;
+    response->queue_time_us = request->queue_time_us;
+    request->size = 0;
+    pipeline->size--;
+
+    return error;
+}
+
+bool tmb_gateway_pipeline_cancel(tmb_gateway_pipeline_t *pipeline, uint64_t deadline_us, tmb_error_t exception_code,
+                                 tmb_gateway_request_t *response) {
+    tmb_gateway_request_t *oldest = NULL;
+    for (size_t i = 0; i < pipeline->capacity; i++) {
+        tmb_gateway_request_t *request = &pipeline->requests[i];
+        if (request->size != 0 && request->queue_time_us < deadline_us &&
+            (oldest == NULL || request->queue_time_us < oldest->queue_time_us)) {
+            oldest = request;
+        }
+    }
+
+    if (oldest == NULL) {
+        return false;
+    }
+
+    tmb_gateway_request_copy(response, oldest);
+    response->adu[0] = oldest->transaction_identifier >> 8;
+    response->adu[1] = oldest->transaction_identifier & 0xff;
+    tmb_gateway_request_set_exception(response, exception_code);
+    oldest->size = 0;
+    pipeline->size--;
+
+    return true;
+}
+
+void tmb_gateway_request_set_exception(tmb_gateway_request_t *request, tmb_error_t exception_code) {
+    uint8_t *adu = request->adu;
+
+    /* keep the MBAP header and the function code of the request */
+    adu[TMB_ADU_TCPIP_SIZE_OFFSET] = 0;
+    adu[TMB_ADU_TCPIP_SIZE_OFFSET + 1] = 3;
+    adu[TMB_ADU_TCPIP_HEADER_SIZE] |= 0x80;
+    adu[TMB_ADU_TCPIP_HEADER_SIZE + 1] = exception_code;
+    request->size = TMB_ADU_TCPIP_HEADER_SIZE + 2;
+}
+
+tmb_error_t tmb_gateway_forward(tmb_handle_t *handle, tmb_gateway_request_t *request) {
+    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+    TMB_ON_FALSE_RETURN(request != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(request->size > TMB_ADU_TCPIP_HEADER_SIZE && request->size <= TMB_ADU_TCPIP_MAX_SIZE,
+                        TMB_E_INVALID_ARGUMENTS);
+
+    uint8_t unit_id = request->adu[TMB_ADU_TCPIP_HEADER_SIZE - 1];
+    const uint8_t *pdu = &request->adu[TMB_ADU_TCPIP_HEADER_SIZE];
+    size_t pdu_size = request->size - TMB_ADU_TCPIP_HEADER_SIZE;
+
+    /* the size of the response to an unknown function is not known, thus it can't be received */
+    if (tmb_function_get(pdu[0]) == NULL) {
+        tmb_gateway_request_set_exception(request, TMB_E_ILLEGAL_FUNCTION);
+
+        return TMB_SUCCESS;
+    }
+
+    uint16_t transaction_identifier = handle->client.last_transaction_identifier++;
+    tmb_adu_t adu;
+    handle->client.reserved_size = 0;
+    TMB_ERROR_CHECK(tmb_adu_init(&adu, handle->buffer, handle->buffer_size, handle->encapsulation,
+                                 transaction_identifier, unit_id));
+    TMB_ERROR_CHECK(tmb_adu_add_bytes(&adu, pdu, pdu_size));
+    TMB_ERROR_CHECK(tmb_adu_finalize(&adu));
+
+    if (tmb_send(handle, adu.buffer, adu.size) != TMB_SUCCESS) {
+        tmb_gateway_request_set_exception(request, TMB_E_GATEWAY_PATH_UNAVAILABLE);
+
+        return TMB_SUCCESS;
+    }
+
+    if (unit_id == TMB_ADDRESS_BROADCAST && handle->encapsulation != TMB_TRANSPORT_PROTOCOL_TCPIP) {
+        /* devices don't answer broadcast requests, but the bus is held while they process them */
+        TMB_ERROR_CHECK(tmb_client_wait_turnaround(handle));
+
+        return TMB_IGNORED;
+    }
+
+    /* the response is forwarded as received, without parsing it */
+    size_t adu_size = 0;
+    tmb_error_t error = tmb_client_read_response(handle, handle->buffer, handle->buffer_size, transaction_identifier,
+                                                 NULL, &adu_size);
+    if (error != TMB_SUCCESS && !TMB_ERROR_IS_MODBUS_EXCEPTION(error)) {
+        tmb_gateway_request_set_exception(request, TMB_E_GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND);
+
+        return TMB_SUCCESS;
+    }
+
+    /* the response PDU replaces the request one, after the original MBAP header */
+    size_t response_offset = TMB_ADU_TCPIP_HEADER_SIZE;
+    size_t response_size = adu_size - TMB_ADU_TCPIP_HEADER_SIZE;
+    if (handle->encapsulation == TMB_TRANSPORT_PROTOCOL_RTU) {
+        response_offset = 1;
+        response_size = adu_size - 1 - TMB_ADU_CRC_LENGTH;
+    }
+
+    memcpy(&request->adu[TMB_ADU_TCPIP_HEADER_SIZE], &handle->buffer[response_offset], response_size);
+    request->adu[TMB_ADU_TCPIP_SIZE_OFFSET] = ((1 + response_size) >> 8) & 0xff;
+    request->adu[TMB_ADU_TCPIP_SIZE_OFFSET + 1] = (1 + response_size) & 0xff;
+    request->size = TMB_ADU_TCPIP_HEADER_SIZE + response_size;
+
+    return TMB_SUCCESS;
+}
+
+#define TMB_POLL_WHEEL_BITS 6
+
+static void tmb_poll_scheduler_insert(tmb_poll_scheduler_t *scheduler, tmb_poll_task_t *task) {
+    uint64_t expires = task->expires_tick;
+    if (expires < scheduler->current_tick) {
+        /* late: the task is due at the next tick processed */
+        expires = scheduler->current_tick;
+    }
+
+    /* the level whose slots span the delay: level l holds the tasks due in less than 64^(l + 1) ticks */
+    uint64_t delay = expires - scheduler->current_tick;
+    uint8_t level = 0;
+    while (level < TMB_POLL_WHEEL_LEVELS - 1 && delay >= (uint64_t)1 << (TMB_POLL_WHEEL_BITS * (level + 1))) {
+        level++;
+    }
+    if (delay >= (uint64_t)1 << (TMB_POLL_WHEEL_BITS * TMB_POLL_WHEEL_LEVELS)) {
+        /* beyond the span of the wheel: the task moves down each time its slot comes round */
+        expires = scheduler->current_tick + ((uint64_t)1 << (TMB_POLL_WHEEL_BITS * TMB_POLL_WHEEL_LEVELS)) - 1;
+    }
+
+    uint8_t slot = (expires >> (TMB_POLL_WHEEL_BITS * level)) & (TMB_POLL_WHEEL_SLOTS - 1);
+    tmb_poll_task_t **head = &scheduler->slots[level][slot];
+    task->level = level;
+    task->slot = slot;
+    task->next = *head;
+    task->pprev = head;
+    if (*head != NULL) {
+        (*head)->pprev = &task->next;
+    }
+    *head = task;
+    scheduler->occupied[level] |= (uint64_t)1 << slot;
+}
+
+static void tmb_poll_scheduler_unlink(tmb_poll_scheduler_t *scheduler, tmb_poll_task_t *task) {
+    *task->pprev = task->next;
+    if (task->next != NULL) {
+        task->next->pprev = task->pprev;
+    }
+    if (scheduler->slots[task->level][task->slot] == NULL) {
+        scheduler->occupied[task->level] &= ~((uint64_t)1 << task->slot);
+    }
+    task->pprev = NULL;
+}
+
+/* moves the tasks of the slots that start at the current tick to the lower levels */
+static void tmb_poll_scheduler_cascade(tmb_poll_scheduler_t *scheduler) {
+    for (uint8_t level = 1; level < TMB_POLL_WHEEL_LEVELS; level++) {
+        uint64_t tick = scheduler->current_tick >> (TMB_POLL_WHEEL_BITS * level);
+        if ((scheduler->current_tick & (((uint64_t)1 << (TMB_POLL_WHEEL_BITS * level)) - 1)) != 0) {
+            return;
+        }
+
+        uint8_t slot = tick & (TMB_POLL_WHEEL_SLOTS - 1);
+        tmb_poll_task_t *task = scheduler->slots[level][slot];
+        scheduler->slots[level][slot] = NULL;
+        scheduler->occupied[level] &= ~((uint64_t)1 << slot);
+        while (task != NULL) {
+            tmb_poll_task_t *next = task->next;
+            tmb_poll_scheduler_insert(scheduler, task);
+            task = next;
+        }
+    }
+}
+
+tmb_error_t tmb_poll_scheduler_init(tmb_poll_scheduler_t *scheduler, uint32_t tick_us, uint64_t now_us) {
+    TMB_ON_FALSE_RETURN(scheduler != NULL && tick_us > 0, TMB_E_INVALID_ARGUMENTS);
+
+    memset(scheduler, 0, sizeof(tmb_poll_scheduler_t));
+    scheduler->tick_us = tick_us;
+    scheduler->current_tick = now_us / tick_us;
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_poll_scheduler_add(tmb_poll_scheduler_t *scheduler, tmb_poll_task_t *task, uint64_t now_us) {
+    TMB_ON_FALSE_RETURN(scheduler != NULL && task != NULL && task->handle != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(task->period_us > 0 && task->phase_us < task->period_us, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(task->max_period_us == 0 || task->max_period_us >= task->period_us, TMB_E_INVALID_ARGUMENTS);
+    if (task->block != NULL) {
+        /* both requests have the same layout */
+        const tmb_request_pdu_t *request = &task->request;
+        TMB_ON_FALSE_RETURN(request->function_code == TMB_FUNCTION_READ_HOLDING_REGISTERS ||
+                                    request->function_code == TMB_FUNCTION_READ_INPUT_REGISTERS,
+                            TMB_E_INVALID_ARGUMENTS);
+        TMB_ON_FALSE_RETURN(request->read_holding_registers.start_address == task->block->start_address &&
+                                    request->read_holding_registers.quantity == task->block->quantity,
+                            TMB_E_INVALID_ARGUMENTS);
+    }
+
+    /* the first time from now that is phase_us plus a multiple of period_us */
+    uint64_t elapsed = now_us % task->period_us;
+    task->due_us = now_us - elapsed + task->phase_us;
+    if (elapsed > task->phase_us) {
+        task->due_us += task->period_us;
+    }
+
+    task->polls = 0;
+    task->overruns = 0;
+    task->last_jitter_us = 0;
+    task->max_jitter_us = 0;
+    task->total_jitter_us = 0;
+    task->changes = 0;
+    task->current_period_us = task->period_us;
+    task->unchanged_polls = 0;
+    task->has_data = false;
+    task->scheduler = scheduler;
+    task->last_due_us = task->due_us;
+
+    /* rounded up, not to dispatch the task before it is due */
+    task->expires_tick = (task->due_us + scheduler->tick_us - 1) / scheduler->tick_us;
+    tmb_poll_scheduler_insert(scheduler, task);
+    scheduler->size++;
+
+    return TMB_SUCCESS;
+}
+
+void tmb_poll_scheduler_remove(tmb_poll_scheduler_t *scheduler, tmb_poll_task_t *task) {
+    if (task->pprev == NULL) {
+        return;
+    }
+
+    tmb_poll_scheduler_unlink(scheduler, task);
+    scheduler->size--;
+}
+
+/* moves a task of the scheduler to a new due time */
+static void tmb_poll_scheduler_rearm(tmb_poll_scheduler_t *scheduler, tmb_poll_task_t *task, uint64_t due_us) {
+    tmb_poll_scheduler_unlink(scheduler, task);
+    task->due_us = due_us;
+    task->expires_tick = (due_us + scheduler->tick_us - 1) / scheduler->tick_us;
+    tmb_poll_scheduler_insert(scheduler, task);
+}
+
+tmb_error_t tmb_poll_scheduler_wake(tmb_poll_scheduler_t *scheduler, tmb_poll_task_t *task, uint64_t now_us) {
+    TMB_ON_FALSE_RETURN(scheduler != NULL && task != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(task->scheduler == scheduler && task->pprev != NULL, TMB_E_INVALID_ARGUMENTS);
+
+    /* due at the start of the current tick, to be dispatched by the next call, even if the scheduler
+     * already processed the current tick */
+    task->current_period_us = task->period_us;
+    task->unchanged_polls = 0;
+    tmb_poll_scheduler_rearm(scheduler, task, now_us - now_us % scheduler->tick_us);
+
+    return TMB_SUCCESS;
+}
+
+/* updates the statistics of a task that is dispatched, and schedules its next poll */
+static tmb_poll_task_t *tmb_poll_scheduler_dispatch(tmb_poll_scheduler_t *scheduler, tmb_poll_task_t *task,
+                                                    uint64_t now_us) {
+    tmb_poll_scheduler_unlink(scheduler, task);
+
+    uint64_t jitter_us = now_us > task->due_us ? now_us - task->due_us : 0;
+    task->polls++;
+    task->last_jitter_us = jitter_us;
+    task->total_jitter_us += jitter_us;
+    if (jitter_us > task->max_jitter_us) {
+        task->max_jitter_us = jitter_us;
+    }
+
+    /* the periods that went by are skipped, not to poll in a burst to catch up */
+    uint64_t missed = jitter_us / task->current_period_us;
+    task->overruns += missed;
+    task->last_due_us = task->due_us;
+    task->due_us += (missed + 1) * task->current_period_us;
+    task->expires_tick = (task->due_us + scheduler->tick_us - 1) / scheduler->tick_us;
+    tmb_poll_scheduler_insert(scheduler, task);
+
+    return task;
+}
+
+tmb_poll_task_t *tmb_poll_scheduler_next(tmb_poll_scheduler_t *scheduler, uint64_t now_us) {
+    uint64_t now_tick = now_us / scheduler->tick_us;
+
+    while (scheduler->current_tick <= now_tick) {
+        uint8_t index = scheduler->current_tick & (TMB_POLL_WHEEL_SLOTS - 1);
+        tmb_poll_task_t *task = scheduler->slots[0][index];
+        if (task != NULL) {
+            return tmb_poll_scheduler_dispatch(scheduler, task, now_us);
+        }
+
+        /* skip to the next slot of the level 0 that has tasks, or to the end of the level 0 */
+        uint64_t pending = scheduler->occupied[0] & ~(((uint64_t)2 << index) - 1);
+        uint64_t next_tick = (scheduler->current_tick | (TMB_POLL_WHEEL_SLOTS - 1)) + 1;
+        if (pending != 0) {
+            next_tick = (scheduler->current_tick & ~(uint64_t)(TMB_POLL_WHEEL_SLOTS - 1)) + TMB_CTZ64(pending);
+        }
+
+        scheduler->current_tick = next_tick <= now_tick ? next_tick : now_tick + 1;
+        if ((scheduler->current_tick & (TMB_POLL_WHEEL_SLOTS - 1)) == 0) {
+            tmb_poll_scheduler_cascade(scheduler);
+        }
+    }
+
+    /* once the current tick is processed, the slot of the next tick may hold tasks that are already due:
+     * the ones due in the middle of the current tick, whose tick is rounded up, and the ones woken meanwhile */
+    tmb_poll_task_t *task = scheduler->slots[0][scheduler->current_tick & (TMB_POLL_WHEEL_SLOTS - 1)];
+    while (task != NULL && task->due_us > now_us) {
+        task = task->next;
+    }
+    if (task != NULL) {
+        return tmb_poll_scheduler_dispatch(scheduler, task, now_us);
+    }
+
+    return NULL;
+}
+
+uint64_t tmb_poll_scheduler_next_due(const tmb_poll_scheduler_t *scheduler) {
+    if (scheduler->size == 0) {
+        return UINT64_MAX;
+    }
+
+    /* the start of the first slot with tasks of each level, after the current one. The slot of the current
+     * tick at the upper levels has already been moved down, thus it holds tasks due a round later */
+    uint64_t next_tick = UINT64_MAX;
+    for (uint8_t level = 0; level < TMB_POLL_WHEEL_LEVELS; level++) {
+        if (scheduler->occupied[level] == 0) {
+            continue;
+        }
+
+        uint8_t shift = TMB_POLL_WHEEL_BITS * level;
+        uint64_t tick = scheduler->current_tick >> shift;
+        uint8_t index = tick & (TMB_POLL_WHEEL_SLOTS - 1);
+        uint8_t first = level == 0 ? index : index + 1;
+
+        /* the slots from the first one to the end of the wheel, then the ones from its start */
+        uint64_t rotated = first < TMB_POLL_WHEEL_SLOTS ? scheduler->occupied[level] >> first : 0;
+        uint64_t distance;
+        if (rotated != 0) {
+            distance = first - index + TMB_CTZ64(rotated);
+        } else {
+            distance = TMB_POLL_WHEEL_SLOTS - index + TMB_CTZ64(scheduler->occupied[level]);
+        }
+
+        uint64_t slot_tick = (tick + distance) << shift;
+        if (slot_tick < next_tick) {
+            next_tick = slot_tick;
+        }
+    }
+
+    if (next_tick < scheduler->current_tick) {
+        next_tick = scheduler->current_tick;
+    }
+
+    return next_tick * scheduler->tick_us;
+}
+
+/* returns the values read by a response, or NULL if it reads nothing */
+static const void *tmb_poll_response_data(const tmb_response_pdu_t *response, size_t *size) {
+    switch (response->function_code) {
+    case TMB_FUNCTION_READ_COILS:
+        *size = response->read_coils.byte_count;
+        return response->read_coils.coil_status;
+
+    case TMB_FUNCTION_READ_DISCRETE_INPUTS:
+        *size = response->read_discrete_inputs.byte_count;
+        return response->read_discrete_inputs.input_status;
+
+    case TMB_FUNCTION_READ_HOLDING_REGISTERS:
+        *size = response->read_holding_registers.byte_count;
+        return response->read_holding_registers.register_values;
+
+    case TMB_FUNCTION_READ_INPUT_REGISTERS:
+        *size = response->read_input_registers.byte_count;
+        return response->read_input_registers.register_values;
+
+    case TMB_FUNCTION_READ_WRITE_MULTIPLE_REGISTERS:
+        *size = response->read_write_multiple_registers.byte_count;
+        return response->read_write_multiple_registers.register_values;
+
+    default:
+        return NULL;
+    }
+}
+
+/* returns a bit for each of the 8 values that differs from the snapshot */
+static uint8_t tmb_register_block_compare(const uint16_t *values, const uint16_t *snapshot) {
+#ifdef TMB_SSE2_SUPPORTED
+    __m128i equal = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *)values),
+                                    _mm_loadu_si128((const __m128i *)snapshot));
+
+    /* narrow each 16 bit lane to a byte, to get one bit per value */
+    return ~_mm_movemask_epi8(_mm_packs_epi16(equal, _mm_setzero_si128())) & 0xff;
+#else
+    uint8_t mask = 0;
+    for (uint8_t i = 0; i < 8; i++) {
+        mask |= (values[i] != snapshot[i]) << i;
+    }
+
+    return mask;
+#endif
+}
+
+tmb_error_t tmb_register_block_init(tmb_register_block_t *block, uint16_t start_address, uint16_t quantity,
+                                    uint16_t *snapshot, const uint16_t *deadbands, bool is_signed) {
+    TMB_ON_FALSE_RETURN(block != NULL && snapshot != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(quantity > 0 && quantity <= TMB_READ_HOLDING_REGISTER_MAX_QUANTITY, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN((uint32_t)start_address + quantity <= 0x10000, TMB_E_INVALID_ARGUMENTS);
+
+    memset(block, 0, sizeof(tmb_register_block_t));
+    block->start_address = start_address;
+    block->quantity = quantity;
+    block->snapshot = snapshot;
+    block->deadbands = deadbands;
+    block->is_signed = is_signed;
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_register_block_diff(tmb_register_block_t *block, const uint16_t *values,
+                                    tmb_register_change_t *changes, size_t *changes_size) {
+    TMB_ON_FALSE_RETURN(block != NULL && values != NULL && changes != NULL && changes_size != NULL,
+                        TMB_E_INVALID_ARGUMENTS);
 
-    switch (request->function_code) {
-    case TMB_FUNCTION_READ_COILS:
-        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, request->read_coils.start_address));
-        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, request->read_coils.quantity));
+    *changes_size = 0;
+    if (!block->has_snapshot) {
+        for (uint16_t i = 0; i < block->quantity; i++) {
+            changes[i] = (tmb_register_change_t){ block->start_address + i, values[i], values[i] };
+            block->snapshot[i] = values[i];
+        }
+        block->has_snapshot = true;
+        *changes_size = block->quantity;
+
+        return TMB_SUCCESS;
+    }
+
+    /* the registers are compared 8 at a time, and only the ones that differ are looked at one by one */
+    for (uint16_t base = 0; base < block->quantity; base += 8) {
+        uint8_t mask;
+        if (base + 8 <= block->quantity) {
+            mask = tmb_register_block_compare(&values[base], &block->snapshot[base]);
+        } else {
+            mask = 0;
+            for (uint16_t i = base; i < block->quantity; i++) {
+                mask |= (values[i] != block->snapshot[i]) << (i - base);
+            }
+        }
+
+        while (mask != 0) {
+            uint16_t i = base + TMB_CTZ64(mask);
+            mask &= mask - 1;
+
+            int32_t difference = block->is_signed ? (int16_t)values[i] - (int16_t)block->snapshot[i]
+                                                  : (int32_t)values[i] - (int32_t)block->snapshot[i];
+            if (block->deadbands != NULL && (uint32_t)(difference < 0 ? -difference : difference) <=
+                                                    block->deadbands[i]) {
+                continue;
+            }
+
+            changes[(*changes_size)++] = (tmb_register_change_t){ block->start_address + i, block->snapshot[i],
+                                                                  values[i] };
+            block->snapshot[i] = values[i];
+        }
+    }
+
+    return TMB_SUCCESS;
+}
+
+/* decodes values of the given number of words, stored in the given order, to their native representation */
+static tmb_error_t tmb_decode_words(const uint16_t *registers, size_t count, size_t words, tmb_word_order_t order,
+                                   void *values) {
+    TMB_ON_FALSE_RETURN(count == 0 || (registers != NULL && values != NULL), TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(order >= TMB_WORD_ORDER_ABCD && order <= TMB_WORD_ORDER_DCBA, TMB_E_INVALID_ARGUMENTS);
+
+    bool low_word_first = order == TMB_WORD_ORDER_CDAB || order == TMB_WORD_ORDER_DCBA;
+    bool swap_bytes = order == TMB_WORD_ORDER_BADC || order == TMB_WORD_ORDER_DCBA;
+    uint8_t *output = values;
+    size_t i = 0;
+
+#ifdef TMB_SSE2_SUPPORTED
+    /* x86 is little endian: values stored least significant word first are laid out as native values already,
+     * for the other orders the words of each value are reversed. 8 registers are decoded at a time */
+    for (; i + 8 <= count * words; i += 8) {
+        __m128i vector = _mm_loadu_si128((const __m128i *)&registers[i]);
+        if (!low_word_first && words == 2) {
+            vector = _mm_shufflehi_epi16(_mm_shufflelo_epi16(vector, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+        } else if (!low_word_first) {
+            vector = _mm_shufflehi_epi16(_mm_shufflelo_epi16(vector, _MM_SHUFFLE(0, 1, 2, 3)), _MM_SHUFFLE(0, 1, 2, 3));
+        }
+        if (swap_bytes) {
+            vector = _mm_or_si128(_mm_slli_epi16(vector, 8), _mm_srli_epi16(vector, 8));
+        }
+        _mm_storeu_si128((__m128i *)&output[i * 2], vector);
+    }
+#endif
+
+    for (; i < count * words; i += words) {
+        uint64_t value = 0;
+        for (size_t j = 0; j < words; j++) {
+            uint16_t word = registers[low_word_first ? i + words - 1 - j : i + j];
+            if (swap_bytes) {
+                word = (uint16_t)((word << 8) | (word >> 8));
+            }
+            value = (value << 16) | word;
+        }
+
+        if (words == 2) {
+            uint32_t value32 = value;
+            memcpy(&output[i * 2], &value32, sizeof(value32));
+        } else {
+            memcpy(&output[i * 2], &value, sizeof(value));
+        }
+    }
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_decode_float(const uint16_t *registers, size_t count, tmb_word_order_t order, float *values) {
+    return tmb_decode_words(registers, count, 2, order, values);
+}
+
+tmb_error_t tmb_decode_int32(const uint16_t *registers, size_t count, tmb_word_order_t order, int32_t *values) {
+    return tmb_decode_words(registers, count, 2, order, values);
+}
+
+tmb_error_t tmb_decode_uint32(const uint16_t *registers, size_t count, tmb_word_order_t order, uint32_t *values) {
+    return tmb_decode_words(registers, count, 2, order, values);
+}
+
+tmb_error_t tmb_decode_int64(const uint16_t *registers, size_t count, tmb_word_order_t order, int64_t *values) {
+    return tmb_decode_words(registers, count, 4, order, values);
+}
+
+tmb_error_t tmb_decode_double(const uint16_t *registers, size_t count, tmb_word_order_t order, double *values) {
+    return tmb_decode_words(registers, count, 4, order, values);
+}
+
+/* compares the data read with the one of the previous poll. Returns false if the response reads nothing */
+static bool tmb_poll_task_compare(tmb_poll_task_t *task, const tmb_response_pdu_t *response, bool *changed) {
+    size_t size = 0;
+    const uint8_t *data = tmb_poll_response_data(response, &size);
+    if (data == NULL) {
+        return false;
+    }
+
+    if (task->block != NULL) {
+        /* the registers may not be aligned in the buffer of the handle */
+        uint16_t values[TMB_READ_HOLDING_REGISTER_MAX_QUANTITY];
+        tmb_register_change_t changes[TMB_READ_HOLDING_REGISTER_MAX_QUANTITY];
+        size_t changes_size = 0;
+        if (size != task->block->quantity * 2U) {
+            return false;
+        }
+        memcpy(values, data, size);
+        if (tmb_register_block_diff(task->block, values, changes, &changes_size) != TMB_SUCCESS) {
+            return false;
+        }
+
+        if (changes_size > 0 && task->on_changes != NULL) {
+            task->on_changes(task, changes, changes_size);
+        }
+        *changed = task->has_data && changes_size > 0;
+        task->has_data = true;
+
+        return true;
+    }
+
+    /* FNV-1a: the data is not kept, thus only a hash of it is compared */
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 0x100000001b3;
+    }
+
+    *changed = task->has_data && hash != task->data_hash;
+    task->data_hash = hash;
+    task->has_data = true;
+
+    return true;
+}
+
+/* updates the period of an adaptive task after a poll */
+static void tmb_poll_task_adapt(tmb_poll_task_t *task, bool changed) {
+    if (changed) {
+        task->changes++;
+    }
+
+    if (task->max_period_us <= task->period_us) {
+        return;
+    }
+
+    if (changed) {
+        /* back to the fastest period, starting from the poll just done */
+        task->unchanged_polls = 0;
+        task->current_period_us = task->period_us;
+        uint64_t due_us = task->last_due_us + task->period_us;
+        if (task->scheduler != NULL && task->pprev != NULL && due_us < task->due_us) {
+            tmb_poll_scheduler_rearm(task->scheduler, task, due_us);
+        }
+    } else if (++task->unchanged_polls >= TMB_POLL_BACKOFF_POLLS) {
+        task->unchanged_polls = 0;
+        task->current_period_us = task->current_period_us <= task->max_period_us / 2 ? task->current_period_us * 2
+                                                                                      : task->max_period_us;
+    }
+}
+
+tmb_error_t tmb_poll_task_execute(tmb_poll_task_t *task) {
+    TMB_ON_FALSE_RETURN(task != NULL, TMB_E_INVALID_ARGUMENTS);
+
+    /* the response is not written by the requests that fail before an exception response is received */
+    tmb_response_pdu_t response;
+    memset(&response, 0, sizeof(tmb_response_pdu_t));
+    tmb_error_t error = tmb_client_send_request(task->handle, &task->request, &response);
+    bool changed = false;
+    bool had_data = task->has_data;
+    if (error == TMB_SUCCESS && tmb_poll_task_compare(task, &response, &changed) && had_data) {
+        tmb_poll_task_adapt(task, changed);
+    }
+    if (task->on_response != NULL) {
+        task->on_response(task, error, &response);
+    }
+
+    return error;
+}
+
+#ifdef TMB_ENABLE_CONCURRENCY
+
+tmb_error_t tmb_result_ring_init(tmb_result_ring_t *ring, tmb_poll_result_t *results, size_t capacity,
+                                 tmb_result_ring_policy_t policy) {
+    TMB_ON_FALSE_RETURN(ring != NULL && results != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(capacity > 0 && (capacity & (capacity - 1)) == 0, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(policy == TMB_RESULT_RING_DROP_NEW || policy == TMB_RESULT_RING_OVERWRITE_OLDEST,
+                        TMB_E_INVALID_ARGUMENTS);
+
+    memset(ring, 0, sizeof(tmb_result_ring_t));
+    ring->results = results;
+    ring->capacity = capacity;
+    ring->policy = policy;
+    for (size_t i = 0; i < capacity; i++) {
+        /* as if written by the position of the previous round */
+        results[i].turn = 2 * (i - capacity) + 2;
+    }
+
+    return TMB_SUCCESS;
+}
+
+tmb_error_t tmb_result_ring_publish(tmb_result_ring_t *ring, const tmb_request_pdu_t *request, tmb_error_t error,
+                                    const tmb_response_pdu_t *response, uint64_t timestamp_us) {
+    TMB_ON_FALSE_RETURN(ring != NULL && request != NULL && (error != TMB_SUCCESS || response != NULL),
+                        TMB_E_INVALID_ARGUMENTS);
+
+    /* the slot of the position p holds its result when its turn is 2p + 2, and is being written when it is
+     * 2p + 1. Overwriting producers claim a position without looking at the consumer, that detects the
+     * results replaced while it was late, or while it was copying them, from the turn */
+    size_t position;
+    if (ring->policy == TMB_RESULT_RING_OVERWRITE_OLDEST) {
+        position = TMB_ATOMIC_FETCH_ADD(&ring->write_index, 1, TMB_ATOMIC_RELAXED);
+    } else {
+        position = TMB_ATOMIC_LOAD(&ring->write_index, TMB_ATOMIC_RELAXED);
+        do {
+            if (position - TMB_ATOMIC_LOAD(&ring->read_index, TMB_ATOMIC_ACQUIRE) >= ring->capacity) {
+                TMB_ATOMIC_ADD_FETCH(&ring->dropped, 1, TMB_ATOMIC_RELAXED);
+
+                return TMB_E_NO_MEMORY;
+            }
+        } while (!TMB_ATOMIC_COMPARE_EXCHANGE(&ring->write_index, &position, position + 1, true, TMB_ATOMIC_RELAXED,
+                                              TMB_ATOMIC_RELAXED));
+    }
+
+    /* a producer of the previous round may still be writing the slot, if the other producers went around
+     * the whole ring meanwhile: wait for it, giving way since it may have been preempted */
+    tmb_poll_result_t *slot = &ring->results[position & (ring->capacity - 1)];
+    while (TMB_ATOMIC_LOAD(&slot->turn, TMB_ATOMIC_ACQUIRE) != 2 * (position - ring->capacity) + 2) {
+        TMB_SPIN_YIELD();
+    }
+    TMB_ATOMIC_STORE(&slot->turn, 2 * position + 1, TMB_ATOMIC_RELAXED);
+    TMB_ATOMIC_FENCE(TMB_ATOMIC_RELEASE);
+
+    slot->timestamp_us = timestamp_us;
+    slot->error = error;
+    slot->unit_id = request->unit_id;
+    slot->function_code = request->function_code;
+    /* start address and quantity are at the same position for all the read requests */
+    slot->start_address = request->read_coils.start_address;
+    slot->quantity = request->read_coils.quantity;
+    slot->size = 0;
+
+    size_t size = 0;
+    const void *data = error == TMB_SUCCESS ? tmb_poll_response_data(response, &size) : NULL;
+    if (data != NULL && size <= sizeof(slot->status)) {
+        memcpy(slot->status, data, size);
+        slot->size = size;
+    }
+    TMB_ATOMIC_STORE(&slot->turn, 2 * position + 2, TMB_ATOMIC_RELEASE);
+
+    return TMB_SUCCESS;
+}
+
+bool tmb_result_ring_consume(tmb_result_ring_t *ring, tmb_poll_result_t *result) {
+    while (true) {
+        size_t position = ring->read_index;
+        tmb_poll_result_t *slot = &ring->results[position & (ring->capacity - 1)];
+        size_t turn = TMB_ATOMIC_LOAD(&slot->turn, TMB_ATOMIC_ACQUIRE);
+        if (turn == 2 * position + 2) {
+            memcpy(result, slot, sizeof(tmb_poll_result_t));
+            TMB_ATOMIC_FENCE(TMB_ATOMIC_ACQUIRE);
+            if (TMB_ATOMIC_LOAD(&slot->turn, TMB_ATOMIC_RELAXED) == turn) {
+                TMB_ATOMIC_STORE(&ring->read_index, position + 1, TMB_ATOMIC_RELEASE);
+
+                return true;
+            }
+
+            /* overwritten while copying it */
+            continue;
+        }
+
+        if ((ptrdiff_t)(turn - (2 * position + 2)) < 0) {
+            /* not published yet */
+            return false;
+        }
+
+        /* the producers went around the ring: skip to the oldest result that can still be there */
+        size_t oldest = TMB_ATOMIC_LOAD(&ring->write_index, TMB_ATOMIC_RELAXED) - ring->capacity;
+        if ((ptrdiff_t)(oldest - position) <= 0) {
+            oldest = position + 1;
+        }
+        TMB_ATOMIC_ADD_FETCH(&ring->dropped, oldest - position, TMB_ATOMIC_RELAXED);
+        TMB_ATOMIC_STORE(&ring->read_index, oldest, TMB_ATOMIC_RELEASE);
+    }
+}
+
+#endif /* TMB_ENABLE_CONCURRENCY */
+
+#ifdef TMB_POSIX_SUPPORTED
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <netinet/in.h>
+
+typedef struct {
+    tmb_transport_protocol_t transport_protocol;
+    int fd;
+} tmb_posix_ctx_t;
+
+static int tmb_posix_transport_read(void *user_ctx, uint8_t *buffer, size_t nbytes) {
+    tmb_posix_ctx_t *transport = user_ctx;
+
+    return read(transport->fd, buffer, nbytes);
+}
+
+static int tmb_posix_transport_read_timeout(void *user_ctx, uint8_t *buffer, size_t nbytes, uint32_t timeout_us) {
+    tmb_posix_ctx_t *transport = user_ctx;
+
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(transport->fd, &fds);
+
+    struct timeval timeout = {
+        .tv_sec = timeout_us / 1000000,
+        .tv_usec = timeout_us % 1000000,
+    };
+
+    int ready = select(transport->fd + 1, &fds, NULL, NULL, &timeout);
+    if (ready <= 0) {
+        return ready;
+    }
+
+    return read(transport->fd, buffer, nbytes);
+}
+
+static int tmb_posix_transport_write(void *user_ctx, const uint8_t *buffer, size_t nbytes) {
+    tmb_posix_ctx_t *transport = user_ctx;
+
+#ifdef MSG_NOSIGNAL
+    if (transport->transport_protocol == TMB_TRANSPORT_PROTOCOL_TCPIP) {
+        /* don't raise SIGPIPE if the peer has closed the connection */
+        return send(transport->fd, buffer, nbytes, MSG_NOSIGNAL);
+    }
+#endif
+
+    return write(transport->fd, buffer, nbytes);
+}
+
+static tmb_error_t tmb_posix_transport_tcpip_open(tmb_posix_ctx_t *ctx,
+                                                  const tmb_posix_transport_tcp_config_t *config) {
+    struct hostent *hostent = gethostbyname(config->host);
+    if (hostent == NULL) {
+        return TMB_E_TCP_HOST_NOT_FOUND;
+    }
+
+    ctx->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (ctx->fd <= 0) {
+        return TMB_E_TCP_OPEN_SOCKET_FAILED;
+    }
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(config->port),
+        .sin_addr = {
+            .s_addr = *((in_addr_t *)hostent->h_addr_list[0]),
+        },
+    };
+
+    if (connect(ctx->fd, (const struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        return TMB_E_TCP_CONNECTION_REFUSED;
+    }
+
+    return TMB_SUCCESS;
+}
+
+static tmb_error_t tmb_posix_transport_serial_open(tmb_posix_ctx_t *ctx,
+                                                   const tmb_posix_transport_serial_config_t *config) {
+    ctx->fd = open(config->device, O_RDWR | O_NOCTTY);
+    if (ctx->fd <= 0) {
+        return TMB_E_OPEN_SERIAL_FAILED;
+    }
+
+    struct termios tty;
+    if (tcgetattr(ctx->fd, &tty) != 0) {
+        return TMB_E_SERIAL_CONFIGURATION_FAILED;
+    }
+
+    /* set parity */
+    switch (config->parity) {
+    case TMB_SERIAL_PARITY_NONE:
+        tty.c_cflag &= ~PARENB;
         break;
-    case TMB_FUNCTION_READ_DISCRETE_INPUTS:
-        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, request->read_discrete_inputs.start_address));
-        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, request->read_discrete_inputs.quantity));
+
+    case TMB_SERIAL_PARITY_EVEN:
+        tty.c_cflag |= PARENB;
+        break;
+
+    case TMB_SERIAL_PARITY_ODD:
+        tty.c_cflag |= PARODD | PARENB;
         break;
+    }
+
+    /* set stop bits */
+    if (config->stop_bits == TMB_SERIAL_STOP_BITS_2)
+        tty.c_cflag |= CSTOPB;
+    else
+        tty.c_cflag &= ~CSTOPB;
+
+    /* set bits */
+    tty.c_cflag &= ~CSIZE;
+
+    if (config->data_bits == TMB_SERIAL_DATA_BITS_7) {
+        /* 8 data bits */
+        tty.c_cflag |= CS7;
+    } else {
+        /* 7 data bits */
+        tty.c_cflag |= CS8;
+    }
+
+    /* disable RTS/CTS hardware flow control */
+    tty.c_cflag &= ~CRTSCTS;
+
+    /* turn on READ & ignore ctrl lines (CLOCAL = 1) */
+    tty.c_cflag |= CREAD | CLOCAL;
+
+    /* disable canonical mode */
+    tty.c_lflag &= ~ICANON;
+
+    /* disable echo */
+    tty.c_lflag &= ~ECHO;
+
+    /* disable erasure */
+    tty.c_lflag &= ~ECHOE;
+
+    /* disable new-line echo */
+    tty.c_lflag &= ~ECHONL;
+
+    /* disable interpretation of INTR, QUIT and SUSP */
+    tty.c_lflag &= ~ISIG;
+
+    /* turn off s/w flow ctrl */
+    tty.c_iflag &= ~(IXON | IXOFF | IXANY);
+
+    /* disable any special handling of received bytes */
+    tty.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL);
+
+    /* prevent special interpretation of output bytes (e.g. newline chars) */
+    tty.c_oflag &= ~OPOST;
+
+    /* prevent conversion of newline to carriage return/line feed */
+    tty.c_oflag &= ~ONLCR;
+
+#ifndef __linux__
+    /* prevent conversion of tabs to spaces */
+    tty.c_oflag &= ~OXTABS;
+
+    /* prevent removal of C-d chars (0x004) in output */
+    tty.c_oflag &= ~ONOEOT;
+#endif
+
+    /* how much to wait for a read */
+    tty.c_cc[VTIME] = 0;
+
+    /* minimum read size: 1 byte */
+    tty.c_cc[VMIN] = 1;
 
-    case TMB_FUNCTION_READ_HOLDING_REGISTERS:
-        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, request->read_holding_registers.start_address));
-        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, request->read_holding_registers.quantity));
-        break;
-    case TMB_FUNCTION_READ_INPUT_REGISTERS:
-        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, request->read_input_registers.start_address));
-        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, request->read_input_registers.quantity));
-        break;
-    case TMB_FUNCTION_WRITE_SINGLE_COIL:
-        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, request->write_single_coil.address));
-        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, request->write_single_coil.value));
-        break;
-    case TMB_FUNCTION_WRITE_SINGLE_REGISTER:
-        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, request->write_single_register.address));
-        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, request->write_single_register.value));
-        break;
-    case TMB_FUNCTION_WRITE_MULTIPLE_COILS:
-        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, request->write_multiple_coils.start_address));
-        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, request->write_multiple_coils.quantity));
-        TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, request->write_multiple_coils.byte_count));
-        TMB_ERROR_CHECK(tmb_adu_add_bytes(adu, request->write_multiple_coils.values,
-                                          request->write_multiple_registers.byte_count));
-        break;
-    case TMB_FUNCTION_WRITE_MULTIPLE_REGISTERS:
-        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, request->write_multiple_registers.start_address));
-        TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, request->write_multiple_registers.quantity));
-        TMB_ERROR_CHECK(tmb_adu_add_uint8(adu, request->write_multiple_registers.byte_count));
-        for (uint16_t i = 0; i < request->write_multiple_registers.quantity; i++) {
-            TMB_ERROR_CHECK(tmb_adu_add_uint16_be(adu, request->write_multiple_registers.values[i]));
-        }
-        break;
+    /* set port speed */
+    if (cfsetispeed(&tty, config->baudrate) != 0) {
+        return TMB_E_SERIAL_CONFIGURATION_FAILED;
+    }
 
-    /* codes not implemented */
-    case TMB_FUNCTION_READ_EXCEPTION_STATUS:
-    case TMB_FUNCTION_DIAGNOSTIC:
-    case TMB_FUNCTION_GET_COM_EVENT_COUNTER:
-    case TMB_FUNCTION_GET_COM_EVENT_LOG:
-    case TMB_FUNCTION_REPORT_SLAVE_ID:
-    case TMB_FUNCTION_READ_FILE_RECORD:
-    case TMB_FUNCTION_WRITE_FILE_RECORD:
-    case TMB_FUNCTION_MASK_WRITE_REGISTER:
-    case TMB_FUNCTION_READ_WRITE_MULTIPLE_REGISTERS:
-    case TMB_FUNCTION_READ_FIFO_QUEUE:
-    case TMB_FUNCTION_ENCAPSULATED_TRANSPORT:
-    default:
-        return TMB_E_ILLEGAL_FUNCTION;
+    if (cfsetospeed(&tty, config->baudrate) != 0) {
+        return TMB_E_SERIAL_CONFIGURATION_FAILED;
+    }
+
+    if (tcsetattr(ctx->fd, TCSANOW, &tty) != 0) {
+        return TMB_E_SERIAL_CONFIGURATION_FAILED;
     }
 
     return TMB_SUCCESS;
 }
 
-static size_t tmb_get_response_size(uint8_t function_code, uint8_t first_byte) {
-    if (TMB_IS_FUNCTION_EXCEPTION_CODE(function_code)) {
-        /* Exception PDU has a size of 2 */
-        return 2;
-    }
+tmb_error_t tmb_posix_transport_new(const tmb_posix_transport_config_t *config, tmb_transport_t **out_transport) {
+    TMB_ON_FALSE_RETURN(config != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(out_transport != NULL, TMB_E_INVALID_ARGUMENTS);
 
-    switch (function_code) {
-    case TMB_FUNCTION_READ_COILS:
-        return 2 + first_byte;
+    tmb_error_t error = TMB_FAILURE;
+    tmb_transport_t *transport = NULL;
+    tmb_posix_ctx_t *ctx = NULL;
 
-    case TMB_FUNCTION_READ_DISCRETE_INPUTS:
-        return 2 + first_byte;
+    ctx = calloc(1, sizeof(tmb_posix_ctx_t));
+    if (ctx == NULL) {
+        error = TMB_E_NO_MEMORY;
+        goto error;
+    }
+    ctx->transport_protocol = config->transport_protocol;
+    if (config->transport_protocol == TMB_TRANSPORT_PROTOCOL_TCPIP) {
+        error = tmb_posix_transport_tcpip_open(ctx, &config->tcp);
+    } else {
+        error = tmb_posix_transport_serial_open(ctx, &config->serial);
+    }
+    if (error != TMB_SUCCESS) {
+        goto error;
+    }
 
-    case TMB_FUNCTION_READ_HOLDING_REGISTERS:
-        return 2 + first_byte;
+    transport = calloc(1, sizeof(tmb_transport_t));
+    if (transport == NULL) {
+        error = TMB_E_NO_MEMORY;
+        goto error;
+    }
+    transport->user_data = ctx;
+    transport->read = tmb_posix_transport_read;
+    transport->write = tmb_posix_transport_write;
+    transport->read_timeout = tmb_posix_transport_read_timeout;
+
+    if (config->transport_protocol != TMB_TRANSPORT_PROTOCOL_TCPIP) {
+        /* start bit, data bits, parity bit and stop bits */
+        uint8_t bits_per_character = 1 + config->serial.data_bits + config->serial.stop_bits +
+                                     (config->serial.parity != TMB_SERIAL_PARITY_NONE);
+        error = tmb_rtu_get_timing(config->serial.baudrate, bits_per_character, &transport->rtu_t15_us,
+                                   &transport->rtu_t35_us);
+        if (error != TMB_SUCCESS) {
+            goto error;
+        }
+    }
 
-    case TMB_FUNCTION_READ_INPUT_REGISTERS:
-        return 2 + first_byte;
+    *out_transport = transport;
 
-    case TMB_FUNCTION_WRITE_SINGLE_COIL:
-        return 5;
+    return TMB_SUCCESS;
 
-    case TMB_FUNCTION_WRITE_SINGLE_REGISTER:
-        return 5;
+error:
+    tmb_posix_transport_free(transport);
 
-    case TMB_FUNCTION_WRITE_MULTIPLE_COILS:
-        return 5;
+    return error;
+}
 
-    case TMB_FUNCTION_WRITE_MULTIPLE_REGISTERS:
-        return 5;
+void tmb_posix_transport_free(tmb_transport_t *transport) {
+    if (transport != NULL && transport->user_data != NULL) {
+        /* free associated context */
+        tmb_posix_ctx_t *ctx = transport->user_data;
+        if (ctx->transport_protocol == TMB_TRANSPORT_PROTOCOL_TCPIP) {
+            shutdown(ctx->fd, SHUT_RDWR);
+        }
 
-    /* codes not implemented */
-    case TMB_FUNCTION_READ_EXCEPTION_STATUS:
-    case TMB_FUNCTION_DIAGNOSTIC:
-    case TMB_FUNCTION_GET_COM_EVENT_COUNTER:
-    case TMB_FUNCTION_GET_COM_EVENT_LOG:
-    case TMB_FUNCTION_REPORT_SLAVE_ID:
-    case TMB_FUNCTION_READ_FILE_RECORD:
-    case TMB_FUNCTION_WRITE_FILE_RECORD:
-    case TMB_FUNCTION_MASK_WRITE_REGISTER:
-    case TMB_FUNCTION_READ_WRITE_MULTIPLE_REGISTERS:
-    case TMB_FUNCTION_READ_FIFO_QUEUE:
-    case TMB_FUNCTION_ENCAPSULATED_TRANSPORT:
-    default:
-        return TMB_E_ILLEGAL_FUNCTION;
+        close(ctx->fd);
+        free(ctx);
     }
 
-    return TMB_SUCCESS;
+    free(transport);
 }
 
-static uint16_t *tmb_get_buffer_uint16(uint8_t *buffer, size_t buffer_size) {
-    uint16_t *result = (uint16_t *)buffer;
+#ifdef TMB_LINUX_SUPPORTED
 
-    for (size_t i = 0; i < buffer_size - 1; i += 2) {
-        uint16_t value = (buffer[i] << 8) | buffer[i + 1];
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/tcp.h>
 
-        result[i / 2] = value;
-    }
+#define TMB_POSIX_TCP_SERVER_MAX_EVENTS 64
 
-    return result;
-}
+/* time for which a listening socket is not polled, after the process ran out of file descriptors */
+#define TMB_POSIX_TCP_ACCEPT_BACKOFF_MS 100
 
-static tmb_error_t tmb_response_parse(tmb_response_pdu_t *response, uint8_t *buffer, size_t buffer_size) {
-    TMB_ON_FALSE_RETURN(buffer != NULL && buffer_size >= 2, TMB_E_INVALID_ARGUMENTS);
-    TMB_ON_FALSE_RETURN(tmb_get_response_size(buffer[0], buffer[1]) <= buffer_size, TMB_E_INVALID_ARGUMENTS);
+typedef struct {
+    /** socket of the connection, -1 if the slot is free */
+    int fd;
 
-    response->function_code = buffer[0];
-    TMB_ON_FALSE_RETURN(!TMB_IS_FUNCTION_EXCEPTION_CODE(response->function_code), TMB_E_INVALID_ARGUMENTS);
+    /** number of bytes received and not yet processed */
+    size_t size;
 
-    switch (response->function_code) {
-    case TMB_FUNCTION_READ_COILS:
-        response->read_coils.byte_count = buffer[1];
-        response->read_coils.coil_status = &buffer[2];
-        break;
+    uint8_t buffer[TMB_ADU_TCPIP_MAX_SIZE];
+} tmb_posix_tcp_connection_t;
 
-    case TMB_FUNCTION_READ_DISCRETE_INPUTS:
-        response->read_discrete_inputs.byte_count = buffer[1];
-        response->read_discrete_inputs.input_status = &buffer[2];
-        break;
+typedef struct {
+    const tmb_posix_tcp_server_config_t *config;
+    size_t index;
+    int listen_fd;
+    int epoll_fd;
 
-    case TMB_FUNCTION_READ_HOLDING_REGISTERS:
-        response->read_holding_registers.byte_count = buffer[1];
-        response->read_holding_registers.register_values = tmb_get_buffer_uint16(&buffer[2], buffer[1]);
-        break;
+    /* time at which the listening socket is polled again, 0 if it is polled */
+    uint64_t listen_resume_us;
 
-    case TMB_FUNCTION_READ_INPUT_REGISTERS:
-        response->read_input_registers.byte_count = buffer[1];
-        response->read_input_registers.register_values = tmb_get_buffer_uint16(&buffer[2], buffer[1]);
-        break;
+    /* the transport writes to the connection that is currently being served */
+    tmb_posix_ctx_t ctx;
+    tmb_transport_t transport;
+    tmb_handle_t handle;
+    uint8_t buffer[TMB_ADU_TCPIP_MAX_SIZE];
 
-    case TMB_FUNCTION_WRITE_SINGLE_COIL:
-        response->write_single_coil.address = TMB_UINT16(buffer, 1);
-        response->write_single_coil.value = TMB_UINT16(buffer, 3);
-        break;
+    tmb_posix_tcp_connection_t *connections;
+} tmb_posix_tcp_worker_t;
 
-    case TMB_FUNCTION_WRITE_SINGLE_REGISTER:
-        response->write_single_register.address = TMB_UINT16(buffer, 1);
-        response->write_single_register.value = TMB_UINT16(buffer, 3);
-        break;
+static uint64_t tmb_posix_now_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
 
-    case TMB_FUNCTION_WRITE_MULTIPLE_COILS:
-        response->write_multiple_coils.start_address = TMB_UINT16(buffer, 1);
-        response->write_multiple_coils.quantity = TMB_UINT16(buffer, 3);
-        break;
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
 
-    case TMB_FUNCTION_WRITE_MULTIPLE_REGISTERS:
-        response->write_multiple_registers.start_address = TMB_UINT16(buffer, 1);
-        response->write_multiple_registers.quantity = TMB_UINT16(buffer, 3);
-        break;
+static tmb_error_t tmb_posix_tcp_listen(const char *host, uint16_t port, int *out_fd) {
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr = {
+            .s_addr = htonl(INADDR_ANY),
+        },
+    };
 
-    /* codes not implemented */
-    case TMB_FUNCTION_READ_EXCEPTION_STATUS:
-    case TMB_FUNCTION_DIAGNOSTIC:
-    case TMB_FUNCTION_GET_COM_EVENT_COUNTER:
-    case TMB_FUNCTION_GET_COM_EVENT_LOG:
-    case TMB_FUNCTION_REPORT_SLAVE_ID:
-    case TMB_FUNCTION_READ_FILE_RECORD:
-    case TMB_FUNCTION_WRITE_FILE_RECORD:
-    case TMB_FUNCTION_MASK_WRITE_REGISTER:
-    case TMB_FUNCTION_READ_WRITE_MULTIPLE_REGISTERS:
-    case TMB_FUNCTION_READ_FIFO_QUEUE:
-    case TMB_FUNCTION_ENCAPSULATED_TRANSPORT:
-    default:
-        return TMB_E_ILLEGAL_FUNCTION;
+    if (host != NULL) {
+        struct hostent *hostent = gethostbyname(host);
+        if (hostent == NULL) {
+            return TMB_E_TCP_HOST_NOT_FOUND;
+        }
+        addr.sin_addr.s_addr = *((in_addr_t *)hostent->h_addr_list[0]);
     }
 
-    return TMB_SUCCESS;
-}
-#include <stdio.h>
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return TMB_E_TCP_OPEN_SOCKET_FAILED;
+    }
 
-static tmb_error_t tmb_send(tmb_handle_t *handle, const uint8_t *buffer, size_t buffer_size) {
-    fprintf(stderr, "sending: ");
-    for (size_t i = 0; i < buffer_size; i++) {
-        fprintf(stderr, "%02X ", buffer[i]);
+    /* every worker binds its own socket to the same port, and the kernel balances connections between them */
+    int enable = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) != 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) != 0) {
+        close(fd);
+        return TMB_E_TCP_OPEN_SOCKET_FAILED;
     }
-    fprintf(stderr, "\n");
 
-    size_t transmitted_bytes = 0;
-    while (transmitted_bytes < buffer_size) {
-        /* write may send less bytes than requested. In this case, repeat the operation */
-        int nbytes = handle->transport->write(handle->transport->user_data, buffer + transmitted_bytes,
-                                              buffer_size - transmitted_bytes);
-        if (nbytes <= 0) {
-            return TMB_E_TRANSPORT;
-        }
-        transmitted_bytes += nbytes;
+    if (bind(fd, (const struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return TMB_E_TCP_BIND_FAILED;
     }
 
+    *out_fd = fd;
+
     return TMB_SUCCESS;
 }
 
-static tmb_error_t tmb_receive(tmb_handle_t *handle, uint8_t *buffer, size_t buffer_size) {
-    fprintf(stderr, "receiving %u bytes\n", buffer_size);
-
-    size_t received_bytes = 0;
-    while (received_bytes < buffer_size) {
-        /* write may send less bytes than requested. In this case, repeat the operation */
-        int nbytes = handle->transport->read(handle->transport->user_data, buffer + received_bytes,
-                                             buffer_size - received_bytes);
-        fprintf(stderr, "received %u bytes\n", buffer_size);
-
-        if (nbytes <= 0) {
-            return TMB_E_TRANSPORT;
-        }
-        received_bytes += nbytes;
-    }
+/* the listening socket is registered in the epoll instance with null data */
+static int tmb_posix_tcp_listen_poll(int epoll_fd, int listen_fd, int operation, uint32_t events) {
+    struct epoll_event event = { .events = events, .data.u64 = 0 };
 
-    return TMB_SUCCESS;
+    return epoll_ctl(epoll_fd, operation, listen_fd, &event);
 }
 
-/* public functions implementation */
+/* accepts a pending connection as a non-blocking socket, thus a client that doesn't read its responses fails
+ * the send instead of stalling the event loop. Returns -1 when there is no connection left to accept */
+static int tmb_posix_tcp_accept(int epoll_fd, int listen_fd, uint64_t *resume_time_us) {
+    while (true) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd >= 0) {
+            if (fcntl(fd, F_SETFL, O_NONBLOCK) != 0 || fcntl(fd, F_SETFD, FD_CLOEXEC) != 0) {
+                close(fd);
+                continue;
+            }
 
-tmb_error_t tmb_init(tmb_handle_t *handle, tmb_mode_t mode, tmb_transport_protocol_t encapsulation, uint8_t *buffer,
-                     size_t buffer_size, const tmb_transport_t *transport) {
-    TMB_ON_FALSE_RETURN(handle != NULL, TMB_E_INVALID_ARGUMENTS);
-    memset(handle, 0, sizeof(tmb_handle_t));
+            int enable = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
 
-    TMB_ON_FALSE_RETURN(buffer != NULL, TMB_E_INVALID_ARGUMENTS);
-    TMB_ON_FALSE_RETURN(transport != NULL, TMB_E_INVALID_ARGUMENTS);
-    TMB_ON_FALSE_RETURN(transport->read != NULL, TMB_E_INVALID_ARGUMENTS);
-    TMB_ON_FALSE_RETURN(transport->write != NULL, TMB_E_INVALID_ARGUMENTS);
-    TMB_ON_FALSE_RETURN(encapsulation != TMB_TRANSPORT_PROTOCOL_ASCII, TMB_E_NOT_IMPLEMENTED);
+            return fd;
+        }
 
-    handle->buffer = buffer;
-    handle->buffer_size = buffer_size;
-    handle->mode = mode;
-    handle->encapsulation = encapsulation;
-    handle->transport = transport;
-    handle->is_valid = true;
+        if (errno == EINTR || errno == ECONNABORTED) {
+            continue;
+        }
 
-    return TMB_SUCCESS;
+        if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+            /* the connection stays pending, thus the listening socket would be reported again right away:
+             * it is not polled until the backoff expires, see tmb_posix_tcp_listen_resume() */
+            tmb_posix_tcp_listen_poll(epoll_fd, listen_fd, EPOLL_CTL_MOD, 0);
+            *resume_time_us = tmb_posix_now_us() + TMB_POSIX_TCP_ACCEPT_BACKOFF_MS * 1000;
+        }
+
+        return -1;
+    }
 }
 
-tmb_error_t tmb_request_validate(const tmb_request_pdu_t *request) {
-    TMB_ON_FALSE_RETURN(request != NULL, TMB_E_INVALID_ARGUMENTS);
+/* polls again the listening socket once its backoff expired, and returns the time to wait for it, in
+ * milliseconds, or -1 if it is polled */
+static int tmb_posix_tcp_listen_resume(int epoll_fd, int listen_fd, uint64_t *resume_time_us) {
+    if (*resume_time_us == 0) {
+        return -1;
+    }
 
-    switch (request->function_code) {
-    case TMB_FUNCTION_READ_COILS:
-        TMB_ON_FALSE_RETURN(TMB_READ_COIL_MIN_QUANTITY <= request->read_coils.quantity &&
-                                    request->read_coils.quantity <= TMB_READ_COIL_MAX_QUANTITY,
-                            TMB_E_ILLEGAL_DATA_VALUE);
-        break;
-    case TMB_FUNCTION_READ_DISCRETE_INPUTS:
-        TMB_ON_FALSE_RETURN(TMB_READ_DISCRETE_INPUT_MIN_QUANTITY <= request->read_discrete_inputs.quantity &&
-                                    request->read_discrete_inputs.quantity <= TMB_READ_DISCRETE_INPUT_MAX_QUANTITY,
-                            TMB_E_ILLEGAL_DATA_VALUE);
-        break;
+    uint64_t now_us = tmb_posix_now_us();
+    if (now_us < *resume_time_us) {
+        /* rounded up, not to wake up before the deadline */
+        return (int)((*resume_time_us - now_us + 999) / 1000);
+    }
 
-    case TMB_FUNCTION_READ_HOLDING_REGISTERS:
-        TMB_ON_FALSE_RETURN(TMB_READ_HOLDING_REGISTER_MIN_QUANTITY <= request->read_holding_registers.quantity &&
-                                    request->read_holding_registers.quantity <= TMB_READ_HOLDING_REGISTER_MAX_QUANTITY,
-                            TMB_E_ILLEGAL_DATA_VALUE);
-        break;
-    case TMB_FUNCTION_READ_INPUT_REGISTERS:
-        TMB_ON_FALSE_RETURN(TMB_READ_INPUT_REGISTER_MIN_QUANTITY <= request->read_input_registers.quantity &&
-                                    request->read_holding_registers.quantity <= TMB_READ_HOLDING_REGISTER_MAX_QUANTITY,
-                            TMB_E_ILLEGAL_DATA_VALUE);
-        break;
-    case TMB_FUNCTION_WRITE_SINGLE_COIL:
-        TMB_ON_FALSE_RETURN(request->write_single_coil.value == TMB_WRITE_SINGLE_COIL_TRUE_VALUE ||
-                                    request->write_single_coil.value == TMB_WRITE_SINGLE_COIL_FALSE_VALUE,
-                            TMB_E_ILLEGAL_DATA_VALUE);
-        break;
-    case TMB_FUNCTION_WRITE_SINGLE_REGISTER:
-        break;
-    case TMB_FUNCTION_WRITE_MULTIPLE_COILS:
-        TMB_ON_FALSE_RETURN(TMB_WRITE_MULTIPLE_COILS_MIN_QUANTITY <= request->write_multiple_coils.quantity &&
-                                    request->write_multiple_coils.quantity <= TMB_WRITE_MULTIPLE_COILS_MAX_QUANTITY,
-                            TMB_E_ILLEGAL_DATA_VALUE);
-        TMB_ON_FALSE_RETURN(request->write_multiple_coils.byte_count ==
-                                    request->write_multiple_coils.quantity / 8 +
-                                            (request->write_multiple_coils.quantity % 8 == 0),
-                            TMB_E_ILLEGAL_DATA_VALUE);
-        break;
-    case TMB_FUNCTION_WRITE_MULTIPLE_REGISTERS:
-        TMB_ON_FALSE_RETURN(TMB_WRITE_MULTIPLE_REGISTERS_MIN_QUANTITY <= request->write_multiple_registers.quantity &&
-                                    request->write_multiple_registers.quantity <= TMB_WRITE_MULTIPLE_COILS_MAX_QUANTITY,
-                            TMB_E_ILLEGAL_DATA_VALUE);
-        TMB_ON_FALSE_RETURN(request->write_multiple_registers.byte_count ==
-                                    request->write_multiple_registers.quantity * 2,
-                            TMB_E_ILLEGAL_DATA_VALUE);
-        break;
+    tmb_posix_tcp_listen_poll(epoll_fd, listen_fd, EPOLL_CTL_MOD, EPOLLIN);
+    *resume_time_us = 0;
 
-    /* codes not implemented */
-    case TMB_FUNCTION_READ_EXCEPTION_STATUS:
-    case TMB_FUNCTION_DIAGNOSTIC:
-    case TMB_FUNCTION_GET_COM_EVENT_COUNTER:
-    case TMB_FUNCTION_GET_COM_EVENT_LOG:
-    case TMB_FUNCTION_REPORT_SLAVE_ID:
-    case TMB_FUNCTION_READ_FILE_RECORD:
-    case TMB_FUNCTION_WRITE_FILE_RECORD:
-    case TMB_FUNCTION_MASK_WRITE_REGISTER:
-    case TMB_FUNCTION_READ_WRITE_MULTIPLE_REGISTERS:
-    case TMB_FUNCTION_READ_FIFO_QUEUE:
-    case TMB_FUNCTION_ENCAPSULATED_TRANSPORT:
-    default:
-        return TMB_E_ILLEGAL_FUNCTION;
+    return -1;
+}
+
+static tmb_error_t tmb_posix_tcp_worker_init(tmb_posix_tcp_worker_t *worker) {
+    worker->ctx.transport_protocol = TMB_TRANSPORT_PROTOCOL_TCPIP;
+    worker->ctx.fd = -1;
+    worker->transport.user_data = &worker->ctx;
+    worker->transport.read = tmb_posix_transport_read;
+    worker->transport.write = tmb_posix_transport_write;
+
+    TMB_ERROR_CHECK(tmb_init(&worker->handle, TMB_MODE_SERVER, TMB_TRANSPORT_PROTOCOL_TCPIP, worker->buffer,
+                             sizeof(worker->buffer), &worker->transport));
+
+    if (worker->config->on_worker_init != NULL) {
+        TMB_ERROR_CHECK(worker->config->on_worker_init(worker->config->user_data, worker->index, &worker->handle));
+    }
+
+    TMB_ERROR_CHECK(tmb_posix_tcp_listen(worker->config->host, worker->config->port, &worker->listen_fd));
+
+    worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (worker->epoll_fd < 0) {
+        return TMB_FAILURE;
+    }
+
+    /* the listening socket is the only one registered without a connection */
+    if (tmb_posix_tcp_listen_poll(worker->epoll_fd, worker->listen_fd, EPOLL_CTL_ADD, EPOLLIN) != 0) {
+        return TMB_FAILURE;
     }
 
     return TMB_SUCCESS;
 }
 
-tmb_error_t tmb_client_send_request(tmb_handle_t *handle, const tmb_request_pdu_t *request,
-                                    tmb_response_pdu_t *response) {
-    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
-    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
-    TMB_ON_FALSE_RETURN(request != NULL, TMB_E_INVALID_ARGUMENTS);
-    TMB_ON_FALSE_RETURN(response != NULL, TMB_E_INVALID_ARGUMENTS);
+static void tmb_posix_tcp_worker_deinit(tmb_posix_tcp_worker_t *worker) {
+    if (worker->listen_fd >= 0) {
+        close(worker->listen_fd);
+        worker->listen_fd = -1;
+    }
 
-    /* pre-validate the request, to avoid sending invalid requests to the server */
-    TMB_ERROR_CHECK(tmb_request_validate(request));
+    if (worker->epoll_fd >= 0) {
+        close(worker->epoll_fd);
+        worker->epoll_fd = -1;
+    }
+}
 
-    /* constructs request PDU */
-    tmb_adu_t adu;
-    TMB_ERROR_CHECK(tmb_adu_init(&adu, handle->buffer, handle->buffer_size, handle->encapsulation,
-                                 handle->client.last_transaction_identifier++, handle->client.device_address));
-    TMB_ERROR_CHECK(tmb_adu_serialize_request(&adu, request));
-    TMB_ERROR_CHECK(tmb_adu_finalize(&adu));
+static void tmb_posix_tcp_worker_accept(tmb_posix_tcp_worker_t *worker) {
+    while (true) {
+        int fd = tmb_posix_tcp_accept(worker->epoll_fd, worker->listen_fd, &worker->listen_resume_us);
+        if (fd < 0) {
+            return;
+        }
 
-    /* send request to transport */
-    TMB_ERROR_CHECK(tmb_send(handle, adu.buffer, adu.size));
+        tmb_posix_tcp_connection_t *connection = NULL;
+        for (size_t i = 0; i < worker->config->max_connections; i++) {
+            if (worker->connections[i].fd < 0) {
+                connection = &worker->connections[i];
+                break;
+            }
+        }
 
-    size_t response_offset = 0;
-    if (handle->encapsulation == TMB_TRANSPORT_PROTOCOL_RTU || handle->encapsulation == TMB_TRANSPORT_PROTOCOL_ASCII) {
-        response_offset = 1;
-    } else {
-        response_offset = 7;
+        if (connection == NULL) {
+            /* too many connections */
+            close(fd);
+            continue;
+        }
+
+        struct epoll_event event = { .events = EPOLLIN, .data.ptr = connection };
+        if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            close(fd);
+            continue;
+        }
+
+        connection->fd = fd;
+        connection->size = 0;
     }
+}
 
-    /* the server here processed the response. Peek 2 bytes from the response
-     * to know their status (success/failure) and size, then read the whole response */
-    TMB_ERROR_CHECK(tmb_receive(handle, handle->buffer, response_offset + TMB_RESPONSE_LOOKAHEAD_BYTES));
+static void tmb_posix_tcp_worker_close(tmb_posix_tcp_worker_t *worker, tmb_posix_tcp_connection_t *connection) {
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+    connection->fd = -1;
+    connection->size = 0;
+}
 
-    if (TMB_IS_FUNCTION_EXCEPTION_CODE(handle->buffer[response_offset])) {
-        /* an exception occurred. Return an error, that is the exception code returned by the server */
+static tmb_error_t tmb_posix_tcp_worker_serve(tmb_posix_tcp_worker_t *worker, tmb_posix_tcp_connection_t *connection) {
+    ssize_t nbytes = recv(connection->fd, connection->buffer + connection->size,
+                          sizeof(connection->buffer) - connection->size, 0);
+    if (nbytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return TMB_SUCCESS;
+    }
+    TMB_ON_FALSE_RETURN(nbytes > 0, TMB_E_TRANSPORT);
+    connection->size += nbytes;
+
+    /* a read may contain a partial request, as well as more than one request */
+    size_t offset = 0;
+    while (connection->size - offset >= TMB_ADU_TCPIP_HEADER_SIZE) {
+        const uint8_t *frame = &connection->buffer[offset];
+        size_t frame_size = TMB_ADU_TCPIP_SIZE_OFFSET + 2 + TMB_UINT16(frame, TMB_ADU_TCPIP_SIZE_OFFSET);
+        TMB_ON_FALSE_RETURN(frame_size > TMB_ADU_TCPIP_HEADER_SIZE && frame_size <= TMB_ADU_TCPIP_MAX_SIZE,
+                            TMB_E_TRANSPORT);
+
+        if (connection->size - offset < frame_size) {
+            break;
+        }
 
-        uint8_t exception_code = handle->buffer[response_offset + 1];
-        if (exception_code != 0) {
-            return (tmb_error_t)exception_code;
+        memcpy(worker->buffer, frame, frame_size);
+        offset += frame_size;
+
+        size_t response_size = 0;
+        tmb_error_t error = tmb_server_process_request(&worker->handle, frame_size, &response_size);
+        if (error == TMB_IGNORED) {
+            continue;
         }
+        TMB_ERROR_CHECK(error);
 
-        /* function code says an error is occurred, but exception code is 0. Should not happen! */
-        return TMB_FAILURE;
+        /* the socket is non-blocking: a response that doesn't fit its buffer fails, closing the connection */
+        worker->ctx.fd = connection->fd;
+        TMB_ERROR_CHECK(tmb_send(&worker->handle, worker->buffer, response_size));
     }
 
-    size_t response_size = tmb_get_response_size(handle->buffer[response_offset], handle->buffer[response_offset + 1]);
-    if (handle->encapsulation == TMB_TRANSPORT_PROTOCOL_RTU || handle->encapsulation == TMB_TRANSPORT_PROTOCOL_ASCII) {
-        response_size += TMB_ADU_CRC_LENGTH;
+    memmove(connection->buffer, &connection->buffer[offset], connection->size - offset);
+    connection->size -= offset;
+
+    return TMB_SUCCESS;
+}
+
+static void *tmb_posix_tcp_worker_run(void *arg) {
+    tmb_posix_tcp_worker_t *worker = arg;
+    struct epoll_event events[TMB_POSIX_TCP_SERVER_MAX_EVENTS];
+
+    while (true) {
+        int timeout_ms = tmb_posix_tcp_listen_resume(worker->epoll_fd, worker->listen_fd, &worker->listen_resume_us);
+        int nevents = epoll_wait(worker->epoll_fd, events, TMB_POSIX_TCP_SERVER_MAX_EVENTS, timeout_ms);
+        if (nevents < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return NULL;
+        }
+
+        for (int i = 0; i < nevents; i++) {
+            tmb_posix_tcp_connection_t *connection = events[i].data.ptr;
+            if (connection == NULL) {
+                tmb_posix_tcp_worker_accept(worker);
+                continue;
+            }
+
+            if (tmb_posix_tcp_worker_serve(worker, connection) != TMB_SUCCESS ||
+                (events[i].events & (EPOLLERR | EPOLLHUP)) != 0) {
+                tmb_posix_tcp_worker_close(worker, connection);
+            }
+        }
     }
+}
 
-    if (response_size > TMB_RESPONSE_LOOKAHEAD_BYTES) {
-        TMB_ON_FALSE_RETURN(response_size <= handle->buffer_size, TMB_E_NO_MEMORY);
+tmb_error_t tmb_posix_tcp_server_run(const tmb_posix_tcp_server_config_t *config) {
+    TMB_ON_FALSE_RETURN(config != NULL, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(config->workers > 0 && config->max_connections > 0, TMB_E_INVALID_ARGUMENTS);
 
-        /* read remaining bytes */
-        TMB_ERROR_CHECK(tmb_receive(handle, handle->buffer + TMB_RESPONSE_LOOKAHEAD_BYTES + response_offset,
-                                    response_size - TMB_RESPONSE_LOOKAHEAD_BYTES));
+    tmb_error_t error = TMB_FAILURE;
+    tmb_posix_tcp_worker_t *workers = calloc(config->workers, sizeof(tmb_posix_tcp_worker_t));
+    tmb_posix_tcp_connection_t *connections =
+            calloc(config->workers * config->max_connections, sizeof(tmb_posix_tcp_connection_t));
+    if (workers == NULL || connections == NULL) {
+        error = TMB_E_NO_MEMORY;
+        goto error;
     }
 
-    fprintf(stderr, "response: ");
-    for (size_t i = 0; i < response_size + response_offset; i++) {
-        fprintf(stderr, "%02x ", handle->buffer[i]);
+    for (size_t i = 0; i < config->workers; i++) {
+        workers[i].config = config;
+        workers[i].index = i;
+        workers[i].listen_fd = -1;
+        workers[i].epoll_fd = -1;
+        workers[i].connections = &connections[i * config->max_connections];
+        for (size_t j = 0; j < config->max_connections; j++) {
+            workers[i].connections[j].fd = -1;
+        }
     }
-    fprintf(stderr, "\n");
 
-    if (handle->encapsulation == TMB_TRANSPORT_PROTOCOL_RTU) {
-        uint16_t crc = tmb_crc16(handle->buffer, response_offset + response_size - TMB_ADU_CRC_LENGTH);
-        fprintf(stderr, "crc = %04x\n", crc);
+    /* open all the sockets before starting any thread, to report configuration errors to the caller */
+    for (size_t i = 0; i < config->workers; i++) {
+        error = tmb_posix_tcp_worker_init(&workers[i]);
+        if (error != TMB_SUCCESS) {
+            goto error;
+        }
+    }
 
-        if (handle->buffer[response_offset + response_size - 2] != (crc & 0xFF) ||
-            handle->buffer[response_offset + response_size - 1] != ((crc >> 8) & 0xFF)) {
-            return TMB_E_INVALID_CRC;
+    for (size_t i = 1; i < config->workers; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, tmb_posix_tcp_worker_run, &workers[i]) != 0) {
+            /* the kernel gives the connections of a closed socket to the other ones */
+            tmb_posix_tcp_worker_deinit(&workers[i]);
+            continue;
         }
+        pthread_detach(thread);
     }
 
-    /* now I have the whole response in the buffer. Need to parse it. */
-    TMB_ERROR_CHECK(tmb_response_parse(response, &handle->buffer[response_offset], response_size - response_offset));
+    /* the calling thread is the first worker */
+    tmb_posix_tcp_worker_run(&workers[0]);
+
+    /* the other workers may still be running, thus their state can't be released */
+    return TMB_FAILURE;
 
-    fprintf(stderr, "response: ");
-    for (size_t i = 0; i < response_size; i++) {
-        fprintf(stderr, "%02x ", handle->buffer[i]);
+error:
+    if (workers != NULL) {
+        for (size_t i = 0; i < config->workers; i++) {
+            tmb_posix_tcp_worker_deinit(&workers[i]);
+        }
     }
-    fprintf(stderr, "\n");
+    free(workers);
+    free(connections);
 
-    return TMB_SUCCESS;
+    return error;
 }
 
-tmb_error_t tmb_client_set_device_address(tmb_handle_t *handle, uint8_t address) {
-    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
-    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+typedef struct tmb_posix_gateway tmb_posix_gateway_t;
 
-    handle->client.device_address = address;
+typedef struct {
+    tmb_posix_gateway_t *gateway;
 
-    return TMB_SUCCESS;
-}
+    /** socket of the connection, -1 if the slot is free */
+    int fd;
 
-tmb_error_t tmb_read_coils(tmb_handle_t *handle, uint16_t start_address, uint16_t quantity, uint8_t *values) {
-    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
-    TMB_ON_FALSE_RETURN(values != NULL, TMB_E_INVALID_ARGUMENTS);
-    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+    /** incremented each time the slot is closed, to drop the responses to the previous connection */
+    uint32_t generation;
 
-    tmb_request_pdu_t request = {
-        .function_code = TMB_FUNCTION_READ_COILS,
-        .read_coils = {
-            .start_address = start_address,
-            .quantity = quantity,
-        },
-    };
+    /** protects the socket from being closed, while the bus threads take a reference to it */
+    pthread_mutex_t mutex;
 
-    tmb_response_pdu_t response;
-    TMB_ERROR_CHECK(tmb_client_send_request(handle, &request, &response));
+    tmb_parser_t parser;
+    uint8_t buffer[TMB_ADU_TCPIP_MAX_SIZE];
+} tmb_posix_gateway_connection_t;
 
-    memcpy(values, response.read_coils.coil_status, response.read_coils.byte_count);
+typedef struct {
+    const tmb_posix_tcp_gateway_config_t *config;
+    size_t index;
+    tmb_handle_t *handle;
 
-    return TMB_SUCCESS;
-}
+    /* requests from the workers, moved to the queue by the thread of the bus, that owns it */
+    tmb_gateway_mailbox_t mailbox;
+    tmb_gateway_queue_t queue;
 
-tmb_error_t tmb_read_discrete_inputs(tmb_handle_t *handle, uint16_t start_address, uint16_t quantity, uint8_t *values) {
-    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
-    TMB_ON_FALSE_RETURN(values != NULL, TMB_E_INVALID_ARGUMENTS);
-    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+    /* signaled by the workers after each push, the bus thread waits on it when it is idle */
+    int event_fd;
 
-    tmb_request_pdu_t request = {
-        .function_code = TMB_FUNCTION_READ_DISCRETE_INPUTS,
-        .read_discrete_inputs = {
-            .start_address = start_address,
-            .quantity = quantity,
-        },
-    };
+    /* the request being forwarded */
+    tmb_gateway_request_t request;
+} tmb_posix_gateway_bus_t;
 
-    tmb_response_pdu_t response;
-    TMB_ERROR_CHECK(tmb_client_send_request(handle, &request, &response));
+typedef struct {
+    tmb_posix_gateway_t *gateway;
+    int listen_fd;
+    int epoll_fd;
 
-    memcpy(values, response.read_discrete_inputs.input_status, response.read_discrete_inputs.byte_count);
+    /* time at which the listening socket is polled again, 0 if it is polled */
+    uint64_t listen_resume_us;
+
+    tmb_posix_gateway_connection_t *connections;
+} tmb_posix_gateway_worker_t;
+
+struct tmb_posix_gateway {
+    const tmb_posix_tcp_gateway_config_t *config;
+
+    /* the bus of each unit, -1 if not routed */
+    int16_t routes[256];
+
+    tmb_posix_gateway_worker_t *workers;
+    tmb_posix_gateway_connection_t *connections;
+    tmb_posix_gateway_bus_t *buses;
+    tmb_gateway_request_t *requests;
+
+    /* number of connections whose mutex is initialized */
+    size_t connections_size;
+};
+
+/* resolves a routing table once, the first range that contains a unit wins */
+static tmb_error_t tmb_posix_tcp_resolve_routes(const tmb_posix_tcp_gateway_route_t *routes, size_t routes_size,
+                                                size_t targets, int16_t *table) {
+    for (size_t unit_id = 0; unit_id < 256; unit_id++) {
+        table[unit_id] = routes_size == 0 ? 0 : -1;
+    }
+    for (size_t i = routes_size; i > 0; i--) {
+        const tmb_posix_tcp_gateway_route_t *route = &routes[i - 1];
+        TMB_ON_FALSE_RETURN(route->first_unit_id <= route->last_unit_id && route->bus < targets,
+                            TMB_E_INVALID_ARGUMENTS);
+        for (size_t unit_id = route->first_unit_id; unit_id <= route->last_unit_id; unit_id++) {
+            table[unit_id] = route->bus;
+        }
+    }
 
     return TMB_SUCCESS;
 }
 
-tmb_error_t tmb_read_holding_registers(tmb_handle_t *handle, uint16_t start_address, uint16_t quantity,
-                                       uint16_t *values) {
-    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
-    TMB_ON_FALSE_RETURN(values != NULL, TMB_E_INVALID_ARGUMENTS);
-    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+/* receives the bytes available on a socket, and passes each frame that they complete to on_frame */
+static tmb_error_t tmb_posix_tcp_receive(int fd, tmb_parser_t *parser,
+                                         void (*on_frame)(void *context, const tmb_frame_t *frame), void *context) {
+    uint8_t bytes[4 * TMB_ADU_TCPIP_MAX_SIZE];
+    ssize_t nbytes = recv(fd, bytes, sizeof(bytes), MSG_DONTWAIT);
+    if (nbytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return TMB_SUCCESS;
+    }
+    TMB_ON_FALSE_RETURN(nbytes > 0, TMB_E_TRANSPORT);
+
+    const uint8_t *next = bytes;
+    size_t size = nbytes;
+    size_t consumed = 0;
+    tmb_frame_t frame;
+    tmb_error_t error;
+    while ((error = tmb_parser_feed(parser, next, size, &consumed, &frame)) != TMB_E_INCOMPLETE) {
+        /* a TCP/IP stream can't be resynchronized after an invalid frame */
+        TMB_ERROR_CHECK(error);
+
+        on_frame(context, &frame);
+        next += consumed;
+        size -= consumed;
+    }
 
-    tmb_request_pdu_t request = {
-        .function_code = TMB_FUNCTION_READ_HOLDING_REGISTERS,
-        .read_holding_registers = {
-            .start_address = start_address,
-            .quantity = quantity,
-        },
-    };
+    return TMB_SUCCESS;
+}
 
-    tmb_response_pdu_t response;
-    TMB_ERROR_CHECK(tmb_client_send_request(handle, &request, &response));
+static void tmb_posix_gateway_reply(const tmb_gateway_request_t *request) {
+    tmb_posix_gateway_connection_t *connection = request->context;
 
-    memcpy(values, response.read_holding_registers.register_values, response.read_holding_registers.byte_count);
+    /* the response is sent on a duplicate of the socket, outside of the lock: the worker can close the
+     * connection meanwhile, without its descriptor being reused for another one */
+    int fd = -1;
+    pthread_mutex_lock(&connection->mutex);
+    if (connection->fd >= 0 && connection->generation == request->tag) {
+        fd = fcntl(connection->fd, F_DUPFD_CLOEXEC, 0);
+    }
+    pthread_mutex_unlock(&connection->mutex);
+    if (fd < 0) {
+        return;
+    }
 
-    return TMB_SUCCESS;
+    /* a client that doesn't read its responses can't hold the bus: when the socket buffer is full the
+     * connection is shut down, and its worker closes it */
+    ssize_t nbytes = send(fd, request->adu, request->size, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (nbytes != (ssize_t)request->size) {
+        shutdown(fd, SHUT_RDWR);
+    }
+    close(fd);
 }
 
-tmb_error_t tmb_read_input_registers(tmb_handle_t *handle, uint16_t start_address, uint16_t quantity,
-                                     uint16_t *values) {
-    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
-    TMB_ON_FALSE_RETURN(values != NULL, TMB_E_INVALID_ARGUMENTS);
-    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+static void *tmb_posix_gateway_bus_run(void *arg) {
+    tmb_posix_gateway_bus_t *bus = arg;
+    const tmb_posix_tcp_gateway_config_t *config = bus->config;
 
-    tmb_request_pdu_t request = {
-        .function_code = TMB_FUNCTION_READ_INPUT_REGISTERS,
-        .read_input_registers = {
-            .quantity = quantity,
-            .start_address = start_address,
-        },
-    };
+    while (true) {
+        /* move the requests received to the queue, as long as it has room for them */
+        while (tmb_gateway_queue_size(&bus->queue) < bus->queue.capacity &&
+               tmb_gateway_mailbox_pop(&bus->mailbox, &bus->request)) {
+            tmb_gateway_queue_push_request(&bus->queue, &bus->request);
+        }
 
-    tmb_response_pdu_t response;
-    TMB_ERROR_CHECK(tmb_client_send_request(handle, &request, &response));
+        if (!tmb_gateway_queue_pop(&bus->queue, &bus->request, tmb_posix_now_us())) {
+            /* the mailbox is checked again after each wake up, thus a push is never missed */
+            uint64_t count;
+            if (read(bus->event_fd, &count, sizeof(count)) < 0 && errno != EINTR) {
+                return NULL;
+            }
+            continue;
+        }
 
-    memcpy(values, response.read_input_registers.register_values, response.read_holding_registers.byte_count);
+        if (tmb_gateway_forward(bus->handle, &bus->request) == TMB_SUCCESS) {
+            tmb_posix_gateway_reply(&bus->request);
+        }
 
-    return TMB_SUCCESS;
+        if (config->on_metrics != NULL) {
+            tmb_gateway_lane_metrics_t metrics[TMB_GATEWAY_LANES];
+            memcpy(metrics, bus->queue.metrics, sizeof(metrics));
+            for (size_t i = 0; i < TMB_GATEWAY_LANES; i++) {
+                metrics[i].rejected += TMB_ATOMIC_LOAD(&bus->mailbox.rejected[i], TMB_ATOMIC_RELAXED);
+            }
+            config->on_metrics(config->user_data, bus->index, metrics);
+        }
+    }
 }
 
-tmb_error_t tmb_write_single_coil(tmb_handle_t *handle, uint16_t address, uint16_t value) {
-    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
-    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+static void tmb_posix_gateway_dispatch(void *context, const tmb_frame_t *frame) {
+    tmb_posix_gateway_connection_t *connection = context;
+    tmb_posix_gateway_t *gateway = connection->gateway;
+    const tmb_posix_tcp_gateway_config_t *config = gateway->config;
+    int index = gateway->routes[frame->address];
+
+    tmb_error_t exception_code = TMB_E_GATEWAY_PATH_UNAVAILABLE;
+    if (index >= 0) {
+        tmb_posix_gateway_bus_t *bus = &gateway->buses[index];
+        uint8_t weight = config->weight != NULL ? config->weight(config->user_data, frame->address) : 1;
+
+        if (tmb_gateway_mailbox_push(&bus->mailbox, frame, connection, connection->generation,
+                                     weight > 0 ? weight : 1, tmb_posix_now_us()) == TMB_SUCCESS) {
+            uint64_t one = 1;
+            write(bus->event_fd, &one, sizeof(one));
+            return;
+        }
+        exception_code = TMB_E_SLAVE_DEVICE_BUSY;
+    }
 
-    tmb_request_pdu_t request = {
-        .function_code = TMB_FUNCTION_WRITE_SINGLE_COIL,
-        .write_single_coil = {
-            .address = address,
-            .value = value,
-        },
-    };
+    /* the request can't reach a bus: answer it right away */
+    tmb_gateway_request_t request;
+    if (tmb_gateway_request_init(&request, frame, connection, connection->generation) == TMB_SUCCESS) {
+        tmb_gateway_request_set_exception(&request, exception_code);
+        tmb_posix_gateway_reply(&request);
+    }
+}
 
-    tmb_response_pdu_t response;
-    TMB_ERROR_CHECK(tmb_client_send_request(handle, &request, &response));
+static void tmb_posix_gateway_accept(tmb_posix_gateway_worker_t *worker) {
+    while (true) {
+        int fd = tmb_posix_tcp_accept(worker->epoll_fd, worker->listen_fd, &worker->listen_resume_us);
+        if (fd < 0) {
+            return;
+        }
 
-    return TMB_SUCCESS;
+        tmb_posix_gateway_connection_t *connection = NULL;
+        for (size_t i = 0; i < worker->gateway->config->max_connections; i++) {
+            if (worker->connections[i].fd < 0) {
+                connection = &worker->connections[i];
+                break;
+            }
+        }
+
+        struct epoll_event event = { .events = EPOLLIN, .data.ptr = connection };
+        if (connection == NULL || epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            close(fd);
+            continue;
+        }
+
+        tmb_parser_init(&connection->parser, TMB_MODE_SERVER, TMB_TRANSPORT_PROTOCOL_TCPIP, connection->buffer,
+                        sizeof(connection->buffer));
+
+        pthread_mutex_lock(&connection->mutex);
+        connection->fd = fd;
+        pthread_mutex_unlock(&connection->mutex);
+    }
 }
 
-tmb_error_t tmb_write_single_register(tmb_handle_t *handle, uint16_t address, uint16_t value) {
-    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
-    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+static void tmb_posix_gateway_close(tmb_posix_gateway_worker_t *worker, tmb_posix_gateway_connection_t *connection) {
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
 
-    tmb_request_pdu_t request = {
-        .function_code = TMB_FUNCTION_WRITE_SINGLE_REGISTER,
-        .write_single_register = {
-            .address = address,
-            .value = value,
-        },
-    };
+    /* the responses still queued for the connection are dropped, since its generation changes */
+    pthread_mutex_lock(&connection->mutex);
+    close(connection->fd);
+    connection->fd = -1;
+    connection->generation++;
+    pthread_mutex_unlock(&connection->mutex);
+}
 
-    tmb_response_pdu_t response;
-    TMB_ERROR_CHECK(tmb_client_send_request(handle, &request, &response));
+static void *tmb_posix_gateway_worker_run(void *arg) {
+    tmb_posix_gateway_worker_t *worker = arg;
+    struct epoll_event events[TMB_POSIX_TCP_SERVER_MAX_EVENTS];
 
-    return TMB_SUCCESS;
+    while (true) {
+        int timeout_ms = tmb_posix_tcp_listen_resume(worker->epoll_fd, worker->listen_fd, &worker->listen_resume_us);
+        int nevents = epoll_wait(worker->epoll_fd, events, TMB_POSIX_TCP_SERVER_MAX_EVENTS, timeout_ms);
+        if (nevents < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return NULL;
+        }
+
+        for (int i = 0; i < nevents; i++) {
+            tmb_posix_gateway_connection_t *connection = events[i].data.ptr;
+            if (connection == NULL) {
+                tmb_posix_gateway_accept(worker);
+                continue;
+            }
+
+            if (tmb_posix_tcp_receive(connection->fd, &connection->parser, tmb_posix_gateway_dispatch, connection) !=
+                        TMB_SUCCESS ||
+                (events[i].events & (EPOLLERR | EPOLLHUP)) != 0) {
+                tmb_posix_gateway_close(worker, connection);
+            }
+        }
+    }
 }
 
-tmb_error_t tmb_write_multiple_coils(tmb_handle_t *handle, uint16_t start_address, uint16_t quantity,
-                                     const uint8_t *values) {
-    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
-    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+static tmb_error_t tmb_posix_gateway_worker_init(tmb_posix_gateway_worker_t *worker) {
+    const tmb_posix_tcp_gateway_config_t *config = worker->gateway->config;
+    TMB_ERROR_CHECK(tmb_posix_tcp_listen(config->host, config->port, &worker->listen_fd));
 
-    tmb_request_pdu_t request = {
-        .function_code = TMB_FUNCTION_WRITE_MULTIPLE_COILS,
-        .write_multiple_coils = {
-            .start_address = start_address,
-            .quantity = quantity,
-            .byte_count = quantity,
-            .values = values,
-        },
-    };
+    worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (worker->epoll_fd < 0) {
+        return TMB_FAILURE;
+    }
 
-    tmb_response_pdu_t response;
-    TMB_ERROR_CHECK(tmb_client_send_request(handle, &request, &response));
+    /* the listening socket is the only one registered without a connection */
+    if (tmb_posix_tcp_listen_poll(worker->epoll_fd, worker->listen_fd, EPOLL_CTL_ADD, EPOLLIN) != 0) {
+        return TMB_FAILURE;
+    }
 
     return TMB_SUCCESS;
 }
 
-tmb_error_t tmb_write_multiple_registers(tmb_handle_t *handle, uint16_t start_address, uint16_t quantity,
-                                         const uint16_t *values) {
-    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
-    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_CLIENT, TMB_E_INVALID_MODE);
+/* closes the sockets of the workers, that must not be running */
+static void tmb_posix_gateway_workers_deinit(tmb_posix_gateway_t *gateway) {
+    const tmb_posix_tcp_gateway_config_t *config = gateway->config;
+
+    if (gateway->workers != NULL) {
+        for (size_t i = 0; i < config->workers; i++) {
+            if (gateway->workers[i].listen_fd >= 0) {
+                close(gateway->workers[i].listen_fd);
+                gateway->workers[i].listen_fd = -1;
+            }
+            if (gateway->workers[i].epoll_fd >= 0) {
+                close(gateway->workers[i].epoll_fd);
+                gateway->workers[i].epoll_fd = -1;
+            }
+        }
+    }
 
-    tmb_request_pdu_t request = {
-        .function_code = TMB_FUNCTION_WRITE_MULTIPLE_REGISTERS,
-        .write_multiple_registers = {
-            .start_address = start_address,
-            .quantity = quantity,
-            .byte_count = quantity,
-            .values = values,
-        },
-    };
+    for (size_t i = 0; i < gateway->connections_size; i++) {
+        pthread_mutex_destroy(&gateway->connections[i].mutex);
+    }
+    gateway->connections_size = 0;
+}
 
-    tmb_response_pdu_t response;
-    TMB_ERROR_CHECK(tmb_client_send_request(handle, &request, &response));
+static void tmb_posix_gateway_free(tmb_posix_gateway_t *gateway) {
+    const tmb_posix_tcp_gateway_config_t *config = gateway->config;
 
-    return TMB_SUCCESS;
+    tmb_posix_gateway_workers_deinit(gateway);
+
+    if (gateway->buses != NULL) {
+        for (size_t i = 0; i < config->buses_size; i++) {
+            if (gateway->buses[i].event_fd >= 0) {
+                close(gateway->buses[i].event_fd);
+            }
+        }
+    }
+
+    free(gateway->workers);
+    free(gateway->connections);
+    free(gateway->buses);
+    free(gateway->requests);
+    free(gateway);
 }
 
-tmb_error_t tmb_server_set_callback(tmb_handle_t *handle, uint16_t address, const tmb_callbacks_t *callbacks) {
-    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
-    TMB_ON_FALSE_RETURN(address <= TMB_ADDRESS_ANY, TMB_E_INVALID_ARGUMENTS);
-    TMB_ON_FALSE_RETURN(handle->mode == TMB_MODE_SERVER, TMB_E_INVALID_MODE);
+tmb_error_t tmb_posix_tcp_gateway_run(const tmb_posix_tcp_gateway_config_t *config) {
+    TMB_ON_FALSE_RETURN(config != NULL && config->buses != NULL && config->buses_size > 0, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(config->buses_size <= INT16_MAX, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(config->workers > 0 && config->max_connections > 0 && config->queue_capacity > 0,
+                        TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(config->routes != NULL || config->routes_size == 0, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(config->timeout_ms <= UINT32_MAX / 1000, TMB_E_INVALID_ARGUMENTS);
+    for (size_t i = 0; i < config->buses_size; i++) {
+        TMB_ON_FALSE_RETURN(config->buses[i] != NULL && config->buses[i]->is_valid, TMB_E_INVALID_ARGUMENTS);
+        TMB_ERROR_CHECK(tmb_client_set_response_timeout(config->buses[i], config->timeout_ms * 1000));
+    }
 
-    size_t first_available_idx = SIZE_MAX;
-    for (size_t i = 0; i < TMB_SERVER_MAX_ADDRESSES; i++) {
-        if (handle->server.callbacks[i].address == address) {
-            /* replace existing entry */
-            handle->server.callbacks[i].callbacks = callbacks;
+    /* the state outlives this function if it returns while the other threads are still running */
+    tmb_posix_gateway_t *gateway = calloc(1, sizeof(tmb_posix_gateway_t));
+    TMB_ON_FALSE_RETURN(gateway != NULL, TMB_E_NO_MEMORY);
+    gateway->config = config;
 
-            return TMB_SUCCESS;
+    tmb_error_t error = tmb_posix_tcp_resolve_routes(config->routes, config->routes_size, config->buses_size,
+                                                     gateway->routes);
+    if (error != TMB_SUCCESS) {
+        goto error;
+    }
+
+    /* each bus has a mailbox, rounded up to a power of 2, and a queue */
+    size_t mailbox_capacity = 1;
+    while (mailbox_capacity < config->queue_capacity) {
+        mailbox_capacity *= 2;
+    }
+    size_t bus_requests = mailbox_capacity + config->queue_capacity;
+
+    error = TMB_E_NO_MEMORY;
+    gateway->workers = calloc(config->workers, sizeof(tmb_posix_gateway_worker_t));
+    gateway->connections = calloc(config->workers * config->max_connections, sizeof(tmb_posix_gateway_connection_t));
+    gateway->buses = calloc(config->buses_size, sizeof(tmb_posix_gateway_bus_t));
+    gateway->requests = calloc(config->buses_size * bus_requests, sizeof(tmb_gateway_request_t));
+    if (gateway->workers == NULL || gateway->connections == NULL || gateway->buses == NULL ||
+        gateway->requests == NULL) {
+        goto error;
+    }
+
+    for (size_t i = 0; i < config->buses_size; i++) {
+        gateway->buses[i].event_fd = -1;
+    }
+    for (size_t i = 0; i < config->workers; i++) {
+        gateway->workers[i].listen_fd = -1;
+        gateway->workers[i].epoll_fd = -1;
+    }
+    for (size_t i = 0; i < config->workers * config->max_connections; i++) {
+        gateway->connections[i].gateway = gateway;
+        gateway->connections[i].fd = -1;
+        pthread_mutex_init(&gateway->connections[i].mutex, NULL);
+    }
+    gateway->connections_size = config->workers * config->max_connections;
+
+    error = TMB_FAILURE;
+    for (size_t i = 0; i < config->buses_size; i++) {
+        tmb_posix_gateway_bus_t *bus = &gateway->buses[i];
+        tmb_gateway_request_t *requests = &gateway->requests[i * bus_requests];
+        bus->config = config;
+        bus->index = i;
+        bus->handle = config->buses[i];
+        tmb_gateway_mailbox_init(&bus->mailbox, requests, mailbox_capacity);
+        tmb_gateway_queue_init(&bus->queue, &requests[mailbox_capacity], config->queue_capacity);
+
+        bus->event_fd = eventfd(0, EFD_CLOEXEC);
+        if (bus->event_fd < 0) {
+            goto error;
         }
+    }
 
-        if (handle->server.callbacks[i].callbacks == NULL) {
-            /* record first existing entry*/
-            first_available_idx = i;
+    /* open all the sockets before starting any thread, to report configuration errors to the caller */
+    for (size_t i = 0; i < config->workers; i++) {
+        tmb_posix_gateway_worker_t *worker = &gateway->workers[i];
+        worker->gateway = gateway;
+        worker->connections = &gateway->connections[i * config->max_connections];
+
+        error = tmb_posix_gateway_worker_init(worker);
+        if (error != TMB_SUCCESS) {
+            goto error;
         }
     }
 
-    if (first_available_idx < TMB_SERVER_MAX_ADDRESSES) {
-        /* write to the first existing entry */
-        handle->server.callbacks[first_available_idx].address = address;
-        handle->server.callbacks[first_available_idx].callbacks = callbacks;
+    for (size_t i = 0; i < config->buses_size; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, tmb_posix_gateway_bus_run, &gateway->buses[i]) != 0) {
+            error = TMB_FAILURE;
+            if (i == 0) {
+                goto error;
+            }
+
+            /* the buses already started use the rest of the state, thus only the sockets are released */
+            tmb_posix_gateway_workers_deinit(gateway);
+            return error;
+        }
+        pthread_detach(thread);
+    }
 
-        return TMB_SUCCESS;
+    for (size_t i = 1; i < config->workers; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, tmb_posix_gateway_worker_run, &gateway->workers[i]) != 0) {
+            /* the kernel gives the connections of a closed socket to the other ones */
+            close(gateway->workers[i].listen_fd);
+            close(gateway->workers[i].epoll_fd);
+            continue;
+        }
+        pthread_detach(thread);
     }
 
-    /* no slot available found */
-    return TMB_E_NO_MEMORY;
-}
+    /* the calling thread is the first worker */
+    tmb_posix_gateway_worker_run(&gateway->workers[0]);
 
-tmb_error_t tmb_server_run_iteration(tmb_handle_t *handle) {
-    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+    /* the buses and the other workers may still be running, thus the state can't be released */
+    return TMB_FAILURE;
+
+error:
+    tmb_posix_gateway_free(gateway);
 
-    return TMB_E_NOT_IMPLEMENTED;
+    return error;
 }
 
-tmb_error_t tmb_server_run_forever(tmb_handle_t *handle) {
-    TMB_ON_FALSE_RETURN(handle != NULL && handle->is_valid, TMB_E_INVALID_ARGUMENTS);
+typedef struct tmb_posix_proxy tmb_posix_proxy_t;
 
-    while (true) {
-        tmb_server_run_iteration(handle);
-    }
-}
+typedef struct {
+    tmb_posix_proxy_t *proxy;
 
-#ifdef TMB_POSIX_SUPPORTED
+    /** socket of the connection, -1 if the slot is free */
+    int fd;
 
-#include <unistd.h>
-#include <fcntl.h>
-#include <termios.h>
-#include <sys/socket.h>
-#include <netdb.h>
-#include <netinet/in.h>
+    /** incremented each time the slot is closed, to drop the responses to the previous connection */
+    uint32_t generation;
+
+    tmb_parser_t parser;
+    uint8_t buffer[TMB_ADU_TCPIP_MAX_SIZE];
+} tmb_posix_proxy_connection_t;
 
 typedef struct {
-    tmb_transport_protocol_t transport_protocol;
+    struct sockaddr_in addr;
+
+    /* socket of the connection, -1 if not connected */
     int fd;
-} tmb_posix_ctx_t;
 
-static int tmb_posix_transport_read(void *user_ctx, uint8_t *buffer, size_t nbytes) {
-    tmb_posix_ctx_t *transport = user_ctx;
+    /* the connection is not established yet: the transactions are sent once it is */
+    bool connecting;
 
-    return read(transport->fd, buffer, nbytes);
-}
+    /* time before which the device is not connected again, after a failure */
+    uint64_t retry_time_us;
 
-static int tmb_posix_transport_write(void *user_ctx, const uint8_t *buffer, size_t nbytes) {
-    tmb_posix_ctx_t *transport = user_ctx;
+    tmb_parser_t parser;
+    uint8_t buffer[TMB_ADU_TCPIP_MAX_SIZE];
+    tmb_gateway_pipeline_t pipeline;
+} tmb_posix_proxy_device_t;
 
-    return write(transport->fd, buffer, nbytes);
-}
+struct tmb_posix_proxy {
+    const tmb_posix_tcp_proxy_config_t *config;
+    int listen_fd;
+    int epoll_fd;
 
-static tmb_error_t tmb_posix_transport_tcpip_open(tmb_posix_ctx_t *ctx,
-                                                  const tmb_posix_transport_tcp_config_t *config) {
-    struct hostent *hostent = gethostbyname(config->host);
-    if (hostent == NULL) {
-        return TMB_E_TCP_HOST_NOT_FOUND;
-    }
+    /* time at which the listening socket is polled again, 0 if it is polled */
+    uint64_t listen_resume_us;
 
-    ctx->fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (ctx->fd <= 0) {
-        return TMB_E_TCP_OPEN_SOCKET_FAILED;
-    }
+    /* the device of each unit, -1 if not routed */
+    int16_t routes[256];
 
-    struct sockaddr_in addr = {
-        .sin_family = AF_INET,
-        .sin_port = htons(config->port),
-        .sin_addr = {
-            .s_addr = *((in_addr_t *)hostent->h_addr_list[0]),
-        },
-    };
+    tmb_posix_proxy_connection_t *connections;
+    tmb_posix_proxy_device_t *devices;
+    tmb_gateway_request_t *requests;
+};
 
-    if (connect(ctx->fd, (const struct sockaddr *)&addr, sizeof(addr)) < 0) {
-        return TMB_E_TCP_CONNECTION_REFUSED;
+/* epoll data of the sockets: 0 for the listening one, then the connections and the devices */
+#define TMB_POSIX_PROXY_EVENT_LISTEN 0
+
+static void tmb_posix_proxy_reply(const tmb_gateway_request_t *response) {
+    tmb_posix_proxy_connection_t *connection = response->context;
+    if (connection->fd < 0 || connection->generation != response->tag) {
+        /* the client is gone */
+        return;
     }
 
-    return TMB_SUCCESS;
+    /* a client that doesn't read its responses can't stall the event loop: when the socket buffer is full
+     * the connection is shut down, and closed by the next receive */
+    ssize_t nbytes = send(connection->fd, response->adu, response->size, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (nbytes != (ssize_t)response->size) {
+        shutdown(connection->fd, SHUT_RDWR);
+    }
 }
 
-static tmb_error_t tmb_posix_transport_serial_open(tmb_posix_ctx_t *ctx,
-                                                   const tmb_posix_transport_serial_config_t *config) {
-    ctx->fd = open(config->device, O_RDWR | O_NOCTTY);
-    if (ctx->fd <= 0) {
-        return TMB_E_OPEN_SERIAL_FAILED;
+static void tmb_posix_proxy_device_close(tmb_posix_proxy_t *proxy, tmb_posix_proxy_device_t *device,
+                                         tmb_error_t exception_code) {
+    if (device->fd >= 0) {
+        epoll_ctl(proxy->epoll_fd, EPOLL_CTL_DEL, device->fd, NULL);
+        close(device->fd);
+        device->fd = -1;
     }
+    device->retry_time_us = tmb_posix_now_us() + (uint64_t)proxy->config->timeout_ms * 1000;
 
-    struct termios tty;
-    if (tcgetattr(ctx->fd, &tty) != 0) {
-        return TMB_E_SERIAL_CONFIGURATION_FAILED;
+    tmb_gateway_request_t response;
+    while (tmb_gateway_pipeline_cancel(&device->pipeline, UINT64_MAX, exception_code, &response)) {
+        tmb_posix_proxy_reply(&response);
     }
+}
 
-    /* set parity */
-    switch (config->parity) {
-    case TMB_SERIAL_PARITY_NONE:
-        tty.c_cflag &= ~PARENB;
-        break;
-
-    case TMB_SERIAL_PARITY_EVEN:
-        tty.c_cflag |= PARENB;
-        break;
+static tmb_error_t tmb_posix_proxy_device_send(tmb_posix_proxy_device_t *device,
+                                               const tmb_gateway_request_t *request) {
+    /* the requests in flight are few and small, thus they always fit the socket buffer: a partial send
+     * is a failure of the connection */
+    ssize_t nbytes = send(device->fd, request->adu, request->size, MSG_NOSIGNAL | MSG_DONTWAIT);
+    TMB_ON_FALSE_RETURN(nbytes == (ssize_t)request->size, TMB_E_TRANSPORT);
 
-    case TMB_SERIAL_PARITY_ODD:
-        tty.c_cflag |= PARODD | PARENB;
-        break;
-    }
+    return TMB_SUCCESS;
+}
 
-    /* set stop bits */
-    if (config->stop_bits == TMB_SERIAL_STOP_BITS_2)
-        tty.c_cflag |= CSTOPB;
-    else
-        tty.c_cflag &= ~CSTOPB;
+static tmb_error_t tmb_posix_proxy_device_connect(tmb_posix_proxy_t *proxy, tmb_posix_proxy_device_t *device) {
+    device->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    TMB_ON_FALSE_RETURN(device->fd >= 0, TMB_E_TCP_OPEN_SOCKET_FAILED);
 
-    /* set bits */
-    tty.c_cflag &= ~CSIZE;
+    int enable = 1;
+    setsockopt(device->fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    tmb_parser_init(&device->parser, TMB_MODE_CLIENT, TMB_TRANSPORT_PROTOCOL_TCPIP, device->buffer,
+                    sizeof(device->buffer));
 
-    if (config->data_bits == TMB_SERIAL_DATA_BITS_7) {
-        /* 8 data bits */
-        tty.c_cflag |= CS7;
-    } else {
-        /* 7 data bits */
-        tty.c_cflag |= CS8;
+    /* the connection completes when the socket becomes writable */
+    device->connecting = true;
+    if (connect(device->fd, (const struct sockaddr *)&device->addr, sizeof(device->addr)) != 0 &&
+        errno != EINPROGRESS) {
+        return TMB_E_TCP_CONNECTION_REFUSED;
     }
 
-    /* disable RTS/CTS hardware flow control */
-    tty.c_cflag &= ~CRTSCTS;
-
-    /* turn on READ & ignore ctrl lines (CLOCAL = 1) */
-    tty.c_cflag |= CREAD | CLOCAL;
+    struct epoll_event event = {
+        .events = EPOLLIN | EPOLLOUT,
+        .data.u64 = 1 + proxy->config->max_connections + (device - proxy->devices),
+    };
+    TMB_ON_FALSE_RETURN(epoll_ctl(proxy->epoll_fd, EPOLL_CTL_ADD, device->fd, &event) == 0, TMB_FAILURE);
 
-    /* disable canonical mode */
-    tty.c_lflag &= ~ICANON;
+    return TMB_SUCCESS;
+}
 
-    /* disable echo */
-    tty.c_lflag &= ~ECHO;
+static tmb_error_t tmb_posix_proxy_device_connected(tmb_posix_proxy_t *proxy, tmb_posix_proxy_device_t *device) {
+    int error = 0;
+    socklen_t length = sizeof(error);
+    TMB_ON_FALSE_RETURN(getsockopt(device->fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0,
+                        TMB_E_TCP_CONNECTION_REFUSED);
 
-    /* disable erasure */
-    tty.c_lflag &= ~ECHOE;
+    struct epoll_event event = {
+        .events = EPOLLIN,
+        .data.u64 = 1 + proxy->config->max_connections + (device - proxy->devices),
+    };
+    TMB_ON_FALSE_RETURN(epoll_ctl(proxy->epoll_fd, EPOLL_CTL_MOD, device->fd, &event) == 0, TMB_FAILURE);
+    device->connecting = false;
 
-    /* disable new-line echo */
-    tty.c_lflag &= ~ECHONL;
+    /* send the transactions started while connecting */
+    for (size_t i = 0; i < device->pipeline.capacity; i++) {
+        if (device->pipeline.requests[i].size != 0) {
+            TMB_ERROR_CHECK(tmb_posix_proxy_device_send(device, &device->pipeline.requests[i]));
+        }
+    }
 
-    /* disable interpretation of INTR, QUIT and SUSP */
-    tty.c_lflag &= ~ISIG;
+    return TMB_SUCCESS;
+}
 
-    /* turn off s/w flow ctrl */
-    tty.c_iflag &= ~(IXON | IXOFF | IXANY);
+static void tmb_posix_proxy_device_complete(void *context, const tmb_frame_t *frame) {
+    tmb_posix_proxy_device_t *device = context;
 
-    /* disable any special handling of received bytes */
-    tty.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL);
+    /* responses to cancelled transactions are dropped */
+    tmb_gateway_request_t response;
+    if (tmb_gateway_pipeline_complete(&device->pipeline, frame, &response) == TMB_SUCCESS) {
+        tmb_posix_proxy_reply(&response);
+    }
+}
 
-    /* prevent special interpretation of output bytes (e.g. newline chars) */
-    tty.c_oflag &= ~OPOST;
+static void tmb_posix_proxy_dispatch(void *context, const tmb_frame_t *frame) {
+    tmb_posix_proxy_connection_t *connection = context;
+    tmb_posix_proxy_t *proxy = connection->proxy;
+    int index = proxy->routes[frame->address];
+    tmb_posix_proxy_device_t *device = index >= 0 ? &proxy->devices[index] : NULL;
+    uint64_t now_us = tmb_posix_now_us();
+
+    tmb_error_t exception_code = TMB_E_GATEWAY_PATH_UNAVAILABLE;
+    if (device != NULL && device->fd < 0 && now_us >= device->retry_time_us &&
+        tmb_posix_proxy_device_connect(proxy, device) != TMB_SUCCESS) {
+        tmb_posix_proxy_device_close(proxy, device, TMB_E_GATEWAY_PATH_UNAVAILABLE);
+    }
 
-    /* prevent conversion of newline to carriage return/line feed */
-    tty.c_oflag &= ~ONLCR;
+    if (device != NULL && device->fd >= 0) {
+        tmb_gateway_request_t *request;
+        if (tmb_gateway_pipeline_submit(&device->pipeline, frame, connection, connection->generation, now_us,
+                                        &request) == TMB_SUCCESS) {
+            if (!device->connecting && tmb_posix_proxy_device_send(device, request) != TMB_SUCCESS) {
+                tmb_posix_proxy_device_close(proxy, device, TMB_E_GATEWAY_PATH_UNAVAILABLE);
+            }
+            return;
+        }
+        exception_code = TMB_E_SLAVE_DEVICE_BUSY;
+    }
 
-#ifndef __linux__
-    /* prevent conversion of tabs to spaces */
-    tty.c_oflag &= ~OXTABS;
+    /* the request can't reach a device: answer it right away */
+    tmb_gateway_request_t response;
+    if (tmb_gateway_request_init(&response, frame, connection, connection->generation) == TMB_SUCCESS) {
+        tmb_gateway_request_set_exception(&response, exception_code);
+        tmb_posix_proxy_reply(&response);
+    }
+}
 
-    /* prevent removal of C-d chars (0x004) in output */
-    tty.c_oflag &= ~ONOEOT;
-#endif
+static void tmb_posix_proxy_accept(tmb_posix_proxy_t *proxy) {
+    while (true) {
+        int fd = tmb_posix_tcp_accept(proxy->epoll_fd, proxy->listen_fd, &proxy->listen_resume_us);
+        if (fd < 0) {
+            return;
+        }
 
-    /* how much to wait for a read */
-    tty.c_cc[VTIME] = 0;
+        size_t index = proxy->config->max_connections;
+        for (size_t i = 0; i < proxy->config->max_connections; i++) {
+            if (proxy->connections[i].fd < 0) {
+                index = i;
+                break;
+            }
+        }
 
-    /* minimum read size: 1 byte */
-    tty.c_cc[VMIN] = 1;
+        struct epoll_event event = { .events = EPOLLIN, .data.u64 = 1 + index };
+        if (index == proxy->config->max_connections || epoll_ctl(proxy->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            close(fd);
+            continue;
+        }
 
-    /* set port speed */
-    if (cfsetispeed(&tty, config->baudrate) != 0) {
-        return TMB_E_SERIAL_CONFIGURATION_FAILED;
+        tmb_posix_proxy_connection_t *connection = &proxy->connections[index];
+        tmb_parser_init(&connection->parser, TMB_MODE_SERVER, TMB_TRANSPORT_PROTOCOL_TCPIP, connection->buffer,
+                        sizeof(connection->buffer));
+        connection->fd = fd;
     }
+}
 
-    if (cfsetospeed(&tty, config->baudrate) != 0) {
-        return TMB_E_SERIAL_CONFIGURATION_FAILED;
+static void tmb_posix_proxy_close(tmb_posix_proxy_t *proxy, tmb_posix_proxy_connection_t *connection) {
+    epoll_ctl(proxy->epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+
+    /* the responses to the transactions still in flight are dropped, since the generation changes */
+    connection->fd = -1;
+    connection->generation++;
+}
+
+/* cancels the transactions that timed out, and returns the time to wait for the next one, in milliseconds */
+static int tmb_posix_proxy_expire(tmb_posix_proxy_t *proxy) {
+    uint64_t timeout_us = (uint64_t)proxy->config->timeout_ms * 1000;
+    uint64_t now_us = tmb_posix_now_us();
+    uint64_t next_us = UINT64_MAX;
+
+    for (size_t i = 0; i < proxy->config->devices_size; i++) {
+        tmb_posix_proxy_device_t *device = &proxy->devices[i];
+        tmb_gateway_request_t response;
+        while (now_us >= timeout_us &&
+               tmb_gateway_pipeline_cancel(&device->pipeline, now_us - timeout_us + 1,
+                                           TMB_E_GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND, &response)) {
+            tmb_posix_proxy_reply(&response);
+        }
+
+        for (size_t j = 0; j < device->pipeline.capacity; j++) {
+            const tmb_gateway_request_t *request = &device->pipeline.requests[j];
+            if (request->size != 0 && request->queue_time_us + timeout_us < next_us) {
+                next_us = request->queue_time_us + timeout_us;
+            }
+        }
     }
 
-    if (tcsetattr(ctx->fd, TCSANOW, &tty) != 0) {
-        return TMB_E_SERIAL_CONFIGURATION_FAILED;
+    if (next_us == UINT64_MAX) {
+        return -1;
     }
 
-    return TMB_SUCCESS;
+    /* rounded up, not to wake up before the deadline */
+    return (int)((next_us - now_us + 999) / 1000);
 }
 
-tmb_error_t tmb_posix_transport_new(const tmb_posix_transport_config_t *config, tmb_transport_t **out_transport) {
-    TMB_ON_FALSE_RETURN(config != NULL, TMB_E_INVALID_ARGUMENTS);
-    TMB_ON_FALSE_RETURN(out_transport != NULL, TMB_E_INVALID_ARGUMENTS);
+static void tmb_posix_proxy_free(tmb_posix_proxy_t *proxy) {
+    if (proxy->listen_fd >= 0) {
+        close(proxy->listen_fd);
+    }
+    if (proxy->epoll_fd >= 0) {
+        close(proxy->epoll_fd);
+    }
 
-    tmb_error_t error = TMB_FAILURE;
-    tmb_transport_t *transport = NULL;
-    tmb_posix_ctx_t *ctx = NULL;
+    free(proxy->connections);
+    free(proxy->devices);
+    free(proxy->requests);
+}
 
-    ctx = calloc(1, sizeof(tmb_posix_ctx_t));
-    if (ctx == NULL) {
-        error = TMB_E_NO_MEMORY;
+tmb_error_t tmb_posix_tcp_proxy_run(const tmb_posix_tcp_proxy_config_t *config) {
+    TMB_ON_FALSE_RETURN(config != NULL && config->devices != NULL && config->devices_size > 0,
+                        TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(config->devices_size <= INT16_MAX, TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(config->max_connections > 0 && config->max_pending > 0 && config->max_pending <= 65536,
+                        TMB_E_INVALID_ARGUMENTS);
+    TMB_ON_FALSE_RETURN(config->routes != NULL || config->routes_size == 0, TMB_E_INVALID_ARGUMENTS);
+
+    tmb_posix_proxy_t proxy = { .config = config, .listen_fd = -1, .epoll_fd = -1 };
+    TMB_ERROR_CHECK(tmb_posix_tcp_resolve_routes(config->routes, config->routes_size, config->devices_size,
+                                                 proxy.routes));
+
+    tmb_error_t error = TMB_E_NO_MEMORY;
+    proxy.connections = calloc(config->max_connections, sizeof(tmb_posix_proxy_connection_t));
+    proxy.devices = calloc(config->devices_size, sizeof(tmb_posix_proxy_device_t));
+    proxy.requests = calloc(config->devices_size * config->max_pending, sizeof(tmb_gateway_request_t));
+    if (proxy.connections == NULL || proxy.devices == NULL || proxy.requests == NULL) {
         goto error;
     }
-    ctx->transport_protocol = config->transport_protocol;
-    if (config->transport_protocol == TMB_TRANSPORT_PROTOCOL_TCPIP) {
-        error = tmb_posix_transport_tcpip_open(ctx, &config->tcp);
-    } else {
-        error = tmb_posix_transport_serial_open(ctx, &config->serial);
+
+    for (size_t i = 0; i < config->max_connections; i++) {
+        proxy.connections[i].proxy = &proxy;
+        proxy.connections[i].fd = -1;
+    }
+
+    /* the host names are resolved once, since the event loop can't block */
+    for (size_t i = 0; i < config->devices_size; i++) {
+        tmb_posix_proxy_device_t *device = &proxy.devices[i];
+        device->fd = -1;
+        tmb_gateway_pipeline_init(&device->pipeline, &proxy.requests[i * config->max_pending], config->max_pending);
+
+        struct hostent *hostent = gethostbyname(config->devices[i].host);
+        if (hostent == NULL) {
+            error = TMB_E_TCP_HOST_NOT_FOUND;
+            goto error;
+        }
+        device->addr.sin_family = AF_INET;
+        device->addr.sin_port = htons(config->devices[i].port);
+        device->addr.sin_addr.s_addr = *((in_addr_t *)hostent->h_addr_list[0]);
     }
+
+    error = tmb_posix_tcp_listen(config->host, config->port, &proxy.listen_fd);
     if (error != TMB_SUCCESS) {
         goto error;
     }
 
-    transport = calloc(1, sizeof(tmb_transport_t));
-    if (transport == NULL) {
-        error = TMB_E_NO_MEMORY;
+    error = TMB_FAILURE;
+    proxy.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (proxy.epoll_fd < 0 ||
+        tmb_posix_tcp_listen_poll(proxy.epoll_fd, proxy.listen_fd, EPOLL_CTL_ADD, EPOLLIN) != 0) {
         goto error;
     }
-    transport->user_data = ctx;
-    transport->read = tmb_posix_transport_read;
-    transport->write = tmb_posix_transport_write;
 
-    *out_transport = transport;
+    struct epoll_event events[TMB_POSIX_TCP_SERVER_MAX_EVENTS];
+    while (true) {
+        int timeout_ms = tmb_posix_proxy_expire(&proxy);
+        int resume_ms = tmb_posix_tcp_listen_resume(proxy.epoll_fd, proxy.listen_fd, &proxy.listen_resume_us);
+        if (resume_ms >= 0 && (timeout_ms < 0 || resume_ms < timeout_ms)) {
+            timeout_ms = resume_ms;
+        }
+        int nevents = epoll_wait(proxy.epoll_fd, events, TMB_POSIX_TCP_SERVER_MAX_EVENTS, timeout_ms);
+        if (nevents < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            goto error;
+        }
 
-    return TMB_SUCCESS;
+        for (int i = 0; i < nevents; i++) {
+            uint64_t index = events[i].data.u64;
+            if (index == TMB_POSIX_PROXY_EVENT_LISTEN) {
+                tmb_posix_proxy_accept(&proxy);
+                continue;
+            }
+
+            if (index <= config->max_connections) {
+                tmb_posix_proxy_connection_t *connection = &proxy.connections[index - 1];
+                if (connection->fd >= 0 &&
+                    (tmb_posix_tcp_receive(connection->fd, &connection->parser, tmb_posix_proxy_dispatch,
+                                           connection) != TMB_SUCCESS ||
+                     (events[i].events & (EPOLLERR | EPOLLHUP)) != 0)) {
+                    tmb_posix_proxy_close(&proxy, connection);
+                }
+                continue;
+            }
+
+            /* the device may have been closed by a previous event */
+            tmb_posix_proxy_device_t *device = &proxy.devices[index - 1 - config->max_connections];
+            if (device->fd < 0) {
+                continue;
+            }
+
+            if (device->connecting) {
+                if (tmb_posix_proxy_device_connected(&proxy, device) != TMB_SUCCESS) {
+                    tmb_posix_proxy_device_close(&proxy, device, TMB_E_GATEWAY_PATH_UNAVAILABLE);
+                }
+            } else if (tmb_posix_tcp_receive(device->fd, &device->parser, tmb_posix_proxy_device_complete, device) !=
+                               TMB_SUCCESS ||
+                       (events[i].events & (EPOLLERR | EPOLLHUP)) != 0) {
+                /* the transactions in flight are lost with the connection */
+                tmb_posix_proxy_device_close(&proxy, device, TMB_E_GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND);
+            }
+        }
+    }
 
 error:
-    tmb_posix_transport_free(transport);
+    tmb_posix_proxy_free(&proxy);
 
     return error;
 }
 
-void tmb_posix_transport_free(tmb_transport_t *transport) {
-    if (transport != NULL && transport->user_data != NULL) {
-        /* free associated context */
-        tmb_posix_ctx_t *ctx = transport->user_data;
-        if (ctx->transport_protocol == TMB_TRANSPORT_PROTOCOL_TCPIP) {
-            shutdown(ctx->fd, SHUT_RDWR);
-        }
-
-        close(ctx->fd);
-        free(ctx);
-    }
-
-    free(transport);
-}
+#endif /* TMB_LINUX_SUPPORTED */
 
 #endif /* TMB_POSIX_SUPPORTED */
 